@@ -0,0 +1,76 @@
+/*
+ * Copyright 2017 Sam Leitch
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MAIN_LED_ANIMATION_H_
+#define MAIN_LED_ANIMATION_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Decodes recorded animations, a compressed file of frames that is read in place (from mapped flash).
+ *
+ * All numbers are little endian. The file starts with a 16 byte header:
+ * * bytes 0-3: "LRA1"
+ * * bytes 4-5: led_count, the LEDs in each frame
+ * * bytes 6-7: frames per second
+ * * bytes 8-11: frame_count
+ * * bytes 12-13: keyframe_interval, every frame with a number that is a multiple of this is a keyframe
+ * * bytes 14-15: 0
+ *
+ * The header is followed by the 32 bit offset (from the start of the file) of each keyframe,
+ * then by the frames. Each frame starts with its type:
+ * * 0, a keyframe: runs of a count (1 to 255) and the r, g, b repeated count times, until every LED is set
+ * * 1, a delta frame: a count of LEDs that keep the color of the previous frame (0 to 255), then a count
+ *   of LEDs (0 to 255) followed by an r, g, b for each of them, repeated until the end of the ring
+ *
+ * Frames after a keyframe only need the LEDs that changed, and a frame can be found
+ * from the keyframe before it, so animations can be played from any frame.
+ *
+ * This file only reads memory, so it can also be built on a computer to check animations.
+ */
+
+typedef struct led_animation_s* led_animation_t;
+
+/**
+ * Checks the header of the animation in data and allocates its decoder.
+ *
+ * Only one frame (led_count * 3 bytes) is allocated, the frames are decoded from data,
+ * which must not change or be unmapped until the decoder is released.
+ * Returns NULL if data does not hold an animation.
+ */
+led_animation_t led_animation_init(const uint8_t* data, size_t size);
+
+int led_animation_get_led_count(led_animation_t ctx);
+int led_animation_get_frame_count(led_animation_t ctx);
+int led_animation_get_frames_per_second(led_animation_t ctx);
+
+/**
+ * Decodes a frame (frame_number is wrapped to the frame count), returning r, g, b for each LED.
+ *
+ * The next frame is decoded from the current one, any other frame from the keyframe before it.
+ * The colors stay valid until the next call. Returns NULL if the frame is corrupt.
+ */
+const uint8_t* led_animation_decode(led_animation_t ctx, int64_t frame_number);
+
+/** Releases the decoder */
+void led_animation_uninit(led_animation_t* ctx);
+
+/* The label of the data partition that holds the recorded animation, see partitions.csv */
+#define LED_ANIMATION_PARTITION_LABEL "animation"
+
+#endif /* MAIN_LED_ANIMATION_H_ */
@@ -0,0 +1,38 @@
+/*
+ * Copyright 2017 Sam Leitch
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MAIN_LED_ANIMATION_PARTITION_H_
+#define MAIN_LED_ANIMATION_PARTITION_H_
+
+#include "led_animation.h"
+#include "led_ring.h"
+
+/**
+ * Plays the animation recorded in the LED_ANIMATION_PARTITION_LABEL partition on the ring, in a loop.
+ *
+ * The partition is memory mapped the first time, and each frame is decoded from flash as it is shown,
+ * so the animation can be much larger than the RAM. It plays at the animation's frame rate,
+ * and the ring's own frame rate is kept for the loops started later.
+ *
+ * Returns false if there is no partition, it does not hold an animation, or the animation
+ * is for a different number of LEDs.
+ */
+bool led_animation_play_partition(led_ring_t led_ring);
+
+/** Returns true if led_animation_play_partition can play the recorded animation on the ring */
+bool led_animation_partition_can_play(led_ring_t led_ring);
+
+#endif /* MAIN_LED_ANIMATION_PARTITION_H_ */
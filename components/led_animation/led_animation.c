@@ -0,0 +1,196 @@
+/*
+ * Copyright 2017 Sam Leitch
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "led_animation.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define LED_ANIMATION_HEADER_SIZE 16
+#define LED_ANIMATION_KEYFRAME 0
+#define LED_ANIMATION_DELTA_FRAME 1
+
+struct led_animation_s {
+  const uint8_t* data;
+  size_t size;
+  int led_count;
+  int frames_per_second;
+  int frame_count;
+  int keyframe_interval;
+  const uint8_t* keyframe_offsets; /* In data, 4 bytes for each keyframe */
+  uint8_t* colors; /* The decoded frame, 3 bytes for each LED */
+  int current_frame; /* The frame in colors, -1 if there is none */
+  size_t next_offset; /* Offset of the frame after current_frame */
+};
+
+static uint32_t led_animation_read_u16(const uint8_t* data) {
+  return data[0] | (data[1] << 8);
+}
+
+static uint32_t led_animation_read_u32(const uint8_t* data) {
+  return data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+led_animation_t led_animation_init(const uint8_t* data, size_t size) {
+  if(size < LED_ANIMATION_HEADER_SIZE || memcmp(data, "LRA1", 4) != 0) return NULL;
+
+  int led_count = led_animation_read_u16(data + 4);
+  int frames_per_second = led_animation_read_u16(data + 6);
+  uint32_t frame_count = led_animation_read_u32(data + 8);
+  int keyframe_interval = led_animation_read_u16(data + 12);
+  if(led_count == 0 || frames_per_second == 0 || frame_count == 0 || frame_count > INT32_MAX || keyframe_interval == 0) {
+    return NULL;
+  }
+
+  size_t keyframe_count = (frame_count + keyframe_interval - 1) / keyframe_interval;
+  if(keyframe_count > (size - LED_ANIMATION_HEADER_SIZE) / 4) return NULL;
+
+  led_animation_t ctx = malloc(sizeof(struct led_animation_s));
+  if(!ctx) return NULL;
+
+  ctx->colors = malloc(led_count * 3);
+  if(!ctx->colors) {
+    free(ctx);
+    return NULL;
+  }
+
+  ctx->data = data;
+  ctx->size = size;
+  ctx->led_count = led_count;
+  ctx->frames_per_second = frames_per_second;
+  ctx->frame_count = frame_count;
+  ctx->keyframe_interval = keyframe_interval;
+  ctx->keyframe_offsets = data + LED_ANIMATION_HEADER_SIZE;
+  ctx->current_frame = -1;
+  ctx->next_offset = 0;
+  return ctx;
+}
+
+int led_animation_get_led_count(led_animation_t ctx) {
+  return ctx->led_count;
+}
+
+int led_animation_get_frame_count(led_animation_t ctx) {
+  return ctx->frame_count;
+}
+
+int led_animation_get_frames_per_second(led_animation_t ctx) {
+  return ctx->frames_per_second;
+}
+
+/** Decodes the runs of a keyframe at offset into colors. Returns the offset after the frame, 0 if it is corrupt. */
+static size_t led_animation_decode_keyframe(led_animation_t ctx, size_t offset) {
+  const uint8_t* data = ctx->data;
+  uint8_t* colors = ctx->colors;
+  int led = 0;
+
+  while(led < ctx->led_count) {
+    if(ctx->size - offset < 4) return 0;
+    int count = data[offset];
+    if(count == 0 || count > ctx->led_count - led) return 0;
+
+    /* The first LED of the run is copied from the file, the rest are copies of the LEDs before them */
+    uint8_t* run = colors + led * 3;
+    memcpy(run, data + offset + 1, 3);
+    int copied = 1;
+    while(copied < count) {
+      int copy_count = copied < count - copied ? copied : count - copied;
+      memcpy(run + copied * 3, run, copy_count * 3);
+      copied += copy_count;
+    }
+
+    led += count;
+    offset += 4;
+  }
+
+  return offset;
+}
+
+/** Applies the changes of a delta frame at offset to colors. Returns the offset after the frame, 0 if it is corrupt. */
+static size_t led_animation_decode_delta(led_animation_t ctx, size_t offset) {
+  const uint8_t* data = ctx->data;
+  int led = 0;
+
+  while(led < ctx->led_count) {
+    if(ctx->size - offset < 2) return 0;
+    int skip_count = data[offset];
+    int count = data[offset + 1];
+    offset += 2;
+
+    if(skip_count + count > ctx->led_count - led || (size_t)count * 3 > ctx->size - offset) return 0;
+    led += skip_count;
+
+    /* The changed colors are copied straight from the file */
+    memcpy(ctx->colors + led * 3, data + offset, count * 3);
+    led += count;
+    offset += count * 3;
+  }
+
+  return offset;
+}
+
+/**
+ * Decodes the frame at offset, which must be a keyframe if needs_keyframe is set.
+ * Returns the offset after the frame, 0 if it is corrupt.
+ */
+static size_t led_animation_decode_frame(led_animation_t ctx, size_t offset, bool needs_keyframe) {
+  if(offset < LED_ANIMATION_HEADER_SIZE || offset >= ctx->size) return 0;
+
+  switch(ctx->data[offset]) {
+  case LED_ANIMATION_KEYFRAME:
+    return led_animation_decode_keyframe(ctx, offset + 1);
+  case LED_ANIMATION_DELTA_FRAME:
+    /* A delta frame needs the frame before it */
+    return needs_keyframe ? 0 : led_animation_decode_delta(ctx, offset + 1);
+  default:
+    return 0;
+  }
+}
+
+const uint8_t* led_animation_decode(led_animation_t ctx, int64_t frame_number) {
+  int frame = frame_number % ctx->frame_count;
+  if(frame < 0) frame += ctx->frame_count;
+  if(frame == ctx->current_frame) return ctx->colors;
+
+  /* Carry on from the current frame, unless the keyframe before the frame is closer */
+  int keyframe = frame / ctx->keyframe_interval;
+  int next_frame = ctx->current_frame + 1;
+  size_t offset = ctx->next_offset;
+  bool from_keyframe = ctx->current_frame < 0 || frame < next_frame || keyframe * ctx->keyframe_interval > next_frame;
+  if(from_keyframe) {
+    next_frame = keyframe * ctx->keyframe_interval;
+    offset = led_animation_read_u32(ctx->keyframe_offsets + keyframe * 4);
+  }
+
+  ctx->current_frame = -1;
+  for(; next_frame <= frame; ++next_frame) {
+    offset = led_animation_decode_frame(ctx, offset, from_keyframe);
+    if(offset == 0) return NULL;
+    from_keyframe = false;
+  }
+
+  ctx->current_frame = frame;
+  ctx->next_offset = offset;
+  return ctx->colors;
+}
+
+void led_animation_uninit(led_animation_t* ctx) {
+  if(!ctx || !*ctx) return;
+
+  free((*ctx)->colors);
+  free(*ctx);
+  *ctx = NULL;
+}
@@ -0,0 +1,85 @@
+/*
+ * Copyright 2017 Sam Leitch
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "led_animation_partition.h"
+
+#include <esp_log.h>
+#include <esp_partition.h>
+
+const static char* LOG_TAG = "led_animation";
+
+/* The partition stays mapped once it is found, since a ring may be playing it */
+static led_animation_t partition_animation = NULL;
+static spi_flash_mmap_handle_t partition_handle;
+
+/** The frame source of the ring, decoding from the mapped partition */
+static rgb_t* led_animation_partition_source(void* arg, int64_t frame_number) {
+  /* rgb_t is r, g, b, the same layout as the decoded colors */
+  return (rgb_t*)led_animation_decode((led_animation_t)arg, frame_number);
+}
+
+/** Maps the partition and checks its animation, the first time it is needed */
+static bool led_animation_map_partition() {
+  if(partition_animation) return true;
+
+  const esp_partition_t* partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+      ESP_PARTITION_SUBTYPE_ANY, LED_ANIMATION_PARTITION_LABEL);
+  if(!partition) {
+    ESP_LOGE(LOG_TAG, "No %s partition", LED_ANIMATION_PARTITION_LABEL);
+    return false;
+  }
+
+  const void* data;
+  esp_err_t result = esp_partition_mmap(partition, 0, partition->size, SPI_FLASH_MMAP_DATA, &data, &partition_handle);
+  if(result != ESP_OK) {
+    ESP_LOGE(LOG_TAG, "esp_partition_mmap returned %d", result);
+    return false;
+  }
+
+  partition_animation = led_animation_init((const uint8_t*)data, partition->size);
+  if(!partition_animation) {
+    ESP_LOGE(LOG_TAG, "The %s partition does not hold an animation", LED_ANIMATION_PARTITION_LABEL);
+    spi_flash_munmap(partition_handle);
+    return false;
+  }
+
+  ESP_LOGI(LOG_TAG, "Mapped %d frames of %d LEDs at %d fps", led_animation_get_frame_count(partition_animation),
+      led_animation_get_led_count(partition_animation), led_animation_get_frames_per_second(partition_animation));
+  return true;
+}
+
+bool led_animation_partition_can_play(led_ring_t led_ring) {
+  if(!led_animation_map_partition()) return false;
+
+  if(led_animation_get_led_count(partition_animation) != led_ring_get_led_count(led_ring)) {
+    ESP_LOGE(LOG_TAG, "The animation is for %d LEDs, the ring has %d",
+        led_animation_get_led_count(partition_animation), led_ring_get_led_count(led_ring));
+    return false;
+  }
+
+  return true;
+}
+
+bool led_animation_play_partition(led_ring_t led_ring) {
+  if(!led_animation_partition_can_play(led_ring)) return false;
+
+  led_ring_lock(led_ring);
+  led_ring_stop_loop(led_ring);
+  led_ring_start_source_loop_at_rate(led_ring, led_animation_partition_source, partition_animation,
+      led_animation_get_frames_per_second(partition_animation));
+  led_ring_unlock(led_ring);
+  return true;
+}
@@ -0,0 +1,8 @@
+#
+# Component makefile.
+#
+# This Makefile can be left empty. By default, it will take the sources in this 
+# directory, compile them and link them into lib(subdirectory_name).a 
+# in the build directory. This behaviour is entirely configurable,
+# please read the ESP-IDF documents if you need to do this.
+#
@@ -0,0 +1,79 @@
+/*
+ * Copyright 2017 Sam Leitch
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MAIN_LED_AUDIO_H_
+#define MAIN_LED_AUDIO_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Analyzes sound so that animations can follow the music.
+ *
+ * One task (the microphone) writes samples into a ring buffer, and another (the animation task) reads the newest
+ * ones as each frame is shown. The ring is lock free, so neither task waits for the other, and samples are
+ * dropped if the reader falls behind.
+ *
+ * Each update runs a fixed point FFT on the last LED_AUDIO_WINDOW_SIZE samples, and gives the loudness of
+ * LED_AUDIO_BAND_COUNT frequency bands, the overall loudness and the beats found in the bass.
+ * Loudness is 0-255 on a log scale below a peak that slowly falls, so quiet and loud rooms both use the full range.
+ *
+ * This file only uses memory, so it can also be built on a computer and fed from a sound file.
+ */
+
+#define LED_AUDIO_WINDOW_SIZE 256
+#define LED_AUDIO_BAND_COUNT 8
+
+/* The values given to animations by led_audio_get_inputs */
+typedef enum {
+  LED_AUDIO_INPUT_BAND = 0, /* 0-255 loudness of each band, from the bass (input 0) to the treble (input 7) */
+  LED_AUDIO_INPUT_LEVEL = LED_AUDIO_BAND_COUNT, /* 0-255 loudness of every band */
+  LED_AUDIO_INPUT_BEAT, /* 255 on a beat, fading to 0 over LED_AUDIO_BEAT_FADE_MS */
+  LED_AUDIO_INPUT_BEAT_COUNT, /* The number of beats found */
+  LED_AUDIO_INPUT_PHASE, /* Grows by 256 each second at full loudness, to spin faster with louder music */
+  LED_AUDIO_INPUT_COUNT
+} led_audio_input_t;
+
+#define LED_AUDIO_BEAT_FADE_MS 250
+
+typedef struct led_audio_s* led_audio_t;
+
+/** Allocates the ring buffer and analysis for samples at sample_rate. Returns NULL if there is no memory. */
+led_audio_t led_audio_init(int sample_rate);
+
+/**
+ * Adds samples to the ring buffer. Only one task may write.
+ *
+ * Returns the number of samples added, which is less than count if the ring is full.
+ */
+int led_audio_write(led_audio_t ctx, const int16_t* samples, int count);
+
+/**
+ * Reads the samples written since the last update and analyzes the newest window. Only one task may update.
+ *
+ * Returns false if there were no new samples, the inputs are then unchanged.
+ */
+bool led_audio_update(led_audio_t ctx);
+
+/** The inputs from the last update, LED_AUDIO_INPUT_COUNT of them */
+const int32_t* led_audio_get_inputs(led_audio_t ctx);
+
+int led_audio_get_sample_rate(led_audio_t ctx);
+
+/** Releases the ring buffer and analysis */
+void led_audio_uninit(led_audio_t* ctx);
+
+#endif /* MAIN_LED_AUDIO_H_ */
@@ -0,0 +1,35 @@
+/*
+ * Copyright 2017 Sam Leitch
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MAIN_LED_AUDIO_I2S_H_
+#define MAIN_LED_AUDIO_I2S_H_
+
+#include "driver/i2s.h"
+#include "led_audio.h"
+
+/* 16 kHz gives FFT bins of 62.5 Hz and a 16 ms window, enough for beats and the bands up to 8 kHz */
+#define LED_AUDIO_I2S_SAMPLE_RATE 16000
+
+/**
+ * Reads an I2S microphone (like the INMP441, with L/R tied low) into a new audio analysis.
+ *
+ * A task on the PRO CPU writes the samples into the analysis' ring buffer as the DMA fills,
+ * the analysis is updated by the task that reads it (see led_audio.h).
+ * Returns NULL if the driver could not be installed or there is no memory.
+ */
+led_audio_t led_audio_i2s_start(i2s_port_t port, int bck_pin, int ws_pin, int data_pin);
+
+#endif /* MAIN_LED_AUDIO_I2S_H_ */
@@ -0,0 +1,310 @@
+/*
+ * Copyright 2017 Sam Leitch
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "led_audio.h"
+
+#include <math.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* A power of 2, so positions can wrap around by masking */
+#define LED_AUDIO_RING_SIZE 2048
+
+/* The lowest frequency of each band, in Hz, each band is an octave up to the next one */
+static const int led_audio_band_frequencies[LED_AUDIO_BAND_COUNT] = { 50, 110, 220, 440, 880, 1760, 3520, 7040 };
+
+/* The bands that are checked for beats */
+#define LED_AUDIO_BASS_BANDS 2
+
+/*
+ * Loudness is kept as the log2 of the power, with 8 fractional bits, so one unit is about 3 dB.
+ * A full scale sine is about 40, and the rounding of the FFT about 20.
+ * * RANGE is how far below the peak a sound is silent (30 dB)
+ * * NOISE_FLOOR is the quietest peak (about -25 dB from full scale), so that noise in a quiet room stays dark
+ * * PEAK_FALL is how fast the peak falls for each second, so the levels follow a room that gets quieter
+ * * BEAT_RISE is how far above its average the bass must jump for a beat (about 4.5 dB)
+ */
+#define LED_AUDIO_LOG_ONE 256
+#define LED_AUDIO_RANGE (10 * LED_AUDIO_LOG_ONE)
+#define LED_AUDIO_NOISE_FLOOR (32 * LED_AUDIO_LOG_ONE)
+#define LED_AUDIO_PEAK_FALL (LED_AUDIO_LOG_ONE / 2)
+#define LED_AUDIO_BEAT_RISE (3 * LED_AUDIO_LOG_ONE / 2)
+
+/* Beats closer than this are ignored (240 beats per minute) */
+#define LED_AUDIO_MIN_BEAT_MS 250
+
+typedef struct led_audio_level_s {
+  int32_t peak; /* The falling peak of the loudness, as a log */
+  int32_t average; /* The average of the loudness over about a second, as a log */
+} led_audio_level_t;
+
+struct led_audio_s {
+  int sample_rate;
+
+  /*
+   * The ring buffer. The writer only changes head and the reader only changes tail,
+   * each position counts every sample and wraps around when it overflows.
+   */
+  int16_t* ring;
+  atomic_uint head;
+  atomic_uint tail;
+
+  int16_t window[LED_AUDIO_WINDOW_SIZE]; /* The newest samples, window_start is the oldest */
+  int window_start;
+  int band_start[LED_AUDIO_BAND_COUNT + 1]; /* The first FFT bin of each band */
+
+  /* The transform of the window, kept here rather than on the small stack of the animation task */
+  int16_t re[LED_AUDIO_WINDOW_SIZE];
+  int16_t im[LED_AUDIO_WINDOW_SIZE];
+
+  led_audio_level_t bands[LED_AUDIO_BAND_COUNT];
+  led_audio_level_t level;
+  led_audio_level_t bass;
+
+  int64_t sample_count; /* Every sample read, the clock of the analysis */
+  int64_t last_beat; /* sample_count at the last beat, negative before the first */
+  int64_t phase; /* LED_AUDIO_INPUT_PHASE multiplied by the sample rate */
+  int32_t inputs[LED_AUDIO_INPUT_COUNT];
+};
+
+/* The Hann window and the FFT twiddles, as Q15 fractions */
+static int16_t led_audio_hann[LED_AUDIO_WINDOW_SIZE];
+static int16_t led_audio_cos[LED_AUDIO_WINDOW_SIZE / 2];
+static int16_t led_audio_sin[LED_AUDIO_WINDOW_SIZE / 2];
+static bool led_audio_tables_ready = false;
+
+static void led_audio_init_tables() {
+  for(int i=0; i < LED_AUDIO_WINDOW_SIZE; ++i) {
+    led_audio_hann[i] = (int16_t)(16383.5f - 16383.5f * cosf(2.0f * (float)M_PI * i / LED_AUDIO_WINDOW_SIZE));
+  }
+
+  for(int i=0; i < LED_AUDIO_WINDOW_SIZE / 2; ++i) {
+    float angle = 2.0f * (float)M_PI * i / LED_AUDIO_WINDOW_SIZE;
+    led_audio_cos[i] = (int16_t)lrintf(32767.0f * cosf(angle));
+    led_audio_sin[i] = (int16_t)lrintf(32767.0f * sinf(angle));
+  }
+
+  led_audio_tables_ready = true;
+}
+
+led_audio_t led_audio_init(int sample_rate) {
+  if(sample_rate <= 0) return NULL;
+
+  led_audio_t ctx = calloc(1, sizeof(struct led_audio_s));
+  if(!ctx) return NULL;
+
+  ctx->ring = malloc(LED_AUDIO_RING_SIZE * sizeof(int16_t));
+  if(!ctx->ring) {
+    free(ctx);
+    return NULL;
+  }
+
+  if(!led_audio_tables_ready) led_audio_init_tables();
+
+  ctx->sample_rate = sample_rate;
+  atomic_init(&ctx->head, 0);
+  atomic_init(&ctx->tail, 0);
+
+  /* Bands above the highest frequency of the samples are left empty */
+  for(int i=0; i <= LED_AUDIO_BAND_COUNT; ++i) {
+    int bin = i < LED_AUDIO_BAND_COUNT ?
+        (int)((int64_t)led_audio_band_frequencies[i] * LED_AUDIO_WINDOW_SIZE / sample_rate) : LED_AUDIO_WINDOW_SIZE / 2;
+    if(bin < 1) bin = 1;
+    if(bin > LED_AUDIO_WINDOW_SIZE / 2) bin = LED_AUDIO_WINDOW_SIZE / 2;
+    if(i > 0 && bin <= ctx->band_start[i - 1]) bin = ctx->band_start[i - 1] + 1;
+    ctx->band_start[i] = bin < LED_AUDIO_WINDOW_SIZE / 2 ? bin : LED_AUDIO_WINDOW_SIZE / 2;
+  }
+
+  for(int i=0; i < LED_AUDIO_BAND_COUNT; ++i) {
+    ctx->bands[i].peak = LED_AUDIO_NOISE_FLOOR;
+    ctx->bands[i].average = LED_AUDIO_NOISE_FLOOR - LED_AUDIO_RANGE;
+  }
+  ctx->level.peak = LED_AUDIO_NOISE_FLOOR;
+  ctx->level.average = LED_AUDIO_NOISE_FLOOR - LED_AUDIO_RANGE;
+  ctx->bass.peak = LED_AUDIO_NOISE_FLOOR;
+  ctx->bass.average = LED_AUDIO_NOISE_FLOOR - LED_AUDIO_RANGE;
+  ctx->last_beat = -(int64_t)sample_rate;
+  return ctx;
+}
+
+int led_audio_write(led_audio_t ctx, const int16_t* samples, int count) {
+  unsigned int head = atomic_load_explicit(&ctx->head, memory_order_relaxed);
+  unsigned int tail = atomic_load_explicit(&ctx->tail, memory_order_acquire);
+
+  unsigned int space = LED_AUDIO_RING_SIZE - (head - tail);
+  if((unsigned int)count > space) count = space;
+
+  for(int i=0; i < count; ++i) {
+    ctx->ring[(head + i) & (LED_AUDIO_RING_SIZE - 1)] = samples[i];
+  }
+
+  /* Release, so the reader sees the samples before the new head */
+  atomic_store_explicit(&ctx->head, head + count, memory_order_release);
+  return count;
+}
+
+/**
+ * Transforms the window in place, with re and im as Q15 fractions.
+ *
+ * Each pass halves its results, so nothing overflows
+ * and the result is the transform divided by LED_AUDIO_WINDOW_SIZE.
+ */
+static void led_audio_fft(int16_t* re, int16_t* im) {
+  for(int i=1, j=0; i < LED_AUDIO_WINDOW_SIZE; ++i) {
+    int bit = LED_AUDIO_WINDOW_SIZE >> 1;
+    for(; j & bit; bit >>= 1) j ^= bit;
+    j |= bit;
+
+    if(i < j) {
+      int16_t swap = re[i]; re[i] = re[j]; re[j] = swap;
+      swap = im[i]; im[i] = im[j]; im[j] = swap;
+    }
+  }
+
+  for(int size=2; size <= LED_AUDIO_WINDOW_SIZE; size <<= 1) {
+    int half = size >> 1;
+    int step = LED_AUDIO_WINDOW_SIZE / size;
+
+    for(int start=0; start < LED_AUDIO_WINDOW_SIZE; start += size) {
+      for(int k=0; k < half; ++k) {
+        int32_t w_re = led_audio_cos[k * step];
+        int32_t w_im = -led_audio_sin[k * step];
+        int even = start + k;
+        int odd = even + half;
+
+        int32_t t_re = (re[odd] * w_re - im[odd] * w_im) >> 15;
+        int32_t t_im = (re[odd] * w_im + im[odd] * w_re) >> 15;
+        re[odd] = (re[even] - t_re) >> 1;
+        im[odd] = (im[even] - t_im) >> 1;
+        re[even] = (re[even] + t_re) >> 1;
+        im[even] = (im[even] + t_im) >> 1;
+      }
+    }
+  }
+}
+
+/** The log2 of a power with 8 fractional bits, 0 for powers below 1 */
+static int32_t led_audio_log2(uint64_t power) {
+  if(power == 0) return 0;
+
+  int bit = 63 - __builtin_clzll(power);
+  /* The 8 bits below the top bit are close enough to the fraction for levels */
+  uint32_t fraction = bit >= 8 ? (uint32_t)(power >> (bit - 8)) & 0xFF : (uint32_t)(power << (8 - bit)) & 0xFF;
+  return bit * LED_AUDIO_LOG_ONE + fraction;
+}
+
+/** Follows the peak and average of a loudness, returning it from 0 to 255 below the peak */
+static int32_t led_audio_follow(led_audio_level_t* level, int32_t loudness, int new_samples, int sample_rate) {
+  level->peak -= (int32_t)((int64_t)LED_AUDIO_PEAK_FALL * new_samples / sample_rate);
+  if(level->peak < loudness) level->peak = loudness;
+  if(level->peak < LED_AUDIO_NOISE_FLOOR) level->peak = LED_AUDIO_NOISE_FLOOR;
+
+  int64_t change = (int64_t)(loudness - level->average) * new_samples / sample_rate;
+  level->average += new_samples >= sample_rate ? loudness - level->average : (int32_t)change;
+
+  int32_t above_silence = loudness - (level->peak - LED_AUDIO_RANGE);
+  if(above_silence <= 0) return 0;
+  return above_silence >= LED_AUDIO_RANGE ? 255 : above_silence * 255 / LED_AUDIO_RANGE;
+}
+
+static void led_audio_analyze(led_audio_t ctx, int new_samples) {
+  int16_t* re = ctx->re;
+  int16_t* im = ctx->im;
+
+  /* Samples are halved, so that rounding cannot overflow the first pass */
+  for(int i=0; i < LED_AUDIO_WINDOW_SIZE; ++i) {
+    int16_t sample = ctx->window[(ctx->window_start + i) & (LED_AUDIO_WINDOW_SIZE - 1)];
+    re[i] = (sample * led_audio_hann[i]) >> 16;
+    im[i] = 0;
+  }
+
+  led_audio_fft(re, im);
+
+  uint64_t total = 0;
+  uint64_t bass = 0;
+  for(int band=0; band < LED_AUDIO_BAND_COUNT; ++band) {
+    uint64_t power = 0;
+    for(int bin = ctx->band_start[band]; bin < ctx->band_start[band + 1]; ++bin) {
+      power += (uint32_t)(re[bin] * re[bin]) + (uint32_t)(im[bin] * im[bin]);
+    }
+
+    total += power;
+    if(band < LED_AUDIO_BASS_BANDS) bass += power;
+
+    /* Power is the square of the FFT, which shows up as 3 dB for each unit of log2 */
+    int32_t loudness = led_audio_log2(power << 16);
+    ctx->inputs[LED_AUDIO_INPUT_BAND + band] = led_audio_follow(ctx->bands + band, loudness, new_samples, ctx->sample_rate);
+  }
+
+  int32_t level = led_audio_follow(&ctx->level, led_audio_log2(total << 16), new_samples, ctx->sample_rate);
+  ctx->inputs[LED_AUDIO_INPUT_LEVEL] = level;
+
+  /* A beat is a jump of the bass above its average, close to the loudest bass so that noise is not a beat */
+  int32_t bass_average = ctx->bass.average;
+  int32_t bass_loudness = led_audio_log2(bass << 16);
+  led_audio_follow(&ctx->bass, bass_loudness, new_samples, ctx->sample_rate);
+  if(bass_loudness > bass_average + LED_AUDIO_BEAT_RISE && bass_loudness > ctx->bass.peak - LED_AUDIO_RANGE / 2 &&
+      (ctx->sample_count - ctx->last_beat) * 1000 >= (int64_t)LED_AUDIO_MIN_BEAT_MS * ctx->sample_rate) {
+    ctx->last_beat = ctx->sample_count;
+    ++ctx->inputs[LED_AUDIO_INPUT_BEAT_COUNT];
+  }
+
+  int64_t since_beat_ms = (ctx->sample_count - ctx->last_beat) * 1000 / ctx->sample_rate;
+  ctx->inputs[LED_AUDIO_INPUT_BEAT] = since_beat_ms >= LED_AUDIO_BEAT_FADE_MS ? 0 :
+      (int32_t)(255 - since_beat_ms * 255 / LED_AUDIO_BEAT_FADE_MS);
+
+  ctx->phase += (int64_t)level * new_samples * 256 / 255;
+  ctx->inputs[LED_AUDIO_INPUT_PHASE] = (int32_t)(ctx->phase / ctx->sample_rate);
+}
+
+bool led_audio_update(led_audio_t ctx) {
+  unsigned int tail = atomic_load_explicit(&ctx->tail, memory_order_relaxed);
+  unsigned int head = atomic_load_explicit(&ctx->head, memory_order_acquire);
+
+  unsigned int available = head - tail;
+  if(available == 0) return false;
+
+  /* Only the newest window is analyzed, older samples are only counted */
+  unsigned int skipped = available > LED_AUDIO_WINDOW_SIZE ? available - LED_AUDIO_WINDOW_SIZE : 0;
+  for(unsigned int i = skipped; i < available; ++i) {
+    ctx->window[ctx->window_start] = ctx->ring[(tail + i) & (LED_AUDIO_RING_SIZE - 1)];
+    ctx->window_start = (ctx->window_start + 1) & (LED_AUDIO_WINDOW_SIZE - 1);
+  }
+
+  /* Release, so the writer does not overwrite the samples before they are copied */
+  atomic_store_explicit(&ctx->tail, head, memory_order_release);
+
+  ctx->sample_count += available;
+  led_audio_analyze(ctx, available);
+  return true;
+}
+
+const int32_t* led_audio_get_inputs(led_audio_t ctx) {
+  return ctx->inputs;
+}
+
+int led_audio_get_sample_rate(led_audio_t ctx) {
+  return ctx->sample_rate;
+}
+
+void led_audio_uninit(led_audio_t* ctx) {
+  if(!ctx || !*ctx) return;
+
+  free((*ctx)->ring);
+  free(*ctx);
+  *ctx = NULL;
+}
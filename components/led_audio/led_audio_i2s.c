@@ -0,0 +1,102 @@
+/*
+ * Copyright 2017 Sam Leitch
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "led_audio_i2s.h"
+
+#include <esp_log.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <soc/soc.h>
+#include <stdlib.h>
+
+const static char* LOG_TAG = "led_audio_i2s";
+
+/* Samples read at once, 4 ms at 16 kHz, which is also the DMA buffer length */
+#define LED_AUDIO_I2S_READ_SIZE 64
+
+typedef struct led_audio_i2s_s {
+  i2s_port_t port;
+  led_audio_t audio;
+} led_audio_i2s_t;
+
+static void led_audio_i2s_loop(void* arg) {
+  led_audio_i2s_t* ctx = (led_audio_i2s_t*)arg;
+  int32_t words[LED_AUDIO_I2S_READ_SIZE];
+  int16_t samples[LED_AUDIO_I2S_READ_SIZE];
+
+  while(true) {
+    int size = i2s_read_bytes(ctx->port, (char*)words, sizeof(words), portMAX_DELAY);
+    if(size <= 0) continue;
+
+    /* The microphone sends 24 bits at the top of each 32 bit word, the top 16 are enough for levels */
+    int count = size / sizeof(int32_t);
+    for(int i=0; i < count; ++i) {
+      samples[i] = words[i] >> 16;
+    }
+
+    /* Samples the animation task has not read are dropped, it only analyzes the newest */
+    led_audio_write(ctx->audio, samples, count);
+  }
+}
+
+led_audio_t led_audio_i2s_start(i2s_port_t port, int bck_pin, int ws_pin, int data_pin) {
+  led_audio_i2s_t* ctx = malloc(sizeof(led_audio_i2s_t));
+  if(!ctx) return NULL;
+
+  ctx->port = port;
+  ctx->audio = led_audio_init(LED_AUDIO_I2S_SAMPLE_RATE);
+  if(!ctx->audio) goto error;
+
+  i2s_config_t config = {
+    .mode = I2S_MODE_MASTER | I2S_MODE_RX,
+    .sample_rate = LED_AUDIO_I2S_SAMPLE_RATE,
+    .bits_per_sample = I2S_BITS_PER_SAMPLE_32BIT,
+    .channel_format = I2S_CHANNEL_FMT_ONLY_LEFT,
+    .communication_format = I2S_COMM_FORMAT_I2S | I2S_COMM_FORMAT_I2S_MSB,
+    .intr_alloc_flags = 0,
+    .dma_buf_count = 4,
+    .dma_buf_len = LED_AUDIO_I2S_READ_SIZE,
+  };
+
+  esp_err_t result = i2s_driver_install(port, &config, 0, NULL);
+  if(result != ESP_OK) {
+    ESP_LOGE(LOG_TAG, "led_audio_i2s_start: i2s_driver_install returned %d", result);
+    goto error;
+  }
+
+  i2s_pin_config_t pins = {
+    .bck_io_num = bck_pin,
+    .ws_io_num = ws_pin,
+    .data_out_num = I2S_PIN_NO_CHANGE,
+    .data_in_num = data_pin,
+  };
+
+  result = i2s_set_pin(port, &pins);
+  if(result != ESP_OK) {
+    ESP_LOGE(LOG_TAG, "led_audio_i2s_start: i2s_set_pin returned %d", result);
+    i2s_driver_uninstall(port);
+    goto error;
+  }
+
+  /* Kept off the APP CPU, where a pipelined led_ring encodes its frames */
+  xTaskCreatePinnedToCore(led_audio_i2s_loop, "led_audio_i2s", 2048, ctx, 10, NULL, PRO_CPU_NUM);
+  return ctx->audio;
+
+  error:
+  led_audio_uninit(&ctx->audio);
+  free(ctx);
+  return NULL;
+}
@@ -0,0 +1,86 @@
+/*
+ * Copyright 2017 Sam Leitch
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MAIN_LED_COMPOSITOR_H_
+#define MAIN_LED_COMPOSITOR_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Combines several layers into one frame, like a rainbow with a spinning dot on top.
+ *
+ * Each layer gives its colors for the frame, which are blended onto the layers below it
+ * (the first layer is blended onto black). The pixels are packed into 32 bit words (0x00BBGGRR)
+ * and all channels of a pixel are blended at once.
+ *
+ * Colors are r, g, b bytes for each LED, the same layout as rgb_t, so this file can also be built on a computer.
+ */
+
+#define LED_COMPOSITOR_MAX_LAYERS 8
+
+typedef enum {
+  LED_COMPOSITOR_BLEND_ALPHA, /* The layer covers the layers below */
+  LED_COMPOSITOR_BLEND_ADD, /* The colors are added, up to full brightness */
+  LED_COMPOSITOR_BLEND_MAX, /* The brightest of each channel */
+  LED_COMPOSITOR_BLEND_MULTIPLY, /* The layers below are dimmed by the layer, like a mask */
+  LED_COMPOSITOR_BLEND_COUNT
+} led_compositor_blend_t;
+
+/**
+ * Gives the colors of a layer for frame frame_number (led_count of them), or NULL to leave the layer out.
+ *
+ * The colors only need to stay valid until the next layer is asked for its colors.
+ */
+typedef const uint8_t* (*led_compositor_source_t)(void* arg, int64_t frame_number);
+
+typedef struct led_compositor_layer_s {
+  led_compositor_source_t source; /* NULL if the layer is not used */
+  void* arg;
+  led_compositor_blend_t blend;
+  uint8_t opacity; /* 255 shows the blend result, 0 hides the layer */
+} led_compositor_layer_t;
+
+/**
+ * The layers of a composition.
+ *
+ * The layers can be changed directly. A copy of a compositor shares its buffers, so copies can be used to
+ * prepare new layers while the old ones are shown, as long as they are only rendered by one task.
+ */
+typedef struct led_compositor_s {
+  int led_count;
+  led_compositor_layer_t layers[LED_COMPOSITOR_MAX_LAYERS];
+  uint32_t* pixels; /* The packed pixels being blended */
+  uint8_t* colors; /* The last frame rendered */
+} led_compositor_t;
+
+/** Allocates the buffers of a compositor for led_count LEDs, with no layers. Returns false if there is no memory. */
+bool led_compositor_init(led_compositor_t* ctx, int led_count);
+
+/** Renders and blends the layers for a frame. Returns r, g, b for each LED, valid until the next frame. */
+const uint8_t* led_compositor_render(led_compositor_t* ctx, int64_t frame_number);
+
+/**
+ * Blends count colors onto packed pixels, with an opacity from 0 to 255.
+ *
+ * This is what led_compositor_render does for each layer.
+ */
+void led_compositor_blend(uint32_t* pixels, const uint8_t* colors, int count, led_compositor_blend_t blend, uint8_t opacity);
+
+/** Releases the buffers of a compositor */
+void led_compositor_uninit(led_compositor_t* ctx);
+
+#endif /* MAIN_LED_COMPOSITOR_H_ */
@@ -0,0 +1,157 @@
+/*
+ * Copyright 2017 Sam Leitch
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "led_compositor.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Pixels are packed as 0x00BBGGRR, one channel per byte.
+ * HIGH_BITS is the top bit of each channel.
+ */
+#define LED_COMPOSITOR_HIGH_BITS 0x808080u
+#define LED_COMPOSITOR_RED_BLUE 0xFF00FFu
+#define LED_COMPOSITOR_GREEN 0x00FF00u
+
+static inline uint32_t led_compositor_pack(const uint8_t* color) {
+  return color[0] | (color[1] << 8) | ((uint32_t)color[2] << 16);
+}
+
+/**
+ * Multiplies every channel by weight / 256 (weight from 0 to 256).
+ *
+ * Red and blue are 16 bits apart, so they are scaled by the same multiply without mixing.
+ */
+static inline uint32_t led_compositor_scale(uint32_t pixel, uint32_t weight) {
+  uint32_t red_blue = (((pixel & LED_COMPOSITOR_RED_BLUE) * weight) >> 8) & LED_COMPOSITOR_RED_BLUE;
+  uint32_t green = (((pixel & LED_COMPOSITOR_GREEN) * weight) >> 8) & LED_COMPOSITOR_GREEN;
+  return red_blue | green;
+}
+
+/** Mixes from the pixel below to the blended pixel by weight / 256, the sum cannot overflow a channel */
+static inline uint32_t led_compositor_mix(uint32_t below, uint32_t blended, uint32_t weight) {
+  return led_compositor_scale(blended, weight) + led_compositor_scale(below, 256 - weight);
+}
+
+/** Adds every channel, keeping channels that overflow at 255 */
+static inline uint32_t led_compositor_add(uint32_t x, uint32_t y) {
+  /* Add the low 7 bits of each channel, so no carry crosses into the next channel, then add the top bits */
+  uint32_t sum = (x & ~LED_COMPOSITOR_HIGH_BITS) + (y & ~LED_COMPOSITOR_HIGH_BITS);
+  sum ^= (x ^ y) & LED_COMPOSITOR_HIGH_BITS;
+
+  /* A channel overflows if both top bits are set, or one is and the low bits carried into it */
+  uint32_t overflow = ((x & y) | ((x ^ y) & ~sum)) & LED_COMPOSITOR_HIGH_BITS;
+  return sum | ((overflow << 1) - (overflow >> 7));
+}
+
+/** Takes the largest value of every channel */
+static inline uint32_t led_compositor_max(uint32_t x, uint32_t y) {
+  /* The top bit of each channel of low is set if the low 7 bits of x are at least those of y, without borrows */
+  uint32_t low = (x | LED_COMPOSITOR_HIGH_BITS) - (y & ~LED_COMPOSITOR_HIGH_BITS);
+  uint32_t x_larger = ((x & ~y) | (~(x ^ y) & low)) & LED_COMPOSITOR_HIGH_BITS;
+  uint32_t mask = (x_larger << 1) - (x_larger >> 7);
+  return (x & mask) | (y & ~mask);
+}
+
+/** Multiplies every channel, as values from 0 to 1 */
+static inline uint32_t led_compositor_multiply(uint32_t x, uint32_t y) {
+  /*
+   * Each channel has its own factor, which one multiply cannot do for several channels,
+   * so the products are made separately and rounded back to 0-255 together.
+   */
+  uint32_t red = (x & 0xFF) * (y & 0xFF);
+  uint32_t green = ((x >> 8) & 0xFF) * ((y >> 8) & 0xFF);
+  uint32_t blue = (x >> 16) * (y >> 16);
+  red = (red + 1 + (red >> 8)) >> 8;
+  green = (green + 1 + (green >> 8)) >> 8;
+  blue = (blue + 1 + (blue >> 8)) >> 8;
+  return red | (green << 8) | (blue << 16);
+}
+
+/* Blends every pixel with one blend function, so the blend mode is not tested for each pixel */
+#define LED_COMPOSITOR_BLEND_LOOP(blend_pixel) \
+  for(int i=0; i < count; ++i) { \
+    uint32_t below = pixels[i]; \
+    pixels[i] = led_compositor_mix(below, blend_pixel(below, led_compositor_pack(colors + i * 3)), weight); \
+  }
+
+static inline uint32_t led_compositor_cover(uint32_t below, uint32_t above) {
+  return above;
+}
+
+void led_compositor_blend(uint32_t* pixels, const uint8_t* colors, int count, led_compositor_blend_t blend, uint8_t opacity) {
+  if(opacity == 0) return;
+  uint32_t weight = opacity + (opacity >> 7); /* 255 becomes 256 */
+
+  switch(blend) {
+  case LED_COMPOSITOR_BLEND_ALPHA:
+    LED_COMPOSITOR_BLEND_LOOP(led_compositor_cover)
+    break;
+  case LED_COMPOSITOR_BLEND_ADD:
+    LED_COMPOSITOR_BLEND_LOOP(led_compositor_add)
+    break;
+  case LED_COMPOSITOR_BLEND_MAX:
+    LED_COMPOSITOR_BLEND_LOOP(led_compositor_max)
+    break;
+  case LED_COMPOSITOR_BLEND_MULTIPLY:
+    LED_COMPOSITOR_BLEND_LOOP(led_compositor_multiply)
+    break;
+  default:
+    break;
+  }
+}
+
+bool led_compositor_init(led_compositor_t* ctx, int led_count) {
+  memset(ctx, 0, sizeof(*ctx));
+  ctx->led_count = led_count;
+  ctx->pixels = malloc(led_count * sizeof(uint32_t));
+  ctx->colors = malloc(led_count * 3);
+  if(!ctx->pixels || !ctx->colors) {
+    led_compositor_uninit(ctx);
+    return false;
+  }
+
+  return true;
+}
+
+const uint8_t* led_compositor_render(led_compositor_t* ctx, int64_t frame_number) {
+  memset(ctx->pixels, 0, ctx->led_count * sizeof(uint32_t));
+
+  for(int i=0; i < LED_COMPOSITOR_MAX_LAYERS; ++i) {
+    const led_compositor_layer_t* layer = ctx->layers + i;
+    if(!layer->source) continue;
+
+    const uint8_t* colors = layer->source(layer->arg, frame_number);
+    if(colors) led_compositor_blend(ctx->pixels, colors, ctx->led_count, layer->blend, layer->opacity);
+  }
+
+  for(int i=0; i < ctx->led_count; ++i) {
+    uint32_t pixel = ctx->pixels[i];
+    ctx->colors[i * 3] = pixel;
+    ctx->colors[i * 3 + 1] = pixel >> 8;
+    ctx->colors[i * 3 + 2] = pixel >> 16;
+  }
+
+  return ctx->colors;
+}
+
+void led_compositor_uninit(led_compositor_t* ctx) {
+  free(ctx->pixels);
+  free(ctx->colors);
+  ctx->pixels = NULL;
+  ctx->colors = NULL;
+}
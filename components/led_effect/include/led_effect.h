@@ -0,0 +1,111 @@
+/*
+ * Copyright 2017 Sam Leitch
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MAIN_LED_EFFECT_H_
+#define MAIN_LED_EFFECT_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Runs small effect programs that give the color of each LED.
+ *
+ * A program is a list of operations on a stack of 32 bit integers, run once for every LED of every frame.
+ * It has no jumps, so it always runs to the end, and it must leave exactly r, g and b on the stack
+ * (each is clamped to 0-255). Programs are checked when they are loaded, so a program that would
+ * overflow the stack or read a missing parameter is rejected rather than stopped while running.
+ *
+ * An uploaded effect is:
+ * * byte 0: frames per second
+ * * byte 1: param_count, up to LED_EFFECT_MAX_PARAMS
+ * * param_count 16 bit little endian signed parameters
+ * * the program, an opcode byte followed by its immediate for each operation
+ *
+ * Nothing is allocated, and the work of a frame is at most LED_EFFECT_MAX_OPS_PER_FRAME operations.
+ */
+
+#define LED_EFFECT_MAX_PARAMS 8
+#define LED_EFFECT_MAX_CODE_SIZE 256
+#define LED_EFFECT_STACK_SIZE 16
+
+/* Live values given to every frame by the device, like the loudness of music */
+#define LED_EFFECT_MAX_INPUTS 16
+
+/* Effects with more operations than this for every LED of a frame are rejected */
+#define LED_EFFECT_MAX_OPS_PER_FRAME 32768
+
+/* The operations, (a b -- c) shows what they take from and leave on the stack */
+typedef enum {
+  LED_EFFECT_OP_PUSH8 = 0x01, /* ( -- n) pushes the unsigned byte that follows */
+  LED_EFFECT_OP_PUSH16 = 0x02, /* ( -- n) pushes the 16 bit little endian signed value that follows */
+  LED_EFFECT_OP_INDEX = 0x10, /* ( -- i) the index of the LED */
+  LED_EFFECT_OP_COUNT = 0x11, /* ( -- n) the number of LEDs */
+  LED_EFFECT_OP_TIME = 0x12, /* ( -- ms) milliseconds since the effect started */
+  LED_EFFECT_OP_FRAME = 0x13, /* ( -- f) frames since the effect started */
+  LED_EFFECT_OP_PARAM = 0x14, /* ( -- p) pushes the parameter with the index in the byte that follows */
+  LED_EFFECT_OP_INPUT = 0x15, /* ( -- v) pushes the input with the index in the byte that follows */
+  LED_EFFECT_OP_DUP = 0x20, /* (a -- a a) */
+  LED_EFFECT_OP_DROP = 0x21, /* (a -- ) */
+  LED_EFFECT_OP_SWAP = 0x22, /* (a b -- b a) */
+  LED_EFFECT_OP_OVER = 0x23, /* (a b -- a b a) */
+  LED_EFFECT_OP_ADD = 0x30, /* (a b -- a+b), arithmetic wraps around */
+  LED_EFFECT_OP_SUB = 0x31, /* (a b -- a-b) */
+  LED_EFFECT_OP_MUL = 0x32, /* (a b -- a*b) */
+  LED_EFFECT_OP_DIV = 0x33, /* (a b -- a/b), 0 if b is 0 */
+  LED_EFFECT_OP_MOD = 0x34, /* (a b -- a%b), 0 if b is 0 */
+  LED_EFFECT_OP_MIN = 0x35, /* (a b -- min) */
+  LED_EFFECT_OP_MAX = 0x36, /* (a b -- max) */
+  LED_EFFECT_OP_NEG = 0x37, /* (a -- -a) */
+  LED_EFFECT_OP_AND = 0x38, /* (a b -- a&b) */
+  LED_EFFECT_OP_OR = 0x39, /* (a b -- a|b) */
+  LED_EFFECT_OP_XOR = 0x3A, /* (a b -- a^b) */
+  LED_EFFECT_OP_SHL = 0x3B, /* (a b -- a<<b), b is taken modulo 32 */
+  LED_EFFECT_OP_SHR = 0x3C, /* (a b -- a>>b), keeps the sign */
+  LED_EFFECT_OP_LT = 0x40, /* (a b -- a<b), 1 or 0 */
+  LED_EFFECT_OP_GT = 0x41, /* (a b -- a>b) */
+  LED_EFFECT_OP_EQ = 0x42, /* (a b -- a==b) */
+  LED_EFFECT_OP_SELECT = 0x43, /* (c a b -- c ? a : b) */
+  LED_EFFECT_OP_WAVE = 0x50, /* (x -- w) sine wave from 0 to 255, with a period of 256 */
+  LED_EFFECT_OP_HUE = 0x51, /* (h -- r g b) full brightness rainbow color, the hue is taken modulo 256 */
+  LED_EFFECT_OP_SCALE = 0x52, /* (a b -- a*b/255) scales a by b out of 255, like a brightness */
+} led_effect_op_t;
+
+/** A loaded effect, kept by the caller so that nothing is allocated */
+typedef struct led_effect_s {
+  int frames_per_second;
+  int param_count;
+  int32_t params[LED_EFFECT_MAX_PARAMS];
+  uint8_t code[LED_EFFECT_MAX_CODE_SIZE];
+  int code_size;
+  int op_count;
+} led_effect_t;
+
+/**
+ * Checks an uploaded effect and loads it into effect, for a ring of led_count LEDs.
+ *
+ * Returns false if it is not valid, or if a frame would take more than LED_EFFECT_MAX_OPS_PER_FRAME operations.
+ */
+bool led_effect_load(led_effect_t* effect, const uint8_t* data, size_t size, int led_count);
+
+/**
+ * Runs the program for each LED of a frame, writing r, g, b for each LED into colors.
+ *
+ * inputs holds LED_EFFECT_MAX_INPUTS values for the frame, 0 for the inputs the device does not have.
+ */
+void led_effect_render(const led_effect_t* effect, int64_t frame_number, const int32_t* inputs, uint8_t* colors, int led_count);
+
+#endif /* MAIN_LED_EFFECT_H_ */
@@ -0,0 +1,204 @@
+/*
+ * Copyright 2017 Sam Leitch
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "led_effect.h"
+
+#include <math.h>
+#include <string.h>
+
+/** What an operation takes from and leaves on the stack, and the size of its immediate */
+typedef struct led_effect_op_info_s {
+  bool valid;
+  uint8_t immediate_size;
+  uint8_t pops;
+  uint8_t pushes;
+} led_effect_op_info_t;
+
+#define LED_EFFECT_OP(op, immediate_size, pops, pushes) [op] = { true, immediate_size, pops, pushes }
+
+static const led_effect_op_info_t led_effect_ops[256] = {
+  LED_EFFECT_OP(LED_EFFECT_OP_PUSH8, 1, 0, 1),
+  LED_EFFECT_OP(LED_EFFECT_OP_PUSH16, 2, 0, 1),
+  LED_EFFECT_OP(LED_EFFECT_OP_INDEX, 0, 0, 1),
+  LED_EFFECT_OP(LED_EFFECT_OP_COUNT, 0, 0, 1),
+  LED_EFFECT_OP(LED_EFFECT_OP_TIME, 0, 0, 1),
+  LED_EFFECT_OP(LED_EFFECT_OP_FRAME, 0, 0, 1),
+  LED_EFFECT_OP(LED_EFFECT_OP_PARAM, 1, 0, 1),
+  LED_EFFECT_OP(LED_EFFECT_OP_INPUT, 1, 0, 1),
+  LED_EFFECT_OP(LED_EFFECT_OP_DUP, 0, 1, 2),
+  LED_EFFECT_OP(LED_EFFECT_OP_DROP, 0, 1, 0),
+  LED_EFFECT_OP(LED_EFFECT_OP_SWAP, 0, 2, 2),
+  LED_EFFECT_OP(LED_EFFECT_OP_OVER, 0, 2, 3),
+  LED_EFFECT_OP(LED_EFFECT_OP_ADD, 0, 2, 1),
+  LED_EFFECT_OP(LED_EFFECT_OP_SUB, 0, 2, 1),
+  LED_EFFECT_OP(LED_EFFECT_OP_MUL, 0, 2, 1),
+  LED_EFFECT_OP(LED_EFFECT_OP_DIV, 0, 2, 1),
+  LED_EFFECT_OP(LED_EFFECT_OP_MOD, 0, 2, 1),
+  LED_EFFECT_OP(LED_EFFECT_OP_MIN, 0, 2, 1),
+  LED_EFFECT_OP(LED_EFFECT_OP_MAX, 0, 2, 1),
+  LED_EFFECT_OP(LED_EFFECT_OP_NEG, 0, 1, 1),
+  LED_EFFECT_OP(LED_EFFECT_OP_AND, 0, 2, 1),
+  LED_EFFECT_OP(LED_EFFECT_OP_OR, 0, 2, 1),
+  LED_EFFECT_OP(LED_EFFECT_OP_XOR, 0, 2, 1),
+  LED_EFFECT_OP(LED_EFFECT_OP_SHL, 0, 2, 1),
+  LED_EFFECT_OP(LED_EFFECT_OP_SHR, 0, 2, 1),
+  LED_EFFECT_OP(LED_EFFECT_OP_LT, 0, 2, 1),
+  LED_EFFECT_OP(LED_EFFECT_OP_GT, 0, 2, 1),
+  LED_EFFECT_OP(LED_EFFECT_OP_EQ, 0, 2, 1),
+  LED_EFFECT_OP(LED_EFFECT_OP_SELECT, 0, 3, 1),
+  LED_EFFECT_OP(LED_EFFECT_OP_WAVE, 0, 1, 1),
+  LED_EFFECT_OP(LED_EFFECT_OP_HUE, 0, 1, 3),
+  LED_EFFECT_OP(LED_EFFECT_OP_SCALE, 0, 2, 1),
+};
+
+/* One period of a sine wave from 0 to 255 */
+static uint8_t led_effect_wave_table[256];
+static bool led_effect_wave_table_ready = false;
+
+static void led_effect_init_wave_table() {
+  for(int x=0; x < 256; ++x) {
+    led_effect_wave_table[x] = (uint8_t)(127.5f + 127.5f * sinf(x * (float)M_PI / 128.0f) + 0.5f);
+  }
+  led_effect_wave_table_ready = true;
+}
+
+bool led_effect_load(led_effect_t* effect, const uint8_t* data, size_t size, int led_count) {
+  if(size < 2 || data[0] == 0 || data[1] > LED_EFFECT_MAX_PARAMS) return false;
+
+  int param_count = data[1];
+  size_t code_offset = 2 + param_count * 2;
+  if(size <= code_offset || size - code_offset > LED_EFFECT_MAX_CODE_SIZE) return false;
+
+  const uint8_t* code = data + code_offset;
+  int code_size = size - code_offset;
+
+  /* There are no jumps, so following the code once finds the depth of the stack at every operation */
+  int depth = 0;
+  int op_count = 0;
+  for(int pc=0; pc < code_size; ++op_count) {
+    const led_effect_op_info_t* info = led_effect_ops + code[pc];
+    if(!info->valid || pc + 1 + info->immediate_size > code_size) return false;
+    if(code[pc] == LED_EFFECT_OP_PARAM && code[pc + 1] >= param_count) return false;
+    if(code[pc] == LED_EFFECT_OP_INPUT && code[pc + 1] >= LED_EFFECT_MAX_INPUTS) return false;
+    if(depth < info->pops || depth - info->pops + info->pushes > LED_EFFECT_STACK_SIZE) return false;
+
+    depth += info->pushes - info->pops;
+    pc += 1 + info->immediate_size;
+  }
+
+  if(depth != 3 || (int64_t)op_count * led_count > LED_EFFECT_MAX_OPS_PER_FRAME) return false;
+
+  if(!led_effect_wave_table_ready) led_effect_init_wave_table();
+
+  effect->frames_per_second = data[0];
+  effect->param_count = param_count;
+  for(int i=0; i < LED_EFFECT_MAX_PARAMS; ++i) {
+    effect->params[i] = i < param_count ? (int16_t)(data[2 + i * 2] | (data[3 + i * 2] << 8)) : 0;
+  }
+  memcpy(effect->code, code, code_size);
+  effect->code_size = code_size;
+  effect->op_count = op_count;
+  return true;
+}
+
+/** Pushes the full brightness rainbow color of a hue, in 6 sections between red, yellow, green, cyan, blue and magenta */
+static inline void led_effect_hue(int32_t hue, int32_t* rgb) {
+  int scaled = (hue & 0xFF) * 6;
+  int32_t up = scaled & 0xFF;
+  int32_t down = 255 - up;
+
+  switch(scaled >> 8) {
+  case 0: rgb[0] = 255; rgb[1] = up; rgb[2] = 0; break;
+  case 1: rgb[0] = down; rgb[1] = 255; rgb[2] = 0; break;
+  case 2: rgb[0] = 0; rgb[1] = 255; rgb[2] = up; break;
+  case 3: rgb[0] = 0; rgb[1] = down; rgb[2] = 255; break;
+  case 4: rgb[0] = up; rgb[1] = 0; rgb[2] = 255; break;
+  default: rgb[0] = 255; rgb[1] = 0; rgb[2] = down; break;
+  }
+}
+
+static inline uint8_t led_effect_clamp(int32_t value) {
+  return value < 0 ? 0 : value > 255 ? 255 : value;
+}
+
+void led_effect_render(const led_effect_t* effect, int64_t frame_number, const int32_t* inputs, uint8_t* colors, int led_count) {
+  int32_t frame = (int32_t)frame_number;
+  int32_t time_ms = (int32_t)(frame_number * 1000 / effect->frames_per_second);
+  const uint8_t* code_end = effect->code + effect->code_size;
+
+  for(int led=0; led < led_count; ++led) {
+    /*
+     * The program was checked when it was loaded, so the stack cannot overflow or underflow.
+     * top points after the top value, binary operations leave their result in top[-1].
+     * Arithmetic is done unsigned so that overflows wrap instead of being undefined.
+     */
+    int32_t stack[LED_EFFECT_STACK_SIZE];
+    int32_t* top = stack;
+
+    for(const uint8_t* pc = effect->code; pc < code_end;) {
+      switch(*pc++) {
+      case LED_EFFECT_OP_PUSH8: *top++ = *pc++; break;
+      case LED_EFFECT_OP_PUSH16: *top++ = (int16_t)(pc[0] | (pc[1] << 8)); pc += 2; break;
+      case LED_EFFECT_OP_INDEX: *top++ = led; break;
+      case LED_EFFECT_OP_COUNT: *top++ = led_count; break;
+      case LED_EFFECT_OP_TIME: *top++ = time_ms; break;
+      case LED_EFFECT_OP_FRAME: *top++ = frame; break;
+      case LED_EFFECT_OP_PARAM: *top++ = effect->params[*pc++]; break;
+      case LED_EFFECT_OP_INPUT: *top++ = inputs[*pc++]; break;
+      case LED_EFFECT_OP_DUP: *top = top[-1]; ++top; break;
+      case LED_EFFECT_OP_DROP: --top; break;
+      case LED_EFFECT_OP_SWAP: { int32_t a = top[-2]; top[-2] = top[-1]; top[-1] = a; break; }
+      case LED_EFFECT_OP_OVER: *top = top[-2]; ++top; break;
+      case LED_EFFECT_OP_ADD: --top; top[-1] = (uint32_t)top[-1] + (uint32_t)top[0]; break;
+      case LED_EFFECT_OP_SUB: --top; top[-1] = (uint32_t)top[-1] - (uint32_t)top[0]; break;
+      case LED_EFFECT_OP_MUL: --top; top[-1] = (uint32_t)top[-1] * (uint32_t)top[0]; break;
+      case LED_EFFECT_OP_DIV:
+        --top;
+        /* INT32_MIN / -1 overflows, so dividing by -1 is a negation */
+        top[-1] = top[0] == 0 ? 0 : top[0] == -1 ? (int32_t)(0u - (uint32_t)top[-1]) : top[-1] / top[0];
+        break;
+      case LED_EFFECT_OP_MOD:
+        --top;
+        top[-1] = top[0] == 0 || top[0] == -1 ? 0 : top[-1] % top[0];
+        break;
+      case LED_EFFECT_OP_MIN: --top; if(top[0] < top[-1]) top[-1] = top[0]; break;
+      case LED_EFFECT_OP_MAX: --top; if(top[0] > top[-1]) top[-1] = top[0]; break;
+      case LED_EFFECT_OP_NEG: top[-1] = 0u - (uint32_t)top[-1]; break;
+      case LED_EFFECT_OP_AND: --top; top[-1] &= top[0]; break;
+      case LED_EFFECT_OP_OR: --top; top[-1] |= top[0]; break;
+      case LED_EFFECT_OP_XOR: --top; top[-1] ^= top[0]; break;
+      case LED_EFFECT_OP_SHL: --top; top[-1] = (uint32_t)top[-1] << (top[0] & 31); break;
+      case LED_EFFECT_OP_SHR: --top; top[-1] >>= (top[0] & 31); break;
+      case LED_EFFECT_OP_LT: --top; top[-1] = top[-1] < top[0]; break;
+      case LED_EFFECT_OP_GT: --top; top[-1] = top[-1] > top[0]; break;
+      case LED_EFFECT_OP_EQ: --top; top[-1] = top[-1] == top[0]; break;
+      case LED_EFFECT_OP_SELECT: top -= 2; top[-1] = top[-1] ? top[0] : top[1]; break;
+      case LED_EFFECT_OP_WAVE: top[-1] = led_effect_wave_table[top[-1] & 0xFF]; break;
+      case LED_EFFECT_OP_HUE: led_effect_hue(top[-1], top - 1); top += 2; break;
+      case LED_EFFECT_OP_SCALE:
+        --top;
+        top[-1] = (int32_t)(((int64_t)top[-1] * top[0]) / 255);
+        break;
+      default:
+        break;
+      }
+    }
+
+    colors[led * 3] = led_effect_clamp(stack[0]);
+    colors[led * 3 + 1] = led_effect_clamp(stack[1]);
+    colors[led * 3 + 2] = led_effect_clamp(stack[2]);
+  }
+}
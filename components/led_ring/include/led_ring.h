@@ -21,25 +21,179 @@
 
 typedef struct led_ring_s* led_ring_t;
 
+/** Returns the current time in microseconds */
+typedef int64_t (*led_ring_clock_t)(void);
+
+#define LED_RING_JITTER_BUCKETS 8
+
+/* The fastest frame rate, a frame each ms, so the frame period is never 0 */
+#define LED_RING_MAX_FRAMES_PER_SECOND 1000
+
+/** Timing of the animation frames of a ring */
+typedef struct led_ring_frame_stats_s {
+  uint32_t frames; /* Animation frames started */
+  uint32_t missed_deadlines; /* Frames skipped because the previous frame finished too late */
+  uint32_t jitter_histogram[LED_RING_JITTER_BUCKETS]; /* Bucket n counts frames that started less than 64 << n us late */
+  int32_t max_jitter_us;
+} led_ring_frame_stats_t;
+
 /** Initialize LED ring
  *
  * In addition to creating an ws2818rmt device to update the LED,
  * this structure creates a buffer of led_count rgb_t elements.
+ *
+ * The ring is shown by its own animation task. The set functions change a draft of the ring,
+ * and led_ring_update or the loop functions publish the whole draft to the animation task,
+ * so it never shows a partly changed frame and never waits for the task changing the ring.
+ * Tasks that change the ring with several calls hold led_ring_lock around them.
  */
 led_ring_t led_ring_init(rmt_channel_t channel, gpio_num_t gpio, int led_count);
 
+/**
+ * Same as led_ring_init, but the animation task is pinned to core and encodes each frame
+ * while the previous one is sent.
+ *
+ * The RMT interrupt that feeds the frame to the LEDs runs on the core that calls this function,
+ * so calling it from the other core (like app_main on the PRO CPU with core set to the APP CPU)
+ * splits rendering and transmitting between the cores. The LEDs show the same frames as led_ring_init.
+ */
+led_ring_t led_ring_init_pipelined(rmt_channel_t channel, gpio_num_t gpio, int led_count, BaseType_t core);
+
+/**
+ * Locks the draft of the ring, so a task can change it with several calls and publish it
+ * without the changes of another task mixed in.
+ *
+ * Each function that changes the draft takes the lock itself, so it is only needed around
+ * a sequence of calls (like stopping the loop, setting the colors and updating the ring).
+ * The task holding the lock can take it again.
+ */
+void led_ring_lock(led_ring_t ctx);
+void led_ring_unlock(led_ring_t ctx);
+
+/** Returns the colors of the ring (in pattern order, the spinner does not move them), hold the lock to change them */
 rgb_t* led_ring_get_color_buffer(led_ring_t ctx);
 
+int led_ring_get_led_count(led_ring_t ctx);
+
 /** Write the LED colors to the led */
 void led_ring_update(led_ring_t ctx);
 
+/**
+ * Waits until the animation task has taken the last scene published, and started showing it.
+ *
+ * The task no longer uses the scenes before it, so the frames of an earlier frames loop or the arg
+ * of an earlier source loop can be changed. The task takes a static scene once the previous frame
+ * is sent, so waiting after each update also keeps a task from updating faster than the LEDs.
+ */
+void led_ring_wait_taken(led_ring_t ctx);
+
+/**
+ * Write the LED colors of several rings (on different channels), starting their first frames together.
+ *
+ * Each ring's task encodes its frame and waits for the others, then the channels are started back to back.
+ * Returns once every frame has started. The scene of an animation loop starts together too, and the
+ * rings show the same frame if they have the same epoch and frame rate.
+ */
+void led_ring_update_all(led_ring_t* rings, int ring_count);
+
+/**
+ * Keeps the changes to the ring from being shown until led_ring_update_all.
+ *
+ * The ring is locked until then, and every function that would show a change (like starting a loop
+ * or updating the ring) only changes the draft. This lets changes that are made with several calls,
+ * on several rings, be shown on the same frame.
+ */
+void led_ring_hold(led_ring_t ctx);
+
+/**
+ * Sets the brightness of the ring (255 is full brightness).
+ *
+ * The brightness is applied when the colors are sent, so the color buffer is not changed
+ * and the current pattern is shown at the new brightness.
+ */
+void led_ring_set_brightness(led_ring_t ctx, uint8_t brightness);
+
+/** Sets the gamma correction of the ring (1.0 is none), see ws2812rmt_set_gamma */
+void led_ring_set_gamma(led_ring_t ctx, float gamma);
+
 /** A spinner loop spins the pattern around the loop */
 void led_ring_start_spinner_loop(led_ring_t ctx);
 
+/**
+ * Sets how many LEDs the spinner moves the pattern on each step (1 by default).
+ *
+ * Negative steps spin the other way. The pattern is rotated while it is encoded,
+ * so the color buffer keeps its original order.
+ */
+void led_ring_set_spin_step(led_ring_t ctx, int step);
+
 /** A strobing loop cycles through each color and sets all leds that color */
 void led_ring_start_strobing_loop(led_ring_t ctx);
 
-/** Stop the loop */
+/**
+ * A frames loop shows frame_count frames of led_count colors one after the other, then starts again.
+ *
+ * The frames are not copied, so they must not change until the loop is stopped (see led_ring_stop_loop).
+ */
+void led_ring_start_frames_loop(led_ring_t ctx, rgb_t* frames, int frame_count);
+
+/**
+ * Gives the colors of frame frame_number of an animation (led_count colors), or NULL if there are none.
+ *
+ * It is called from the animation task, usually for the frame after the last one, but frames can be
+ * skipped or asked for again. The colors must not change until the next call.
+ */
+typedef rgb_t* (*led_ring_frame_source_t)(void* arg, int64_t frame_number);
+
+/** A source loop shows the frames given by source, like frames decoded from flash as they are needed */
+void led_ring_start_source_loop(led_ring_t ctx, led_ring_frame_source_t source, void* arg);
+
+/**
+ * A source loop with a frame rate of its own, like an effect or a recorded animation.
+ *
+ * The rate belongs to this loop, so the ring's frame rate is not changed and the loops
+ * started after it use the ring's rate again. 0 is the ring's rate, and rates above
+ * LED_RING_MAX_FRAMES_PER_SECOND are invalid.
+ */
+void led_ring_start_source_loop_at_rate(led_ring_t ctx, led_ring_frame_source_t source, void* arg,
+    int frames_per_second);
+
+/**
+ * Sets the frame rate of the spinner, strobing, frames and source loops (10 frames per second by default).
+ *
+ * Frames are started at fixed deadlines, so the rate does not depend on how long
+ * each frame takes to send. A source loop with a rate of its own keeps it.
+ * Rates above LED_RING_MAX_FRAMES_PER_SECOND are invalid and leave the rate unchanged.
+ */
+void led_ring_set_frame_rate(led_ring_t ctx, int frames_per_second);
+
+/**
+ * Sets the clock used to choose the frame of an animation (esp_timer_get_time by default).
+ *
+ * Each frame is chosen from the time since the epoch of the animation,
+ * so rings on different devices with synchronized clocks show the same frame at the same time.
+ */
+void led_ring_set_clock(led_ring_t ctx, led_ring_clock_t clock);
+
+/**
+ * Sets the time, on the ring's clock, of the first frame of the current animation.
+ *
+ * Starting a loop sets the epoch to the current time. Animations with the same epoch are in phase,
+ * and the first frame is held until the epoch if it is in the future.
+ */
+void led_ring_set_epoch(led_ring_t ctx, int64_t epoch_us);
+
+/** Copies the frame timing stats of the animation loop into stats */
+void led_ring_get_frame_stats(led_ring_t ctx, led_ring_frame_stats_t* stats);
+
+/** Copies the transmission stats of the ring's ws2812rmt channel into stats */
+void led_ring_get_output_stats(led_ring_t ctx, ws2812rmt_stats_t* stats);
+
+/**
+ * Stop the loop, the last frame is shown until the ring is updated.
+ *
+ * After led_ring_wait_taken, the animation task no longer uses the frames or the source of the loop.
+ */
 void led_ring_stop_loop(led_ring_t ctx);
 
 void led_ring_set_one_color(led_ring_t ctx, rgb_t color);
@@ -47,6 +201,14 @@ void led_ring_set_colors(led_ring_t ctx, rgb_t* colors);
 void led_ring_set_pattern(led_ring_t ctx, rgb_t* pattern, int color_count);
 void led_ring_set_rainbow(led_ring_t ctx, int max_brightness);
 
+/**
+ * Sets a rainbow going from hue_start up to hue_end (wrapping at 256).
+ *
+ * Hue 0 is red, 85 is green and 170 is blue. A full rainbow is used when hue_start == hue_end.
+ * Each ring caches its recently used rainbows, so switching back to one is a copy.
+ */
+void led_ring_set_rainbow_range(led_ring_t ctx, uint8_t max_brightness, uint8_t hue_start, uint8_t hue_end);
+
 void led_ring_uninit(led_ring_t *ctx);
 
 #endif /* MAIN_LED_RING_H_ */
@@ -16,22 +16,95 @@
 
 #include "led_ring.h"
 
-#include <freertos/freeRTOS.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
 #include <freertos/task.h>
 #include <esp_log.h>
+#include <esp_timer.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
 
 #define MAX_LED_RINGS 8
 #define LOG_LEDRING "led_ring"
+#define LED_RING_DEFAULT_FRAME_PERIOD_US 100000
+
+/* The scenes of the triple buffer, one written, one published and one shown */
+#define LED_RING_SCENE_COUNT 3
+
+/* Set in ready_scene when a scene is published, until the animation task takes it */
+#define LED_RING_SCENE_NEW 0x4
+#define LED_RING_SCENE_INDEX 0x3
+
+typedef enum {
+  LED_RING_STATIC,
+  LED_RING_SPINNING, /* Spins the pattern around the ring */
+  LED_RING_STROBING, /* Sets all LEDs to each color in turn */
+  LED_RING_PLAYING, /* Shows each of the frames in turn */
+  LED_RING_SOURCED, /* Shows the frames given by a frame source */
+  LED_RING_HELD, /* Keeps the last frame of a stopped loop on the LEDs */
+} led_ring_animation_t;
+
+#define LED_RING_PALETTE_CACHE_SIZE 4
+
+/** A rainbow that has already been calculated for the ring */
+typedef struct led_ring_palette_s {
+  int led_count; /* 0 if the entry is unused */
+  uint8_t max_brightness;
+  uint8_t hue_start;
+  uint8_t hue_end;
+  rgb_t* colors;
+} led_ring_palette_t;
+
+/** Everything the animation task needs to show the ring, published as a whole */
+typedef struct led_ring_scene_s {
+  rgb_t* colors;
+  int rotation; /* Index of the color shown on the first LED of a static scene */
+  led_ring_animation_t animation;
+  int spin_step; /* Change of rotation for each step of the spinner */
+  rgb_t* frames; /* Frames of the frames loop, led_count colors each */
+  int frame_count;
+  led_ring_frame_source_t source; /* Gives the frames of the source loop */
+  void* source_arg;
+  int64_t frame_period_us;
+  int64_t epoch_us; /* The time on the clock of the first frame of the animation */
+  uint32_t loop_id; /* Changes each time a loop is started, so the frame deadlines start again */
+  uint8_t brightness;
+  float gamma;
+  struct led_ring_group_s* group; /* Set when the first frame starts with other rings, see led_ring_update_all */
+  uint32_t scene_id; /* Counts the scenes published, see led_ring_wait_taken */
+} led_ring_scene_t;
+
+/** Rings whose first frames of a new scene are started together by led_ring_update_all */
+typedef struct led_ring_group_s {
+  SemaphoreHandle_t ready; /* Given by each ring's task when its frame is encoded */
+} led_ring_group_t;
 
 struct led_ring_s {
   ws2812rmt_t ws2812;
   int led_count;
   rgb_t* led_color_buffer;
+  led_ring_scene_t draft; /* Changed by the other tasks, draft.colors is led_color_buffer */
+  led_ring_scene_t scenes[LED_RING_SCENE_COUNT];
+  int write_scene; /* The scene the next publish copies the draft into */
+  int read_scene; /* The scene being shown, only used by the animation task */
+  atomic_uint ready_scene; /* The last scene published */
+  atomic_uint taken_scene_id; /* scene_id of the last scene taken by the animation task */
+  SemaphoreHandle_t taken_semaphore; /* Given when the animation task takes a scene */
+  SemaphoreHandle_t draft_mutex; /* Recursive, held by the task changing the draft until it is published */
+  SemaphoreHandle_t start_semaphore; /* Given once the frame of a group has been started for the task */
+  bool held; /* Publishes wait for led_ring_update_all, see led_ring_hold */
+  int64_t frame_period_us; /* Set by led_ring_set_frame_rate, for the loops without a rate of their own */
+  int loop_frames_per_second; /* The rate of the loop in the draft, 0 if it uses the ring's */
   TaskHandle_t loop_task;
   SemaphoreHandle_t loop_semaphore;
-  volatile bool strobing;
-  volatile bool spinning;
-  volatile bool animating;
+  esp_timer_handle_t frame_timer; /* Gives loop_semaphore once per frame period while animating */
+  int64_t frame_deadline_us; /* The time the current animation frame should start */
+  led_ring_clock_t clock; /* Chooses the frame of the animation */
+  led_ring_frame_stats_t frame_stats;
+  bool pipelined; /* Encode the next frame of an animation as soon as the current one is started */
+  led_ring_palette_t palettes[LED_RING_PALETTE_CACHE_SIZE]; /* Rainbows already calculated for this ring */
+  int next_palette; /* The cache entry replaced next */
 };
 
 struct led_ring_s led_rings[MAX_LED_RINGS];
@@ -40,6 +113,10 @@ rgb_t* led_ring_get_color_buffer(led_ring_t ctx) {
   return ctx->led_color_buffer;
 }
 
+int led_ring_get_led_count(led_ring_t ctx) {
+  return ctx->led_count;
+}
+
 #define RAINBOW_SECTION_RED_TO_YELLOW   0
 #define RAINBOW_SECTION_YELLOW_TO_GREEN 1
 #define RAINBOW_SECTION_GREEN_TO_CYAN   2
@@ -47,152 +124,638 @@ rgb_t* led_ring_get_color_buffer(led_ring_t ctx) {
 #define RAINBOW_SECTION_BLUE_TO_MAGENTA 4
 #define RAINBOW_SECTION_MAGENTA_TO_RED  5
 
+/* Full brightness color for each of the 256 hues */
+static rgb_t led_ring_hue_table[256];
+static bool led_ring_hue_table_ready = false;
+
 /**
- * Returns a color for a rainbow of colors of any size.
+ * Fills the hue table with a full brightness rainbow.
  *
  * The rainbow has 6 sections based on 6 color transitions.
  * Within each section:
- * * 2 of the RGB values are fixed at max_brightness or 0
- * * 1 of the RGB values is in transition from max_brightness to 0 or 0 to max_brightness
+ * * 2 of the RGB values are fixed at 255 or 0
+ * * 1 of the RGB values is in transition from 255 to 0 or 0 to 255
+ */
+static void led_ring_init_hue_table() {
+  for(int hue=0; hue < 256; ++hue) {
+    rgb_t color = { 0, 0, 0 };
+
+    /* hue * 6 is the position on the rainbow in 8.8 fixed point */
+    int section_num = (hue * 6) >> 8;
+    uint8_t partial_brightness = (hue * 6) & 0xFF;
+
+    switch(section_num) {
+    case RAINBOW_SECTION_RED_TO_YELLOW:
+      color.r = 255;
+      color.g = partial_brightness;
+      break;
+    case RAINBOW_SECTION_YELLOW_TO_GREEN:
+      color.g = 255;
+      color.r = 255 - partial_brightness;
+      break;
+    case RAINBOW_SECTION_GREEN_TO_CYAN:
+      color.g = 255;
+      color.b = partial_brightness;
+      break;
+    case RAINBOW_SECTION_CYAN_TO_BLUE:
+      color.b = 255;
+      color.g = 255 - partial_brightness;
+      break;
+    case RAINBOW_SECTION_BLUE_TO_MAGENTA:
+      color.b = 255;
+      color.r = partial_brightness;
+      break;
+    case RAINBOW_SECTION_MAGENTA_TO_RED:
+      color.r = 255;
+      color.b = 255 - partial_brightness;
+      break;
+    }
+
+    led_ring_hue_table[hue] = color;
+  }
+
+  led_ring_hue_table_ready = true;
+}
+
+/** Scales a full brightness value to max_brightness without a division (255 maps to max_brightness) */
+static inline uint8_t led_ring_scale(uint8_t value, uint8_t max_brightness) {
+  return (value * (max_brightness + 1)) >> 8;
+}
+
+/**
+ * Calculates a rainbow of count colors going from hue_start up to hue_end.
+ *
+ * Hues wrap around at 256, and a full rainbow is used when hue_start == hue_end.
+ * The hue of each LED is stepped in 16.16 fixed point, so there is only one division per rainbow.
+ */
+static void led_ring_calculate_rainbow(rgb_t* colors, int count, uint8_t max_brightness, uint8_t hue_start, uint8_t hue_end) {
+  uint32_t hue_span = (uint8_t)(hue_end - hue_start);
+  if(hue_span == 0) hue_span = 256;
+
+  uint32_t hue_step = (hue_span << 16) / count;
+  uint32_t hue = (uint32_t)hue_start << 16;
+
+  for(int i=0; i < count; ++i) {
+    rgb_t color = led_ring_hue_table[(hue >> 16) & 0xFF];
+    colors[i].r = led_ring_scale(color.r, max_brightness);
+    colors[i].g = led_ring_scale(color.g, max_brightness);
+    colors[i].b = led_ring_scale(color.b, max_brightness);
+    hue += hue_step;
+  }
+}
+
+/**
+ * Returns a cached rainbow, calculating it if it is not in the cache.
+ *
+ * Returns NULL if there is no memory for a new cache entry.
+ */
+static rgb_t* led_ring_get_rainbow(led_ring_t ctx, uint8_t max_brightness, uint8_t hue_start, uint8_t hue_end) {
+  int count = ctx->led_count;
+  for(int i=0; i < LED_RING_PALETTE_CACHE_SIZE; ++i) {
+    led_ring_palette_t* palette = ctx->palettes + i;
+    if(palette->led_count == count && palette->max_brightness == max_brightness &&
+        palette->hue_start == hue_start && palette->hue_end == hue_end) {
+      return palette->colors;
+    }
+  }
+
+  /* Replace the oldest entry */
+  led_ring_palette_t* palette = ctx->palettes + ctx->next_palette;
+  if(palette->led_count != count) {
+    free(palette->colors);
+    palette->led_count = 0;
+    palette->colors = malloc(count * sizeof(rgb_t));
+    if(!palette->colors) return NULL;
+  }
+
+  led_ring_calculate_rainbow(palette->colors, count, max_brightness, hue_start, hue_end);
+  palette->led_count = count;
+  palette->max_brightness = max_brightness;
+  palette->hue_start = hue_start;
+  palette->hue_end = hue_end;
+  ctx->next_palette = (ctx->next_palette + 1) % LED_RING_PALETTE_CACHE_SIZE;
+  return palette->colors;
+}
+
+/** Wakes the animation loop for the next frame */
+static void led_ring_frame_timer(void* param) {
+  led_ring_t ctx = (led_ring_t)param;
+  xSemaphoreGive(ctx->loop_semaphore);
+}
+
+void led_ring_lock(led_ring_t ctx) {
+  xSemaphoreTakeRecursive(ctx->draft_mutex, portMAX_DELAY);
+}
+
+void led_ring_unlock(led_ring_t ctx) {
+  xSemaphoreGiveRecursive(ctx->draft_mutex);
+}
+
+/**
+ * Publishes the draft to the animation task, which shows it on its next frame.
+ *
+ * The draft is copied into the write scene, which is then swapped with the published one.
+ * The animation task swaps its scene with the published one when it is new, so it always
+ * shows a whole scene without waiting for the other tasks.
  */
-static rgb_t led_ring_calculate_rainbow_color(int index, int count, int max_brightness) {
-  rgb_t color = { 0, 0, 0 };
-
-  /* All of this math is to compensate for rainbow that are not even multiples of 6 in length */
-  int section_num = index * 6 / count;
-  int section_start = count * section_num / 6;
-  int section_offset = index - section_start;
-  int next_section_start = count * (section_num + 1) / 6;
-  int section_size = next_section_start - section_start;
-  int partial_brightness = (section_offset * max_brightness) / section_size;
-
-  switch(section_num) {
-  case RAINBOW_SECTION_RED_TO_YELLOW:
-    color.r = max_brightness;
-    color.g = partial_brightness;
-    break;
-  case RAINBOW_SECTION_YELLOW_TO_GREEN:
-    color.g = max_brightness;
-    color.r = max_brightness - partial_brightness;
-    break;
-  case RAINBOW_SECTION_GREEN_TO_CYAN:
-    color.g = max_brightness;
-    color.b = partial_brightness;
-    break;
-  case RAINBOW_SECTION_CYAN_TO_BLUE:
-    color.b = max_brightness;
-    color.g = max_brightness - partial_brightness;
-    break;
-  case RAINBOW_SECTION_BLUE_TO_MAGENTA:
-    color.b = max_brightness;
-    color.r = partial_brightness;
-    break;
-  case RAINBOW_SECTION_MAGENTA_TO_RED:
-    color.r = max_brightness;
-    color.b = max_brightness - partial_brightness;
-    break;
-  }
-
-  return color;
+static void led_ring_publish(led_ring_t ctx) {
+  led_ring_lock(ctx);
+  if(ctx->held) {
+    led_ring_unlock(ctx);
+    return;
+  }
+
+  ++ctx->draft.scene_id;
+  led_ring_scene_t* scene = ctx->scenes + ctx->write_scene;
+  rgb_t* colors = scene->colors;
+  *scene = ctx->draft;
+  scene->colors = colors;
+  memcpy(colors, ctx->draft.colors, ctx->led_count * sizeof(rgb_t));
+
+  unsigned int previous = atomic_exchange(&ctx->ready_scene, ctx->write_scene | LED_RING_SCENE_NEW);
+  ctx->write_scene = previous & LED_RING_SCENE_INDEX;
+
+  led_ring_unlock(ctx);
+  xSemaphoreGive(ctx->loop_semaphore);
+}
+
+/** Takes the published scene if it is new, returns true if the scene changed */
+static bool led_ring_take_scene(led_ring_t ctx) {
+  if(!(atomic_load(&ctx->ready_scene) & LED_RING_SCENE_NEW)) return false;
+
+  unsigned int ready = atomic_exchange(&ctx->ready_scene, ctx->read_scene);
+  ctx->read_scene = ready & LED_RING_SCENE_INDEX;
+  return true;
 }
 
+/**
+ * Records how late the current frame started and moves the deadline to the next frame.
+ *
+ * Deadlines are absolute, so the time taken by a frame does not change the frame rate.
+ * If a frame starts after the deadline of the next one, the skipped frames are counted
+ * as missed and the deadline moves past them.
+ */
+static void led_ring_track_deadline(led_ring_t ctx, int64_t frame_period_us) {
+  int64_t lateness = esp_timer_get_time() - ctx->frame_deadline_us;
+  if(lateness < 0) lateness = 0;
+
+  if(lateness >= frame_period_us) {
+    int64_t missed = lateness / frame_period_us;
+    ctx->frame_stats.missed_deadlines += missed;
+    ctx->frame_deadline_us += missed * frame_period_us;
+    lateness -= missed * frame_period_us;
+  }
+
+  /* Bucket n counts frames that started less than 64 << n us late */
+  uint32_t lateness_64us = (uint32_t)lateness >> 6;
+  int bucket = lateness_64us == 0 ? 0 : 32 - __builtin_clz(lateness_64us);
+  if(bucket >= LED_RING_JITTER_BUCKETS) bucket = LED_RING_JITTER_BUCKETS - 1;
+  ++ctx->frame_stats.jitter_histogram[bucket];
+
+  if(lateness > ctx->frame_stats.max_jitter_us) ctx->frame_stats.max_jitter_us = lateness;
+  ++ctx->frame_stats.frames;
+  ctx->frame_deadline_us += frame_period_us;
+}
+
+/** Encodes a frame of an animated scene, returns false if there is nothing to send */
+static bool led_ring_prepare_frame(led_ring_t ctx, const led_ring_scene_t* scene, int64_t frame_number) {
+  // Rotate the pattern, the colors themselves are not moved
+  int rotation = (frame_number * scene->spin_step) % ctx->led_count;
+  if(rotation < 0) rotation += ctx->led_count;
+
+  switch(scene->animation) {
+  case LED_RING_STROBING:
+    return ws2812rmt_prepare(ctx->ws2812, scene->colors + rotation, 1, true, 0);
+  case LED_RING_SPINNING:
+    return ws2812rmt_prepare(ctx->ws2812, scene->colors, ctx->led_count, true, rotation);
+  case LED_RING_PLAYING:
+    return ws2812rmt_prepare(ctx->ws2812, scene->frames + (frame_number % scene->frame_count) * ctx->led_count,
+        ctx->led_count, true, 0);
+  case LED_RING_SOURCED:
+  {
+    rgb_t* colors = scene->source(scene->source_arg, frame_number);
+    return colors && ws2812rmt_prepare(ctx->ws2812, colors, ctx->led_count, true, 0);
+  }
+  default:
+    return false;
+  }
+}
+
+/**
+ * Starts the encoded frame, or for the first frame of a group, waits for led_ring_update_all
+ * to start it together with the frames of the other rings.
+ */
+static void led_ring_start_frame(led_ring_t ctx, led_ring_group_t* group) {
+  if(!group) {
+    ws2812rmt_start(ctx->ws2812);
+    return;
+  }
+
+  xSemaphoreGive(group->ready);
+  xSemaphoreTake(ctx->start_semaphore, portMAX_DELAY);
+}
+
+/**
+ * Shows the published scenes.
+ *
+ * This is the only task that uses the ws2812 device, the other tasks change the ring by publishing scenes.
+ *
+ * When pipelined, the next frame of an animation is encoded while the current one is sent,
+ * so only starting the transmission is left for the deadline. If the scene changes or a frame
+ * is skipped, the frame encoded ahead is thrown away and the right one is encoded instead.
+ */
 static void led_ring_animation_loop(void* param) {
   ESP_LOGI(LOG_LEDRING, "led_ring animation loop");
   led_ring_t ctx = (led_ring_t)param;
+  uint32_t loop_id = 0;
+  int64_t prepared_frame = -1; /* The frame encoded ahead, when pipelined */
+  uint8_t brightness = 255;
+  float gamma = 1.0f;
 
   rgb_t black = { 0, 0, 0 };
-  ws2812rmt_set_colors(ctx->ws2812, &black, 1, true);
+  ws2812rmt_submit_colors(ctx->ws2812, &black, 1, true);
 
   while(1) {
-    if(!ctx->animating) xSemaphoreTake(ctx->loop_semaphore, portMAX_DELAY);
+    xSemaphoreTake(ctx->loop_semaphore, portMAX_DELAY);
+    bool changed = led_ring_take_scene(ctx);
+    const led_ring_scene_t* scene = ctx->scenes + ctx->read_scene;
+    if(changed) {
+      atomic_store(&ctx->taken_scene_id, scene->scene_id);
+      xSemaphoreGive(ctx->taken_semaphore);
+    }
 
-    if(ctx->strobing) {
-      ws2812rmt_set_colors(ctx->ws2812, ctx->led_color_buffer, 1, true);
+    if(scene->brightness != brightness) {
+      brightness = scene->brightness;
+      ws2812rmt_set_brightness(ctx->ws2812, brightness);
     }
 
-    if(ctx->spinning) {
-      ws2812rmt_set_colors(ctx->ws2812, ctx->led_color_buffer, ctx->led_count, true);
+    if(scene->gamma != gamma) {
+      gamma = scene->gamma;
+      ws2812rmt_set_gamma(ctx->ws2812, gamma);
     }
 
-    if(ctx->animating) {
-      vTaskDelay(pdMS_TO_TICKS(100));
+    if(changed) {
+      ws2812rmt_cancel(ctx->ws2812);
+      prepared_frame = -1;
+    }
+
+    /* A group only waits for the first frame of its scene */
+    led_ring_group_t* group = changed ? scene->group : NULL;
+
+    /* Nothing is sent, and the frames and source of the stopped loop are no longer used */
+    if(scene->animation == LED_RING_HELD) continue;
 
-      // Shift the pattern
-      rgb_t led_0 = ctx->led_color_buffer[0];
-      for(int i=0; i < ctx->led_count - 1; ++i) ctx->led_color_buffer[i] = ctx->led_color_buffer[i + 1];
-      ctx->led_color_buffer[ctx->led_count - 1] = led_0;
+    if(scene->animation == LED_RING_STATIC) {
+      if(changed) {
+        ws2812rmt_prepare(ctx->ws2812, scene->colors, ctx->led_count, true, scene->rotation);
+        led_ring_start_frame(ctx, group);
+      }
+      continue;
+    }
+
+    /* Only frames woken by the timer are on the schedule, a scene published mid loop is shown straight away */
+    bool new_loop = scene->loop_id != loop_id;
+    if(new_loop) {
+      loop_id = scene->loop_id;
+      ctx->frame_deadline_us = esp_timer_get_time();
+    }
+    if(!changed || new_loop) led_ring_track_deadline(ctx, scene->frame_period_us);
+
+    /*
+     * The frame is chosen from the time since the epoch rather than counted,
+     * so rings with synchronized clocks stay in phase and late frames do not slow the animation.
+     */
+    int64_t frame_number = (ctx->clock() - scene->epoch_us) / scene->frame_period_us;
+    if(frame_number < 0) frame_number = 0;
+
+    if(frame_number != prepared_frame) {
+      ws2812rmt_cancel(ctx->ws2812);
+      led_ring_prepare_frame(ctx, scene, frame_number);
+    }
+    led_ring_start_frame(ctx, group);
+
+    if(ctx->pipelined) {
+      prepared_frame = frame_number + 1;
+      led_ring_prepare_frame(ctx, scene, prepared_frame);
     }
   }
 }
 
-led_ring_t led_ring_init(rmt_channel_t channel, gpio_num_t gpio_num, int led_count) {
+/** Initializes everything but the animation task */
+static led_ring_t led_ring_init_ctx(rmt_channel_t channel, gpio_num_t gpio_num, int led_count) {
   ESP_LOGI(LOG_LEDRING, "Initializing LED ring count %d, channel %d, GPIO %d", led_count, channel, gpio_num);
   led_ring_t ctx = led_rings + channel;
   ctx->led_count = led_count;
   ctx->led_color_buffer = calloc(led_count, sizeof(rgb_t));
   if(!ctx->led_color_buffer) return NULL;
   ctx->ws2812 = ws2812rmt_init(channel, gpio_num, led_count);
-  ctx->animating = false;
-  ctx->strobing = false;
-  ctx->spinning = false;
+
+  memset(&ctx->draft, 0, sizeof(ctx->draft));
+  ctx->draft.colors = ctx->led_color_buffer;
+  ctx->draft.animation = LED_RING_STATIC;
+  ctx->draft.spin_step = 1;
+  ctx->draft.frame_period_us = LED_RING_DEFAULT_FRAME_PERIOD_US;
+  ctx->draft.brightness = 255;
+  ctx->draft.gamma = 1.0f;
+
+  for(int i=0; i < LED_RING_SCENE_COUNT; ++i) {
+    ctx->scenes[i] = ctx->draft;
+    ctx->scenes[i].colors = calloc(led_count, sizeof(rgb_t));
+    if(!ctx->scenes[i].colors) return NULL;
+  }
+  atomic_init(&ctx->ready_scene, 0);
+  atomic_init(&ctx->taken_scene_id, 0);
+  ctx->read_scene = 1;
+  ctx->write_scene = 2;
+
+  ctx->held = false;
+  ctx->frame_period_us = LED_RING_DEFAULT_FRAME_PERIOD_US;
+  ctx->loop_frames_per_second = 0;
+  ctx->draft_mutex = xSemaphoreCreateRecursiveMutex();
+  ctx->start_semaphore = xSemaphoreCreateBinary();
+  ctx->taken_semaphore = xSemaphoreCreateBinary();
   ctx->loop_semaphore = xSemaphoreCreateBinary();
+  ctx->clock = esp_timer_get_time;
+  memset(&ctx->frame_stats, 0, sizeof(ctx->frame_stats));
+  memset(ctx->palettes, 0, sizeof(ctx->palettes));
+  ctx->next_palette = 0;
+
+  /* Filled before any task can calculate a rainbow, so it is only read afterwards */
+  if(!led_ring_hue_table_ready) led_ring_init_hue_table();
+
+  esp_timer_create_args_t timer_args = {
+    .callback = led_ring_frame_timer,
+    .arg = ctx,
+    .dispatch_method = ESP_TIMER_TASK,
+    .name = "led_ring_frame",
+  };
+  ESP_ERROR_CHECK(esp_timer_create(&timer_args, &ctx->frame_timer));
+  ctx->pipelined = false;
+
+  return ctx;
+}
+
+led_ring_t led_ring_init(rmt_channel_t channel, gpio_num_t gpio_num, int led_count) {
+  led_ring_t ctx = led_ring_init_ctx(channel, gpio_num, led_count);
+  if(!ctx) return NULL;
+
   xTaskCreate(led_ring_animation_loop, "led_animation_loop", 2048, ctx, 5, &(ctx->loop_task));
 
   return ctx;
 }
 
+led_ring_t led_ring_init_pipelined(rmt_channel_t channel, gpio_num_t gpio_num, int led_count, BaseType_t core) {
+  led_ring_t ctx = led_ring_init_ctx(channel, gpio_num, led_count);
+  if(!ctx) return NULL;
+
+  ctx->pipelined = true;
+  xTaskCreatePinnedToCore(led_ring_animation_loop, "led_animation_loop", 2048, ctx, 5, &(ctx->loop_task), core);
+
+  return ctx;
+}
+
 void led_ring_update(led_ring_t ctx) {
-  ws2812rmt_set_colors(ctx->ws2812, ctx->led_color_buffer, ctx->led_count, true);
+  led_ring_publish(ctx);
 }
 
-static void led_ring_start_loop(led_ring_t ctx) {
-  ctx->animating = true;
-  xSemaphoreGive(ctx->loop_semaphore);
+void led_ring_wait_taken(led_ring_t ctx) {
+  led_ring_lock(ctx);
+  uint32_t scene_id = ctx->draft.scene_id;
+  led_ring_unlock(ctx);
+
+  /*
+   * The ids wrap, so the difference tells whether the task has reached scene_id.
+   * The semaphore only wakes one task, so tasks waiting together also check once a tick.
+   */
+  while((int32_t)(atomic_load(&ctx->taken_scene_id) - scene_id) < 0) {
+    xSemaphoreTake(ctx->taken_semaphore, 1);
+  }
+}
+
+void led_ring_hold(led_ring_t ctx) {
+  led_ring_lock(ctx);
+  ctx->held = true;
+}
+
+/** Lets the ring publish again, and gives up the lock taken by led_ring_hold */
+static void led_ring_release(led_ring_t ctx) {
+  if(!ctx->held) return;
+  ctx->held = false;
+  led_ring_unlock(ctx);
+}
+
+void led_ring_update_all(led_ring_t* rings, int ring_count) {
+  led_ring_group_t group;
+  group.ready = xSemaphoreCreateCounting(ring_count, 0);
+  if(!group.ready) {
+    ESP_LOGE(LOG_LEDRING, "No memory to start %d rings together, updating them one by one", ring_count);
+    for(int i=0; i < ring_count; ++i) {
+      led_ring_lock(rings[i]);
+      led_ring_release(rings[i]);
+      led_ring_publish(rings[i]);
+      led_ring_unlock(rings[i]);
+    }
+    return;
+  }
+
+  /*
+   * The rings stay locked until their frames are started, so no other scene can replace the group's.
+   * The lock of a held ring is kept until then too, it is given up with the ring's own.
+   */
+  for(int i=0; i < ring_count; ++i) {
+    led_ring_lock(rings[i]);
+    led_ring_release(rings[i]);
+    rings[i]->draft.group = &group;
+    led_ring_publish(rings[i]);
+    rings[i]->draft.group = NULL;
+  }
+
+  /* Each task encodes its frame and waits, so only starting the channels is left */
+  for(int i=0; i < ring_count; ++i) xSemaphoreTake(group.ready, portMAX_DELAY);
+
+  /* Wait for every channel first, so that starting one does not delay the others */
+  for(int i=0; i < ring_count; ++i) ws2812rmt_wait_idle(rings[i]->ws2812);
+  for(int i=0; i < ring_count; ++i) ws2812rmt_start(rings[i]->ws2812);
+
+  for(int i=0; i < ring_count; ++i) {
+    xSemaphoreGive(rings[i]->start_semaphore);
+    led_ring_unlock(rings[i]);
+  }
+
+  vSemaphoreDelete(group.ready);
+}
+
+/** Starts a loop at frames_per_second, or at the ring's frame rate if it is 0 */
+static void led_ring_start_loop(led_ring_t ctx, led_ring_animation_t animation, int frames_per_second) {
+  led_ring_lock(ctx);
+  esp_timer_stop(ctx->frame_timer);
+  ctx->loop_frames_per_second = frames_per_second;
+  ctx->draft.frame_period_us = frames_per_second > 0 ? 1000000 / frames_per_second : ctx->frame_period_us;
+  ctx->draft.animation = animation;
+  ctx->draft.epoch_us = ctx->clock();
+  ++ctx->draft.loop_id;
+  led_ring_publish(ctx);
+  esp_timer_start_periodic(ctx->frame_timer, ctx->draft.frame_period_us);
+  led_ring_unlock(ctx);
+}
+
+void led_ring_set_frame_rate(led_ring_t ctx, int frames_per_second) {
+  if(frames_per_second <= 0 || frames_per_second > LED_RING_MAX_FRAMES_PER_SECOND) {
+    ESP_LOGE(LOG_LEDRING, "frames_per_second %d is invalid", frames_per_second);
+    return;
+  }
+
+  led_ring_lock(ctx);
+  ctx->frame_period_us = 1000000 / frames_per_second;
+  if(ctx->draft.animation != LED_RING_STATIC && ctx->loop_frames_per_second == 0) {
+    led_ring_start_loop(ctx, ctx->draft.animation, 0);
+  }
+  led_ring_unlock(ctx);
+}
+
+void led_ring_set_clock(led_ring_t ctx, led_ring_clock_t clock) {
+  ctx->clock = clock;
+}
+
+void led_ring_set_epoch(led_ring_t ctx, int64_t epoch_us) {
+  led_ring_lock(ctx);
+  ctx->draft.epoch_us = epoch_us;
+  if(ctx->draft.animation != LED_RING_STATIC) led_ring_publish(ctx);
+  led_ring_unlock(ctx);
+}
+
+void led_ring_get_frame_stats(led_ring_t ctx, led_ring_frame_stats_t* stats) {
+  *stats = ctx->frame_stats;
+}
+
+void led_ring_get_output_stats(led_ring_t ctx, ws2812rmt_stats_t* stats) {
+  ws2812rmt_get_stats(ctx->ws2812, stats);
 }
 
 void led_ring_start_spinner_loop(led_ring_t ctx) {
-  ctx->spinning = true;
-  led_ring_start_loop(ctx);
+  led_ring_start_loop(ctx, LED_RING_SPINNING, 0);
 }
 
 void led_ring_start_strobing_loop(led_ring_t ctx) {
-  ctx->strobing = true;
-  led_ring_start_loop(ctx);
+  led_ring_start_loop(ctx, LED_RING_STROBING, 0);
+}
+
+void led_ring_start_frames_loop(led_ring_t ctx, rgb_t* frames, int frame_count) {
+  if(frame_count <= 0) {
+    ESP_LOGE(LOG_LEDRING, "frame_count %d is invalid", frame_count);
+    return;
+  }
+
+  led_ring_lock(ctx);
+  ctx->draft.frames = frames;
+  ctx->draft.frame_count = frame_count;
+  led_ring_start_loop(ctx, LED_RING_PLAYING, 0);
+  led_ring_unlock(ctx);
+}
+
+void led_ring_start_source_loop(led_ring_t ctx, led_ring_frame_source_t source, void* arg) {
+  led_ring_start_source_loop_at_rate(ctx, source, arg, 0);
+}
+
+void led_ring_start_source_loop_at_rate(led_ring_t ctx, led_ring_frame_source_t source, void* arg,
+    int frames_per_second) {
+  if(!source || frames_per_second < 0 || frames_per_second > LED_RING_MAX_FRAMES_PER_SECOND) {
+    ESP_LOGE(LOG_LEDRING, "source or frames_per_second %d is invalid", frames_per_second);
+    return;
+  }
+
+  led_ring_lock(ctx);
+  ctx->draft.source = source;
+  ctx->draft.source_arg = arg;
+  led_ring_start_loop(ctx, LED_RING_SOURCED, frames_per_second);
+  led_ring_unlock(ctx);
+}
+
+void led_ring_set_brightness(led_ring_t ctx, uint8_t brightness) {
+  led_ring_lock(ctx);
+  ctx->draft.brightness = brightness;
+  led_ring_publish(ctx);
+  led_ring_unlock(ctx);
+}
+
+void led_ring_set_gamma(led_ring_t ctx, float gamma) {
+  led_ring_lock(ctx);
+  ctx->draft.gamma = gamma;
+  led_ring_publish(ctx);
+  led_ring_unlock(ctx);
+}
+
+void led_ring_set_spin_step(led_ring_t ctx, int step) {
+  led_ring_lock(ctx);
+  ctx->draft.spin_step = step;
+  if(ctx->draft.animation != LED_RING_STATIC) led_ring_publish(ctx);
+  led_ring_unlock(ctx);
 }
 
 void led_ring_stop_loop(led_ring_t ctx) {
-  ctx->animating = false;
-  ctx->strobing = false;
-  ctx->spinning = false;
+  led_ring_lock(ctx);
+  esp_timer_stop(ctx->frame_timer);
+  if(ctx->draft.animation != LED_RING_STATIC) {
+    /* The task is told to leave the loop, so led_ring_wait_taken tells when its frames and source are free */
+    ctx->draft.animation = LED_RING_HELD;
+    led_ring_publish(ctx);
+  }
+  ctx->draft.animation = LED_RING_STATIC;
+  led_ring_unlock(ctx);
 }
 
 void led_ring_set_one_color(led_ring_t ctx, rgb_t color) {
+  led_ring_lock(ctx);
+  ctx->draft.rotation = 0;
   for (int i=0; i < ctx->led_count; ++i) ctx->led_color_buffer[i] = color;
+  led_ring_unlock(ctx);
 }
 
 void led_ring_set_colors(led_ring_t ctx, rgb_t* colors) {
-  for(int i=0; i < ctx->led_count - 1; ++i) ctx->led_color_buffer[i] = colors[i];
+  led_ring_lock(ctx);
+  ctx->draft.rotation = 0;
+  for(int i=0; i < ctx->led_count; ++i) ctx->led_color_buffer[i] = colors[i];
+  led_ring_unlock(ctx);
 }
 
 void led_ring_set_pattern(led_ring_t ctx, rgb_t* pattern, int color_count) {
+  led_ring_lock(ctx);
+  ctx->draft.rotation = 0;
   for(int i=0; i < ctx->led_count; ++i) {
     int color_index = i % color_count;
     ctx->led_color_buffer[i] = pattern[color_index];
   }
+  led_ring_unlock(ctx);
 }
 
 void led_ring_set_rainbow(led_ring_t ctx, int max_brightness) {
-  for (int i=0; i < ctx->led_count; ++i) {
-    rgb_t color = led_ring_calculate_rainbow_color(i, ctx->led_count, max_brightness);
-    ctx->led_color_buffer[i] = color;
+  led_ring_set_rainbow_range(ctx, max_brightness, 0, 0);
+}
+
+void led_ring_set_rainbow_range(led_ring_t ctx, uint8_t max_brightness, uint8_t hue_start, uint8_t hue_end) {
+  led_ring_lock(ctx);
+  ctx->draft.rotation = 0;
+  rgb_t* rainbow = led_ring_get_rainbow(ctx, max_brightness, hue_start, hue_end);
+  if(rainbow) {
+    memcpy(ctx->led_color_buffer, rainbow, ctx->led_count * sizeof(rgb_t));
+  } else {
+    led_ring_calculate_rainbow(ctx->led_color_buffer, ctx->led_count, max_brightness, hue_start, hue_end);
   }
+  led_ring_unlock(ctx);
 }
 
 void led_ring_uninit(led_ring_t *ctx) {
   if(!ctx) return;
+  esp_timer_stop((*ctx)->frame_timer);
+  esp_timer_delete((*ctx)->frame_timer);
   vTaskDelete((*ctx)->loop_task);
+  for(int i=0; i < LED_RING_SCENE_COUNT; ++i) free((*ctx)->scenes[i].colors);
+  for(int i=0; i < LED_RING_PALETTE_CACHE_SIZE; ++i) free((*ctx)->palettes[i].colors);
   free((*ctx)->led_color_buffer);
+  vSemaphoreDelete((*ctx)->draft_mutex);
+  vSemaphoreDelete((*ctx)->start_semaphore);
+  vSemaphoreDelete((*ctx)->taken_semaphore);
+  vSemaphoreDelete((*ctx)->loop_semaphore);
   ws2812rmt_uninit(&((*ctx)->ws2812));
   ctx = NULL;
 }
-
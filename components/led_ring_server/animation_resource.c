@@ -0,0 +1,185 @@
+/*
+ * Copyright 2017 Sam Leitch
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "animation_resource.h"
+#include "led_ring_resource.h"
+
+#include <coap/block.h>
+#include <esp_log.h>
+#include <resource.h>
+#include <string.h>
+
+/* Block size used for GET when the client does not ask for one (szx 6 is 1024 bytes) */
+#define ANIMATION_DEFAULT_BLOCK_SZX 6
+
+const static char* resource_name = "animation";
+
+/*
+ * One buffer holds the animation being shown while the other receives an upload,
+ * so an upload never changes the frames on the ring until it is complete.
+ */
+static uint8_t animation_buffers[2][ANIMATION_MAX_SIZE];
+static int playing_buffer = 0;
+static size_t playing_size = 0;
+static size_t upload_size = 0; /* Bytes of the current upload received so far */
+
+static led_ring_t led_ring;
+
+static void animation_add_block1_option(coap_pdu_t* response, const coap_block_t* block) {
+  unsigned char buf[4];
+  unsigned int value = (block->num << 4) | (block->m << 3) | block->szx;
+  unsigned int len = coap_encode_var_bytes(buf, value);
+  coap_add_option(response, COAP_OPTION_BLOCK1, len, buf);
+}
+
+/** Shows the frames of the upload buffer on the ring, called by the led_ring resource with the ring locked */
+static bool animation_show_upload(led_ring_t led_ring, void* arg) {
+  rgb_t* frames = (rgb_t*)animation_buffers[1 - playing_buffer];
+  int frame_count = upload_size / (led_ring_get_led_count(led_ring) * sizeof(rgb_t));
+
+  if(frame_count == 1) {
+    led_ring_set_colors(led_ring, frames);
+    led_ring_update(led_ring);
+  } else {
+    led_ring_start_frames_loop(led_ring, frames, frame_count);
+  }
+  return true;
+}
+
+/** Shows the uploaded frames and makes the old buffer the upload buffer */
+static bool animation_apply_upload() {
+  size_t frame_size = led_ring_get_led_count(led_ring) * sizeof(rgb_t);
+  if(upload_size == 0 || upload_size % frame_size != 0) return false;
+
+  /* Through the led_ring resource, so the animation is its mode and it does not show a command in the middle */
+  int upload_buffer = 1 - playing_buffer;
+  led_ring_resource_show(led_ring, LED_RING_MODE_ANIMATION, animation_show_upload, NULL);
+
+  playing_buffer = upload_buffer;
+  playing_size = upload_size;
+  return true;
+}
+
+/* GET handler */
+static void animation_get_handler(coap_context_t *ctx, struct coap_resource_t *resource,
+    const coap_endpoint_t *local_interface, coap_address_t *peer,
+    coap_pdu_t *request, str *token, coap_pdu_t *response)
+{
+  unsigned char buf[3];
+  unsigned int len;
+
+  coap_block_t block;
+  if(!coap_get_block(request, COAP_OPTION_BLOCK2, &block)) {
+    block.num = 0;
+    block.m = 0;
+    block.szx = ANIMATION_DEFAULT_BLOCK_SZX;
+  }
+
+  response->hdr->code = COAP_RESPONSE_CODE(205);
+
+  len = coap_encode_var_bytes(buf, COAP_MEDIATYPE_APPLICATION_OCTET_STREAM);
+  coap_add_option(response, COAP_OPTION_CONTENT_TYPE, len, buf);
+
+  if(coap_write_block_opt(&block, COAP_OPTION_BLOCK2, response, playing_size) < 0) {
+    response->hdr->code = COAP_RESPONSE_CODE(402);
+    return;
+  }
+
+  coap_add_block(response, playing_size, animation_buffers[playing_buffer], block.num, block.szx);
+}
+
+/* PUT handler */
+static void animation_put_handler(coap_context_t *ctx, struct coap_resource_t *resource,
+    const coap_endpoint_t *local_interface, coap_address_t *peer,
+    coap_pdu_t *request, str *token, coap_pdu_t *response)
+{
+  size_t size = 0;
+  uint8_t* data = NULL;
+  coap_get_data(request, &size, &data);
+
+  coap_opt_iterator_t opt_iter;
+  coap_opt_t* option = coap_check_option(request, COAP_OPTION_CONTENT_TYPE, &opt_iter);
+  if(option && coap_decode_var_bytes(coap_opt_value(option), coap_opt_length(option)) != COAP_MEDIATYPE_APPLICATION_OCTET_STREAM) {
+    response->hdr->code = COAP_RESPONSE_CODE(415);
+    return;
+  }
+
+  /* Size1 tells us the size of the whole upload before the first block */
+  option = coap_check_option(request, COAP_OPTION_SIZE1, &opt_iter);
+  if(option && coap_decode_var_bytes(coap_opt_value(option), coap_opt_length(option)) > ANIMATION_MAX_SIZE) {
+    goto too_large;
+  }
+
+  /* A request without Block1 is a complete upload */
+  coap_block_t block;
+  bool blockwise = coap_get_block(request, COAP_OPTION_BLOCK1, &block);
+  size_t offset = blockwise ? (size_t)block.num << (block.szx + 4) : 0;
+
+  if(offset == 0) {
+    upload_size = 0;
+
+    /*
+     * The upload buffer held the animation before the playing one, and the animation task
+     * may still be encoding a frame of it. It is done with it once it takes the last scene.
+     */
+    led_ring_wait_taken(led_ring);
+  }
+
+  if(offset != upload_size) {
+    ESP_LOGE(resource_name, "Block at %d received, expected %d", (int)offset, (int)upload_size);
+    response->hdr->code = COAP_RESPONSE_CODE(408);
+    return;
+  }
+
+  if(offset + size > ANIMATION_MAX_SIZE) goto too_large;
+
+  memcpy(animation_buffers[1 - playing_buffer] + offset, data, size);
+  upload_size = offset + size;
+
+  if(blockwise) animation_add_block1_option(response, &block);
+
+  if(blockwise && block.m) {
+    response->hdr->code = COAP_RESPONSE_CODE(231);
+    return;
+  }
+
+  bool valid = animation_apply_upload();
+  upload_size = 0;
+  response->hdr->code = valid ? COAP_RESPONSE_CODE(204) : COAP_RESPONSE_CODE(400);
+  return;
+
+  too_large:
+  {
+    unsigned char buf[3];
+    unsigned int len = coap_encode_var_bytes(buf, ANIMATION_MAX_SIZE);
+    coap_add_option(response, COAP_OPTION_SIZE1, len, buf);
+    upload_size = 0;
+    response->hdr->code = COAP_RESPONSE_CODE(413);
+  }
+}
+
+coap_resource_t* animation_resource_init(coap_context_t* ctx, led_ring_t led_ring_ctx) {
+  coap_resource_t* resource = coap_resource_init((uint8_t*)resource_name, strlen(resource_name), 0);
+  if (!resource) return resource;
+
+  led_ring = led_ring_ctx;
+
+  coap_register_handler(resource, COAP_REQUEST_GET, animation_get_handler);
+  coap_register_handler(resource, COAP_REQUEST_PUT, animation_put_handler);
+  coap_add_resource(ctx, resource);
+
+  return resource;
+}
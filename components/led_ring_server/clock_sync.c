@@ -0,0 +1,381 @@
+/*
+ * Copyright 2017 Sam Leitch
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "clock_sync.h"
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <esp_log.h>
+#include <esp_system.h>
+#include <esp_timer.h>
+#include <lwip/sockets.h>
+#include <soc/soc.h>
+#include <string.h>
+
+const static char *LOG_TAG = "clock_sync";
+
+#define CLOCK_SYNC_INTERVAL_US 1000000
+
+/* The leader is forgotten if none of its beacons are heard for this many intervals */
+#define CLOCK_SYNC_LEADER_TIMEOUT 3
+
+/* Exchanges kept to choose the one with the shortest round trip */
+#define CLOCK_SYNC_SAMPLE_COUNT 8
+
+/* Devices that started closer together than this are told apart by their id, so the jitter of the beacons can not swap the leader */
+#define CLOCK_SYNC_SENIORITY_MARGIN_US 100000
+
+/* Corrections move the clock by at most 1/64 of the time that passes, so the time never jumps or runs backwards */
+#define CLOCK_SYNC_SLEW_RATE 64
+
+/* A larger correction is another group's clock, which is adopted straight away instead of over minutes */
+#define CLOCK_SYNC_MAX_SLEW_US 1000000
+
+/* Beacons are sent to the All CoAP Nodes group, on the clock sync port */
+#define CLOCK_SYNC_MULTICAST_ADDR ((uint32_t)0xBB0100E0UL)
+
+/*
+ * Packets are 32 bytes:
+ * * byte 0: type
+ * * bytes 4-7: id of the sender
+ * * bytes 8-31: t1, t2 and t3 as big endian microseconds (requests only use t1)
+ *
+ * The t1 of a beacon is how long the sender has been running, which tells the devices which one started first.
+ */
+#define CLOCK_SYNC_PACKET_SIZE 32
+#define CLOCK_SYNC_BEACON 1
+#define CLOCK_SYNC_REQUEST 2
+#define CLOCK_SYNC_RESPONSE 3
+
+typedef struct clock_sync_sample_s {
+  int64_t offset_us;
+  int64_t round_trip_us;
+} clock_sync_sample_t;
+
+/*
+ * Every device on the network shares the group socket, which only receives the beacons.
+ * Everything else goes through the device's own socket, so the replies come back to it.
+ */
+static int sockfd = -1;
+static int group_sockfd = -1;
+
+static uint32_t device_id;
+static uint32_t leader_id;
+static int64_t leader_start_us; /* Local time the leader started, 0 when this device leads */
+static struct sockaddr_in leader_addr;
+static int64_t leader_heard_us; /* Local time of the last beacon from the leader */
+static bool synchronized = false; /* True after the first exchange with a leader */
+
+static clock_sync_sample_t samples[CLOCK_SYNC_SAMPLE_COUNT];
+static int sample_count = 0;
+static int next_sample = 0;
+
+/*
+ * Read by other tasks through clock_sync_get_time, the offsets are not written atomically.
+ * The offset slews from slew_from_us to status.offset_us, starting at the local time slew_start_us.
+ */
+static clock_sync_status_t status;
+static int64_t slew_from_us = 0;
+static int64_t slew_start_us = 0;
+static portMUX_TYPE status_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static void clock_sync_write_u32(uint8_t* data, uint32_t value) {
+  for(int i=3; i >= 0; --i) {
+    data[i] = value & 0xFF;
+    value >>= 8;
+  }
+}
+
+static uint32_t clock_sync_read_u32(const uint8_t* data) {
+  return ((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) | ((uint32_t)data[2] << 8) | data[3];
+}
+
+static void clock_sync_write_time(uint8_t* data, int64_t time_us) {
+  clock_sync_write_u32(data, (uint64_t)time_us >> 32);
+  clock_sync_write_u32(data + 4, (uint64_t)time_us);
+}
+
+static int64_t clock_sync_read_time(const uint8_t* data) {
+  return (int64_t)(((uint64_t)clock_sync_read_u32(data) << 32) | clock_sync_read_u32(data + 4));
+}
+
+/** Returns the offset at the local time local_us, status_lock must be held */
+static int64_t clock_sync_offset_at(int64_t local_us) {
+  int64_t slewed_us = local_us > slew_start_us ? (local_us - slew_start_us) / CLOCK_SYNC_SLEW_RATE : 0;
+  int64_t remaining_us = status.offset_us - slew_from_us;
+
+  if(remaining_us >= 0) return slew_from_us + (slewed_us < remaining_us ? slewed_us : remaining_us);
+  return slew_from_us - (slewed_us < -remaining_us ? slewed_us : -remaining_us);
+}
+
+/** Returns the synchronized time at the local time local_us */
+static int64_t clock_sync_time_at(int64_t local_us) {
+  portENTER_CRITICAL(&status_lock);
+  int64_t offset_us = clock_sync_offset_at(local_us);
+  portEXIT_CRITICAL(&status_lock);
+  return local_us + offset_us;
+}
+
+int64_t clock_sync_get_time() {
+  /* The local time is read in the lock, so a correction can not land between it and the offset */
+  portENTER_CRITICAL(&status_lock);
+  int64_t local_us = esp_timer_get_time();
+  int64_t offset_us = clock_sync_offset_at(local_us);
+  portEXIT_CRITICAL(&status_lock);
+  return local_us + offset_us;
+}
+
+void clock_sync_get_status(clock_sync_status_t* result) {
+  portENTER_CRITICAL(&status_lock);
+  *result = status;
+  result->slew_us = status.offset_us - clock_sync_offset_at(esp_timer_get_time());
+  result->offset_us -= result->slew_us;
+  portEXIT_CRITICAL(&status_lock);
+}
+
+/**
+ * Moves the clock to a new offset from the leader.
+ * The first offset is stepped to, so a new device adopts the group's clock, and later ones are slewed to.
+ */
+static void clock_sync_set_offset(int64_t offset_us, int64_t round_trip_us) {
+  portENTER_CRITICAL(&status_lock);
+  int64_t now_us = esp_timer_get_time();
+  int64_t current_us = clock_sync_offset_at(now_us);
+  int64_t correction_us = offset_us - current_us;
+  bool step = !synchronized || correction_us > CLOCK_SYNC_MAX_SLEW_US || correction_us < -CLOCK_SYNC_MAX_SLEW_US;
+
+  slew_from_us = step ? offset_us : current_us;
+  slew_start_us = now_us;
+  status.offset_us = offset_us;
+  status.round_trip_us = round_trip_us;
+  ++status.exchanges;
+  portEXIT_CRITICAL(&status_lock);
+
+  if(step) ESP_LOGI(LOG_TAG, "Adopted clock %08x, offset %lld us", leader_id, (long long)offset_us);
+  synchronized = true;
+}
+
+static void clock_sync_send(uint8_t type, const struct sockaddr_in* addr, int64_t t1, int64_t t2, int64_t t3) {
+  uint8_t packet[CLOCK_SYNC_PACKET_SIZE];
+  memset(packet, 0, sizeof(packet));
+  packet[0] = type;
+  clock_sync_write_u32(packet + 4, device_id);
+  clock_sync_write_time(packet + 8, t1);
+  clock_sync_write_time(packet + 16, t2);
+  clock_sync_write_time(packet + 24, t3);
+
+  int result = sendto(sockfd, packet, sizeof(packet), 0, (const struct sockaddr*)addr, sizeof(*addr));
+  if(result < 0) ESP_LOGE(LOG_TAG, "clock_sync_send: sendto returned %d", result);
+}
+
+/**
+ * Returns true if the device that started at start_us (on the local clock) with id
+ * started before the one that started at other_start_us with other_id.
+ */
+static bool clock_sync_is_senior(int64_t start_us, uint32_t id, int64_t other_start_us, uint32_t other_id) {
+  if(start_us < other_start_us - CLOCK_SYNC_SENIORITY_MARGIN_US) return true;
+  if(start_us > other_start_us + CLOCK_SYNC_SENIORITY_MARGIN_US) return false;
+  return id < other_id;
+}
+
+static void clock_sync_set_leader(uint32_t id, int64_t start_us, const struct sockaddr_in* addr) {
+  if(id != leader_id) {
+    ESP_LOGI(LOG_TAG, "Following clock %08x", id);
+    sample_count = 0;
+    next_sample = 0;
+    leader_start_us = start_us;
+  }
+
+  leader_id = id;
+  leader_addr = *addr;
+
+  portENTER_CRITICAL(&status_lock);
+  status.leader = false;
+  portEXIT_CRITICAL(&status_lock);
+}
+
+/**
+ * Records an exchange with the leader.
+ *
+ * t1 and t4 are the local times the request was sent and the response received,
+ * t2 and t3 are the leader's times the request was received and the response sent.
+ * The exchange with the shortest round trip has the least uncertainty, so its offset is used.
+ */
+static void clock_sync_add_sample(int64_t t1, int64_t t2, int64_t t3, int64_t t4) {
+  clock_sync_sample_t* sample = samples + next_sample;
+  sample->offset_us = ((t2 - t1) + (t3 - t4)) / 2;
+  sample->round_trip_us = (t4 - t1) - (t3 - t2);
+  next_sample = (next_sample + 1) % CLOCK_SYNC_SAMPLE_COUNT;
+  if(sample_count < CLOCK_SYNC_SAMPLE_COUNT) ++sample_count;
+
+  const clock_sync_sample_t* best = samples;
+  for(int i=1; i < sample_count; ++i) {
+    if(samples[i].round_trip_us < best->round_trip_us) best = samples + i;
+  }
+
+  clock_sync_set_offset(best->offset_us, best->round_trip_us);
+}
+
+static void clock_sync_receive(const uint8_t* packet, int length, const struct sockaddr_in* from, int64_t receive_us) {
+  if(length < CLOCK_SYNC_PACKET_SIZE) return;
+
+  uint32_t id = clock_sync_read_u32(packet + 4);
+  if(id == device_id) return; // Our own beacon
+
+  switch(packet[0]) {
+  case CLOCK_SYNC_BEACON:
+    {
+      /* The device that started first leads, so a device that joins later follows the clock that is already running */
+      int64_t start_us = receive_us - clock_sync_read_time(packet + 8);
+      if(id == leader_id || clock_sync_is_senior(start_us, id, leader_start_us, leader_id)) {
+        clock_sync_set_leader(id, start_us, from);
+        leader_heard_us = receive_us;
+      }
+    }
+    break;
+  case CLOCK_SYNC_REQUEST:
+    clock_sync_send(CLOCK_SYNC_RESPONSE, from, clock_sync_read_time(packet + 8),
+        clock_sync_time_at(receive_us), clock_sync_get_time());
+    break;
+  case CLOCK_SYNC_RESPONSE:
+    if(id != leader_id) return;
+    clock_sync_add_sample(clock_sync_read_time(packet + 8), clock_sync_read_time(packet + 16),
+        clock_sync_read_time(packet + 24), receive_us);
+    break;
+  }
+}
+
+/** Sends the beacon, and asks the leader for its time if this device is following one */
+static void clock_sync_tick(int64_t now_us) {
+  struct sockaddr_in group_addr;
+  memset(&group_addr, 0, sizeof(group_addr));
+  group_addr.sin_family = AF_INET;
+  group_addr.sin_addr.s_addr = CLOCK_SYNC_MULTICAST_ADDR;
+  group_addr.sin_port = htons(CLOCK_SYNC_PORT);
+  clock_sync_send(CLOCK_SYNC_BEACON, &group_addr, now_us, 0, 0);
+
+  if(leader_id == device_id) return;
+
+  if(now_us - leader_heard_us > CLOCK_SYNC_LEADER_TIMEOUT * CLOCK_SYNC_INTERVAL_US) {
+    /* The clock keeps its current offset, so the time does not jump */
+    ESP_LOGI(LOG_TAG, "Leader %08x lost, leading clock %08x", leader_id, device_id);
+    leader_id = device_id;
+    leader_start_us = 0;
+    portENTER_CRITICAL(&status_lock);
+    status.leader = true;
+    portEXIT_CRITICAL(&status_lock);
+    return;
+  }
+
+  clock_sync_send(CLOCK_SYNC_REQUEST, &leader_addr, esp_timer_get_time(), 0, 0);
+}
+
+static void clock_sync_loop(void* param) {
+  ESP_LOGI(LOG_TAG, "Starting clock sync as %08x", device_id);
+  int64_t next_tick_us = esp_timer_get_time();
+  uint8_t packet[CLOCK_SYNC_PACKET_SIZE];
+
+  for(;;) {
+    int64_t now_us = esp_timer_get_time();
+    if(now_us >= next_tick_us) {
+      clock_sync_tick(now_us);
+      next_tick_us = now_us + CLOCK_SYNC_INTERVAL_US;
+    }
+
+    fd_set readfds;
+    FD_ZERO(&readfds);
+    FD_SET(sockfd, &readfds);
+    FD_SET(group_sockfd, &readfds);
+    int64_t wait_us = next_tick_us - now_us;
+    struct timeval timeout = { .tv_sec = wait_us / 1000000, .tv_usec = wait_us % 1000000 };
+
+    int max_fd = sockfd > group_sockfd ? sockfd : group_sockfd;
+    int result = select(max_fd + 1, &readfds, NULL, NULL, &timeout);
+    if(result <= 0) continue;
+
+    int fds[] = { sockfd, group_sockfd };
+    for(int i=0; i < 2; ++i) {
+      if(!FD_ISSET(fds[i], &readfds)) continue;
+
+      struct sockaddr_in from;
+      socklen_t from_size = sizeof(from);
+      int length = recvfrom(fds[i], packet, sizeof(packet), 0, (struct sockaddr*)&from, &from_size);
+      if(length < 0) {
+        ESP_LOGE(LOG_TAG, "clock_sync_loop: recvfrom returned %d", length);
+        continue;
+      }
+
+      clock_sync_receive(packet, length, &from, esp_timer_get_time());
+    }
+  }
+}
+
+void clock_sync_start() {
+  device_id = esp_random();
+  leader_id = device_id;
+  leader_start_us = 0;
+  status.leader = true;
+
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = INADDR_ANY;
+  addr.sin_port = 0;
+
+  sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+  group_sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+  if(sockfd < 0 || group_sockfd < 0) {
+    ESP_LOGE(LOG_TAG, "clock_sync_start: socket returned %d", sockfd < 0 ? sockfd : group_sockfd);
+    goto error;
+  }
+
+  int result = bind(sockfd, (struct sockaddr*)&addr, sizeof(addr));
+  if(result < 0) {
+    ESP_LOGE(LOG_TAG, "clock_sync_start: bind returned %d", result);
+    goto error;
+  }
+
+  /* Lets other programs on the same computer or device share the port, it is not fatal without it */
+  int reuse = 1;
+  result = setsockopt(group_sockfd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+  if(result < 0) ESP_LOGW(LOG_TAG, "clock_sync_start: setsockopt(SO_REUSEADDR) returned %d", result);
+
+  addr.sin_port = htons(CLOCK_SYNC_PORT);
+  result = bind(group_sockfd, (struct sockaddr*)&addr, sizeof(addr));
+  if(result < 0) {
+    ESP_LOGE(LOG_TAG, "clock_sync_start: bind returned %d", result);
+    goto error;
+  }
+
+  struct ip_mreq mreq;
+  mreq.imr_interface.s_addr = INADDR_ANY;
+  mreq.imr_multiaddr.s_addr = CLOCK_SYNC_MULTICAST_ADDR;
+
+  result = setsockopt(group_sockfd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq));
+  if(result < 0) {
+    ESP_LOGE(LOG_TAG, "clock_sync_start: setsockopt returned %d", result);
+    goto error;
+  }
+
+  xTaskCreatePinnedToCore(clock_sync_loop, "clock_sync_loop", 2048, NULL, 10, NULL, PRO_CPU_NUM);
+  return;
+
+  error:
+  if(sockfd >= 0) close(sockfd);
+  if(group_sockfd >= 0) close(group_sockfd);
+  sockfd = -1;
+  group_sockfd = -1;
+}
@@ -21,13 +21,17 @@
 #include <esp_log.h>
 #include <freertos/task.h>
 #include <lwip/sockets.h>
+#include <soc/soc.h>
 
 const static char *LOG_TAG = "CoAP_server";
 
 #define COAP_DEFAULT_TIME_SEC 5
 #define COAP_DEFAULT_TIME_USEC 0
 
-#define COAP_INADDR_ALL_NODES ((u32_t)0xBB0100E0UL)
+/* Changes to observed resources are collected and notified at most this often */
+#define COAP_NOTIFY_INTERVAL_MS 100
+
+#define COAP_INADDR_ALL_NODES ((uint32_t)0xBB0100E0UL)
 
 coap_context_t* coap_server_create() {
   coap_context_t*  ctx = NULL;
@@ -47,7 +51,7 @@ coap_context_t* coap_server_create() {
 int coap_join_multicast(coap_context_t* ctx) {
   ESP_LOGI(LOG_TAG, "Joining All CoAP Nodes multicast group");
 
-  ip_mreq mreq;
+  struct ip_mreq mreq;
   mreq.imr_interface.s_addr = INADDR_ANY;
   mreq.imr_multiaddr.s_addr = COAP_INADDR_ALL_NODES;
 
@@ -57,12 +61,26 @@ int coap_join_multicast(coap_context_t* ctx) {
   return result;
 }
 
+/** Resends confirmable messages (like notifications) that have not been acknowledged */
+static void coap_server_retransmit(coap_context_t* ctx) {
+  coap_tick_t now;
+  coap_ticks(&now);
+
+  coap_queue_t* next_pdu = coap_peek_next(ctx);
+  while ( next_pdu && next_pdu->t <= now - ctx->sendqueue_basetime ) {
+    coap_retransmit(ctx, coap_pop_next(ctx));
+    next_pdu = coap_peek_next(ctx);
+  }
+}
+
 /**
  * Start the CoAP server.
  *
  * All resource should be registered before calling this function.
  * This server implementation only supports synchronous responses.
  *
+ * Observers of resources that changed are notified every COAP_NOTIFY_INTERVAL_MS,
+ * so several changes in that time are sent as one notification.
  */
 void coap_server_loop(void *param) {
   ESP_LOGI(LOG_TAG, "Starting CoAP server");
@@ -70,8 +88,25 @@ void coap_server_loop(void *param) {
 
   if ( coap_join_multicast(ctx) < 0 ) goto end;
 
+  TickType_t last_notify = xTaskGetTickCount();
+
   for (;;) {
-      coap_read(ctx);
+    fd_set readfds;
+    FD_ZERO(&readfds);
+    FD_SET(ctx->sockfd, &readfds);
+    struct timeval timeout = { .tv_sec = 0, .tv_usec = COAP_NOTIFY_INTERVAL_MS * 1000 };
+
+    int result = select(ctx->sockfd + 1, &readfds, NULL, NULL, &timeout);
+    if ( result < 0 ) ESP_LOGE(LOG_TAG, "coap_server_loop: select returned %d", result);
+    if ( result > 0 ) coap_read(ctx);
+
+    coap_server_retransmit(ctx);
+
+    TickType_t now = xTaskGetTickCount();
+    if ( now - last_notify >= pdMS_TO_TICKS(COAP_NOTIFY_INTERVAL_MS) ) {
+      coap_check_notify(ctx);
+      last_notify = now;
+    }
   }
 
   end:
@@ -79,5 +114,6 @@ void coap_server_loop(void *param) {
 }
 
 void coap_server_start(coap_context_t* ctx) {
-  xTaskCreate(coap_server_loop, "coap_server_loop", 2048, ctx, 10, NULL);
+  /* Runs next to the network stack, leaving the APP CPU to the LED rings */
+  xTaskCreatePinnedToCore(coap_server_loop, "coap_server_loop", 2048, ctx, 10, NULL, PRO_CPU_NUM);
 }
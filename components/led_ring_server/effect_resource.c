@@ -0,0 +1,329 @@
+/*
+ * Copyright 2017 Sam Leitch
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "effect_resource.h"
+#include "led_audio.h"
+#include "led_compositor.h"
+#include "led_effect.h"
+#include "led_ring_resource.h"
+
+#include <esp_log.h>
+#include <resource.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* The largest upload, the header with every parameter and the largest program */
+#define EFFECT_MAX_SIZE (2 + LED_EFFECT_MAX_PARAMS * 2 + LED_EFFECT_MAX_CODE_SIZE)
+
+const static char* resource_name = "effect";
+
+/** The effect of a layer */
+typedef struct effect_layer_s {
+  led_effect_t effect;
+  int ring_frames_per_second; /* The frame rate of the ring, which can be faster than the effect */
+} effect_layer_t;
+
+/** Every layer of the composition, the layers of the compositor point to the effects */
+typedef struct effect_layers_s {
+  led_compositor_t compositor;
+  effect_layer_t layers[LED_COMPOSITOR_MAX_LAYERS];
+} effect_layers_t;
+
+/*
+ * One set of layers is run by the animation task while the other receives an upload,
+ * so an upload never changes the layers in the middle of a frame.
+ */
+static effect_layers_t compositions[2];
+static int playing_composition = 0;
+
+static led_ring_t led_ring;
+static uint8_t* effect_colors; /* The frame rendered by the effect of a layer */
+
+static led_audio_t audio; /* NULL without a microphone */
+static int32_t effect_inputs[LED_EFFECT_MAX_INPUTS]; /* The inputs of the frame, from the audio analysis */
+
+/** The source of a layer, running its effect for each LED */
+static const uint8_t* effect_layer_source(void* arg, int64_t frame_number) {
+  const effect_layer_t* layer = (const effect_layer_t*)arg;
+  int64_t effect_frame = frame_number * layer->effect.frames_per_second / layer->ring_frames_per_second;
+  led_effect_render(&layer->effect, effect_frame, effect_inputs, effect_colors, led_ring_get_led_count(led_ring));
+  return effect_colors;
+}
+
+/** The frame source of the ring, analyzing the sound heard since the last frame and blending the layers */
+static rgb_t* effect_source(void* arg, int64_t frame_number) {
+  if(audio && led_audio_update(audio)) {
+    memcpy(effect_inputs, led_audio_get_inputs(audio), LED_AUDIO_INPUT_COUNT * sizeof(int32_t));
+  }
+
+  /* rgb_t is r, g, b, the same layout as the composited colors */
+  return (rgb_t*)led_compositor_render((led_compositor_t*)arg, frame_number);
+}
+
+/**
+ * Finds the value of a name=value URI query, copied into value.
+ * Returns false if the query is missing, and an empty value if it does not fit.
+ */
+static bool effect_get_query(coap_pdu_t* request, const char* name, char* value, size_t value_size) {
+  size_t name_length = strlen(name);
+  coap_opt_iterator_t opt_iter;
+  coap_opt_t* option = coap_check_option(request, COAP_OPTION_URI_QUERY, &opt_iter);
+
+  for(; option; option = coap_option_next(&opt_iter)) {
+    size_t length = coap_opt_length(option);
+    const char* query = (const char*)coap_opt_value(option);
+    if(length <= name_length || strncmp(query, name, name_length) != 0 || query[name_length] != '=') continue;
+
+    length -= name_length + 1;
+    if(length >= value_size) length = 0;
+    memcpy(value, query + name_length + 1, length);
+    value[length] = '\0';
+    return true;
+  }
+
+  return false;
+}
+
+/**
+ * Reads a number from 0 to max from a URI query, or keeps value if the query is missing.
+ * Returns false if it is not a number in range.
+ */
+static bool effect_parse_number(coap_pdu_t* request, const char* name, long max, long* value) {
+  char text[8];
+  if(!effect_get_query(request, name, text, sizeof(text))) return true;
+
+  char* end;
+  long number = strtol(text, &end, 10);
+  if(end == text || *end != '\0' || number < 0 || number > max) return false;
+
+  *value = number;
+  return true;
+}
+
+/** Reads the blend=<mode> URI query, or keeps blend if the query is missing. Returns false if the mode is unknown. */
+static bool effect_parse_blend(coap_pdu_t* request, led_compositor_blend_t* blend) {
+  const static char* names[LED_COMPOSITOR_BLEND_COUNT] = { "alpha", "add", "max", "multiply" };
+
+  char text[16];
+  if(!effect_get_query(request, "blend", text, sizeof(text))) return true;
+
+  for(int i=0; i < LED_COMPOSITOR_BLEND_COUNT; ++i) {
+    if(strcmp(text, names[i]) == 0) {
+      *blend = (led_compositor_blend_t)i;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/**
+ * Copies the playing layers into the other composition to be changed.
+ * Without a layer query the composition starts empty, so a single effect replaces everything.
+ *
+ * The animation task may still be rendering the other composition if it has not taken the scene
+ * of the last upload yet, so it is only changed once the task has.
+ */
+static effect_layers_t* effect_prepare_composition(bool keep_layers) {
+  led_ring_wait_taken(led_ring);
+
+  effect_layers_t* playing = compositions + playing_composition;
+  effect_layers_t* next = compositions + (1 - playing_composition);
+
+  *next = *playing;
+  for(int i=0; i < LED_COMPOSITOR_MAX_LAYERS; ++i) {
+    led_compositor_layer_t* layer = next->compositor.layers + i;
+    if(!keep_layers) layer->source = NULL;
+    layer->arg = next->layers + i;
+  }
+
+  return next;
+}
+
+/** Starts the loop of a composition, called by the led_ring resource with the ring locked */
+static bool effect_show_composition(led_ring_t led_ring, void* arg) {
+  effect_layers_t* composition = (effect_layers_t*)arg;
+  int frames_per_second = composition->layers[0].ring_frames_per_second;
+  if(frames_per_second == 0) return false;
+
+  led_ring_start_source_loop_at_rate(led_ring, effect_source, &composition->compositor, frames_per_second);
+  return true;
+}
+
+/** Shows a changed composition, at the frame rate of its fastest effect, which is only used by this loop */
+static void effect_play_composition(effect_layers_t* next) {
+  int frames_per_second = 0;
+  for(int i=0; i < LED_COMPOSITOR_MAX_LAYERS; ++i) {
+    if(next->compositor.layers[i].source && next->layers[i].effect.frames_per_second > frames_per_second) {
+      frames_per_second = next->layers[i].effect.frames_per_second;
+    }
+  }
+
+  for(int i=0; i < LED_COMPOSITOR_MAX_LAYERS; ++i) {
+    next->layers[i].ring_frames_per_second = frames_per_second;
+  }
+
+  playing_composition = 1 - playing_composition;
+
+  /* Through the led_ring resource, so the effect is its mode and it does not show a command in the middle */
+  led_ring_resource_show(led_ring, LED_RING_MODE_EFFECT, effect_show_composition, next);
+}
+
+/* GET handler */
+static void effect_get_handler(coap_context_t *ctx, struct coap_resource_t *resource,
+    const coap_endpoint_t *local_interface, coap_address_t *peer,
+    coap_pdu_t *request, str *token, coap_pdu_t *response)
+{
+  unsigned char buf[3];
+  unsigned int len;
+
+  long index = 0;
+  if(!effect_parse_number(request, "layer", LED_COMPOSITOR_MAX_LAYERS - 1, &index)) {
+    response->hdr->code = COAP_RESPONSE_CODE(400);
+    return;
+  }
+
+  const effect_layers_t* playing = compositions + playing_composition;
+  if(!playing->compositor.layers[index].source) {
+    response->hdr->code = COAP_RESPONSE_CODE(404);
+    return;
+  }
+
+  /* The upload is rebuilt from the loaded effect */
+  const led_effect_t* effect = &playing->layers[index].effect;
+  uint8_t upload[EFFECT_MAX_SIZE];
+  size_t size = 0;
+  upload[size++] = effect->frames_per_second;
+  upload[size++] = effect->param_count;
+  for(int i=0; i < effect->param_count; ++i) {
+    upload[size++] = effect->params[i];
+    upload[size++] = effect->params[i] >> 8;
+  }
+  memcpy(upload + size, effect->code, effect->code_size);
+  size += effect->code_size;
+
+  response->hdr->code = COAP_RESPONSE_CODE(205);
+
+  len = coap_encode_var_bytes(buf, COAP_MEDIATYPE_APPLICATION_OCTET_STREAM);
+  coap_add_option(response, COAP_OPTION_CONTENT_TYPE, len, buf);
+
+  coap_add_data(response, size, upload);
+}
+
+/* PUT handler */
+static void effect_put_handler(coap_context_t *ctx, struct coap_resource_t *resource,
+    const coap_endpoint_t *local_interface, coap_address_t *peer,
+    coap_pdu_t *request, str *token, coap_pdu_t *response)
+{
+  size_t size = 0;
+  uint8_t* data = NULL;
+  coap_get_data(request, &size, &data);
+
+  coap_opt_iterator_t opt_iter;
+  coap_opt_t* option = coap_check_option(request, COAP_OPTION_CONTENT_TYPE, &opt_iter);
+  if(option && coap_decode_var_bytes(coap_opt_value(option), coap_opt_length(option)) != COAP_MEDIATYPE_APPLICATION_OCTET_STREAM) {
+    response->hdr->code = COAP_RESPONSE_CODE(415);
+    return;
+  }
+
+  if(size > EFFECT_MAX_SIZE) {
+    response->hdr->code = COAP_RESPONSE_CODE(413);
+    return;
+  }
+
+  char text[8];
+  bool has_layer = effect_get_query(request, "layer", text, sizeof(text));
+  long index = 0;
+  long opacity = 255;
+  led_compositor_blend_t blend = LED_COMPOSITOR_BLEND_ALPHA;
+  if(!effect_parse_number(request, "layer", LED_COMPOSITOR_MAX_LAYERS - 1, &index) ||
+      !effect_parse_number(request, "opacity", 255, &opacity) ||
+      !effect_parse_blend(request, &blend)) {
+    response->hdr->code = COAP_RESPONSE_CODE(400);
+    return;
+  }
+
+  effect_layers_t* next = effect_prepare_composition(has_layer);
+  effect_layer_t* layer = next->layers + index;
+  if(!led_effect_load(&layer->effect, data, size, led_ring_get_led_count(led_ring))) {
+    ESP_LOGE(resource_name, "Rejected a %d byte effect", (int)size);
+    response->hdr->code = COAP_RESPONSE_CODE(400);
+    return;
+  }
+
+  /* The budget is for the whole frame, so the layers together may not take more than one effect could */
+  int64_t frame_ops = 0;
+  for(int i=0; i < LED_COMPOSITOR_MAX_LAYERS; ++i) {
+    if(i == index || next->compositor.layers[i].source) frame_ops += next->layers[i].effect.op_count;
+  }
+  if(frame_ops * led_ring_get_led_count(led_ring) > LED_EFFECT_MAX_OPS_PER_FRAME) {
+    ESP_LOGE(resource_name, "Rejected an effect over the operations of a frame");
+    response->hdr->code = COAP_RESPONSE_CODE(413);
+    return;
+  }
+
+  led_compositor_layer_t* compositor_layer = next->compositor.layers + index;
+  compositor_layer->source = effect_layer_source;
+  compositor_layer->blend = blend;
+  compositor_layer->opacity = opacity;
+
+  effect_play_composition(next);
+
+  response->hdr->code = COAP_RESPONSE_CODE(204);
+}
+
+/* DELETE handler */
+static void effect_delete_handler(coap_context_t *ctx, struct coap_resource_t *resource,
+    const coap_endpoint_t *local_interface, coap_address_t *peer,
+    coap_pdu_t *request, str *token, coap_pdu_t *response)
+{
+  char text[8];
+  bool has_layer = effect_get_query(request, "layer", text, sizeof(text));
+  long index = 0;
+  if(!effect_parse_number(request, "layer", LED_COMPOSITOR_MAX_LAYERS - 1, &index)) {
+    response->hdr->code = COAP_RESPONSE_CODE(400);
+    return;
+  }
+
+  effect_layers_t* next = effect_prepare_composition(has_layer);
+  next->compositor.layers[index].source = NULL;
+  effect_play_composition(next);
+
+  response->hdr->code = COAP_RESPONSE_CODE(202);
+}
+
+coap_resource_t* effect_resource_init(coap_context_t* ctx, led_ring_t led_ring_ctx, led_audio_t audio_ctx) {
+  int led_count = led_ring_get_led_count(led_ring_ctx);
+  effect_colors = malloc(led_count * 3);
+  if (!effect_colors) return NULL;
+
+  /* Both compositions share the compositor's buffers, only the animation task renders them */
+  if (!led_compositor_init(&compositions[0].compositor, led_count)) return NULL;
+  compositions[1].compositor = compositions[0].compositor;
+
+  coap_resource_t* resource = coap_resource_init((uint8_t*)resource_name, strlen(resource_name), 0);
+  if (!resource) return resource;
+
+  led_ring = led_ring_ctx;
+  audio = audio_ctx;
+
+  coap_register_handler(resource, COAP_REQUEST_GET, effect_get_handler);
+  coap_register_handler(resource, COAP_REQUEST_PUT, effect_put_handler);
+  coap_register_handler(resource, COAP_REQUEST_DELETE, effect_delete_handler);
+  coap_add_resource(ctx, resource);
+
+  return resource;
+}
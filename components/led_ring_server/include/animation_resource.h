@@ -0,0 +1,40 @@
+/*
+ * Copyright 2017 Sam Leitch
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MAIN_ANIMATION_RESOURCE_H_
+#define MAIN_ANIMATION_RESOURCE_H_
+
+#include "led_ring.h"
+
+#include <coap.h>
+
+/* The largest animation that can be uploaded, in bytes */
+#define ANIMATION_MAX_SIZE 8192
+
+/**
+ * The animation resource plays frames uploaded with PUT.
+ *
+ * The payload (Content-Format application/octet-stream) is r, g, b for each LED of each frame,
+ * so it must be a multiple of 3 * led_count bytes. A single frame is shown until the next change.
+ * The frames are shown at the frame rate of the ring.
+ *
+ * Animations larger than one message are sent using Block1 (RFC 7959), with the blocks in order.
+ * The new animation replaces the old one only once the last block has arrived.
+ * GET returns the current animation, using Block2 if it does not fit in one message.
+ */
+coap_resource_t* animation_resource_init(coap_context_t* ctx, led_ring_t led_ring);
+
+#endif /* MAIN_ANIMATION_RESOURCE_H_ */
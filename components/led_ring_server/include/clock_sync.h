@@ -0,0 +1,55 @@
+/*
+ * Copyright 2017 Sam Leitch
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MAIN_CLOCK_SYNC_H_
+#define MAIN_CLOCK_SYNC_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Synchronizes a clock between the devices on the network.
+ *
+ * Every device multicasts a beacon with a random id and how long it has been running each second,
+ * and the device that started first is the leader (the lowest id if they started together).
+ * A device that joins later follows the clock that is already running instead of taking it over.
+ * The other devices ask the leader for its time, and use the exchange with
+ * the shortest round trip of the last few to calculate the offset of their clock.
+ *
+ * A device adopts the leader's clock on its first exchange, and later corrections are slewed
+ * at 1/64 of the time that passes, so the time never runs backwards and scheduled commands and
+ * frame numbers based on it stay in order. Only a clock over a second away (another group) is stepped to.
+ */
+
+#define CLOCK_SYNC_PORT 5690
+
+typedef struct clock_sync_status_s {
+  bool leader; /* True if this device is the leader */
+  int64_t offset_us; /* Added to esp_timer_get_time to get the synchronized time */
+  int64_t slew_us; /* Correction still to be slewed into offset_us */
+  int64_t round_trip_us; /* Round trip of the exchange the offset came from, the error is at most half of this */
+  uint32_t exchanges; /* Exchanges completed with the leader */
+} clock_sync_status_t;
+
+/** Starts the task that synchronizes the clock */
+void clock_sync_start();
+
+/** Returns the synchronized time in microseconds */
+int64_t clock_sync_get_time();
+
+void clock_sync_get_status(clock_sync_status_t* status);
+
+#endif /* MAIN_CLOCK_SYNC_H_ */
@@ -0,0 +1,47 @@
+/*
+ * Copyright 2017 Sam Leitch
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MAIN_EFFECT_RESOURCE_H_
+#define MAIN_EFFECT_RESOURCE_H_
+
+#include "led_audio.h"
+#include "led_ring.h"
+
+#include <coap.h>
+
+/**
+ * The effect resource plays effect programs uploaded with PUT.
+ *
+ * The payload (Content-Format application/octet-stream) is an effect as described in led_effect.h.
+ * The program is run for every LED by the animation task as each frame is shown, at the effect's
+ * frame rate, until the ring is changed. Invalid programs, and programs that would take too long
+ * for the ring's LEDs, are rejected with 4.00. An effect that would take the layers together over
+ * LED_EFFECT_MAX_OPS_PER_FRAME operations for each frame is rejected with 4.13.
+ *
+ * Effects can be stacked into layers (see led_compositor.h) with the URI queries:
+ * * layer=<0-7>, the layer to upload to, the other layers are kept. Without it the effect replaces every layer.
+ * * blend=<alpha|add|max|multiply>, how the layer is blended onto the layers below it (alpha by default)
+ * * opacity=<0-255>, how much of the blended layer is shown (255 by default)
+ *
+ * The ring runs at the frame rate of the fastest layer. GET returns the effect of a layer (layer 0 by default),
+ * and DELETE removes a layer, or every layer without a layer query.
+ *
+ * With audio (NULL without a microphone), the sound heard since the last frame is analyzed before each frame,
+ * and effects read it with LED_EFFECT_OP_INPUT and the indexes of led_audio_input_t.
+ */
+coap_resource_t* effect_resource_init(coap_context_t* ctx, led_ring_t led_ring, led_audio_t audio);
+
+#endif /* MAIN_EFFECT_RESOURCE_H_ */
@@ -21,6 +21,91 @@
 
 #include <coap.h>
 
+/**
+ * The modes of the led_ring resource.
+ *
+ * In JSON requests the mode is a string, ["solid_color", r, g, b] or ["spinning_rainbow"].
+ * In binary requests (Content-Format application/octet-stream) the first byte is one of these ids,
+ * followed by the parameters of the mode:
+ * * solid_color: r, g, b
+ * * rainbow modes: optional brightness, hue_start, hue_end
+ * * dots modes: nothing
+ * * static_frame: r, g, b for each LED (the frame is repeated if it is shorter than the ring)
+ * * recorded: nothing, plays the animation recorded in flash (see led_animation.h)
+ *
+ * A recorded request gets 4.04 Not Found if no animation for the ring is recorded, and the mode does not change.
+ *
+ * The modes after recorded are set by the other ways of showing frames (see led_ring_resource_show),
+ * so GET reports them, but they are not valid in requests:
+ * * stream: frames streamed by pixel_stream
+ * * animation: frames uploaded to the animation resource
+ * * effect: the layers of effects uploaded to the effect resource
+ */
+typedef enum {
+  LED_RING_MODE_SOLID_COLOR = 0,
+  LED_RING_MODE_STATIC_RAINBOW = 1,
+  LED_RING_MODE_SPINNING_RAINBOW = 2,
+  LED_RING_MODE_STROBING_RAINBOW = 3,
+  LED_RING_MODE_STATIC_DOTS = 4,
+  LED_RING_MODE_SPINNING_DOTS = 5,
+  LED_RING_MODE_STROBING_DOTS = 6,
+  LED_RING_MODE_STATIC_FRAME = 7,
+  LED_RING_MODE_RECORDED = 8,
+  LED_RING_MODE_STREAM = 9,
+  LED_RING_MODE_ANIMATION = 10,
+  LED_RING_MODE_EFFECT = 11,
+  LED_RING_MODE_COUNT
+} led_ring_mode_t;
+
+#define LED_RING_RESOURCE_TIME_BUCKETS 8
+
+/* One ring per RMT channel */
+#define LED_RING_RESOURCE_MAX_RINGS 8
+
+/** Counters of the requests to the led_ring resource */
+typedef struct led_ring_resource_stats_s {
+  uint32_t mode_requests[LED_RING_MODE_COUNT]; /* Accepted PUT requests for each mode, and changes to the other modes */
+  uint32_t parse_failures; /* PUT requests rejected as invalid */
+  uint32_t handler_histogram[LED_RING_RESOURCE_TIME_BUCKETS]; /* Bucket n counts PUT requests handled in less than 64 << n us */
+  uint32_t max_handler_us;
+} led_ring_resource_stats_t;
+
+/** Adds the led_ring resource for a single ring, same as led_ring_resource_init_rings with one ring */
 coap_resource_t* led_ring_resource_init(coap_context_t* ctx, led_ring_t led_ring);
 
+/**
+ * Adds a led_ring/<index> resource for each ring, and led_ring/batch to change several rings in one request.
+ *
+ * led_ring stays a name for the first ring. A batch PUT takes a command for any of the rings:
+ * * JSON: {"0": ["solid_color", 255, 0, 0], "2": ["spinning_dots"]}
+ * * Binary: for each ring, its index, the length of its command as 16 bit big endian, and the command
+ *
+ * If any command is invalid none are applied. The commands of a batch are applied at the same time
+ * (the at= time, or straight away) with the same epoch, and the new modes start on the same frame,
+ * so the rings switch together and their animations stay in phase.
+ */
+bool led_ring_resource_init_rings(coap_context_t* ctx, led_ring_t* led_rings, int ring_count);
+
+/** Copies the request counters into stats */
+void led_ring_resource_get_stats(led_ring_resource_stats_t* stats);
+
+/**
+ * Plays the recorded animation on a ring of the resource, like a ["recorded"] request,
+ * so GET and the observers see the mode. Returns false if it can not be played.
+ */
+bool led_ring_resource_play_recorded(led_ring_t led_ring);
+
+/** Shows something on a ring, called with the ring locked. Returns false if nothing was shown. */
+typedef bool (*led_ring_resource_show_t)(led_ring_t led_ring, void* arg);
+
+/**
+ * Changes a ring to a mode shown by something other than the resource, like a streamed frame.
+ *
+ * show is called with the ring locked and its loop stopped, in turn with the commands of the resource,
+ * so a command cannot be shown in the middle of it. A command waiting for its time is dropped,
+ * and GET and the observers see the mode. A ring without a resource is only shown.
+ * Returns false if show did not show anything, and the mode is left as it was.
+ */
+bool led_ring_resource_show(led_ring_t led_ring, led_ring_mode_t mode, led_ring_resource_show_t show, void* arg);
+
 #endif /* MAIN_LED_RING_RESOURCE_H_ */
@@ -0,0 +1,60 @@
+/*
+ * Copyright 2017 Sam Leitch
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MAIN_PIXEL_STREAM_H_
+#define MAIN_PIXEL_STREAM_H_
+
+#include "led_ring.h"
+
+/**
+ * Pixel streaming over UDP using the Distributed Display Protocol (DDP).
+ *
+ * Each packet has a 10 byte header followed by RGB data:
+ * * byte 0: flags, version 1 (0x40) is required, 0x01 (PUSH) marks the last packet of a frame
+ *           and 0x10 (TIMECODE) adds 4 bytes to the header
+ * * byte 1: sequence number of the frame in the low 4 bits (1 to 15, or 0 if not used)
+ * * byte 2: data type, 0 (undefined) or 0x0B (8 bit RGB)
+ * * byte 3: destination id (ignored)
+ * * bytes 4-7: big endian byte offset of the data in the frame
+ * * bytes 8-9: big endian length of the data
+ *
+ * A frame can be split over several packets, and packets only change the LEDs they cover.
+ * Frames are shown when their PUSH packet arrives. Showing a frame stops any animation started over CoAP
+ * and changes the mode of the led_ring resource to stream, and the last one to send a command or frame controls the ring.
+ */
+
+#define PIXEL_STREAM_DEFAULT_PORT 4048
+
+typedef struct pixel_stream_s* pixel_stream_t;
+
+typedef struct pixel_stream_stats_s {
+  uint32_t packets; /* Packets received */
+  uint32_t frames; /* Frames completed by a PUSH packet */
+  uint32_t frames_shown; /* Frames sent to the ring */
+  uint32_t late_packets; /* Packets for a frame that was already completed */
+  uint32_t dropped_frames; /* Frames replaced before they were shown, or that never got a PUSH */
+  uint32_t invalid_packets;
+} pixel_stream_stats_t;
+
+/** Creates a pixel stream listening on port, returns NULL if the socket or buffers can not be created */
+pixel_stream_t pixel_stream_create(led_ring_t led_ring, uint16_t port);
+
+/** Starts the tasks that receive and show the frames */
+void pixel_stream_start(pixel_stream_t ctx);
+
+void pixel_stream_get_stats(pixel_stream_t ctx, pixel_stream_stats_t* stats);
+
+#endif /* MAIN_PIXEL_STREAM_H_ */
@@ -0,0 +1,48 @@
+/*
+ * Copyright 2017 Sam Leitch
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MAIN_STATS_RESOURCE_H_
+#define MAIN_STATS_RESOURCE_H_
+
+#include "led_ring.h"
+
+#include <coap.h>
+#include <stdbool.h>
+
+/**
+ * The stats resource returns the counters of the ring and the led_ring resource as JSON.
+ * Histograms are arrays of 8 buckets, where bucket n counts times less than base << n us:
+ *
+ * * sent, skipped: frames transmitted, and skipped because they had not changed
+ * * encode, encode_max: time to encode a frame (base 8us)
+ * * wire, wire_max: time to transmit a frame (base 512us)
+ * * frames, missed, jitter, jitter_max: animation frames, deadlines missed and how late frames started (base 64us)
+ * * requests: accepted led_ring requests for each mode, in the order of led_ring_mode_t
+ * * parse_failures: led_ring requests rejected as invalid
+ * * handler, handler_max: time to handle a led_ring request (base 64us)
+ */
+
+/** Adds the stats resource for a single ring, same as stats_resource_init_rings with one ring */
+coap_resource_t* stats_resource_init(coap_context_t* ctx, led_ring_t led_ring);
+
+/**
+ * Adds a stats/<index> resource for each ring, next to the led_ring/<index> resources, and stats for the first ring.
+ *
+ * The counters of the ring (sent to jitter_max) are its own, and the request counters are shared by every ring.
+ */
+bool stats_resource_init_rings(coap_context_t* ctx, led_ring_t* led_rings, int ring_count);
+
+#endif /* MAIN_STATS_RESOURCE_H_ */
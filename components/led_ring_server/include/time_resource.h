@@ -0,0 +1,32 @@
+/*
+ * Copyright 2017 Sam Leitch
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MAIN_TIME_RESOURCE_H_
+#define MAIN_TIME_RESOURCE_H_
+
+#include <coap.h>
+
+/**
+ * The time resource returns the synchronized clock (see clock_sync.h) as JSON:
+ * {"time": ms, "offset": us, "slew": us, "round_trip": us, "leader": bool}
+ *
+ * time is the value to base the at=<ms> query of led_ring requests on,
+ * offset is the skew of the local clock from the leader, and slew the part of the last
+ * correction that is still being applied to it.
+ */
+coap_resource_t* time_resource_init(coap_context_t* ctx);
+
+#endif /* MAIN_TIME_RESOURCE_H_ */
@@ -15,24 +15,96 @@
  */
 
 #include "led_ring_resource.h"
+#include "clock_sync.h"
+#include "led_animation_partition.h"
 
 #include <cJSON.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
 #include <esp_log.h>
+#include <esp_timer.h>
 #include <resource.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
+#define LED_RING_MAX_JSON_SIZE 256
+
+/* Values of the Observe option in a GET request (RFC 7641) */
+#define LED_RING_OBSERVE_REGISTER 0
+#define LED_RING_OBSERVE_DEREGISTER 1
+
+/* A batch holds a command for every ring */
+#define LED_RING_MAX_BATCH_JSON_SIZE 1024
+
+/*
+ * JSON requests are copied here to be null terminated, rather than onto the stack of the CoAP task.
+ * Requests are only handled by that task, one at a time.
+ */
+static char json_buffer[LED_RING_MAX_BATCH_JSON_SIZE + 1];
+
 const static char* resource_name = "led_ring";
+const static char* batch_resource_name = "led_ring/batch";
+
+/* Names of the modes in JSON requests, indexed by led_ring_mode_t */
+const static char* mode_names[LED_RING_MODE_COUNT] = {
+  "solid_color",
+  "static_rainbow",
+  "spinning_rainbow",
+  "strobing_rainbow",
+  "static_dots",
+  "spinning_dots",
+  "strobing_dots",
+  "static_frame",
+  "recorded",
+  "stream",
+  "animation",
+  "effect",
+};
+
+/** A PUT request, whichever format it arrived in */
+typedef struct led_ring_command_s {
+  led_ring_mode_t mode;
+  rgb_t color; /* solid_color */
+  uint8_t brightness; /* Rainbow modes */
+  uint8_t hue_start;
+  uint8_t hue_end;
+  const rgb_t* frame; /* static_frame, points into the request payload */
+  int frame_count;
+  int64_t at_us; /* Synchronized time to apply the command, 0 to apply it now */
+} led_ring_command_t;
+
+/* The parameters of a command that are optional */
+const static led_ring_command_t default_command = {
+  .mode = LED_RING_MODE_COUNT,
+  .brightness = 64,
+  .hue_start = 0,
+  .hue_end = 0,
+  .at_us = 0,
+};
 
-const static char* mode_solid_color = "solid_color";
-const static char* mode_static_rainbow = "static_rainbow";
-const static char* mode_strobing_rainbow = "strobing_rainbow";
-const static char* mode_spinning_rainbow = "spinning_rainbow";
-const static char* mode_spinning_dots = "spinning_dots";
-const static char* mode_strobing_dots = "strobing_dots";
-const static char* mode_static_dots = "static_dots";
+/** A ring and its resources */
+typedef struct led_ring_state_s {
+  led_ring_t led_ring;
+  coap_resource_t* resource; /* led_ring/<index> */
+  coap_resource_t* alias_resource; /* led_ring, which is the first ring for older clients */
+  char resource_name[12];
 
-static char mode[256];
-static rgb_t solid_color = { 0, 0, 0 };
+  /* The state returned by GET */
+  led_ring_mode_t mode;
+  rgb_t solid_color;
+  uint8_t rainbow_brightness;
+  uint8_t rainbow_hue_start;
+  uint8_t rainbow_hue_end;
+
+  /* A command waiting for its time, pending_frame holds its frame */
+  led_ring_command_t pending_command;
+  rgb_t* pending_frame;
+  bool command_pending;
+  bool pending_in_batch; /* Shown by batch_timer together with the rest of its batch, rather than by pending_timer */
+  esp_timer_handle_t pending_timer;
+} led_ring_state_t;
 
 const static rgb_t dots[] = {
     {64, 64, 64},
@@ -41,8 +113,445 @@ const static rgb_t dots[] = {
 };
 
 const static int dot_count = 3;
-static led_ring_t led_ring;
+static led_ring_state_t rings[LED_RING_RESOURCE_MAX_RINGS];
+static int ring_count = 0;
+static led_ring_resource_stats_t stats;
+
+/* Held while the rings are changed, since pending commands are shown by the timer task */
+static SemaphoreHandle_t show_mutex;
+
+/* Shows the pending commands of batches when the first of them is due */
+static esp_timer_handle_t batch_timer;
+
+
+static bool is_rainbow_mode(led_ring_mode_t mode) {
+  return mode == LED_RING_MODE_STATIC_RAINBOW ||
+      mode == LED_RING_MODE_SPINNING_RAINBOW ||
+      mode == LED_RING_MODE_STROBING_RAINBOW;
+}
+
+/** Returns false if the command can not be shown on the ring, like a recorded animation that is not there */
+static bool led_ring_can_show(led_ring_state_t* ring, const led_ring_command_t* command) {
+  return command->mode != LED_RING_MODE_RECORDED || led_animation_partition_can_play(ring->led_ring);
+}
+
+/** Changes the ring to the mode of the command, called with the ring locked. Returns false if it could not. */
+static bool led_ring_change(led_ring_t led_ring, const led_ring_command_t* command) {
+  led_ring_stop_loop(led_ring);
+
+  switch(command->mode) {
+  case LED_RING_MODE_SOLID_COLOR:
+    led_ring_set_one_color(led_ring, command->color);
+    break;
+  case LED_RING_MODE_STATIC_RAINBOW:
+  case LED_RING_MODE_SPINNING_RAINBOW:
+  case LED_RING_MODE_STROBING_RAINBOW:
+    led_ring_set_rainbow_range(led_ring, command->brightness, command->hue_start, command->hue_end);
+    break;
+  case LED_RING_MODE_STATIC_DOTS:
+  case LED_RING_MODE_SPINNING_DOTS:
+  case LED_RING_MODE_STROBING_DOTS:
+    led_ring_set_pattern(led_ring, (rgb_t*)dots, dot_count);
+    break;
+  case LED_RING_MODE_STATIC_FRAME:
+    led_ring_set_pattern(led_ring, (rgb_t*)command->frame, command->frame_count);
+    break;
+  case LED_RING_MODE_RECORDED:
+    break;
+  default:
+    return false;
+  }
+
+  switch(command->mode) {
+  case LED_RING_MODE_SPINNING_RAINBOW:
+  case LED_RING_MODE_SPINNING_DOTS:
+    led_ring_start_spinner_loop(led_ring);
+    break;
+  case LED_RING_MODE_STROBING_RAINBOW:
+  case LED_RING_MODE_STROBING_DOTS:
+    led_ring_start_strobing_loop(led_ring);
+    break;
+  case LED_RING_MODE_RECORDED:
+    if(!led_animation_play_partition(led_ring)) return false;
+    break;
+  default:
+    led_ring_update(led_ring);
+    return true;
+  }
+
+  /* Commands applied at the same time start their animations in phase, even if this one arrived late */
+  if(command->at_us) led_ring_set_epoch(led_ring, command->at_us);
+  return true;
+}
+
+/**
+ * Shows the command on the ring, called with show_mutex held.
+ *
+ * The ring stays locked until the new mode is published, since the effect, animation and
+ * pixel stream tasks change the same ring.
+ */
+static bool led_ring_show(led_ring_state_t* ring, const led_ring_command_t* command) {
+  led_ring_lock(ring->led_ring);
+  bool shown = led_ring_change(ring->led_ring, command);
+  led_ring_unlock(ring->led_ring);
+  return shown;
+}
+
+/** Shows the pending command of a ring when its time comes */
+static void led_ring_show_pending(void* param) {
+  led_ring_state_t* ring = (led_ring_state_t*)param;
+  xSemaphoreTake(show_mutex, portMAX_DELAY);
+  if(ring->command_pending && !ring->pending_in_batch) led_ring_show(ring, &ring->pending_command);
+  ring->command_pending = false;
+  xSemaphoreGive(show_mutex);
+}
+
+/** Keeps the command until its time, replacing the pending one. Called with show_mutex held. */
+static void led_ring_set_pending(led_ring_state_t* ring, const led_ring_command_t* command, bool in_batch) {
+  ring->pending_command = *command;
+  if(command->mode == LED_RING_MODE_STATIC_FRAME) {
+    memcpy(ring->pending_frame, command->frame, command->frame_count * sizeof(rgb_t));
+    ring->pending_command.frame = ring->pending_frame;
+  }
+  ring->command_pending = true;
+  ring->pending_in_batch = in_batch;
+}
+
+/**
+ * Changes the state returned by GET to the command. Called with show_mutex held.
+ *
+ * The state changes when the command is accepted, so observers can see the new mode before it is shown.
+ */
+static void led_ring_set_state(led_ring_state_t* ring, const led_ring_command_t* command) {
+  if(command->mode == LED_RING_MODE_SOLID_COLOR) ring->solid_color = command->color;
+  if(is_rainbow_mode(command->mode)) {
+    ring->rainbow_brightness = command->brightness;
+    ring->rainbow_hue_start = command->hue_start;
+    ring->rainbow_hue_end = command->hue_end;
+  }
+  ring->mode = command->mode;
+
+  /* Observers are notified by the server loop, which combines changes that arrive close together */
+  ring->resource->dirty = 1;
+  if(ring->alias_resource) ring->alias_resource->dirty = 1;
+}
+
+/**
+ * Shows the command now, or at its time if it is in the future. Called with show_mutex held.
+ *
+ * Returns false if the command can not be shown, and the ring and its state are left as they were.
+ */
+static bool led_ring_schedule(led_ring_state_t* ring, const led_ring_command_t* command) {
+  if(!led_ring_can_show(ring, command)) return false;
+
+  int64_t delay_us = command->at_us - clock_sync_get_time();
+  if(command->at_us && delay_us > 0) {
+    esp_timer_stop(ring->pending_timer);
+    led_ring_set_pending(ring, command, false);
+    esp_timer_start_once(ring->pending_timer, delay_us);
+  } else {
+    if(!led_ring_show(ring, command)) return false;
+    ring->command_pending = false;
+    esp_timer_stop(ring->pending_timer);
+  }
+
+  led_ring_set_state(ring, command);
+  return true;
+}
+
+/** Applies a command to one ring, returns false if it can not be shown */
+static bool led_ring_apply(led_ring_state_t* ring, const led_ring_command_t* command) {
+  xSemaphoreTake(show_mutex, portMAX_DELAY);
+  bool applied = led_ring_schedule(ring, command);
+  xSemaphoreGive(show_mutex);
+  return applied;
+}
+
+/**
+ * Shows the pending batch commands that are due, and sets batch_timer for the next. Called with show_mutex held.
+ *
+ * The rings are held while they change, so the commands that are due together are shown
+ * on the same frame by led_ring_update_all, whether they are animations or not.
+ */
+static void led_ring_show_due_batches() {
+  esp_timer_stop(batch_timer);
+
+  int64_t now_us = clock_sync_get_time();
+  int64_t next_us = INT64_MAX;
+  led_ring_t due[LED_RING_RESOURCE_MAX_RINGS];
+  int due_count = 0;
+
+  for(int i=0; i < ring_count; ++i) {
+    led_ring_state_t* ring = rings + i;
+    if(!ring->command_pending || !ring->pending_in_batch) continue;
+
+    if(ring->pending_command.at_us > now_us) {
+      if(ring->pending_command.at_us < next_us) next_us = ring->pending_command.at_us;
+      continue;
+    }
+
+    led_ring_hold(ring->led_ring);
+    led_ring_change(ring->led_ring, &ring->pending_command);
+    ring->command_pending = false;
+    due[due_count++] = ring->led_ring;
+  }
+
+  if(due_count) led_ring_update_all(due, due_count);
+  if(next_us != INT64_MAX) esp_timer_start_once(batch_timer, next_us - now_us);
+}
+
+/** Shows the batches whose time has come */
+static void led_ring_show_pending_batches(void* param) {
+  xSemaphoreTake(show_mutex, portMAX_DELAY);
+  led_ring_show_due_batches();
+  xSemaphoreGive(show_mutex);
+}
+
+/**
+ * Applies the commands of a batch, commands[i] to ring i for each ring with has_command[i] set.
+ *
+ * The commands share one time, now if the request has no at=, and one epoch, so every ring
+ * switches on the same frame and their animations start in phase. The timer task cannot show
+ * a pending command in the middle of the batch, since the rings are changed with show_mutex held.
+ * Returns false, without applying any, if one of the commands can not be shown.
+ */
+static bool led_ring_apply_batch(led_ring_command_t* commands, const bool* has_command, int64_t at_us) {
+  if(!at_us) at_us = clock_sync_get_time();
+
+  xSemaphoreTake(show_mutex, portMAX_DELAY);
+  for(int i=0; i < ring_count; ++i) {
+    if(has_command[i] && !led_ring_can_show(rings + i, commands + i)) {
+      xSemaphoreGive(show_mutex);
+      return false;
+    }
+  }
+
+  for(int i=0; i < ring_count; ++i) {
+    if(!has_command[i]) continue;
+    commands[i].at_us = at_us;
+    esp_timer_stop(rings[i].pending_timer);
+    led_ring_set_pending(rings + i, commands + i, true);
+    led_ring_set_state(rings + i, commands + i);
+  }
+  led_ring_show_due_batches();
+  xSemaphoreGive(show_mutex);
+  return true;
+}
+
+/** Reads a byte from the message. Returns false if it is missing or not a number from 0 to 255. */
+static bool led_ring_get_byte(cJSON* message, int index, uint8_t* value) {
+  cJSON* json = cJSON_GetArrayItem(message, index);
+  if(!json || json->type != cJSON_Number || json->valueint < 0 || json->valueint > 255) return false;
+
+  *value = (uint8_t)json->valueint;
+  return true;
+}
+
+/** Reads an optional byte from the message. Returns false if it is present but not a number from 0 to 255. */
+static bool led_ring_get_optional_byte(cJSON* message, int index, uint8_t* value) {
+  if(!cJSON_GetArrayItem(message, index)) return true;
+  return led_ring_get_byte(message, index, value);
+}
+
+/** Reads a JSON message of the form ["mode", parameters...] */
+static bool led_ring_parse_json_message(cJSON* message, led_ring_command_t* command) {
+  cJSON* mode_json = cJSON_GetArrayItem(message, 0);
+  if(!mode_json || mode_json->type != cJSON_String) return false;
+
+  int mode_index = 0;
+  while(mode_index < LED_RING_MODE_COUNT && strcmp(mode_json->valuestring, mode_names[mode_index]) != 0) ++mode_index;
+  command->mode = (led_ring_mode_t)mode_index;
+
+  switch(command->mode) {
+  case LED_RING_MODE_SOLID_COLOR:
+    return led_ring_get_byte(message, 1, &command->color.r) &&
+        led_ring_get_byte(message, 2, &command->color.g) &&
+        led_ring_get_byte(message, 3, &command->color.b);
+  case LED_RING_MODE_STATIC_RAINBOW:
+  case LED_RING_MODE_SPINNING_RAINBOW:
+  case LED_RING_MODE_STROBING_RAINBOW:
+    return led_ring_get_optional_byte(message, 1, &command->brightness) &&
+        led_ring_get_optional_byte(message, 2, &command->hue_start) &&
+        led_ring_get_optional_byte(message, 3, &command->hue_end);
+  case LED_RING_MODE_STATIC_DOTS:
+  case LED_RING_MODE_SPINNING_DOTS:
+  case LED_RING_MODE_STROBING_DOTS:
+  case LED_RING_MODE_RECORDED:
+    return true;
+  default:
+    /* Frames are only accepted in the binary format */
+    return false;
+  }
+}
+
+/**
+ * Parses a JSON payload of at most LED_RING_MAX_BATCH_JSON_SIZE bytes.
+ * It is copied into json_buffer so that it can be null terminated for cJSON.
+ */
+static cJSON* led_ring_read_json(const uint8_t* data, size_t size) {
+  memcpy(json_buffer, data, size);
+  json_buffer[size] = '\0';
+  return cJSON_Parse(json_buffer);
+}
+
+/** Reads a JSON request */
+static bool led_ring_parse_json(const uint8_t* data, size_t size, led_ring_command_t* command) {
+  if(size > LED_RING_MAX_JSON_SIZE) return false;
+
+  cJSON* message = led_ring_read_json(data, size);
+  bool valid = led_ring_parse_json_message(message, command);
+  cJSON_Delete(message);
+  return valid;
+}
+
+/** Reads a binary request (see led_ring_resource.h) for a ring of led_count LEDs, without copying or allocating */
+static bool led_ring_parse_binary(const uint8_t* data, size_t size, int led_count, led_ring_command_t* command) {
+  if(size < 1 || data[0] >= LED_RING_MODE_COUNT) return false;
+
+  command->mode = (led_ring_mode_t)data[0];
+  const uint8_t* params = data + 1;
+  size_t param_size = size - 1;
+
+  switch(command->mode) {
+  case LED_RING_MODE_SOLID_COLOR:
+    if(param_size != 3) return false;
+    command->color.r = params[0];
+    command->color.g = params[1];
+    command->color.b = params[2];
+    return true;
+  case LED_RING_MODE_STATIC_RAINBOW:
+  case LED_RING_MODE_SPINNING_RAINBOW:
+  case LED_RING_MODE_STROBING_RAINBOW:
+    if(param_size > 3) return false;
+    if(param_size > 0) command->brightness = params[0];
+    if(param_size > 1) command->hue_start = params[1];
+    if(param_size > 2) command->hue_end = params[2];
+    return true;
+  case LED_RING_MODE_STATIC_DOTS:
+  case LED_RING_MODE_SPINNING_DOTS:
+  case LED_RING_MODE_STROBING_DOTS:
+  case LED_RING_MODE_RECORDED:
+    return param_size == 0;
+  case LED_RING_MODE_STATIC_FRAME:
+    if(param_size == 0 || param_size % 3 != 0) return false;
+    if((int)(param_size / 3) > led_count) return false;
+    command->frame = (const rgb_t*)params;
+    command->frame_count = param_size / 3;
+    return true;
+  default:
+    return false;
+  }
+}
+
+/**
+ * Reads the at=<ms> URI query, the synchronized time in milliseconds to apply the command.
+ * Returns false if it is not a number.
+ */
+static bool led_ring_parse_at(coap_pdu_t* request, int64_t* at_us) {
+  coap_opt_iterator_t opt_iter;
+  coap_opt_t* option = coap_check_option(request, COAP_OPTION_URI_QUERY, &opt_iter);
+
+  for(; option; option = coap_option_next(&opt_iter)) {
+    size_t length = coap_opt_length(option);
+    const char* query = (const char*)coap_opt_value(option);
+    if(length <= 3 || strncmp(query, "at=", 3) != 0) continue;
+
+    char text[24];
+    if(length - 3 >= sizeof(text)) return false;
+    memcpy(text, query + 3, length - 3);
+    text[length - 3] = '\0';
+
+    char* end;
+    long long at_ms = strtoll(text, &end, 10);
+    /* A time that does not fit in microseconds is not a time the clock will reach */
+    if(*end != '\0' || at_ms <= 0 || at_ms > INT64_MAX / 1000) return false;
+
+    *at_us = at_ms * 1000;
+  }
 
+  return true;
+}
+
+/** Marks a ring of a batch as having a command. Returns false if the ring does not exist or already has one. */
+static bool led_ring_claim_ring(long index, bool* has_command) {
+  if(index < 0 || index >= ring_count || has_command[index]) return false;
+  has_command[index] = true;
+  return true;
+}
+
+/** Reads a JSON batch of the form {"<ring>": ["mode", parameters...], ...} */
+static bool led_ring_parse_json_batch(const uint8_t* data, size_t size,
+    led_ring_command_t* commands, bool* has_command) {
+  if(size > LED_RING_MAX_BATCH_JSON_SIZE) return false;
+
+  cJSON* batch = led_ring_read_json(data, size);
+  bool valid = batch && batch->type == cJSON_Object && cJSON_GetArraySize(batch) > 0;
+
+  for(cJSON* entry = valid ? batch->child : NULL; entry && valid; entry = entry->next) {
+    char* end;
+    long index = strtol(entry->string, &end, 10);
+    valid = *entry->string != '\0' && *end == '\0' && led_ring_claim_ring(index, has_command) &&
+        led_ring_parse_json_message(entry, commands + index);
+  }
+
+  cJSON_Delete(batch);
+  return valid;
+}
+
+/** Reads a binary batch, a ring index, a 16 bit big endian length and a binary request for each ring */
+static bool led_ring_parse_binary_batch(const uint8_t* data, size_t size,
+    led_ring_command_t* commands, bool* has_command) {
+  if(size == 0) return false;
+
+  while(size > 0) {
+    if(size < 3) return false;
+    int index = data[0];
+    size_t length = (data[1] << 8) | data[2];
+    data += 3;
+    size -= 3;
+
+    if(length > size || !led_ring_claim_ring(index, has_command)) return false;
+    if(!led_ring_parse_binary(data, length, led_ring_get_led_count(rings[index].led_ring), commands + index)) return false;
+
+    data += length;
+    size -= length;
+  }
+
+  return true;
+}
+
+/** Finds the ring of a led_ring resource */
+static led_ring_state_t* led_ring_find(coap_resource_t* resource) {
+  for(int i=0; i < ring_count; ++i) {
+    if(rings[i].resource == resource || rings[i].alias_resource == resource) return rings + i;
+  }
+
+  return NULL;
+}
+
+/** Returns the Content-Format of a request. Requests without one are JSON, as sent by older clients. */
+static unsigned int led_ring_get_content_format(coap_pdu_t* request) {
+  coap_opt_iterator_t opt_iter;
+  coap_opt_t* option = coap_check_option(request, COAP_OPTION_CONTENT_TYPE, &opt_iter);
+  if(!option) return COAP_MEDIATYPE_APPLICATION_JSON;
+  return coap_decode_var_bytes(coap_opt_value(option), coap_opt_length(option));
+}
+
+/**
+ * Adds the time since start_us to the handler histogram.
+ *
+ * The CoAP task is not pinned, so it can move to the other core while it waits for show_mutex.
+ * The time is measured with esp_timer rather than the cycle counter of each core.
+ */
+static void led_ring_record_handler_time(int64_t start_us) {
+  /* Bucket n counts requests handled in less than 64 << n us */
+  uint32_t handler_us = esp_timer_get_time() - start_us;
+  uint32_t handler_64us = handler_us >> 6;
+  int bucket = handler_64us == 0 ? 0 : 32 - __builtin_clz(handler_64us);
+  if(bucket >= LED_RING_RESOURCE_TIME_BUCKETS) bucket = LED_RING_RESOURCE_TIME_BUCKETS - 1;
+  ++stats.handler_histogram[bucket];
+  if(handler_us > stats.max_handler_us) stats.max_handler_us = handler_us;
+}
 
 /* GET handler */
 static void led_ring_get_handler(coap_context_t *ctx, struct coap_resource_t *resource,
@@ -53,100 +562,286 @@ static void led_ring_get_handler(coap_context_t *ctx, struct coap_resource_t *re
   unsigned char buf[3];
   unsigned int len;
 
+  led_ring_state_t* ring = led_ring_find(resource);
+  if(!ring) {
+    response->hdr->code = COAP_RESPONSE_CODE(404);
+    return;
+  }
+
   response->hdr->code = COAP_RESPONSE_CODE(205);
 
-  if (strcmp(mode, mode_solid_color) == 0) {
-    sprintf(message, "[\"%s\", %d, %d, %d]", mode, solid_color.r, solid_color.g, solid_color.b);
+  /* A request of NULL is a notification to an existing observer */
+  bool observed = request == NULL;
+  coap_opt_iterator_t opt_iter;
+  coap_opt_t* option = request ? coap_check_option(request, COAP_OPTION_OBSERVE, &opt_iter) : NULL;
+  unsigned int observe = option ? coap_decode_var_bytes(coap_opt_value(option), coap_opt_length(option)) : 0;
+  if (option && observe == LED_RING_OBSERVE_REGISTER) {
+    coap_subscription_t* subscription = coap_add_observer(resource, local_interface, peer, token);
+    if (subscription) {
+      subscription->non = request->hdr->type == COAP_MESSAGE_NON;
+      observed = true;
+    }
+  } else if (option && observe == LED_RING_OBSERVE_DEREGISTER) {
+    coap_delete_observer(resource, peer, token);
+  }
+
+  if (observed) {
+    len = coap_encode_var_bytes(buf, ctx->observe);
+    coap_add_option(response, COAP_OPTION_OBSERVE, len, buf);
+  }
+
+  led_ring_mode_t mode = ring->mode;
+  if (mode == LED_RING_MODE_SOLID_COLOR) {
+    sprintf(message, "[\"%s\", %d, %d, %d]", mode_names[mode], ring->solid_color.r, ring->solid_color.g, ring->solid_color.b);
+  } else if (is_rainbow_mode(mode)) {
+    sprintf(message, "[\"%s\", %d, %d, %d]", mode_names[mode],
+        ring->rainbow_brightness, ring->rainbow_hue_start, ring->rainbow_hue_end);
   } else {
-    sprintf(message, "[\"%s\"]", mode);
+    sprintf(message, "[\"%s\"]", mode_names[mode]);
   }
 
   len = coap_encode_var_bytes(buf, COAP_MEDIATYPE_APPLICATION_JSON);
   coap_add_option(response, COAP_OPTION_CONTENT_TYPE, len, buf);
 
-  len = coap_encode_var_bytes(buf, 5); // 5 second cache
-  coap_add_option(response, COAP_OPTION_MAXAGE, len, buf);
+  if (!observed) {
+    len = coap_encode_var_bytes(buf, 5); // 5 second cache
+    coap_add_option(response, COAP_OPTION_MAXAGE, len, buf);
+  }
 
   coap_add_data(response, strlen(message), (uint8_t*)message);
 }
 
+/** Reads and applies a PUT request to a ring, setting the response code */
+static void led_ring_handle_put(led_ring_state_t* ring, coap_pdu_t *request, coap_pdu_t *response) {
+  size_t size = 0;
+  uint8_t* data = NULL;
+  coap_get_data(request, &size, &data);
+
+  unsigned int content_format = led_ring_get_content_format(request);
+  led_ring_command_t command = default_command;
+
+  bool valid;
+  if(content_format == COAP_MEDIATYPE_APPLICATION_OCTET_STREAM) {
+    valid = led_ring_parse_binary(data, size, led_ring_get_led_count(ring->led_ring), &command);
+  } else if(content_format == COAP_MEDIATYPE_APPLICATION_JSON) {
+    if(size > LED_RING_MAX_JSON_SIZE) {
+      response->hdr->code = COAP_RESPONSE_CODE(413);
+      return;
+    }
+    valid = led_ring_parse_json(data, size, &command);
+  } else {
+    response->hdr->code = COAP_RESPONSE_CODE(415);
+    return;
+  }
+
+  if(!valid || !led_ring_parse_at(request, &command.at_us)) {
+    ++stats.parse_failures;
+    response->hdr->code = COAP_RESPONSE_CODE(400);
+    return;
+  }
+
+  if(!led_ring_apply(ring, &command)) {
+    response->hdr->code = COAP_RESPONSE_CODE(404);
+    return;
+  }
+
+  ++stats.mode_requests[command.mode];
+  response->hdr->code = COAP_RESPONSE_CODE(204);
+}
+
+/** Reads and applies a batch PUT request, setting the response code. Nothing is applied if any command is invalid. */
+static void led_ring_handle_batch_put(coap_pdu_t *request, coap_pdu_t *response) {
+  size_t size = 0;
+  uint8_t* data = NULL;
+  coap_get_data(request, &size, &data);
+
+  unsigned int content_format = led_ring_get_content_format(request);
+  led_ring_command_t commands[LED_RING_RESOURCE_MAX_RINGS];
+  bool has_command[LED_RING_RESOURCE_MAX_RINGS];
+  for(int i=0; i < LED_RING_RESOURCE_MAX_RINGS; ++i) {
+    commands[i] = default_command;
+    has_command[i] = false;
+  }
+
+  bool valid;
+  if(content_format == COAP_MEDIATYPE_APPLICATION_OCTET_STREAM) {
+    valid = led_ring_parse_binary_batch(data, size, commands, has_command);
+  } else if(content_format == COAP_MEDIATYPE_APPLICATION_JSON) {
+    if(size > LED_RING_MAX_BATCH_JSON_SIZE) {
+      response->hdr->code = COAP_RESPONSE_CODE(413);
+      return;
+    }
+    valid = led_ring_parse_json_batch(data, size, commands, has_command);
+  } else {
+    response->hdr->code = COAP_RESPONSE_CODE(415);
+    return;
+  }
+
+  int64_t at_us = 0;
+  if(!valid || !led_ring_parse_at(request, &at_us)) {
+    ++stats.parse_failures;
+    response->hdr->code = COAP_RESPONSE_CODE(400);
+    return;
+  }
+
+  if(!led_ring_apply_batch(commands, has_command, at_us)) {
+    response->hdr->code = COAP_RESPONSE_CODE(404);
+    return;
+  }
+
+  for(int i=0; i < ring_count; ++i) {
+    if(has_command[i]) ++stats.mode_requests[commands[i].mode];
+  }
+  response->hdr->code = COAP_RESPONSE_CODE(204);
+}
+
 /* PUT handler */
 static void led_ring_put_handler(coap_context_t *ctx, struct coap_resource_t *resource,
     const coap_endpoint_t *local_interface, coap_address_t *peer,
     coap_pdu_t *request, str *token, coap_pdu_t *response)
 {
-  cJSON* message = cJSON_Parse((const char *)request->data);
-  cJSON* mode_json = cJSON_GetArrayItem(message, 0);
+  int64_t start_us = esp_timer_get_time();
 
-  if(!mode_json || mode_json->type != cJSON_String) goto error;
+  led_ring_state_t* ring = led_ring_find(resource);
+  if(ring) {
+    led_ring_handle_put(ring, request, response);
+  } else {
+    response->hdr->code = COAP_RESPONSE_CODE(404);
+  }
 
-  if(strcmp(mode_json->valuestring, mode_solid_color) == 0) {
+  led_ring_record_handler_time(start_us);
+}
 
-    cJSON* r_json = cJSON_GetArrayItem(message, 1);
-    if(!r_json || r_json->type != cJSON_Number) goto error;
+/* PUT handler of the batch resource */
+static void led_ring_batch_put_handler(coap_context_t *ctx, struct coap_resource_t *resource,
+    const coap_endpoint_t *local_interface, coap_address_t *peer,
+    coap_pdu_t *request, str *token, coap_pdu_t *response)
+{
+  int64_t start_us = esp_timer_get_time();
+  led_ring_handle_batch_put(request, response);
+  led_ring_record_handler_time(start_us);
+}
 
-    cJSON* g_json = cJSON_GetArrayItem(message, 2);
-    if(!g_json || g_json->type != cJSON_Number) goto error;
+void led_ring_resource_get_stats(led_ring_resource_stats_t* result) {
+  *result = stats;
+}
 
-    cJSON* b_json = cJSON_GetArrayItem(message, 3);
-    if(!b_json || b_json->type != cJSON_Number) goto error;
+bool led_ring_resource_play_recorded(led_ring_t led_ring) {
+  for(int i=0; i < ring_count; ++i) {
+    if(rings[i].led_ring != led_ring) continue;
 
-    led_ring_stop_loop(led_ring);
+    led_ring_command_t command = default_command;
+    command.mode = LED_RING_MODE_RECORDED;
+    return led_ring_apply(rings + i, &command);
+  }
 
-    solid_color.r = (uint8_t)r_json->valueint;
-    solid_color.g = (uint8_t)g_json->valueint;
-    solid_color.b = (uint8_t)b_json->valueint;
+  return false;
+}
 
-    led_ring_set_one_color(led_ring, solid_color);
-    led_ring_update(led_ring);
-  } else if(strcmp(mode_json->valuestring, mode_static_rainbow) == 0) {
-    led_ring_stop_loop(led_ring);
-    led_ring_set_rainbow(led_ring, 64);
-    led_ring_update(led_ring);
-  } else if(strcmp(mode_json->valuestring, mode_spinning_rainbow) == 0) {
-    led_ring_stop_loop(led_ring);
-    led_ring_set_rainbow(led_ring, 64);
-    led_ring_start_spinner_loop(led_ring);
-  } else if(strcmp(mode_json->valuestring, mode_strobing_rainbow) == 0) {
-    led_ring_stop_loop(led_ring);
-    led_ring_set_rainbow(led_ring, 64);
-    led_ring_start_strobing_loop(led_ring);
-  } else if(strcmp(mode_json->valuestring, mode_static_dots) == 0) {
-    led_ring_stop_loop(led_ring);
-    led_ring_set_pattern(led_ring, (rgb_t*)dots, dot_count);
-    led_ring_update(led_ring);
-  } else if(strcmp(mode_json->valuestring, mode_spinning_dots) == 0) {
-    led_ring_stop_loop(led_ring);
-    led_ring_set_pattern(led_ring, (rgb_t*)dots, dot_count);
-    led_ring_start_spinner_loop(led_ring);
-  } else if(strcmp(mode_json->valuestring, mode_strobing_dots) == 0) {
-    led_ring_stop_loop(led_ring);
-    led_ring_set_pattern(led_ring, (rgb_t*)dots, dot_count);
-    led_ring_start_strobing_loop(led_ring);
-  } else {
-    goto error;
+bool led_ring_resource_show(led_ring_t led_ring, led_ring_mode_t mode, led_ring_resource_show_t show, void* arg) {
+  led_ring_state_t* ring = NULL;
+  for(int i=0; i < ring_count; ++i) {
+    if(rings[i].led_ring == led_ring) ring = rings + i;
   }
 
-  strcpy(mode, mode_json->valuestring);
-  response->hdr->code = COAP_RESPONSE_CODE(204);
-  cJSON_Delete(message);
-  return;
+  if(ring) xSemaphoreTake(show_mutex, portMAX_DELAY);
+  led_ring_lock(led_ring);
+  led_ring_stop_loop(led_ring);
+  bool shown = show(led_ring, arg);
+  led_ring_unlock(led_ring);
+  if(!ring) return shown;
 
-  error:
-  response->hdr->code = COAP_RESPONSE_CODE(400);
-  cJSON_Delete(message);
+  if(shown) {
+    /* A command for later would replace this without changing the mode back */
+    ring->command_pending = false;
+    esp_timer_stop(ring->pending_timer);
+
+    /* Each streamed frame is not a change, only the start of the stream */
+    if(ring->mode != mode || mode != LED_RING_MODE_STREAM) {
+      led_ring_command_t command = default_command;
+      command.mode = mode;
+      led_ring_set_state(ring, &command);
+      ++stats.mode_requests[mode];
+    }
+  }
+
+  xSemaphoreGive(show_mutex);
+  return shown;
 }
 
-coap_resource_t* led_ring_resource_init(coap_context_t* ctx, led_ring_t led_ring_ctx) {
-  coap_resource_t* resource = coap_resource_init((uint8_t*)resource_name, strlen(resource_name), 0);
+/** Creates an observable resource with the led_ring handlers */
+static coap_resource_t* led_ring_add_resource(coap_context_t* ctx, const char* name) {
+  coap_resource_t* resource = coap_resource_init((uint8_t*)name, strlen(name), 0);
   if (!resource) return resource;
 
-  led_ring = led_ring_ctx;
-  strcpy(mode, mode_solid_color);
-
+  resource->observable = 1;
   coap_register_handler(resource, COAP_REQUEST_GET, led_ring_get_handler);
   coap_register_handler(resource, COAP_REQUEST_PUT, led_ring_put_handler);
   coap_add_resource(ctx, resource);
 
   return resource;
 }
+
+/** Sets up the state and led_ring/<index> resource of a ring */
+static bool led_ring_state_init(coap_context_t* ctx, led_ring_state_t* ring, led_ring_t led_ring, int index) {
+  ring->led_ring = led_ring;
+  ring->alias_resource = NULL;
+  ring->mode = LED_RING_MODE_SOLID_COLOR;
+  ring->solid_color = (rgb_t){ 0, 0, 0 };
+  ring->rainbow_brightness = 64;
+  ring->rainbow_hue_start = 0;
+  ring->rainbow_hue_end = 0;
+  ring->command_pending = false;
+
+  ring->pending_frame = malloc(led_ring_get_led_count(led_ring) * sizeof(rgb_t));
+  if (!ring->pending_frame) return false;
+
+  esp_timer_create_args_t timer_args = {
+    .callback = led_ring_show_pending,
+    .arg = ring,
+    .dispatch_method = ESP_TIMER_TASK,
+    .name = "led_ring_pending",
+  };
+  ESP_ERROR_CHECK(esp_timer_create(&timer_args, &ring->pending_timer));
+
+  /* The resource keeps a pointer to its name */
+  snprintf(ring->resource_name, sizeof(ring->resource_name), "%s/%d", resource_name, index);
+  ring->resource = led_ring_add_resource(ctx, ring->resource_name);
+  return ring->resource != NULL;
+}
+
+bool led_ring_resource_init_rings(coap_context_t* ctx, led_ring_t* led_rings, int count) {
+  if (count <= 0 || count > LED_RING_RESOURCE_MAX_RINGS) return false;
+
+  show_mutex = xSemaphoreCreateMutex();
+  if (!show_mutex) return false;
+
+  esp_timer_create_args_t timer_args = {
+    .callback = led_ring_show_pending_batches,
+    .arg = NULL,
+    .dispatch_method = ESP_TIMER_TASK,
+    .name = "led_ring_batch",
+  };
+  ESP_ERROR_CHECK(esp_timer_create(&timer_args, &batch_timer));
+
+  for (int i=0; i < count; ++i) {
+    if (!led_ring_state_init(ctx, rings + i, led_rings[i], i)) return false;
+    ring_count = i + 1;
+  }
+
+  rings[0].alias_resource = led_ring_add_resource(ctx, resource_name);
+  if (!rings[0].alias_resource) return false;
+
+  coap_resource_t* batch_resource = coap_resource_init((uint8_t*)batch_resource_name, strlen(batch_resource_name), 0);
+  if (!batch_resource) return false;
+
+  coap_register_handler(batch_resource, COAP_REQUEST_PUT, led_ring_batch_put_handler);
+  coap_add_resource(ctx, batch_resource);
+
+  return true;
+}
+
+coap_resource_t* led_ring_resource_init(coap_context_t* ctx, led_ring_t led_ring) {
+  if (!led_ring_resource_init_rings(ctx, &led_ring, 1)) return NULL;
+  return rings[0].alias_resource;
+}
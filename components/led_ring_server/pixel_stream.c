@@ -0,0 +1,267 @@
+/*
+ * Copyright 2017 Sam Leitch
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "pixel_stream.h"
+#include "led_ring_resource.h"
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+#include <esp_log.h>
+#include <lwip/sockets.h>
+#include <soc/soc.h>
+#include <stdlib.h>
+#include <string.h>
+
+const static char *LOG_TAG = "pixel_stream";
+
+#define DDP_HEADER_SIZE 10
+#define DDP_TIMECODE_SIZE 4
+#define DDP_FLAGS_VERSION_MASK 0xC0
+#define DDP_FLAGS_VERSION_1 0x40
+#define DDP_FLAGS_TIMECODE 0x10
+#define DDP_FLAGS_QUERY 0x08
+#define DDP_FLAGS_PUSH 0x01
+#define DDP_SEQUENCE_MASK 0x0F
+#define DDP_TYPE_UNDEFINED 0x00
+#define DDP_TYPE_RGB8 0x0B
+
+/* The largest UDP payload that fits in one ethernet frame */
+#define PIXEL_STREAM_MAX_PACKET 1472
+
+/* Completed frames that can wait while the ring is busy, more than this drops the oldest */
+#define PIXEL_STREAM_JITTER_FRAMES 2
+
+/* The frame being received, the waiting frames, and the frame being shown */
+#define PIXEL_STREAM_FRAME_COUNT (PIXEL_STREAM_JITTER_FRAMES + 2)
+
+struct pixel_stream_s {
+  led_ring_t led_ring;
+  int frame_size; /* Bytes in each frame */
+  int sockfd;
+  rgb_t* frames[PIXEL_STREAM_FRAME_COUNT];
+  QueueHandle_t free_frames; /* Indexes of frames that are not used */
+  QueueHandle_t ready_frames; /* Indexes of completed frames, oldest first */
+  int frame_index; /* The frame being received */
+  bool frame_started; /* True if the frame being received has data but no PUSH yet */
+  uint8_t sequence; /* Sequence number of the last packet, 0 if unknown */
+  uint8_t packet[PIXEL_STREAM_MAX_PACKET];
+  pixel_stream_stats_t stats;
+};
+
+static inline uint32_t pixel_stream_read_u32(const uint8_t* data) {
+  return ((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) | ((uint32_t)data[2] << 8) | data[3];
+}
+
+static inline uint16_t pixel_stream_read_u16(const uint8_t* data) {
+  return ((uint16_t)data[0] << 8) | data[1];
+}
+
+/**
+ * Queues the received frame to be shown and starts the next one.
+ *
+ * If the queue is full, the oldest frame is dropped so the ring does not fall behind the stream.
+ * The next frame starts as a copy of this one, since packets only change part of a frame.
+ */
+static void pixel_stream_push_frame(pixel_stream_t ctx) {
+  /* Counted before it is queued, so a frame that is shown has always been counted */
+  ++ctx->stats.frames;
+
+  int ready_index = ctx->frame_index;
+  if(xQueueSend(ctx->ready_frames, &ready_index, 0) != pdTRUE) {
+    int oldest_index;
+    if(xQueueReceive(ctx->ready_frames, &oldest_index, 0) == pdTRUE) {
+      xQueueSend(ctx->free_frames, &oldest_index, 0);
+      ++ctx->stats.dropped_frames;
+    }
+    xQueueSend(ctx->ready_frames, &ready_index, 0);
+  }
+
+  int next_index;
+  xQueueReceive(ctx->free_frames, &next_index, portMAX_DELAY);
+  if(next_index != ready_index) memcpy(ctx->frames[next_index], ctx->frames[ready_index], ctx->frame_size);
+
+  ctx->frame_index = next_index;
+  ctx->frame_started = false;
+}
+
+/**
+ * Returns true if a packet with this sequence number belongs to a frame that was already completed.
+ *
+ * Sequence numbers wrap from 15 to 1, so a number up to 7 behind the last one is late.
+ */
+static bool pixel_stream_is_late(pixel_stream_t ctx, uint8_t sequence) {
+  if(sequence == 0 || ctx->sequence == 0) return false;
+
+  uint8_t ahead = (sequence - ctx->sequence) & DDP_SEQUENCE_MASK;
+  if(ahead == 0) return !ctx->frame_started;
+  return ahead >= 8;
+}
+
+static void pixel_stream_receive_packet(pixel_stream_t ctx, int length) {
+  const uint8_t* packet = ctx->packet;
+  ++ctx->stats.packets;
+
+  if(length < DDP_HEADER_SIZE) goto invalid;
+
+  uint8_t flags = packet[0];
+  if((flags & DDP_FLAGS_VERSION_MASK) != DDP_FLAGS_VERSION_1) goto invalid;
+  if(flags & DDP_FLAGS_QUERY) return; // Status queries are not supported
+
+  uint8_t type = packet[2];
+  if(type != DDP_TYPE_UNDEFINED && type != DDP_TYPE_RGB8) goto invalid;
+
+  int header_size = (flags & DDP_FLAGS_TIMECODE) ? DDP_HEADER_SIZE + DDP_TIMECODE_SIZE : DDP_HEADER_SIZE;
+  uint32_t offset = pixel_stream_read_u32(packet + 4);
+  uint32_t data_size = pixel_stream_read_u16(packet + 8);
+  if(length < header_size + (int)data_size) goto invalid;
+
+  uint8_t sequence = packet[1] & DDP_SEQUENCE_MASK;
+  if(pixel_stream_is_late(ctx, sequence)) {
+    ++ctx->stats.late_packets;
+    return;
+  }
+
+  // A new sequence number before the PUSH means the PUSH packet was lost
+  if(sequence != ctx->sequence && ctx->frame_started) ++ctx->stats.dropped_frames;
+  ctx->sequence = sequence;
+
+  // Data past the end of the ring is ignored
+  if(offset < (uint32_t)ctx->frame_size) {
+    if(data_size > ctx->frame_size - offset) data_size = ctx->frame_size - offset;
+    memcpy((uint8_t*)ctx->frames[ctx->frame_index] + offset, packet + header_size, data_size);
+    ctx->frame_started = true;
+  }
+
+  if(flags & DDP_FLAGS_PUSH) pixel_stream_push_frame(ctx);
+  return;
+
+  invalid:
+  ++ctx->stats.invalid_packets;
+}
+
+static void pixel_stream_receive_loop(void* param) {
+  ESP_LOGI(LOG_TAG, "Starting pixel stream");
+  pixel_stream_t ctx = (pixel_stream_t)param;
+
+  for(;;) {
+    int length = recv(ctx->sockfd, ctx->packet, sizeof(ctx->packet), 0);
+    if(length < 0) {
+      ESP_LOGE(LOG_TAG, "pixel_stream_receive_loop: recv returned %d", length);
+      continue;
+    }
+
+    pixel_stream_receive_packet(ctx, length);
+  }
+}
+
+/** A completed frame being shown */
+typedef struct pixel_stream_frame_s {
+  pixel_stream_t ctx;
+  int index;
+} pixel_stream_frame_t;
+
+/** Shows a completed frame and frees it, once it is copied to the ring */
+static bool pixel_stream_show_frame(led_ring_t led_ring, void* arg) {
+  pixel_stream_frame_t* frame = (pixel_stream_frame_t*)arg;
+  led_ring_set_colors(led_ring, frame->ctx->frames[frame->index]);
+  xQueueSend(frame->ctx->free_frames, &frame->index, 0);
+  led_ring_update(led_ring);
+  return true;
+}
+
+/**
+ * Shows the completed frames, waiting for the ring to take each one.
+ *
+ * The ring takes a frame once the previous one is sent, so frames wait in the jitter buffer
+ * (and the oldest are dropped) while the ring is slower than the stream.
+ */
+static void pixel_stream_render_loop(void* param) {
+  pixel_stream_t ctx = (pixel_stream_t)param;
+
+  for(;;) {
+    pixel_stream_frame_t frame = { ctx };
+    xQueueReceive(ctx->ready_frames, &frame.index, portMAX_DELAY);
+
+    /* Through the led_ring resource, so the stream is its mode and it does not show a command in the middle */
+    led_ring_resource_show(ctx->led_ring, LED_RING_MODE_STREAM, pixel_stream_show_frame, &frame);
+    led_ring_wait_taken(ctx->led_ring);
+    ++ctx->stats.frames_shown;
+  }
+}
+
+static void pixel_stream_free(pixel_stream_t ctx) {
+  if(ctx->sockfd >= 0) close(ctx->sockfd);
+  if(ctx->free_frames) vQueueDelete(ctx->free_frames);
+  if(ctx->ready_frames) vQueueDelete(ctx->ready_frames);
+  for(int i=0; i < PIXEL_STREAM_FRAME_COUNT; ++i) free(ctx->frames[i]);
+  free(ctx);
+}
+
+pixel_stream_t pixel_stream_create(led_ring_t led_ring, uint16_t port) {
+  pixel_stream_t ctx = calloc(1, sizeof(struct pixel_stream_s));
+  if(!ctx) return NULL;
+
+  int led_count = led_ring_get_led_count(led_ring);
+  ctx->led_ring = led_ring;
+  ctx->frame_size = led_count * sizeof(rgb_t);
+  ctx->sockfd = -1;
+
+  ctx->free_frames = xQueueCreate(PIXEL_STREAM_FRAME_COUNT, sizeof(int));
+  ctx->ready_frames = xQueueCreate(PIXEL_STREAM_JITTER_FRAMES, sizeof(int));
+  if(!ctx->free_frames || !ctx->ready_frames) goto error;
+
+  for(int i=0; i < PIXEL_STREAM_FRAME_COUNT; ++i) {
+    ctx->frames[i] = calloc(led_count, sizeof(rgb_t));
+    if(!ctx->frames[i]) goto error;
+    if(i > 0) xQueueSend(ctx->free_frames, &i, 0);
+  }
+  ctx->frame_index = 0;
+
+  ctx->sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+  if(ctx->sockfd < 0) {
+    ESP_LOGE(LOG_TAG, "pixel_stream_create: socket returned %d", ctx->sockfd);
+    goto error;
+  }
+
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = INADDR_ANY;
+  addr.sin_port = htons(port);
+
+  int result = bind(ctx->sockfd, (struct sockaddr*)&addr, sizeof(addr));
+  if(result < 0) {
+    ESP_LOGE(LOG_TAG, "pixel_stream_create: bind returned %d", result);
+    goto error;
+  }
+
+  return ctx;
+
+  error:
+  pixel_stream_free(ctx);
+  return NULL;
+}
+
+void pixel_stream_start(pixel_stream_t ctx) {
+  /* Kept off the APP CPU, where a pipelined led_ring encodes its frames */
+  xTaskCreatePinnedToCore(pixel_stream_receive_loop, "pixel_stream_receive", 2048, ctx, 10, NULL, PRO_CPU_NUM);
+  xTaskCreatePinnedToCore(pixel_stream_render_loop, "pixel_stream_render", 2048, ctx, 5, NULL, PRO_CPU_NUM);
+}
+
+void pixel_stream_get_stats(pixel_stream_t ctx, pixel_stream_stats_t* stats) {
+  *stats = ctx->stats;
+}
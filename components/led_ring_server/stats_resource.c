@@ -0,0 +1,150 @@
+/*
+ * Copyright 2017 Sam Leitch
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "stats_resource.h"
+#include "led_ring_resource.h"
+
+#include <resource.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Every counter at 10 digits is about 800 bytes */
+#define STATS_MAX_MESSAGE_SIZE 1024
+
+const static char* resource_name = "stats";
+
+/** The stats/<index> resource of a ring */
+typedef struct stats_ring_s {
+  led_ring_t led_ring;
+  coap_resource_t* resource;
+  char resource_name[12];
+} stats_ring_t;
+
+static stats_ring_t rings[LED_RING_RESOURCE_MAX_RINGS];
+static int ring_count = 0;
+static coap_resource_t* alias_resource; /* stats, which is the first ring */
+
+/* Kept off the stack of the CoAP task */
+static char message[STATS_MAX_MESSAGE_SIZE];
+
+/**
+ * Appends to the message, returns the new length.
+ *
+ * A message that does not fit is cut at the end of the buffer, so the length never passes it.
+ */
+static int stats_append(int len, const char* format, ...) {
+  if(len >= (int)sizeof(message) - 1) return sizeof(message) - 1;
+
+  va_list args;
+  va_start(args, format);
+  int written = vsnprintf(message + len, sizeof(message) - len, format, args);
+  va_end(args);
+
+  if(written < 0) return len;
+  len += written;
+  return len < (int)sizeof(message) - 1 ? len : (int)sizeof(message) - 1;
+}
+
+/** Appends "name": [values...] to the message, returns the new length */
+static int stats_add_array(int len, const char* name, const uint32_t* values, int count) {
+  len = stats_append(len, "\"%s\":[", name);
+  for(int i=0; i < count; ++i) {
+    len = stats_append(len, i == 0 ? "%u" : ",%u", values[i]);
+  }
+  return stats_append(len, "],");
+}
+
+/* GET handler */
+static void stats_get_handler(coap_context_t *ctx, struct coap_resource_t *resource,
+    const coap_endpoint_t *local_interface, coap_address_t *peer,
+    coap_pdu_t *request, str *token, coap_pdu_t *response)
+{
+  unsigned char buf[3];
+  unsigned int len;
+
+  led_ring_t led_ring = NULL;
+  for(int i=0; i < ring_count; ++i) {
+    if(rings[i].resource == resource) led_ring = rings[i].led_ring;
+  }
+  if(resource == alias_resource) led_ring = rings[0].led_ring;
+  if(!led_ring) {
+    response->hdr->code = COAP_RESPONSE_CODE(404);
+    return;
+  }
+
+  ws2812rmt_stats_t output;
+  led_ring_frame_stats_t frames;
+  led_ring_resource_stats_t requests;
+  led_ring_get_output_stats(led_ring, &output);
+  led_ring_get_frame_stats(led_ring, &frames);
+  led_ring_resource_get_stats(&requests);
+
+  int size = stats_append(0, "{\"sent\":%u,\"skipped\":%u,", output.frames_sent, output.frames_skipped);
+  size = stats_add_array(size, "encode", output.encode_histogram, WS2812RMT_TIME_BUCKETS);
+  size = stats_add_array(size, "wire", output.wire_histogram, WS2812RMT_TIME_BUCKETS);
+  size = stats_append(size, "\"encode_max\":%u,\"wire_max\":%u,\"frames\":%u,\"missed\":%u,",
+      output.max_encode_us, output.max_wire_us, frames.frames, frames.missed_deadlines);
+  size = stats_add_array(size, "jitter", frames.jitter_histogram, LED_RING_JITTER_BUCKETS);
+  size = stats_add_array(size, "requests", requests.mode_requests, LED_RING_MODE_COUNT);
+  size = stats_add_array(size, "handler", requests.handler_histogram, LED_RING_RESOURCE_TIME_BUCKETS);
+  size = stats_append(size, "\"jitter_max\":%d,\"parse_failures\":%u,\"handler_max\":%u}",
+      frames.max_jitter_us, requests.parse_failures, requests.max_handler_us);
+
+  response->hdr->code = COAP_RESPONSE_CODE(205);
+
+  len = coap_encode_var_bytes(buf, COAP_MEDIATYPE_APPLICATION_JSON);
+  coap_add_option(response, COAP_OPTION_CONTENT_TYPE, len, buf);
+
+  len = coap_encode_var_bytes(buf, 0); // The counters change with every frame
+  coap_add_option(response, COAP_OPTION_MAXAGE, len, buf);
+
+  coap_add_data(response, size, (uint8_t*)message);
+}
+
+/** Adds a resource with the stats handler */
+static coap_resource_t* stats_add_resource(coap_context_t* ctx, const char* name) {
+  coap_resource_t* resource = coap_resource_init((uint8_t*)name, strlen(name), 0);
+  if (!resource) return resource;
+
+  coap_register_handler(resource, COAP_REQUEST_GET, stats_get_handler);
+  coap_add_resource(ctx, resource);
+
+  return resource;
+}
+
+bool stats_resource_init_rings(coap_context_t* ctx, led_ring_t* led_rings, int count) {
+  if (count <= 0 || count > LED_RING_RESOURCE_MAX_RINGS) return false;
+
+  for (int i=0; i < count; ++i) {
+    stats_ring_t* ring = rings + i;
+    ring->led_ring = led_rings[i];
+
+    /* The resource keeps a pointer to its name */
+    snprintf(ring->resource_name, sizeof(ring->resource_name), "%s/%d", resource_name, i);
+    ring->resource = stats_add_resource(ctx, ring->resource_name);
+    if (!ring->resource) return false;
+    ring_count = i + 1;
+  }
+
+  alias_resource = stats_add_resource(ctx, resource_name);
+  return alias_resource != NULL;
+}
+
+coap_resource_t* stats_resource_init(coap_context_t* ctx, led_ring_t led_ring) {
+  if (!stats_resource_init_rings(ctx, &led_ring, 1)) return NULL;
+  return alias_resource;
+}
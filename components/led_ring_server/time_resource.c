@@ -0,0 +1,61 @@
+/*
+ * Copyright 2017 Sam Leitch
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "time_resource.h"
+#include "clock_sync.h"
+
+#include <resource.h>
+#include <stdio.h>
+#include <string.h>
+
+const static char* resource_name = "time";
+
+/* GET handler */
+static void time_get_handler(coap_context_t *ctx, struct coap_resource_t *resource,
+    const coap_endpoint_t *local_interface, coap_address_t *peer,
+    coap_pdu_t *request, str *token, coap_pdu_t *response)
+{
+  char message[128];
+  unsigned char buf[3];
+  unsigned int len;
+
+  clock_sync_status_t status;
+  clock_sync_get_status(&status);
+  long long time_ms = clock_sync_get_time() / 1000;
+
+  response->hdr->code = COAP_RESPONSE_CODE(205);
+
+  len = coap_encode_var_bytes(buf, COAP_MEDIATYPE_APPLICATION_JSON);
+  coap_add_option(response, COAP_OPTION_CONTENT_TYPE, len, buf);
+
+  len = coap_encode_var_bytes(buf, 0); // The time can not be cached
+  coap_add_option(response, COAP_OPTION_MAXAGE, len, buf);
+
+  sprintf(message, "{\"time\": %lld, \"offset\": %lld, \"slew\": %lld, \"round_trip\": %lld, \"leader\": %s}",
+      time_ms, (long long)status.offset_us, (long long)status.slew_us, (long long)status.round_trip_us,
+      status.leader ? "true" : "false");
+  coap_add_data(response, strlen(message), (uint8_t*)message);
+}
+
+coap_resource_t* time_resource_init(coap_context_t* ctx) {
+  coap_resource_t* resource = coap_resource_init((uint8_t*)resource_name, strlen(resource_name), 0);
+  if (!resource) return resource;
+
+  coap_register_handler(resource, COAP_REQUEST_GET, time_get_handler);
+  coap_add_resource(ctx, resource);
+
+  return resource;
+}
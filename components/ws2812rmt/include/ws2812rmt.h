@@ -29,25 +29,79 @@ typedef struct rgb_s {
 	uint8_t b;
 } rgb_t;
 
-inline bool rgb_equal(rgb_t left, rgb_t right) {
+static inline bool rgb_equal(rgb_t left, rgb_t right) {
   return left.r == right.r && left.g == right.g && left.b == right.b;
 }
 
 /** Context used to reference a ws2812rmt channel */
 typedef struct ws2812rmt_s* ws2812rmt_t;
 
+/**
+ * The signal of an LED chipset: bit timings, reset length, byte order and bytes per LED.
+ *
+ * RGBW chipsets are sent the white part of each color on the white LED.
+ */
+typedef struct ws2812rmt_chipset_s ws2812rmt_chipset_t;
+
+extern const ws2812rmt_chipset_t ws2812rmt_chipset_ws2812b; /* 800 kHz, GRB */
+extern const ws2812rmt_chipset_t ws2812rmt_chipset_sk6812_rgbw; /* 800 kHz, GRBW */
+extern const ws2812rmt_chipset_t ws2812rmt_chipset_ws2811; /* 400 kHz, RGB */
+extern const ws2812rmt_chipset_t ws2812rmt_chipset_apa106; /* 580 kHz, RGB */
+
+#define WS2812RMT_TIME_BUCKETS 8
+
+/** Transmission counters of a ws2812rmt channel */
+typedef struct ws2812rmt_stats_s {
+  uint32_t frames_sent; /* Frames encoded and transmitted */
+  uint32_t frames_skipped; /* Frames not transmitted because they were identical to the last frame */
+  uint32_t encode_histogram[WS2812RMT_TIME_BUCKETS]; /* Bucket n counts frames encoded in less than 8 << n us (not when streaming) */
+  uint32_t max_encode_us;
+  uint32_t wire_histogram[WS2812RMT_TIME_BUCKETS]; /* Bucket n counts frames sent in less than 512 << n us */
+  uint32_t max_wire_us;
+} ws2812rmt_stats_t;
+
+/** The colors for one channel of a multi-channel frame */
+typedef struct ws2812rmt_frame_s {
+  ws2812rmt_t ctx;
+  rgb_t* colors;
+  int color_count;
+  bool repeat;
+  int rotation; /* See ws2812rmt_submit_rotated */
+} ws2812rmt_frame_t;
+
+/** Callback for a finished transmission. This is called from the RMT interrupt. */
+typedef void (*ws2812rmt_done_cb_t)(ws2812rmt_t ctx, void* arg);
+
 /** Initializes a ws2812rmt channel with a given RMT channel and GPIO port
  *
- * The ws2812rmt will malloc and store an internal buffer of (led_count * 96) + 4 bytes.
+ * The ws2812rmt will malloc and store two internal buffers of (led_count * 96) + 4 bytes
+ * (led_count * 128 for RGBW), so that a frame can be encoded while the previous one is transmitted.
+ *
+ * All versions of init also malloc a copy of the last frame sent of (led_count * 3) bytes.
+ *
+ * Except for ws2812rmt_init_chipset, the channel drives the chipset chosen in menuconfig (WS2812B by default).
  */
 ws2812rmt_t ws2812rmt_init(rmt_channel_t channel, gpio_num_t gpio_num, int led_count);
 
+/** Same as ws2812rmt_init, for a given chipset (like &ws2812rmt_chipset_sk6812_rgbw) */
+ws2812rmt_t ws2812rmt_init_chipset(rmt_channel_t channel, gpio_num_t gpio_num, int led_count,
+    const ws2812rmt_chipset_t* chipset);
+
 /** Initializes a ws2812rmt channel with a given RMT channel and GPIO port
  *
- * This version of init uses a static rmt_item32_t buffer that must be at least (led_count * 24) + 1 items large.
+ * This version of init uses a static rmt_item32_t buffer that must be at least (led_count * 24) + 1 items large
+ * ((led_count * 32) + 1 for RGBW).
+ * With a single buffer, ws2812rmt_submit_colors waits for the previous frame before encoding.
  */
 ws2812rmt_t ws2812rmt_init_static(rmt_channel_t channel, gpio_num_t gpio_num, int led_count, rmt_item32_t* tx_buffer);
 
+/** Initializes a ws2812rmt channel that encodes colors while they are transmitted
+ *
+ * No tx buffer is allocated. The colors are encoded from the RMT TX threshold interrupt
+ * into the channel memory half that was just sent, so memory use does not depend on led_count.
+ */
+ws2812rmt_t ws2812rmt_init_streaming(rmt_channel_t channel, gpio_num_t gpio_num, int led_count);
+
 /**
  * Sets the LED colors.
  *
@@ -58,11 +112,98 @@ ws2812rmt_t ws2812rmt_init_static(rmt_channel_t channel, gpio_num_t gpio_num, in
  *
  * If repeat is set, the pattern will be repeated for all LEDs.
  * Otherwise transmission will stop after the pattern is complete.
+ * The pattern is encoded once and copied for the repeats, so a short pattern
+ * (like a single color) is cheap to send on a long strip.
  *
  * If color_count is greater than led_count of the ws2812rmt device, it will be truncated.
+ *
+ * If the colors are identical to the last colors sent, nothing is encoded or transmitted.
  */
 void ws2812rmt_set_colors(ws2812rmt_t ctx, rgb_t* colors, int color_count, bool repeat);
 
+/**
+ * Starts transmitting the LED colors without waiting for the transmission to finish.
+ *
+ * The arguments are the same as ws2812rmt_set_colors.
+ *
+ * The colors are encoded into the buffer that is not being transmitted, so the next
+ * frame can be prepared while the current one is sent. If a frame is still being sent
+ * when the new one is ready, this waits for it before starting the new one.
+ *
+ * Streaming channels read the colors during transmission. The colors must not change
+ * until the frame is done.
+ */
+void ws2812rmt_submit_colors(ws2812rmt_t ctx, rgb_t* colors, int color_count, bool repeat);
+
+/**
+ * Starts transmitting colors on several channels at the same time.
+ *
+ * The arguments of each frame are the same as ws2812rmt_set_colors, with at most one frame per channel.
+ *
+ * All frames are encoded first, then the transmissions are started back to back once every
+ * channel is idle. The channels transmit in parallel, so the time for the whole frame is the
+ * time of the longest strip rather than the sum of all strips.
+ */
+void ws2812rmt_submit_frames(ws2812rmt_frame_t* frames, int frame_count);
+
+/**
+ * Encodes a frame without sending it, so the next frame can be encoded ahead of time.
+ *
+ * The arguments are the same as ws2812rmt_submit_rotated. ws2812rmt_start sends the frame
+ * and ws2812rmt_cancel throws it away. With double buffering the frame is encoded while
+ * the previous one is sent, streaming channels wait for the previous frame first.
+ *
+ * Returns false if there is nothing to send, because the frame is the same as the last one.
+ */
+bool ws2812rmt_prepare(ws2812rmt_t ctx, rgb_t* colors, int color_count, bool repeat, int rotation);
+
+/** Starts transmitting the frame encoded by ws2812rmt_prepare, waiting for the previous frame if it is still sent */
+void ws2812rmt_start(ws2812rmt_t ctx);
+
+/** Throws away the frame encoded by ws2812rmt_prepare, if it has not been started */
+void ws2812rmt_cancel(ws2812rmt_t ctx);
+
+/** Same as ws2812rmt_submit_frames, but returns once all channels are transmitted */
+void ws2812rmt_set_frames(ws2812rmt_frame_t* frames, int frame_count);
+
+/**
+ * Sets the brightness of the channel (255, the default, is full brightness).
+ *
+ * The brightness is applied while the colors are encoded, so the colors do not need
+ * to be changed. It applies from the next frame submitted.
+ */
+void ws2812rmt_set_brightness(ws2812rmt_t ctx, uint8_t brightness);
+
+/**
+ * Sets the gamma correction of the channel.
+ *
+ * 1.0 (the default) sends the colors as they are. Around 2.2 makes steps of the
+ * color values look evenly spaced to the eye. Like the brightness, it is applied while encoding.
+ */
+void ws2812rmt_set_gamma(ws2812rmt_t ctx, float gamma);
+
+/** Copies the transmission counters of the channel into stats */
+void ws2812rmt_get_stats(ws2812rmt_t ctx, ws2812rmt_stats_t* stats);
+
+/**
+ * Same as ws2812rmt_submit_colors, but the colors are rotated while they are encoded.
+ *
+ * LED i shows colors[(i + rotation) % color_count], so a pattern can be spun
+ * without moving the colors. A negative rotation rotates the other way.
+ */
+void ws2812rmt_submit_rotated(ws2812rmt_t ctx, rgb_t* colors, int color_count, bool repeat, int rotation);
+
+/** Waits until all submitted colors have been transmitted */
+void ws2812rmt_wait_idle(ws2812rmt_t ctx);
+
+/**
+ * Sets a callback that is called every time a frame has been transmitted.
+ *
+ * The callback runs in the RMT interrupt, so it should only do things like
+ * giving a semaphore or notifying a task (using the FromISR functions).
+ */
+void ws2812rmt_set_done_callback(ws2812rmt_t ctx, ws2812rmt_done_cb_t callback, void* arg);
+
 /** Shuts down RMT and releases resources */
 void ws2812rmt_uninit(ws2812rmt_t *ctx);
 
@@ -17,40 +17,260 @@
 
 #include "ws2812rmt.h"
 #include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
 #include <limits.h>
+#include <math.h>
 #include <freertos/semphr.h>
+#include <xtensa/hal.h>
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "sdkconfig.h"
 
 #define LOG_WS2812 "ws2812rmt"
 
+/* The first bucket of the time histograms is 1 << shift us */
+#define WS2812RMT_ENCODE_SHIFT 3
+#define WS2812RMT_WIRE_SHIFT 9
+
+/** The signal of an LED chipset, see WS2812RMT_DEFINE_CHIPSET */
+struct ws2812rmt_chipset_s {
+  const char* name;
+  int bytes_per_led;
+  rmt_item32_t reset;
+  const rmt_item32_t (*nibbles)[4]; /* The RMT items for every 4-bit value, MSB first */
+  int (*bytes)(uint8_t* bytes, rgb_t color, const uint8_t* levels); /* Writes the bytes of an LED, returns their count */
+  void (*encode)(rmt_item32_t* items, const rgb_t* colors, int color_count, int rotation, const uint8_t* levels);
+};
+
 /* Context for storing transmit data */
 struct ws2812rmt_s {
   rmt_channel_t channel;
   int led_count; /* Count of LED color values */
-  rmt_item32_t* tx_buffer; /* The RMT buffer for the channel */
+  const ws2812rmt_chipset_t* chipset;
+  int items_per_led; /* 8 RMT items per byte of the chipset */
+  rmt_item32_t* tx_buffers[2]; /* The RMT buffers for the channel. One can be encoded while the other is sent. */
+  int tx_buffer_count; /* 2 when double buffered, 1 for a static buffer, 0 when streaming */
+  int tx_buffer_index; /* The buffer the next frame is encoded into */
   bool static_init;
+  ws2812rmt_done_cb_t done_callback; /* Called from the RMT interrupt when a frame is sent */
+  void* done_arg;
+  bool streaming; /* Colors are encoded by the translator while transmitting */
+  const rgb_t* stream_colors; /* The colors being streamed */
+  int stream_color_count;
+  int stream_color_index; /* The color currently being encoded */
+  uint8_t stream_bytes[4]; /* The bytes of the current color, in the order of the chipset */
+  int stream_byte_index; /* The byte of the current color being encoded */
+  rgb_t* last_colors; /* The colors of the last frame sent, used to skip identical frames */
+  int last_color_count; /* Count of colors in last_colors, 0 if nothing has been sent */
+  int last_num_values; /* Count of LEDs set by the last frame */
+  ws2812rmt_stats_t stats;
+  int64_t tx_start_us; /* esp_timer_get_time when the current frame was started */
+  int pending_items; /* Size of the prepared frame that has not been started (in units of the mode) */
+  uint8_t brightness;
+  float gamma;
+  uint8_t levels[256]; /* The value sent for each color value, combining gamma and brightness */
 };
 
 struct ws2812rmt_s ws2812rmt_ctx[8];
 
+/* RMT ticks for a time in ns, the 80MHz APB clock with clk_div 1 is 12.5ns per tick */
+#define WS2812RMT_TICKS(ns) (((ns) * 80 + 500) / 1000)
+
+/* The value of the RMT item for a bit that is high for high_ns, then low for low_ns */
+#define WS2812RMT_BIT(high_ns, low_ns) \
+  ((uint32_t)WS2812RMT_TICKS(high_ns) | (1u << 15) | ((uint32_t)WS2812RMT_TICKS(low_ns) << 16))
+
+/* The value of the reset item, low for reset_us. Its second duration of 0 ends the transmission. */
+#define WS2812RMT_RESET(reset_us) ((uint32_t)WS2812RMT_TICKS((reset_us) * 1000))
+
+/* The 4 RMT items of a nibble, MSB first */
+#define WS2812RMT_NIBBLE(nibble, zero, one) { \
+  { .val = ((nibble) & 0x8) ? (one) : (zero) }, { .val = ((nibble) & 0x4) ? (one) : (zero) }, \
+  { .val = ((nibble) & 0x2) ? (one) : (zero) }, { .val = ((nibble) & 0x1) ? (one) : (zero) } }
+
+#define WS2812RMT_NIBBLES(zero, one) { \
+  WS2812RMT_NIBBLE(0, zero, one), WS2812RMT_NIBBLE(1, zero, one), WS2812RMT_NIBBLE(2, zero, one), \
+  WS2812RMT_NIBBLE(3, zero, one), WS2812RMT_NIBBLE(4, zero, one), WS2812RMT_NIBBLE(5, zero, one), \
+  WS2812RMT_NIBBLE(6, zero, one), WS2812RMT_NIBBLE(7, zero, one), WS2812RMT_NIBBLE(8, zero, one), \
+  WS2812RMT_NIBBLE(9, zero, one), WS2812RMT_NIBBLE(10, zero, one), WS2812RMT_NIBBLE(11, zero, one), \
+  WS2812RMT_NIBBLE(12, zero, one), WS2812RMT_NIBBLE(13, zero, one), WS2812RMT_NIBBLE(14, zero, one), \
+  WS2812RMT_NIBBLE(15, zero, one) }
+
+/** Adds 8 RMT items to the tx buffer representing a single byte, as two 4 item block copies from nibbles */
+static inline void ws2812rmt_set_byte(rmt_item32_t* items, const rmt_item32_t (*nibbles)[4], uint8_t value) {
+  memcpy(items, nibbles[value >> 4], sizeof(nibbles[0]));
+  memcpy(items + 4, nibbles[value & 0x0F], sizeof(nibbles[0]));
+}
+
+/** The white part of a color, sent on the white LED of RGBW chipsets */
+static inline uint8_t ws2812rmt_white(rgb_t color) {
+  uint8_t white = color.r < color.g ? color.r : color.g;
+  return white < color.b ? white : color.b;
+}
+
 /**
- *  80MHz clock is 12.5ns per tick
+ * Defines the nibble table, encoder and descriptor of a chipset.
  *
- *  0.4us = 32 ticks
- *  0.45us = 36 ticks
- *  0.8us = 64 ticks
- *  0.85us = 68 ticks
- *  50us = 4000 ticks
+ * zero and one are the WS2812RMT_BIT items of the bits, and the remaining arguments are the bytes of an LED
+ * in the order they are sent, written with r, g, b and w. With has_white the white part of the color is taken
+ * out of r, g and b and sent as w. Everything is generated for the chipset, so the encoder has no tests
+ * of the chipset in its loop, and the table is built by the compiler.
+ */
+#define WS2812RMT_DEFINE_CHIPSET(chipset, zero, one, reset_us, has_white, ...) \
+  _Static_assert(WS2812RMT_TICKS((reset_us) * 1000) < (1 << 15), "reset of " #chipset " is too long"); \
+  \
+  static const rmt_item32_t ws2812rmt_##chipset##_nibbles[16][4] = WS2812RMT_NIBBLES(zero, one); \
+  \
+  static int ws2812rmt_##chipset##_bytes(uint8_t* bytes, rgb_t color, const uint8_t* levels) { \
+    uint8_t w = (has_white) ? ws2812rmt_white(color) : 0; \
+    uint8_t r = levels[color.r - w]; \
+    uint8_t g = levels[color.g - w]; \
+    uint8_t b = levels[color.b - w]; \
+    w = levels[w]; \
+    const uint8_t values[] = { __VA_ARGS__ }; \
+    memcpy(bytes, values, sizeof(values)); \
+    return sizeof(values); \
+  } \
+  \
+  static void ws2812rmt_##chipset##_encode(rmt_item32_t* items, const rgb_t* colors, int color_count, \
+      int rotation, const uint8_t* levels) { \
+    int color_index = rotation; \
+    for(int i=0; i < color_count; ++i) { \
+      uint8_t bytes[4]; \
+      int byte_count = ws2812rmt_##chipset##_bytes(bytes, colors[color_index], levels); \
+      for(int j=0; j < byte_count; ++j) { \
+        ws2812rmt_set_byte(items, ws2812rmt_##chipset##_nibbles, bytes[j]); \
+        items += 8; \
+      } \
+      if(++color_index == color_count) color_index = 0; \
+    } \
+  } \
+  \
+  const ws2812rmt_chipset_t ws2812rmt_chipset_##chipset = { \
+    .name = #chipset, \
+    .bytes_per_led = (has_white) ? 4 : 3, \
+    .reset = { .val = WS2812RMT_RESET(reset_us) }, \
+    .nibbles = ws2812rmt_##chipset##_nibbles, \
+    .bytes = ws2812rmt_##chipset##_bytes, \
+    .encode = ws2812rmt_##chipset##_encode, \
+  };
+
+/*
+ * Timings from the datasheets, in ns for the bits and us for the reset.
+ * The WS2812B timings are the ones this driver has always used.
+ */
+WS2812RMT_DEFINE_CHIPSET(ws2812b, WS2812RMT_BIT(400, 800), WS2812RMT_BIT(850, 450), 50, false, g, r, b)
+WS2812RMT_DEFINE_CHIPSET(sk6812_rgbw, WS2812RMT_BIT(300, 900), WS2812RMT_BIT(600, 600), 80, true, g, r, b, w)
+WS2812RMT_DEFINE_CHIPSET(ws2811, WS2812RMT_BIT(500, 2000), WS2812RMT_BIT(1200, 1300), 50, false, r, g, b)
+WS2812RMT_DEFINE_CHIPSET(apa106, WS2812RMT_BIT(350, 1360), WS2812RMT_BIT(1360, 350), 50, false, r, g, b)
+
+/* The chipset of the channels that are not initialized with ws2812rmt_init_chipset, chosen in menuconfig */
+#if defined(CONFIG_WS2812RMT_CHIPSET_SK6812_RGBW)
+#define WS2812RMT_DEFAULT_CHIPSET (&ws2812rmt_chipset_sk6812_rgbw)
+#elif defined(CONFIG_WS2812RMT_CHIPSET_WS2811)
+#define WS2812RMT_DEFAULT_CHIPSET (&ws2812rmt_chipset_ws2811)
+#elif defined(CONFIG_WS2812RMT_CHIPSET_APA106)
+#define WS2812RMT_DEFAULT_CHIPSET (&ws2812rmt_chipset_apa106)
+#else
+#define WS2812RMT_DEFAULT_CHIPSET (&ws2812rmt_chipset_ws2812b)
+#endif
+
+/**
+ * Encodes the next part of a streamed frame into dest.
  *
- *  For WS2812B:
- *  Zero = 0.4us high, 0.8us low
- *  One = 0.85us high, 0.45us low
- *  Reset = 50us low
+ * The RMT driver calls this when starting a transmission and again from the TX threshold
+ * interrupt each time half of the channel memory has been sent. Every unit of src_size is
+ * one color byte, except the last unit which is the reset item. Only the size is used,
+ * the colors are read from the stream state of ctx, one LED at a time.
  */
+void ws2812rmt_translate(ws2812rmt_t ctx, size_t src_size, rmt_item32_t* dest, size_t wanted_num,
+    size_t* translated_size, size_t* item_num) {
+  size_t translated = 0;
+  size_t items = 0;
+
+  while(translated < src_size && items + 8 <= wanted_num) {
+    if(src_size - translated == 1) {
+      dest[items++] = ctx->chipset->reset;
+      ++translated;
+      break;
+    }
+
+    if(ctx->stream_byte_index == 0) {
+      ctx->chipset->bytes(ctx->stream_bytes, ctx->stream_colors[ctx->stream_color_index], ctx->levels);
+    }
+
+    ws2812rmt_set_byte(dest + items, ctx->chipset->nibbles, ctx->stream_bytes[ctx->stream_byte_index]);
+    items += 8;
+    ++translated;
+
+    if(++ctx->stream_byte_index == ctx->chipset->bytes_per_led) {
+      ctx->stream_byte_index = 0;
+      if(++ctx->stream_color_index == ctx->stream_color_count) ctx->stream_color_index = 0;
+    }
+  }
 
-rmt_item32_t ws2812rmt_item_zero = { .duration0 = 32, .level0 = 1, .duration1 = 64, .level1 = 0 };
-rmt_item32_t ws2812rmt_item_one = { .duration0 = 68, .level0 = 1, .duration1 = 36, .level1 = 0 };
-rmt_item32_t ws2812rmt_item_reset = { .duration0 = 4000, .level0 = 0, .duration1 = 0, .level1 = 0 };
+  *translated_size = translated;
+  *item_num = items;
+}
+
+/**
+ * The RMT translator has no user argument, so each channel gets
+ * a translator that forwards to the context of that channel.
+ */
+#define WS2812RMT_TRANSLATOR(channel) \
+  void ws2812rmt_translate_##channel(const void* src, rmt_item32_t* dest, size_t src_size, \
+      size_t wanted_num, size_t* translated_size, size_t* item_num) { \
+    ws2812rmt_translate(ws2812rmt_ctx + channel, src_size, dest, wanted_num, translated_size, item_num); \
+  }
+
+WS2812RMT_TRANSLATOR(0)
+WS2812RMT_TRANSLATOR(1)
+WS2812RMT_TRANSLATOR(2)
+WS2812RMT_TRANSLATOR(3)
+WS2812RMT_TRANSLATOR(4)
+WS2812RMT_TRANSLATOR(5)
+WS2812RMT_TRANSLATOR(6)
+WS2812RMT_TRANSLATOR(7)
+
+const sample_to_rmt_t ws2812rmt_translators[8] = {
+  ws2812rmt_translate_0, ws2812rmt_translate_1, ws2812rmt_translate_2, ws2812rmt_translate_3,
+  ws2812rmt_translate_4, ws2812rmt_translate_5, ws2812rmt_translate_6, ws2812rmt_translate_7,
+};
+
+/**
+ * Adds a time in us to a histogram, where bucket n counts times less than (1 << shift) << n us.
+ *
+ * This only does a few shifts, so it can be used on every frame and in interrupts.
+ */
+static inline void ws2812rmt_record_us(uint32_t* histogram, uint32_t* max_us, uint32_t us, int shift) {
+  uint32_t scaled = us >> shift;
+  int bucket = scaled == 0 ? 0 : 32 - __builtin_clz(scaled);
+  if(bucket >= WS2812RMT_TIME_BUCKETS) bucket = WS2812RMT_TIME_BUCKETS - 1;
+  ++histogram[bucket];
+  if(us > *max_us) *max_us = us;
+}
+
+/**
+ * Adds a time measured in CPU cycles to a histogram, see ws2812rmt_record_us.
+ *
+ * Each core has its own cycle counter, so both ends of the time must be read on the same core.
+ */
+static inline void ws2812rmt_record_time(uint32_t* histogram, uint32_t* max_us, uint32_t cycles, int shift) {
+  ws2812rmt_record_us(histogram, max_us, cycles / CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ, shift);
+}
+
+/** Forwards the RMT end of transmission interrupt to the channel's done callback */
+void ws2812rmt_tx_end(rmt_channel_t channel, void* arg) {
+  ws2812rmt_t ctx = ws2812rmt_ctx + channel;
+  /*
+   * The frame may have been started on the other core (like the pipelined led_ring task),
+   * so the wire time is measured with esp_timer, which is the same on both cores.
+   */
+  ws2812rmt_record_us(ctx->stats.wire_histogram, &ctx->stats.max_wire_us,
+      esp_timer_get_time() - ctx->tx_start_us, WS2812RMT_WIRE_SHIFT);
+  if(ctx->done_callback) ctx->done_callback(ctx, ctx->done_arg);
+}
 
 /** Initializes the RMT engine to transmit on a specified GPIO */
 void ws2812rmt_init_rmt(rmt_channel_t channel, gpio_num_t gpio_num) {
@@ -68,11 +288,53 @@ void ws2812rmt_init_rmt(rmt_channel_t channel, gpio_num_t gpio_num) {
   rmt_config(&rmt_tx);
 
   ESP_ERROR_CHECK(rmt_driver_install(channel, 0, 0));
+  rmt_register_tx_end_callback(ws2812rmt_tx_end, NULL);
+}
+
+
+/** Calculates the level of each color value from the gamma and brightness */
+void ws2812rmt_init_levels(ws2812rmt_t ctx) {
+  for(int value=0; value < 256; ++value) {
+    float level = powf(value / 255.0f, ctx->gamma) * ctx->brightness;
+    ctx->levels[value] = (uint8_t)(level + 0.5f);
+  }
+}
+
+
+/** Allocates the copy of the last frame sent and resets the stats and levels */
+bool ws2812rmt_init_last_colors(ws2812rmt_t ctx) {
+  ctx->last_color_count = 0;
+  ctx->last_num_values = 0;
+  memset(&ctx->stats, 0, sizeof(ctx->stats));
+  ctx->brightness = 255;
+  ctx->gamma = 1.0f;
+  ws2812rmt_init_levels(ctx);
+  ctx->last_colors = malloc(ctx->led_count * sizeof(rgb_t));
+  if(!ctx->last_colors) {
+    ESP_LOGE(LOG_WS2812, "Failed to allocate %d byte last frame buffer", ctx->led_count * sizeof(rgb_t));
+    return false;
+  }
+
+  return true;
+}
+
+
+/** Sets the chipset of a context */
+void ws2812rmt_init_chipset_items(ws2812rmt_t ctx, const ws2812rmt_chipset_t* chipset) {
+  ctx->chipset = chipset;
+  ctx->items_per_led = chipset->bytes_per_led * 8;
 }
 
 
 ws2812rmt_t ws2812rmt_init(rmt_channel_t channel, gpio_num_t gpio_num, int led_count) {
-  ESP_LOGI(LOG_WS2812, "Initializing ws2812rmt context with channel %d and gpio_num %d", channel, gpio_num);
+  return ws2812rmt_init_chipset(channel, gpio_num, led_count, WS2812RMT_DEFAULT_CHIPSET);
+}
+
+
+ws2812rmt_t ws2812rmt_init_chipset(rmt_channel_t channel, gpio_num_t gpio_num, int led_count,
+    const ws2812rmt_chipset_t* chipset) {
+  ESP_LOGI(LOG_WS2812, "Initializing %s ws2812rmt context with channel %d and gpio_num %d",
+      chipset->name, channel, gpio_num);
   if(led_count <= 0) {
     ESP_LOGE(LOG_WS2812, "led_count %d is invalid", led_count);
     return NULL;
@@ -82,14 +344,55 @@ ws2812rmt_t ws2812rmt_init(rmt_channel_t channel, gpio_num_t gpio_num, int led_c
   ctx->channel = channel;
   ctx->led_count = led_count;
   ctx->static_init = false;
-  size_t buffer_size = (led_count * 24 + 1) * sizeof(rmt_item32_t);
-  ctx->tx_buffer = malloc(buffer_size);
-  if(!ctx->tx_buffer) {
-    ESP_LOGE(LOG_WS2812, "Failed to allocate %d byte buffer", buffer_size);
+  ctx->streaming = false;
+  ctx->done_callback = NULL;
+  ws2812rmt_init_chipset_items(ctx, chipset);
+  size_t buffer_size = (led_count * ctx->items_per_led + 1) * sizeof(rmt_item32_t);
+  ctx->tx_buffers[0] = malloc(buffer_size);
+  ctx->tx_buffers[1] = malloc(buffer_size);
+  if(!ctx->tx_buffers[0] || !ctx->tx_buffers[1]) {
+    ESP_LOGE(LOG_WS2812, "Failed to allocate 2 %d byte buffers", buffer_size);
+    free(ctx->tx_buffers[0]);
+    free(ctx->tx_buffers[1]);
+    return NULL;
+  }
+  ctx->tx_buffer_count = 2;
+  ctx->tx_buffer_index = 0;
+  ctx->pending_items = 0;
+  if(!ws2812rmt_init_last_colors(ctx)) {
+    free(ctx->tx_buffers[0]);
+    free(ctx->tx_buffers[1]);
+    return NULL;
+  }
+
+  ws2812rmt_init_rmt(channel, gpio_num);
+  return ctx;
+}
+
+
+ws2812rmt_t ws2812rmt_init_streaming(rmt_channel_t channel, gpio_num_t gpio_num, int led_count) {
+  ESP_LOGI(LOG_WS2812, "Initializing streaming ws2812rmt context with channel %d and gpio_num %d", channel, gpio_num);
+  if(led_count <= 0) {
+    ESP_LOGE(LOG_WS2812, "led_count %d is invalid", led_count);
     return NULL;
   }
 
+  ws2812rmt_t ctx = ws2812rmt_ctx + channel;
+  ctx->channel = channel;
+  ctx->led_count = led_count;
+  ctx->static_init = false;
+  ctx->streaming = true;
+  ctx->done_callback = NULL;
+  ws2812rmt_init_chipset_items(ctx, WS2812RMT_DEFAULT_CHIPSET);
+  ctx->tx_buffers[0] = NULL;
+  ctx->tx_buffers[1] = NULL;
+  ctx->tx_buffer_count = 0;
+  ctx->tx_buffer_index = 0;
+  ctx->pending_items = 0;
+  if(!ws2812rmt_init_last_colors(ctx)) return NULL;
+
   ws2812rmt_init_rmt(channel, gpio_num);
+  ESP_ERROR_CHECK(rmt_translator_init(channel, ws2812rmt_translators[channel]));
   return ctx;
 }
 
@@ -109,77 +412,239 @@ ws2812rmt_t ws2812rmt_init_static(rmt_channel_t channel, gpio_num_t gpio_num, in
   ws2812rmt_t ctx = ws2812rmt_ctx + channel;
   ctx->channel = channel;
   ctx->led_count = led_count;
-  ctx->static_init = false;
-  ctx->tx_buffer = tx_buffer;
+  ctx->static_init = true;
+  ctx->streaming = false;
+  ctx->done_callback = NULL;
+  ws2812rmt_init_chipset_items(ctx, WS2812RMT_DEFAULT_CHIPSET);
+  ctx->tx_buffers[0] = tx_buffer;
+  ctx->tx_buffers[1] = NULL;
+  ctx->tx_buffer_count = 1;
+  ctx->tx_buffer_index = 0;
+  ctx->pending_items = 0;
+  if(!ws2812rmt_init_last_colors(ctx)) return NULL;
 
   ws2812rmt_init_rmt(channel, gpio_num);
   return ctx;
 }
 
 
-/** Adds 8 RMT items to the tx buffer representing a single byte */
-void ws2812rmt_set_byte(ws2812rmt_t ctx, uint8_t value, int item_index) {
-  // Iterate through each bit starting at MSB (Offset by start value)
-  uint8_t mask = 0x80;
+/**
+ * Compares a frame with the last frame sent and remembers it if it is different.
+ *
+ * Only the colors are compared (in the order they are sent, starting at rotation),
+ * since the rest of a repeated frame is the same pattern.
+ * Returns true if the frame is identical to the last one sent.
+ */
+bool ws2812rmt_is_last_frame(ws2812rmt_t ctx, rgb_t* colors, int color_count, int num_values, int rotation) {
+  bool identical = ctx->last_color_count == color_count && ctx->last_num_values == num_values;
+  int color_index = rotation;
+  for(int i=0; identical && i < color_count; ++i) {
+    identical = rgb_equal(ctx->last_colors[i], colors[color_index]);
+    if(++color_index == color_count) color_index = 0;
+  }
 
-  while (mask > 0) {
-    rmt_item32_t item_for_masked_bit = (value & mask) > 0 ? ws2812rmt_item_one : ws2812rmt_item_zero;
-    ctx->tx_buffer[item_index] = item_for_masked_bit;
-    mask >>= 1;
-    ++item_index;
+  if(identical) return true;
+
+  int tail_count = color_count - rotation;
+  memcpy(ctx->last_colors, colors + rotation, tail_count * sizeof(rgb_t));
+  memcpy(ctx->last_colors + tail_count, colors, rotation * sizeof(rgb_t));
+  ctx->last_color_count = color_count;
+  ctx->last_num_values = num_values;
+  return false;
+}
+
+
+/**
+ * Encodes a frame and records what to transmit in pending_items.
+ *
+ * Returns false if there is nothing to transmit.
+ */
+bool ws2812rmt_prepare(ws2812rmt_t ctx, rgb_t* colors, int color_count, bool repeat, int rotation) {
+  ESP_LOGD(LOG_WS2812, "prepare color_count = %d, repeat = %d, rotation = %d", color_count, repeat, rotation);
+  if(!ctx) {
+    ESP_LOGE(LOG_WS2812, "ctx is invalid");
+    return false;
+  }
+
+  ctx->pending_items = 0;
+
+  if(color_count <= 0 || color_count > ctx->led_count) {
+    ESP_LOGE(LOG_WS2812, "color_count %d is invalid", color_count);
+    return false;
+  }
+
+  int num_values = ctx->led_count;
+  if(color_count < num_values && !repeat) num_values = color_count;
+
+  rotation %= color_count;
+  if(rotation < 0) rotation += color_count;
+
+  if(ws2812rmt_is_last_frame(ctx, colors, color_count, num_values, rotation)) {
+    ++ctx->stats.frames_skipped;
+    return false;
   }
+
+  ++ctx->stats.frames_sent;
+  uint32_t encode_start = xthal_get_ccount();
+
+  if(ctx->streaming) {
+    /* The translator of the previous frame may still be using the stream state */
+    ws2812rmt_wait_idle(ctx);
+
+    ctx->stream_colors = colors;
+    ctx->stream_color_count = color_count;
+    ctx->stream_color_index = rotation;
+    ctx->stream_byte_index = 0;
+
+    /* One unit per color byte plus one for the reset item */
+    ctx->pending_items = num_values * ctx->chipset->bytes_per_led + 1;
+    return true;
+  }
+
+  /* With a single buffer, the previous frame must be sent before it can be overwritten */
+  if(ctx->tx_buffer_count == 1) ws2812rmt_wait_idle(ctx);
+
+  /* Only one period of the pattern is encoded, the repeats are copies of it */
+  rmt_item32_t* items = ctx->tx_buffers[ctx->tx_buffer_index];
+  ctx->chipset->encode(items, colors, color_count, rotation, ctx->levels);
+
+  int item_count = num_values * ctx->items_per_led;
+  int encoded = color_count * ctx->items_per_led;
+  while(encoded < item_count) {
+    /* Everything encoded so far is whole periods, so it can be copied after itself */
+    int copy_count = encoded < item_count - encoded ? encoded : item_count - encoded;
+    memcpy(items + encoded, items, copy_count * sizeof(rmt_item32_t));
+    encoded += copy_count;
+  }
+
+  items[item_count] = ctx->chipset->reset;
+
+  ws2812rmt_record_time(ctx->stats.encode_histogram, &ctx->stats.max_encode_us,
+      xthal_get_ccount() - encode_start, WS2812RMT_ENCODE_SHIFT);
+
+  ctx->pending_items = item_count + 1;
+  return true;
 }
 
 
-/** Adds 24 RMT items to the tx buffer based on the given color value */
-void ws2812rmt_set_color(ws2812rmt_t ctx, rgb_t color, int led_index) {
-  int item_index = led_index * 24;
+/** Starts transmitting the frame encoded by ws2812rmt_prepare */
+void ws2812rmt_start(ws2812rmt_t ctx) {
+  if(ctx->pending_items == 0) return;
+
+  if(ctx->streaming) {
+    /* The driver only does arithmetic on src, the translator reads the colors from ctx */
+    rmt_write_sample(ctx->channel, (const uint8_t*)ctx->stream_colors, ctx->pending_items, false);
+    ctx->tx_start_us = esp_timer_get_time();
+  } else {
+    /*
+     * Waits for the previous frame (sent from the other buffer) to finish.
+     * The buffer being started was sent two frames ago and is no longer in use.
+     */
+    rmt_write_items(ctx->channel, ctx->tx_buffers[ctx->tx_buffer_index], ctx->pending_items, false);
+    ctx->tx_start_us = esp_timer_get_time();
+    if(++ctx->tx_buffer_index == ctx->tx_buffer_count) ctx->tx_buffer_index = 0;
+  }
+
+  ctx->pending_items = 0;
+}
+
+
+void ws2812rmt_cancel(ws2812rmt_t ctx) {
+  if(ctx->pending_items == 0) return;
+
+  ctx->pending_items = 0;
+  --ctx->stats.frames_sent;
 
-  ws2812rmt_set_byte(ctx, color.g, item_index);
-  ws2812rmt_set_byte(ctx, color.r, item_index + 8);
-  ws2812rmt_set_byte(ctx, color.b, item_index + 16);
+  /* last_colors holds the frame that was thrown away rather than the one last sent */
+  ctx->last_color_count = 0;
 }
 
 
-/** Adds 1 RMT item indicating that the transmission should end. */
-void ws2812rmt_set_reset(ws2812rmt_t ctx, int led_index) {
-  int item_index = led_index * 24;
+void ws2812rmt_submit_colors(ws2812rmt_t ctx, rgb_t* colors, int color_count, bool repeat) {
+  ws2812rmt_submit_rotated(ctx, colors, color_count, repeat, 0);
+}
+
 
-  ctx->tx_buffer[item_index] = ws2812rmt_item_reset;
+void ws2812rmt_submit_rotated(ws2812rmt_t ctx, rgb_t* colors, int color_count, bool repeat, int rotation) {
+  if(ws2812rmt_prepare(ctx, colors, color_count, repeat, rotation)) ws2812rmt_start(ctx);
+}
+
+
+void ws2812rmt_wait_idle(ws2812rmt_t ctx) {
+  if(!ctx) return;
+  rmt_wait_tx_done(ctx->channel, portMAX_DELAY);
 }
 
 
 void ws2812rmt_set_colors(ws2812rmt_t ctx, rgb_t* colors, int color_count, bool repeat) {
-  ESP_LOGD(LOG_WS2812, "set_colors color_count = %d, repeat = %d", color_count, repeat);
-  if(!ctx) {
-    ESP_LOGE(LOG_WS2812, "ctx is invalid");
-    return;
+  ws2812rmt_submit_colors(ctx, colors, color_count, repeat);
+  ws2812rmt_wait_idle(ctx);
+}
+
+
+void ws2812rmt_submit_frames(ws2812rmt_frame_t* frames, int frame_count) {
+  for(int i=0; i < frame_count; ++i) {
+    ws2812rmt_prepare(frames[i].ctx, frames[i].colors, frames[i].color_count, frames[i].repeat, frames[i].rotation);
   }
 
-  if(color_count <= 0 || color_count > ctx->led_count) {
-    ESP_LOGE(LOG_WS2812, "color_count %d is invalid", color_count);
-    return;
+  /* Wait for every channel first, so that starting one does not delay the others */
+  for(int i=0; i < frame_count; ++i) {
+    if(frames[i].ctx && frames[i].ctx->pending_items > 0) ws2812rmt_wait_idle(frames[i].ctx);
   }
 
-  int num_values = ctx->led_count;
-  if(color_count < num_values && !repeat) num_values = color_count;
+  for(int i=0; i < frame_count; ++i) {
+    if(frames[i].ctx) ws2812rmt_start(frames[i].ctx);
+  }
+}
+
+
+void ws2812rmt_set_frames(ws2812rmt_frame_t* frames, int frame_count) {
+  ws2812rmt_submit_frames(frames, frame_count);
+  for(int i=0; i < frame_count; ++i) ws2812rmt_wait_idle(frames[i].ctx);
+}
+
+
+void ws2812rmt_get_stats(ws2812rmt_t ctx, ws2812rmt_stats_t* stats) {
+  if(!ctx) return;
+  *stats = ctx->stats;
+}
+
+
+void ws2812rmt_set_brightness(ws2812rmt_t ctx, uint8_t brightness) {
+  if(!ctx) return;
+  ctx->brightness = brightness;
+  ws2812rmt_init_levels(ctx);
+  ctx->last_color_count = 0; /* The same colors now look different */
+}
 
-  for(int i=0; i < num_values; ++i) {
-    int color_index = i;
-    if(color_index >= color_count) color_index %= color_count;
 
-    ws2812rmt_set_color(ctx, colors[color_index], i);
+void ws2812rmt_set_gamma(ws2812rmt_t ctx, float gamma) {
+  if(!ctx) return;
+  if(gamma <= 0.0f) {
+    ESP_LOGE(LOG_WS2812, "gamma %f is invalid", gamma);
+    return;
   }
 
-  ws2812rmt_set_reset(ctx, num_values);
+  ctx->gamma = gamma;
+  ws2812rmt_init_levels(ctx);
+  ctx->last_color_count = 0; /* The same colors now look different */
+}
+
 
-  int num_items = num_values * 24 + 1;
-  rmt_write_items(ctx->channel, ctx->tx_buffer, num_items, true);
+void ws2812rmt_set_done_callback(ws2812rmt_t ctx, ws2812rmt_done_cb_t callback, void* arg) {
+  if(!ctx) return;
+  ctx->done_arg = arg;
+  ctx->done_callback = callback;
 }
 
 
 void ws2812rmt_uninit(ws2812rmt_t *ctx) {
   if(!ctx) return;
-  if(!(*ctx)->static_init) free((*ctx)->tx_buffer);
+  ws2812rmt_wait_idle(*ctx);
+  free((*ctx)->last_colors);
+  if(!(*ctx)->static_init) {
+    free((*ctx)->tx_buffers[0]);
+    free((*ctx)->tx_buffers[1]);
+  }
   ctx = NULL;
 }
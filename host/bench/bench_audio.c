@@ -0,0 +1,130 @@
+/*
+ * Copyright 2017 Sam Leitch
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Time the animation task spends analyzing sound for each frame, and how soon beats are found:
+ *
+ *   bench_audio [music.wav] [frames_per_second]
+ *
+ * The samples of each frame are played into the analysis and it is updated, as the animation task does.
+ * Without a file, music with known beats (see host_audio.h) is played, and the beats that are found
+ * and their delay from the start of the beat to the end of the frame are shown too.
+ */
+
+#include "host_audio.h"
+#include "host_bench.h"
+#include "led_audio.h"
+#include "led_audio_wav.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define SAMPLE_RATE 16000
+#define DURATION_S 20
+#define FULL_WINDOW_COUNT 100000
+#define ROUNDS 9 /* Each time is the best of the rounds, which is the least disturbed by the host */
+
+int main(int argc, char** argv) {
+  led_audio_wav_t wav;
+  int beat_count = 0;
+  if(argc > 1) {
+    if(!led_audio_wav_read(&wav, argv[1])) {
+      fprintf(stderr, "%s is not a 16 bit PCM WAV file\n", argv[1]);
+      return 1;
+    }
+  } else {
+    wav = (led_audio_wav_t){ SAMPLE_RATE, SAMPLE_RATE * DURATION_S, malloc(SAMPLE_RATE * DURATION_S * sizeof(int16_t)), 0 };
+    beat_count = host_audio_make_music(wav.samples, wav.sample_count, wav.sample_rate);
+  }
+
+  int frames_per_second = argc > 2 ? atoi(argv[2]) : 30;
+  int frame_samples = wav.sample_rate / frames_per_second;
+  int frame_count = wav.sample_count / frame_samples;
+  int64_t* frame_ns = malloc(frame_count * sizeof(int64_t));
+  for(int f=0; f < frame_count; ++f) frame_ns[f] = INT64_MAX;
+
+  /* Each frame keeps its best time over the rounds, the beats are the same every round */
+  int found = 0;
+  int false_beats = 0;
+  double delay_s = 0;
+  for(int round=0; round < ROUNDS; ++round) {
+    led_audio_t audio = led_audio_init(wav.sample_rate);
+    wav.position = 0;
+    found = false_beats = 0;
+    delay_s = 0;
+
+    int last_count = 0;
+    for(int f=0; f < frame_count; ++f) {
+      led_audio_wav_play(&wav, audio, frame_samples);
+      int64_t start = host_bench_now_ns();
+      led_audio_update(audio);
+      int64_t time = host_bench_now_ns() - start;
+      if(time < frame_ns[f]) frame_ns[f] = time;
+
+      const int32_t* inputs = led_audio_get_inputs(audio);
+      if(inputs[LED_AUDIO_INPUT_BEAT_COUNT] == last_count) continue;
+      last_count = inputs[LED_AUDIO_INPUT_BEAT_COUNT];
+
+      double since_beat = (double)wav.position / wav.sample_rate - HOST_AUDIO_FIRST_BEAT_S;
+      since_beat -= HOST_AUDIO_BEAT_INTERVAL_S * (int)(since_beat / HOST_AUDIO_BEAT_INTERVAL_S);
+      if(beat_count && since_beat >= 0 && since_beat < HOST_AUDIO_BEAT_INTERVAL_S / 2) {
+        ++found;
+        delay_s += since_beat;
+      } else {
+        ++false_beats;
+      }
+    }
+
+    led_audio_uninit(&audio);
+  }
+
+  int64_t total_ns = 0;
+  int64_t max_ns = 0;
+  for(int f=0; f < frame_count; ++f) {
+    total_ns += frame_ns[f];
+    if(frame_ns[f] > max_ns) max_ns = frame_ns[f];
+  }
+  double mean_us = total_ns / 1000.0 / frame_count;
+
+  /* The most one update can take, when a whole window is new */
+  led_audio_t audio = led_audio_init(wav.sample_rate);
+  int64_t best = INT64_MAX;
+  for(int round=0; round < ROUNDS; ++round) {
+    int64_t start = host_bench_now_ns();
+    for(int i=0; i < FULL_WINDOW_COUNT; ++i) {
+      led_audio_write(audio, wav.samples + (i * 64) % (wav.sample_count - LED_AUDIO_WINDOW_SIZE), LED_AUDIO_WINDOW_SIZE);
+      led_audio_update(audio);
+    }
+    int64_t time = host_bench_now_ns() - start;
+    if(time < best) best = time;
+  }
+  led_audio_uninit(&audio);
+
+  printf("%d samples at %d Hz, %d frames at %d fps\n", wav.sample_count, wav.sample_rate, frame_count, frames_per_second);
+  printf("update for each frame: %6.2f us mean, %6.2f us max, %.3f%% of a frame\n", mean_us, max_ns / 1000.0,
+      mean_us * frames_per_second / 10000);
+  printf("update of a whole window: %6.2f us\n", (double)best / 1000 / FULL_WINDOW_COUNT);
+  if(beat_count) {
+    printf("%d of %d beats found, %d false, %.1f ms mean delay to the end of the frame\n", found, beat_count,
+        false_beats, found ? delay_s * 1000 / found : 0);
+  } else {
+    printf("%d beats found\n", false_beats);
+  }
+
+  free(frame_ns);
+  led_audio_wav_free(&wav);
+  return 0;
+}
@@ -0,0 +1,84 @@
+/*
+ * Copyright 2017 Sam Leitch
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Time to send a frame on 2, 4 and 8 channels one after the other (ws2812rmt_set_colors on each)
+ * and in parallel (ws2812rmt_set_frames), with transmissions taking their time on the wire.
+ */
+
+#include "host_bench.h"
+#include "host_rmt.h"
+#include "ws2812rmt.h"
+
+#include <stdio.h>
+
+#define LED_COUNT 150
+#define FRAME_COUNT 20
+
+static rgb_t frames[2][LED_COUNT];
+
+/** The spread of the start times of the last transmissions on the channels, in us */
+static int64_t start_skew_us(int channel_count) {
+  int64_t first = host_rmt_get_start_us(0);
+  int64_t last = first;
+  for(int c=1; c < channel_count; ++c) {
+    int64_t start = host_rmt_get_start_us(c);
+    if(start < first) first = start;
+    if(start > last) last = start;
+  }
+  return last - first;
+}
+
+int main() {
+  for(int i=0; i < LED_COUNT; ++i) {
+    frames[0][i] = (rgb_t){ i, 0, 255 - i };
+    frames[1][i] = (rgb_t){ 0, i, i };
+  }
+
+  ws2812rmt_t channels[RMT_CHANNEL_MAX];
+  for(int c=0; c < RMT_CHANNEL_MAX; ++c) channels[c] = ws2812rmt_init(c, 18 + c, LED_COUNT);
+  host_rmt_set_wire_time(true);
+
+  printf("%d LEDs per channel, %.2f ms on the wire, %d frames\n", LED_COUNT,
+      (LED_COUNT * 24 * 1.25 + 50) / 1000, FRAME_COUNT);
+  printf("channels  sequential  parallel  speedup  start skew\n");
+
+  for(int channel_count = 2; channel_count <= RMT_CHANNEL_MAX; channel_count *= 2) {
+    int64_t start = host_bench_now_ns();
+    for(int f=0; f < FRAME_COUNT; ++f) {
+      for(int c=0; c < channel_count; ++c) ws2812rmt_set_colors(channels[c], frames[f & 1], LED_COUNT, false);
+    }
+    double sequential_ms = (host_bench_now_ns() - start) / 1e6 / FRAME_COUNT;
+
+    ws2812rmt_frame_t frame_set[RMT_CHANNEL_MAX];
+    int64_t max_skew_us = 0;
+    start = host_bench_now_ns();
+    for(int f=0; f < FRAME_COUNT; ++f) {
+      for(int c=0; c < channel_count; ++c) {
+        frame_set[c] = (ws2812rmt_frame_t){ channels[c], frames[f & 1], LED_COUNT, false, 0 };
+      }
+      ws2812rmt_set_frames(frame_set, channel_count);
+      int64_t skew_us = start_skew_us(channel_count);
+      if(skew_us > max_skew_us) max_skew_us = skew_us;
+    }
+    double parallel_ms = (host_bench_now_ns() - start) / 1e6 / FRAME_COUNT;
+
+    printf("%8d  %7.2f ms  %5.2f ms  %6.1fx  %5lld us\n", channel_count, sequential_ms, parallel_ms,
+        sequential_ms / parallel_ms, (long long)max_skew_us);
+  }
+
+  return 0;
+}
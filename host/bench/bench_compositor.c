@@ -0,0 +1,128 @@
+/*
+ * Copyright 2017 Sam Leitch
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Pixels composited per second for 1 to 8 layers.
+ *
+ * Each layer uses the next blend mode and the layers above the first are partly transparent,
+ * which is the slowest path. A copy of the blend of one channel at a time is timed the same way,
+ * for comparing with the packed blends.
+ */
+
+#include "host_bench.h"
+#include "led_compositor.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LED_COUNT 1024
+#define FRAME_COUNT 2000
+#define ROUNDS 9 /* Each time is the best of the rounds, which is the least disturbed by the host */
+
+static uint8_t layer_colors[LED_COMPOSITOR_MAX_LAYERS][LED_COUNT * 3];
+
+static const uint8_t* layer_source(void* arg, int64_t frame_number) {
+  return arg;
+}
+
+/** The blend of one channel at a time, as the compositor blended before packing the pixels */
+static void blend_channels(uint8_t* below, const uint8_t* above, int count, led_compositor_blend_t blend, int opacity) {
+  int weight = opacity + (opacity >> 7);
+  for(int i=0; i < count * 3; ++i) {
+    int blended;
+    switch(blend) {
+    case LED_COMPOSITOR_BLEND_ADD:
+      blended = below[i] + above[i] > 255 ? 255 : below[i] + above[i];
+      break;
+    case LED_COMPOSITOR_BLEND_MAX:
+      blended = below[i] > above[i] ? below[i] : above[i];
+      break;
+    case LED_COMPOSITOR_BLEND_MULTIPLY: {
+      int product = below[i] * above[i];
+      blended = (product + 1 + (product >> 8)) >> 8;
+      break;
+    }
+    default:
+      blended = above[i];
+      break;
+    }
+    below[i] = ((blended * weight) >> 8) + ((below[i] * (256 - weight)) >> 8);
+  }
+}
+
+static uint8_t layer_opacity(int layer) {
+  return layer ? 160 : 255;
+}
+
+/** Returns the rate of the compositor in millions of pixels per second */
+static double time_compositor(int layer_count) {
+  led_compositor_t compositor;
+  led_compositor_init(&compositor, LED_COUNT);
+  for(int i=0; i < layer_count; ++i) {
+    compositor.layers[i] = (led_compositor_layer_t){
+      layer_source, layer_colors[i], i % LED_COMPOSITOR_BLEND_COUNT, layer_opacity(i) };
+  }
+
+  int64_t best = INT64_MAX;
+  for(int round=0; round < ROUNDS; ++round) {
+    int64_t start = host_bench_now_ns();
+    for(int f=0; f < FRAME_COUNT; ++f) host_bench_use(led_compositor_render(&compositor, f));
+    int64_t time = host_bench_now_ns() - start;
+    if(time < best) best = time;
+  }
+
+  led_compositor_uninit(&compositor);
+  return (double)FRAME_COUNT * LED_COUNT * 1000 / best;
+}
+
+/** Returns the rate of the blend of one channel at a time in millions of pixels per second */
+static double time_channels(int layer_count) {
+  static uint8_t colors[LED_COUNT * 3];
+
+  int64_t best = INT64_MAX;
+  for(int round=0; round < ROUNDS; ++round) {
+    int64_t start = host_bench_now_ns();
+    for(int f=0; f < FRAME_COUNT; ++f) {
+      memset(colors, 0, sizeof(colors));
+      for(int i=0; i < layer_count; ++i) {
+        blend_channels(colors, layer_colors[i], LED_COUNT, i % LED_COMPOSITOR_BLEND_COUNT, layer_opacity(i));
+      }
+      host_bench_use(colors);
+    }
+    int64_t time = host_bench_now_ns() - start;
+    if(time < best) best = time;
+  }
+
+  return (double)FRAME_COUNT * LED_COUNT * 1000 / best;
+}
+
+int main() {
+  srand(1);
+  for(int i=0; i < LED_COMPOSITOR_MAX_LAYERS; ++i) {
+    for(int j=0; j < LED_COUNT * 3; ++j) layer_colors[i][j] = rand();
+  }
+
+  printf("%d LEDs, %d frames\n", LED_COUNT, FRAME_COUNT);
+  printf("layers  packed Mpixels/s  channels Mpixels/s  packed Mlayer-pixels/s\n");
+  for(int layer_count=1; layer_count <= LED_COMPOSITOR_MAX_LAYERS; ++layer_count) {
+    double packed = time_compositor(layer_count);
+    double channels = time_channels(layer_count);
+    printf("%6d  %16.1f  %18.1f  %22.1f\n", layer_count, packed, channels, packed * layer_count);
+  }
+  return 0;
+}
@@ -0,0 +1,121 @@
+/*
+ * Copyright 2017 Sam Leitch
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Time each LED takes to run representative effect programs, from a single color to the longest program
+ * the frame budget allows, and the time of each operation.
+ */
+
+#include "host_bench.h"
+#include "led_effect.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define LED_COUNT 1024
+#define FRAME_COUNT 500
+#define ROUNDS 9 /* Each time is the best of the rounds, which is the least disturbed by the host */
+
+/* A program with the header of an effect at 30 fps without parameters */
+#define NO_PARAMS 0x1e, 0x00
+
+typedef struct bench_effect_program_s {
+  const char* name;
+  const uint8_t* upload;
+  size_t size;
+} bench_effect_program_t;
+
+/* Dim blue on every LED */
+static const uint8_t solid[] = { NO_PARAMS, 0x01, 0x00, 0x01, 0x00, 0x01, 0x40 };
+
+/* The spinning rainbow of README.md, one hue step per frame */
+static const uint8_t rainbow[] = {
+  0x1e, 0x01, 0x01, 0x00, 0x10, 0x02, 0x00, 0x01, 0x32, 0x11, 0x33, 0x13, 0x14, 0x00, 0x32, 0x30, 0x51 };
+
+/* A wave moving along the ring, full in red, half in green and a quarter in blue */
+static const uint8_t wave[] = {
+  NO_PARAMS, 0x10, 0x01, 0x10, 0x32, 0x13, 0x01, 0x04, 0x32, 0x30, 0x50,
+  0x20, 0x01, 0x01, 0x3c, 0x23, 0x01, 0x02, 0x3c };
+
+/* White sparkles on the LEDs whose hash of index and frame is high */
+static const uint8_t sparkle[] = {
+  NO_PARAMS, 0x10, 0x13, 0x3a, 0x02, 0x39, 0x30, 0x32, 0x20, 0x01, 0x07, 0x3c, 0x3a,
+  0x01, 0xff, 0x38, 0x01, 0xf0, 0x41, 0x01, 0xff, 0x01, 0x00, 0x43, 0x20, 0x20 };
+
+/* Filled in by main, the most additions the frame budget allows */
+static uint8_t longest[2 + LED_EFFECT_MAX_CODE_SIZE] = { NO_PARAMS };
+
+/** Fills longest with a value, additions of 1 up to the budget of LED_COUNT LEDs, and DUP DUP. Returns its size. */
+static size_t make_longest() {
+  int max_ops = LED_EFFECT_MAX_OPS_PER_FRAME / LED_COUNT;
+  size_t size = 2;
+  longest[size++] = LED_EFFECT_OP_PUSH8;
+  longest[size++] = 0;
+  for(int ops = 1 + 2 + 2; ops <= max_ops && size + 3 + 2 <= sizeof(longest); ops += 2) {
+    longest[size++] = LED_EFFECT_OP_PUSH8;
+    longest[size++] = 1;
+    longest[size++] = LED_EFFECT_OP_ADD;
+  }
+  longest[size++] = LED_EFFECT_OP_DUP;
+  longest[size++] = LED_EFFECT_OP_DUP;
+  return size;
+}
+
+/** Returns the time of a frame in ns, the best of the rounds */
+static double time_effect(const led_effect_t* effect) {
+  static uint8_t colors[LED_COUNT * 3];
+  int32_t inputs[LED_EFFECT_MAX_INPUTS] = { 0 };
+
+  int64_t best = INT64_MAX;
+  for(int round=0; round < ROUNDS; ++round) {
+    int64_t start = host_bench_now_ns();
+    for(int f=0; f < FRAME_COUNT; ++f) {
+      led_effect_render(effect, f, inputs, colors, LED_COUNT);
+      host_bench_use(colors);
+    }
+    int64_t time = host_bench_now_ns() - start;
+    if(time < best) best = time;
+  }
+
+  return (double)best / FRAME_COUNT;
+}
+
+int main() {
+  const bench_effect_program_t programs[] = {
+    { "solid", solid, sizeof(solid) },
+    { "rainbow", rainbow, sizeof(rainbow) },
+    { "wave", wave, sizeof(wave) },
+    { "sparkle", sparkle, sizeof(sparkle) },
+    { "longest", longest, make_longest() },
+  };
+
+  printf("%d LEDs, %d frames, at most %d operations for each LED\n", LED_COUNT, FRAME_COUNT,
+      LED_EFFECT_MAX_OPS_PER_FRAME / LED_COUNT);
+  printf("program  operations  ns/pixel  ns/operation  us/frame\n");
+  for(int i=0; i < sizeof(programs) / sizeof(programs[0]); ++i) {
+    led_effect_t effect;
+    if(!led_effect_load(&effect, programs[i].upload, programs[i].size, LED_COUNT)) {
+      printf("%s was rejected\n", programs[i].name);
+      return 1;
+    }
+
+    double frame_ns = time_effect(&effect);
+    printf("%-7s  %10d  %8.1f  %12.2f  %8.1f\n", programs[i].name, effect.op_count, frame_ns / LED_COUNT,
+        frame_ns / LED_COUNT / effect.op_count, frame_ns / 1000);
+  }
+  return 0;
+}
@@ -0,0 +1,104 @@
+/*
+ * Copyright 2017 Sam Leitch
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Time to encode an LED with the nibble table encoder of ws2812rmt_prepare,
+ * and with the per-bit encoder it replaced.
+ */
+
+#include "host_bench.h"
+#include "host_rmt.h"
+#include "ws2812rmt.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LED_COUNT 1000
+#define FRAME_COUNT 2000
+
+static rmt_item32_t item_zero = { .duration0 = 32, .level0 = 1, .duration1 = 64, .level1 = 0 };
+static rmt_item32_t item_one = { .duration0 = 68, .level0 = 1, .duration1 = 36, .level1 = 0 };
+static rmt_item32_t item_reset = { .duration0 = 4000, .level0 = 0, .duration1 = 0, .level1 = 0 };
+
+static rmt_item32_t per_bit_items[LED_COUNT * 24 + 1];
+
+/* The encoder before the nibble table: a branch per bit and a modulo per LED */
+static void per_bit_set_byte(uint8_t value, int item_index) {
+  uint8_t mask = 0x80;
+
+  while (mask > 0) {
+    rmt_item32_t item_for_masked_bit = (value & mask) > 0 ? item_one : item_zero;
+    per_bit_items[item_index] = item_for_masked_bit;
+    mask >>= 1;
+    ++item_index;
+  }
+}
+
+static void per_bit_set_colors(rgb_t* colors, int color_count, int num_values) {
+  for(int i=0; i < num_values; ++i) {
+    int color_index = i;
+    if(color_index >= color_count) color_index %= color_count;
+
+    int item_index = i * 24;
+    per_bit_set_byte(colors[color_index].g, item_index);
+    per_bit_set_byte(colors[color_index].r, item_index + 8);
+    per_bit_set_byte(colors[color_index].b, item_index + 16);
+  }
+  per_bit_items[num_values * 24] = item_reset;
+}
+
+int main() {
+  static rgb_t frames[2][LED_COUNT];
+  srand(1);
+  for(int f=0; f < 2; ++f) {
+    for(int i=0; i < LED_COUNT; ++i) frames[f][i] = (rgb_t){ rand(), rand(), rand() };
+  }
+
+  ws2812rmt_t ctx = ws2812rmt_init(RMT_CHANNEL_0, 18, LED_COUNT);
+
+  /* Both encoders send the same bytes */
+  ws2812rmt_set_colors(ctx, frames[0], LED_COUNT, false);
+  static uint8_t sent[LED_COUNT * 3];
+  static uint8_t decoded[LED_COUNT * 3];
+  host_rmt_get_frame(RMT_CHANNEL_0, sent, sizeof(sent));
+  per_bit_set_colors(frames[0], LED_COUNT, LED_COUNT);
+  int size = host_rmt_decode(per_bit_items, LED_COUNT * 24 + 1, 1, &host_rmt_timing_ws2812b, decoded, sizeof(decoded));
+  if(size != sizeof(decoded) || memcmp(sent, decoded, sizeof(sent)) != 0) {
+    printf("The encoders do not send the same bytes\n");
+    return 1;
+  }
+
+  int64_t start = host_bench_now_ns();
+  for(int f=0; f < FRAME_COUNT; ++f) {
+    per_bit_set_colors(frames[f & 1], LED_COUNT, LED_COUNT);
+    host_bench_use(per_bit_items);
+  }
+  double per_bit_ns = (double)(host_bench_now_ns() - start) / FRAME_COUNT / LED_COUNT;
+
+  /* Cancelling makes the next frame different from the last one, so every frame is encoded */
+  start = host_bench_now_ns();
+  for(int f=0; f < FRAME_COUNT; ++f) {
+    ws2812rmt_prepare(ctx, frames[f & 1], LED_COUNT, false, 0);
+    ws2812rmt_cancel(ctx);
+  }
+  double table_ns = (double)(host_bench_now_ns() - start) / FRAME_COUNT / LED_COUNT;
+
+  printf("%d LEDs, %d frames\n", LED_COUNT, FRAME_COUNT);
+  printf("per-bit encoder:      %6.2f ns/LED\n", per_bit_ns);
+  printf("nibble table encoder: %6.2f ns/LED (%.1fx)\n", table_ns, per_bit_ns / table_ns);
+  return 0;
+}
@@ -0,0 +1,125 @@
+/*
+ * Copyright 2017 Sam Leitch
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Cost of applying gamma and brightness while encoding.
+ *
+ * A copy of the nibble table encoder is timed without and with the level lookup, then
+ * ws2812rmt_prepare is timed at the default levels and with brightness and gamma set.
+ */
+
+#include "host_bench.h"
+#include "ws2812rmt.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LED_COUNT 1000
+#define FRAME_COUNT 1000
+#define ROUNDS 9 /* Each time is the best of the rounds, which is the least disturbed by the host */
+
+static rmt_item32_t nibbles[16][4];
+static rmt_item32_t items[LED_COUNT * 24 + 1];
+static uint8_t levels[256];
+
+static inline void set_byte(rmt_item32_t* dest, uint8_t value) {
+  memcpy(dest, nibbles[value >> 4], sizeof(nibbles[0]));
+  memcpy(dest + 4, nibbles[value & 0x0F], sizeof(nibbles[0]));
+}
+
+static void encode_plain(const rgb_t* colors) {
+  rmt_item32_t* dest = items;
+  for(int i=0; i < LED_COUNT; ++i) {
+    set_byte(dest, colors[i].g);
+    set_byte(dest + 8, colors[i].r);
+    set_byte(dest + 16, colors[i].b);
+    dest += 24;
+  }
+}
+
+static void encode_levels(const rgb_t* colors) {
+  rmt_item32_t* dest = items;
+  for(int i=0; i < LED_COUNT; ++i) {
+    set_byte(dest, levels[colors[i].g]);
+    set_byte(dest + 8, levels[colors[i].r]);
+    set_byte(dest + 16, levels[colors[i].b]);
+    dest += 24;
+  }
+}
+
+static double time_encoder(void (*encode)(const rgb_t*), rgb_t frames[2][LED_COUNT]) {
+  int64_t best = INT64_MAX;
+  for(int round=0; round < ROUNDS; ++round) {
+    int64_t start = host_bench_now_ns();
+    for(int f=0; f < FRAME_COUNT; ++f) {
+      encode(frames[f & 1]);
+      host_bench_use(items);
+    }
+    int64_t time = host_bench_now_ns() - start;
+    if(time < best) best = time;
+  }
+  return (double)best / FRAME_COUNT / LED_COUNT;
+}
+
+static double time_prepare(ws2812rmt_t ctx, rgb_t frames[2][LED_COUNT]) {
+  int64_t best = INT64_MAX;
+  for(int round=0; round < ROUNDS; ++round) {
+    int64_t start = host_bench_now_ns();
+    for(int f=0; f < FRAME_COUNT; ++f) {
+      ws2812rmt_prepare(ctx, frames[f & 1], LED_COUNT, false, 0);
+      ws2812rmt_cancel(ctx);
+    }
+    int64_t time = host_bench_now_ns() - start;
+    if(time < best) best = time;
+  }
+  return (double)best / FRAME_COUNT / LED_COUNT;
+}
+
+int main() {
+  static rgb_t frames[2][LED_COUNT];
+  srand(1);
+  for(int f=0; f < 2; ++f) {
+    for(int i=0; i < LED_COUNT; ++i) frames[f][i] = (rgb_t){ rand(), rand(), rand() };
+  }
+
+  rmt_item32_t zero = {{{ 32, 1, 64, 0 }}};
+  rmt_item32_t one = {{{ 68, 1, 36, 0 }}};
+  for(int nibble=0; nibble < 16; ++nibble) {
+    for(int bit=0; bit < 4; ++bit) nibbles[nibble][bit] = (nibble & (0x8 >> bit)) ? one : zero;
+  }
+  for(int value=0; value < 256; ++value) levels[value] = (uint8_t)(powf(value / 255.0f, 2.2f) * 128 + 0.5f);
+
+  double plain_ns = time_encoder(encode_plain, frames);
+  double levels_ns = time_encoder(encode_levels, frames);
+
+  ws2812rmt_t ctx = ws2812rmt_init(RMT_CHANNEL_0, 18, LED_COUNT);
+  double default_ns = time_prepare(ctx, frames);
+  ws2812rmt_set_brightness(ctx, 128);
+  ws2812rmt_set_gamma(ctx, 2.2f);
+  double corrected_ns = time_prepare(ctx, frames);
+
+  printf("%d LEDs, %d frames\n", LED_COUNT, FRAME_COUNT);
+  printf("encoder without levels:                 %6.2f ns/LED\n", plain_ns);
+  printf("encoder with levels:                    %6.2f ns/LED (%+.1f%%)\n", levels_ns,
+      100 * (levels_ns - plain_ns) / plain_ns);
+  printf("ws2812rmt_prepare, default levels:      %6.2f ns/LED\n", default_ns);
+  printf("ws2812rmt_prepare, brightness 128, 2.2: %6.2f ns/LED (%+.1f%%)\n", corrected_ns,
+      100 * (corrected_ns - default_ns) / default_ns);
+  return 0;
+}
@@ -0,0 +1,129 @@
+/*
+ * Copyright 2017 Sam Leitch
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Cost of led_ring PUT requests in JSON and in the binary format.
+ *
+ * The same commands are sent to the led_ring resource through the PUT handler, timing the requests
+ * and counting what they allocate. The handler also shows each command on the ring, which is the
+ * same for both formats, so the difference between them is the cost of parsing.
+ */
+
+#include "host_bench.h"
+#include "host_coap.h"
+#include "led_ring.h"
+#include "led_ring_resource.h"
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define REQUEST_COUNT 100000
+#define ROUNDS 5 /* The time is the best of the rounds, which is the least disturbed by the host */
+
+/* Allocations counted by the malloc wrappers (see CMakeLists.txt) */
+static atomic_long allocations;
+static atomic_long allocated_bytes;
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* pointer, size_t size);
+
+void* __wrap_malloc(size_t size) {
+  atomic_fetch_add(&allocations, 1);
+  atomic_fetch_add(&allocated_bytes, size);
+  return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t count, size_t size) {
+  atomic_fetch_add(&allocations, 1);
+  atomic_fetch_add(&allocated_bytes, count * size);
+  return __real_calloc(count, size);
+}
+
+void* __wrap_realloc(void* pointer, size_t size) {
+  atomic_fetch_add(&allocations, 1);
+  atomic_fetch_add(&allocated_bytes, size);
+  return __real_realloc(pointer, size);
+}
+
+typedef struct request_s {
+  const char* name;
+  unsigned int content_format;
+  const uint8_t* payload;
+  size_t size;
+} request_t;
+
+static const uint8_t solid_json[] = "[\"solid_color\",64,0,0]";
+static const uint8_t solid_binary[] = { LED_RING_MODE_SOLID_COLOR, 64, 0, 0 };
+static const uint8_t rainbow_json[] = "[\"static_rainbow\",128,0,85]";
+static const uint8_t rainbow_binary[] = { LED_RING_MODE_STATIC_RAINBOW, 128, 0, 85 };
+
+static const request_t requests[] = {
+  { "solid_color JSON", COAP_MEDIATYPE_APPLICATION_JSON, solid_json, sizeof(solid_json) - 1 },
+  { "solid_color binary", COAP_MEDIATYPE_APPLICATION_OCTET_STREAM, solid_binary, sizeof(solid_binary) },
+  { "static_rainbow JSON", COAP_MEDIATYPE_APPLICATION_JSON, rainbow_json, sizeof(rainbow_json) - 1 },
+  { "static_rainbow binary", COAP_MEDIATYPE_APPLICATION_OCTET_STREAM, rainbow_binary, sizeof(rainbow_binary) },
+};
+
+static void run_request(coap_context_t* context, coap_resource_t* resource, const request_t* request) {
+  coap_pdu_t* pdu = coap_pdu_init(COAP_MESSAGE_CON, COAP_REQUEST_PUT, 1, COAP_MAX_PDU_SIZE);
+  unsigned char buf[4];
+  unsigned int len = coap_encode_var_bytes(buf, request->content_format);
+  coap_add_option(pdu, COAP_OPTION_CONTENT_TYPE, len, buf);
+  coap_add_data(pdu, request->size, request->payload);
+  coap_pdu_t* response = coap_pdu_init(COAP_MESSAGE_ACK, 0, 1, COAP_MAX_PDU_SIZE);
+
+  if(host_coap_request(context, resource, NULL, pdu, response) != COAP_RESPONSE_CODE(204)) {
+    printf("%s was rejected\n", request->name);
+    exit(1);
+  }
+
+  int64_t best = INT64_MAX;
+  long round_allocations = 0;
+  long round_bytes = 0;
+  for(int round=0; round < ROUNDS; ++round) {
+    long start_allocations = atomic_load(&allocations);
+    long start_bytes = atomic_load(&allocated_bytes);
+    int64_t start = host_bench_now_ns();
+    for(int i=0; i < REQUEST_COUNT; ++i) host_coap_request(context, resource, NULL, pdu, response);
+    int64_t time = host_bench_now_ns() - start;
+
+    if(time < best) best = time;
+    round_allocations = atomic_load(&allocations) - start_allocations;
+    round_bytes = atomic_load(&allocated_bytes) - start_bytes;
+  }
+
+  printf("%-22s %9.0f requests/s %6.0f ns/request %5.1f allocations/request %6.1f bytes/request\n",
+      request->name, 1e9 * REQUEST_COUNT / best, (double)best / REQUEST_COUNT,
+      (double)round_allocations / REQUEST_COUNT, (double)round_bytes / REQUEST_COUNT);
+
+  coap_delete_pdu(response);
+  coap_delete_pdu(pdu);
+}
+
+int main() {
+  coap_context_t* context = coap_new_context(NULL);
+  led_ring_t ring = led_ring_init(RMT_CHANNEL_0, 18, 24);
+  led_ring_resource_init(context, ring);
+  coap_resource_t* resource = host_coap_find_resource(context, "led_ring");
+
+  printf("%d PUT requests to led_ring, 24 LEDs\n", REQUEST_COUNT);
+  for(int i=0; i < sizeof(requests) / sizeof(requests[0]); ++i) run_request(context, resource, requests + i);
+  return 0;
+}
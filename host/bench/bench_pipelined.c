@@ -0,0 +1,85 @@
+/*
+ * Copyright 2017 Sam Leitch
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Frames per second of led_ring_init and led_ring_init_pipelined on a long strip, with transmissions taking
+ * their time on the wire.
+ *
+ * Each frame comes from a source loop at the fastest rate the wire allows, and takes a set time to render,
+ * standing in for an effect or for the time the ESP32 takes to encode a long strip. led_ring_init renders
+ * each frame at its deadline, so it starts late and misses the next deadline once rendering and sending take
+ * longer than a frame. The pipelined ring renders the next frame while the current one is on the wire.
+ */
+
+#include "host_bench.h"
+#include "host_rmt.h"
+#include "led_ring.h"
+
+#include <freertos/task.h>
+#include <stdio.h>
+
+#define LED_COUNT 1000 /* 30 ms on the wire */
+#define FRAME_RATE 30 /* A frame every 33 ms */
+#define MEASURE_MS 2000
+
+static rgb_t frame[LED_COUNT];
+static int64_t render_ns;
+
+/** Renders a frame that changes every time, taking render_ns */
+static rgb_t* slow_source(void* arg, int64_t frame_number) {
+  int64_t start = host_bench_now_ns();
+  for(int i=0; i < LED_COUNT; ++i) frame[i] = (rgb_t){ frame_number, i, i >> 8 };
+  while(host_bench_now_ns() - start < render_ns) host_bench_use(frame);
+  return frame;
+}
+
+/** Returns the frames per second sent by the ring on channel */
+static double measure_frame_rate(led_ring_t ring, rmt_channel_t channel) {
+  led_ring_start_source_loop_at_rate(ring, slow_source, NULL, FRAME_RATE);
+  vTaskDelay(pdMS_TO_TICKS(200));
+
+  uint32_t first_frame = host_rmt_get_frame_count(channel);
+  int64_t start = host_bench_now_ns();
+  vTaskDelay(pdMS_TO_TICKS(MEASURE_MS));
+  uint32_t frames = host_rmt_get_frame_count(channel) - first_frame;
+  int64_t time = host_bench_now_ns() - start;
+
+  led_ring_stop_loop(ring);
+  led_ring_wait_taken(ring);
+  vTaskDelay(pdMS_TO_TICKS(100));
+  return frames * 1e9 / time;
+}
+
+int main() {
+  led_ring_t ring = led_ring_init(RMT_CHANNEL_0, 18, LED_COUNT);
+  led_ring_t pipelined = led_ring_init_pipelined(RMT_CHANNEL_1, 19, LED_COUNT, 1);
+  host_rmt_set_wire_time(true);
+
+  printf("%d LEDs, %.2f ms on the wire, %d fps loop, %d ms for each rate\n", LED_COUNT,
+      (LED_COUNT * 24 * 1.25 + 50) / 1000, FRAME_RATE, MEASURE_MS);
+  printf("render  led_ring_init  pipelined  improvement\n");
+
+  const int render_ms[] = { 0, 5, 10, 20, 30 };
+  for(int i=0; i < sizeof(render_ms) / sizeof(render_ms[0]); ++i) {
+    render_ns = render_ms[i] * 1000000LL;
+    double plain_fps = measure_frame_rate(ring, RMT_CHANNEL_0);
+    double pipelined_fps = measure_frame_rate(pipelined, RMT_CHANNEL_1);
+    printf("%3d ms  %9.1f fps  %5.1f fps  %10.2fx\n", render_ms[i], plain_fps, pipelined_fps,
+        pipelined_fps / plain_fps);
+  }
+
+  return 0;
+}
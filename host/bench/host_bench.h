@@ -0,0 +1,40 @@
+/*
+ * Copyright 2017 Sam Leitch
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HOST_BENCH_H_
+#define HOST_BENCH_H_
+
+#include <stdint.h>
+#include <time.h>
+
+/**
+ * Timing for the host benchmarks. The numbers are for comparing two ways of doing the same
+ * thing on the same computer, they are not the time the ESP32 takes.
+ */
+
+/** A monotonic time in ns */
+static inline int64_t host_bench_now_ns() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/** Keeps the compiler from dropping a computation whose result is not used */
+static inline void host_bench_use(const void* data) {
+  __asm__ volatile("" : : "r"(data) : "memory");
+}
+
+#endif /* HOST_BENCH_H_ */
@@ -0,0 +1,172 @@
+/*
+ * Copyright 2017 Sam Leitch
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cJSON.h>
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+static const char* host_json_skip(const char* in) {
+  while(in && *in && (unsigned char)*in <= ' ') ++in;
+  return in;
+}
+
+static const char* host_json_value(cJSON* item, const char* in);
+
+/** Parses a string without unicode escapes into a new buffer */
+static const char* host_json_string(char** out, const char* in) {
+  if(*in != '"') return NULL;
+  const char* end = ++in;
+  size_t length = 0;
+  for(; *end && *end != '"'; ++end, ++length) {
+    if(*end == '\\' && !*++end) return NULL;
+  }
+  if(*end != '"') return NULL;
+
+  char* value = malloc(length + 1);
+  if(!value) return NULL;
+  char* copy = value;
+  for(; in < end; ++in) {
+    if(*in != '\\') {
+      *copy++ = *in;
+      continue;
+    }
+    switch(*++in) {
+      case 'n': *copy++ = '\n'; break;
+      case 't': *copy++ = '\t'; break;
+      case 'r': *copy++ = '\r'; break;
+      case 'b': *copy++ = '\b'; break;
+      case 'f': *copy++ = '\f'; break;
+      case 'u': free(value); return NULL;
+      default: *copy++ = *in; break;
+    }
+  }
+  *copy = 0;
+  *out = value;
+  return end + 1;
+}
+
+/** Parses the members of an array or object up to close */
+static const char* host_json_children(cJSON* item, const char* in, char close, bool keys) {
+  in = host_json_skip(in + 1);
+  if(*in == close) return in + 1;
+
+  cJSON* last = NULL;
+  for(;;) {
+    cJSON* child = calloc(1, sizeof(cJSON));
+    if(!child) return NULL;
+    if(last) {
+      last->next = child;
+      child->prev = last;
+    } else {
+      item->child = child;
+    }
+    last = child;
+
+    if(keys) {
+      in = host_json_string(&child->string, host_json_skip(in));
+      in = host_json_skip(in);
+      if(!in || *in != ':') return NULL;
+      ++in;
+    }
+
+    in = host_json_skip(host_json_value(child, host_json_skip(in)));
+    if(!in) return NULL;
+    if(*in == close) return in + 1;
+    if(*in != ',') return NULL;
+    ++in;
+  }
+}
+
+static const char* host_json_value(cJSON* item, const char* in) {
+  if(!in) return NULL;
+  if(!strncmp(in, "null", 4)) {
+    item->type = cJSON_NULL;
+    return in + 4;
+  }
+  if(!strncmp(in, "false", 5)) {
+    item->type = cJSON_False;
+    return in + 5;
+  }
+  if(!strncmp(in, "true", 4)) {
+    item->type = cJSON_True;
+    item->valueint = 1;
+    return in + 4;
+  }
+  if(*in == '"') {
+    item->type = cJSON_String;
+    return host_json_string(&item->valuestring, in);
+  }
+  if(*in == '-' || (*in >= '0' && *in <= '9')) {
+    char* end;
+    item->type = cJSON_Number;
+    item->valuedouble = strtod(in, &end);
+    item->valueint = (int)item->valuedouble;
+    return end;
+  }
+  if(*in == '[') {
+    item->type = cJSON_Array;
+    return host_json_children(item, in, ']', false);
+  }
+  if(*in == '{') {
+    item->type = cJSON_Object;
+    return host_json_children(item, in, '}', true);
+  }
+  return NULL;
+}
+
+cJSON* cJSON_Parse(const char* value) {
+  cJSON* item = calloc(1, sizeof(cJSON));
+  if(!item) return NULL;
+
+  const char* end = host_json_skip(host_json_value(item, host_json_skip(value)));
+  if(!end || *end) {
+    cJSON_Delete(item);
+    return NULL;
+  }
+  return item;
+}
+
+void cJSON_Delete(cJSON* item) {
+  while(item) {
+    cJSON* next = item->next;
+    cJSON_Delete(item->child);
+    free(item->valuestring);
+    free(item->string);
+    free(item);
+    item = next;
+  }
+}
+
+int cJSON_GetArraySize(const cJSON* array) {
+  int size = 0;
+  for(cJSON* child = array ? array->child : NULL; child; child = child->next) ++size;
+  return size;
+}
+
+cJSON* cJSON_GetArrayItem(const cJSON* array, int index) {
+  cJSON* child = array ? array->child : NULL;
+  while(child && index-- > 0) child = child->next;
+  return child;
+}
+
+cJSON* cJSON_GetObjectItem(const cJSON* object, const char* string) {
+  cJSON* child = object ? object->child : NULL;
+  while(child && (!child->string || strcasecmp(child->string, string) != 0)) child = child->next;
+  return child;
+}
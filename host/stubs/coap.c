@@ -0,0 +1,265 @@
+/*
+ * Copyright 2017 Sam Leitch
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <coap.h>
+#include "host_coap.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+coap_context_t* coap_new_context(const coap_address_t* listen_addr) {
+  coap_context_t* context = calloc(1, sizeof(coap_context_t));
+  if(context && listen_addr) context->endpoint.addr = *listen_addr;
+  return context;
+}
+
+void coap_free_context(coap_context_t* context) {
+  free(context);
+}
+
+void coap_address_init(coap_address_t* addr) {
+  memset(addr, 0, sizeof(coap_address_t));
+  addr->size = sizeof(addr->addr);
+}
+
+coap_pdu_t* coap_pdu_init(unsigned char type, unsigned char code, unsigned short id, size_t size) {
+  coap_pdu_t* pdu = calloc(1, sizeof(coap_pdu_t));
+  if(!pdu) return NULL;
+  pdu->max_size = size;
+  pdu->hdr = &pdu->header;
+  pdu->header.version = 1;
+  pdu->header.type = type;
+  pdu->header.code = code;
+  pdu->header.id = id;
+  return pdu;
+}
+
+void coap_delete_pdu(coap_pdu_t* pdu) {
+  if(!pdu) return;
+  free(pdu->data);
+  free(pdu);
+}
+
+unsigned int coap_encode_var_bytes(unsigned char* buf, unsigned int val) {
+  unsigned int n = 0;
+  for(unsigned int i = val; i && n < sizeof(val); i >>= 8) ++n;
+  for(unsigned int i = n; i > 0; --i, val >>= 8) buf[i - 1] = val & 0xff;
+  return n;
+}
+
+unsigned int coap_decode_var_bytes(unsigned char* buf, unsigned int len) {
+  unsigned int val = 0;
+  for(unsigned int i = 0; i < len; ++i) val = (val << 8) | buf[i];
+  return val;
+}
+
+size_t coap_add_option(coap_pdu_t* pdu, unsigned short type, unsigned int len, const unsigned char* data) {
+  if(pdu->option_count == HOST_COAP_MAX_OPTIONS || len > HOST_COAP_MAX_OPTION_SIZE) return 0;
+  coap_opt_t* option = pdu->options + pdu->option_count++;
+  option->number = type;
+  option->length = len;
+  memcpy(option->value, data, len);
+  return len + 1;
+}
+
+int coap_add_data(coap_pdu_t* pdu, unsigned int len, const unsigned char* data) {
+  if(len == 0) return 1;
+  if(pdu->max_size && len > pdu->max_size) return 0;
+  free(pdu->data);
+  pdu->data = malloc(len);
+  if(!pdu->data) return 0;
+  memcpy(pdu->data, data, len);
+  pdu->length = len;
+  return 1;
+}
+
+int coap_get_data(coap_pdu_t* pdu, size_t* len, unsigned char** data) {
+  *len = pdu->data ? pdu->length : 0;
+  *data = pdu->data;
+  return pdu->data != NULL;
+}
+
+coap_opt_t* coap_check_option(coap_pdu_t* pdu, unsigned short type, coap_opt_iterator_t* oi) {
+  oi->pdu = pdu;
+  oi->index = 0;
+  oi->type = type;
+  oi->filtered = 1;
+  return coap_option_next(oi);
+}
+
+coap_opt_t* coap_option_next(coap_opt_iterator_t* oi) {
+  while(oi->index < oi->pdu->option_count) {
+    coap_opt_t* option = oi->pdu->options + oi->index++;
+    if(!oi->filtered || option->number == oi->type) return option;
+  }
+  return NULL;
+}
+
+unsigned short coap_opt_length(const coap_opt_t* opt) {
+  return opt->length;
+}
+
+unsigned char* coap_opt_value(coap_opt_t* opt) {
+  return opt->value;
+}
+
+coap_resource_t* coap_resource_init(const unsigned char* uri, size_t len, int flags) {
+  coap_resource_t* resource = calloc(1, sizeof(coap_resource_t));
+  if(!resource) return NULL;
+  resource->uri.s = (unsigned char*)uri;
+  resource->uri.length = len;
+  return resource;
+}
+
+void coap_register_handler(coap_resource_t* resource, unsigned char method, coap_method_handler_t handler) {
+  resource->handler[method - 1] = handler;
+}
+
+void coap_add_resource(coap_context_t* context, coap_resource_t* resource) {
+  resource->next = context->resources;
+  context->resources = resource;
+}
+
+static int host_coap_same_observer(const coap_subscription_t* subscription, const coap_address_t* peer,
+    const str* token) {
+  if(memcmp(&subscription->subscriber.addr, &peer->addr, sizeof(peer->addr)) != 0) return 0;
+  if(!token) return 1;
+  return subscription->token_length == token->length &&
+      memcmp(subscription->token, token->s, token->length) == 0;
+}
+
+coap_subscription_t* coap_find_observer(coap_resource_t* resource, const coap_address_t* peer, const str* token) {
+  for(coap_subscription_t* s = resource->subscribers; s; s = s->next) {
+    if(host_coap_same_observer(s, peer, token)) return s;
+  }
+  return NULL;
+}
+
+coap_subscription_t* coap_add_observer(coap_resource_t* resource, const coap_endpoint_t* local_interface,
+    const coap_address_t* observer, const str* token) {
+  coap_subscription_t* subscription = coap_find_observer(resource, observer, token);
+  if(subscription) return subscription;
+  if(token && token->length > sizeof(subscription->token)) return NULL;
+
+  subscription = calloc(1, sizeof(coap_subscription_t));
+  if(!subscription) return NULL;
+  subscription->subscriber = *observer;
+  if(token) {
+    subscription->token_length = token->length;
+    memcpy(subscription->token, token->s, token->length);
+  }
+  subscription->next = resource->subscribers;
+  resource->subscribers = subscription;
+  return subscription;
+}
+
+void coap_delete_observer(coap_resource_t* resource, const coap_address_t* observer, const str* token) {
+  for(coap_subscription_t** link = &resource->subscribers; *link; link = &(*link)->next) {
+    if(host_coap_same_observer(*link, observer, token)) {
+      coap_subscription_t* subscription = *link;
+      *link = subscription->next;
+      free(subscription);
+      return;
+    }
+  }
+}
+
+void coap_check_notify(coap_context_t* context) {
+  for(coap_resource_t* resource = context->resources; resource; resource = resource->next) {
+    if(!resource->observable || !resource->dirty) continue;
+    resource->dirty = 0;
+    ++context->observe;
+
+    coap_method_handler_t handler = resource->handler[COAP_REQUEST_GET - 1];
+    if(!handler) continue;
+    for(coap_subscription_t* s = resource->subscribers; s; s = s->next) {
+      str token = { s->token_length, s->token };
+      coap_pdu_t* response = coap_pdu_init(s->non ? COAP_MESSAGE_NON : COAP_MESSAGE_CON, 0, 0, COAP_MAX_PDU_SIZE);
+      handler(context, resource, &context->endpoint, &s->subscriber, NULL, &token, response);
+      coap_delete_pdu(response);
+    }
+  }
+}
+
+int coap_get_block(coap_pdu_t* pdu, unsigned short type, coap_block_t* block) {
+  coap_opt_iterator_t opt_iter;
+  coap_opt_t* option = coap_check_option(pdu, type, &opt_iter);
+  if(!option) return 0;
+
+  unsigned int value = coap_decode_var_bytes(coap_opt_value(option), coap_opt_length(option));
+  block->num = value >> 4;
+  block->m = (value >> 3) & 1;
+  block->szx = value & 7;
+  return 1;
+}
+
+int coap_write_block_opt(coap_block_t* block, unsigned short type, coap_pdu_t* pdu, size_t data_length) {
+  size_t start = (size_t)block->num << (block->szx + 4);
+  if(data_length && start >= data_length) return -1;
+
+  block->m = start + ((size_t)1 << (block->szx + 4)) < data_length;
+
+  unsigned char buf[3];
+  unsigned int value = (block->num << 4) | (block->m << 3) | block->szx;
+  coap_add_option(pdu, type, coap_encode_var_bytes(buf, value), buf);
+  return 1;
+}
+
+int coap_add_block(coap_pdu_t* pdu, unsigned int len, const unsigned char* data, unsigned int block_num,
+    unsigned char block_szx) {
+  size_t start = (size_t)block_num << (block_szx + 4);
+  if(len <= start) return 0;
+
+  size_t size = len - start;
+  if(size > ((size_t)1 << (block_szx + 4))) size = (size_t)1 << (block_szx + 4);
+  return coap_add_data(pdu, size, data + start);
+}
+
+coap_resource_t* host_coap_find_resource(coap_context_t* context, const char* uri) {
+  for(coap_resource_t* resource = context->resources; resource; resource = resource->next) {
+    if(resource->uri.length == strlen(uri) && memcmp(resource->uri.s, uri, resource->uri.length) == 0) {
+      return resource;
+    }
+  }
+  return NULL;
+}
+
+int host_coap_request(coap_context_t* context, coap_resource_t* resource, const coap_address_t* peer,
+    coap_pdu_t* request, coap_pdu_t* response) {
+  coap_method_handler_t handler = resource->handler[request->hdr->code - 1];
+  if(!handler) return 0;
+
+  coap_address_t default_peer;
+  if(!peer) {
+    coap_address_init(&default_peer);
+    default_peer.addr.sin.sin_family = AF_INET;
+    default_peer.addr.sin.sin_port = htons(COAP_DEFAULT_PORT);
+    default_peer.addr.sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    peer = &default_peer;
+  }
+
+  unsigned char token_bytes[] = "t";
+  str token = { 1, token_bytes };
+  coap_address_t from = *peer;
+  handler(context, resource, &context->endpoint, &from, request, &token, response);
+  return response->hdr->code;
+}
+
+int host_coap_observer_count(coap_resource_t* resource) {
+  int count = 0;
+  for(coap_subscription_t* s = resource->subscribers; s; s = s->next) ++count;
+  return count;
+}
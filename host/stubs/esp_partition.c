@@ -0,0 +1,89 @@
+/*
+ * Copyright 2017 Sam Leitch
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "esp_partition.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define HOST_PARTITION_MAX_MAPS 4
+
+/* The partition given by host_partition_set_file, if there is one */
+static esp_partition_t file_partition;
+static char file_path[256];
+static bool file_set = false;
+
+/* The mappings, a handle is the index plus 1 */
+static struct {
+  void* data;
+  size_t size;
+} maps[HOST_PARTITION_MAX_MAPS];
+
+bool host_partition_set_file(const char* label, const char* path) {
+  struct stat file_stat;
+  if(stat(path, &file_stat) < 0 || strlen(path) >= sizeof(file_path)) return false;
+
+  memset(&file_partition, 0, sizeof(file_partition));
+  file_partition.type = ESP_PARTITION_TYPE_DATA;
+  file_partition.subtype = ESP_PARTITION_SUBTYPE_ANY;
+  file_partition.size = file_stat.st_size;
+  snprintf(file_partition.label, sizeof(file_partition.label), "%s", label);
+  strcpy(file_path, path);
+  file_set = true;
+  return true;
+}
+
+const esp_partition_t* esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype,
+    const char* label) {
+  if(!file_set || type != file_partition.type) return NULL;
+  if(label && strcmp(label, file_partition.label) != 0) return NULL;
+  return &file_partition;
+}
+
+esp_err_t esp_partition_mmap(const esp_partition_t* partition, uint32_t offset, uint32_t size,
+    spi_flash_mmap_memory_t memory, const void** out_ptr, spi_flash_mmap_handle_t* out_handle) {
+  if(partition != &file_partition || !file_set) return ESP_ERR_NOT_FOUND;
+  if(offset > partition->size || size > partition->size - offset) return ESP_ERR_INVALID_ARG;
+
+  int map = 0;
+  while(map < HOST_PARTITION_MAX_MAPS && maps[map].data) ++map;
+  if(map == HOST_PARTITION_MAX_MAPS) return ESP_ERR_NO_MEM;
+
+  int fd = open(file_path, O_RDONLY);
+  if(fd < 0) return ESP_ERR_NOT_FOUND;
+
+  /* The whole file is mapped, since mmap offsets have to be page aligned */
+  void* data = mmap(NULL, partition->size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if(data == MAP_FAILED) return ESP_ERR_NO_MEM;
+
+  maps[map].data = data;
+  maps[map].size = partition->size;
+  *out_ptr = (const uint8_t*)data + offset;
+  *out_handle = map + 1;
+  return ESP_OK;
+}
+
+void spi_flash_munmap(spi_flash_mmap_handle_t handle) {
+  if(handle == 0 || handle > HOST_PARTITION_MAX_MAPS || !maps[handle - 1].data) return;
+
+  munmap(maps[handle - 1].data, maps[handle - 1].size);
+  maps[handle - 1].data = NULL;
+}
@@ -0,0 +1,46 @@
+/*
+ * Copyright 2017 Sam Leitch
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "esp_log.h"
+#include "esp_system.h"
+
+#include <stdbool.h>
+#include <sys/random.h>
+
+esp_log_level_t host_log_level = ESP_LOG_WARN;
+
+void esp_log_level_set(const char* tag, esp_log_level_t level) {
+  host_log_level = level;
+}
+
+static bool next_random_set = false;
+static uint32_t next_random;
+
+void host_esp_random_set_next(uint32_t value) {
+  next_random = value;
+  next_random_set = true;
+}
+
+uint32_t esp_random(void) {
+  if(next_random_set) {
+    next_random_set = false;
+    return next_random;
+  }
+
+  uint32_t value = 0;
+  getrandom(&value, sizeof(value), 0);
+  return value;
+}
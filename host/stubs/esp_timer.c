@@ -0,0 +1,176 @@
+/*
+ * Copyright 2017 Sam Leitch
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "esp_timer.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <time.h>
+
+struct esp_timer {
+  esp_timer_cb_t callback;
+  void* arg;
+  int64_t alarm_us; /* When the callback is due */
+  uint64_t period_us; /* 0 for a one shot timer */
+  bool armed;
+  struct esp_timer* next; /* The list of every timer */
+};
+
+static pthread_mutex_t timer_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t timer_changed;
+static pthread_once_t timer_once = PTHREAD_ONCE_INIT;
+static struct esp_timer* timers = NULL;
+static struct timespec boot_time;
+
+static void host_timer_init_boot() {
+  clock_gettime(CLOCK_MONOTONIC, &boot_time);
+}
+
+int64_t esp_timer_get_time(void) {
+  static pthread_once_t boot_once = PTHREAD_ONCE_INIT;
+  pthread_once(&boot_once, host_timer_init_boot);
+
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (int64_t)(now.tv_sec - boot_time.tv_sec) * 1000000 + (now.tv_nsec - boot_time.tv_nsec) / 1000;
+}
+
+/** Returns the armed timer that is due first, or NULL */
+static struct esp_timer* host_timer_next() {
+  struct esp_timer* first = NULL;
+  for(struct esp_timer* timer = timers; timer; timer = timer->next) {
+    if(timer->armed && (!first || timer->alarm_us < first->alarm_us)) first = timer;
+  }
+  return first;
+}
+
+/** Runs the callbacks as they are due, the lock is released while a callback runs */
+static void* host_timer_task(void* param) {
+  pthread_mutex_lock(&timer_lock);
+
+  for(;;) {
+    struct esp_timer* timer = host_timer_next();
+    if(!timer) {
+      pthread_cond_wait(&timer_changed, &timer_lock);
+      continue;
+    }
+
+    int64_t now_us = esp_timer_get_time();
+    if(timer->alarm_us > now_us) {
+      struct timespec deadline;
+      clock_gettime(CLOCK_MONOTONIC, &deadline);
+      int64_t ns = deadline.tv_nsec + (timer->alarm_us - now_us) * 1000;
+      deadline.tv_sec += ns / 1000000000;
+      deadline.tv_nsec = ns % 1000000000;
+      pthread_cond_timedwait(&timer_changed, &timer_lock, &deadline);
+      continue;
+    }
+
+    if(timer->period_us) {
+      timer->alarm_us += timer->period_us;
+    } else {
+      timer->armed = false;
+    }
+
+    esp_timer_cb_t callback = timer->callback;
+    void* arg = timer->arg;
+    pthread_mutex_unlock(&timer_lock);
+    callback(arg);
+    pthread_mutex_lock(&timer_lock);
+  }
+
+  return NULL;
+}
+
+static void host_timer_start_task() {
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&timer_changed, &attr);
+  pthread_condattr_destroy(&attr);
+
+  pthread_t thread;
+  pthread_create(&thread, NULL, host_timer_task, NULL);
+  pthread_detach(thread);
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t* create_args, esp_timer_handle_t* out_handle) {
+  pthread_once(&timer_once, host_timer_start_task);
+  if(!create_args || !create_args->callback || !out_handle) return ESP_ERR_INVALID_ARG;
+
+  struct esp_timer* timer = calloc(1, sizeof(struct esp_timer));
+  if(!timer) return ESP_ERR_NO_MEM;
+  timer->callback = create_args->callback;
+  timer->arg = create_args->arg;
+
+  pthread_mutex_lock(&timer_lock);
+  timer->next = timers;
+  timers = timer;
+  pthread_mutex_unlock(&timer_lock);
+
+  *out_handle = timer;
+  return ESP_OK;
+}
+
+static esp_err_t host_timer_start(esp_timer_handle_t timer, uint64_t timeout_us, uint64_t period_us) {
+  pthread_mutex_lock(&timer_lock);
+  esp_err_t result = ESP_ERR_INVALID_STATE;
+  if(!timer->armed) {
+    timer->alarm_us = esp_timer_get_time() + timeout_us;
+    timer->period_us = period_us;
+    timer->armed = true;
+    pthread_cond_broadcast(&timer_changed);
+    result = ESP_OK;
+  }
+  pthread_mutex_unlock(&timer_lock);
+  return result;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us) {
+  return host_timer_start(timer, timeout_us, 0);
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period) {
+  return host_timer_start(timer, period, period);
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+  pthread_mutex_lock(&timer_lock);
+  esp_err_t result = timer->armed ? ESP_OK : ESP_ERR_INVALID_STATE;
+  timer->armed = false;
+  pthread_mutex_unlock(&timer_lock);
+  return result;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer) {
+  pthread_mutex_lock(&timer_lock);
+  if(timer->armed) {
+    pthread_mutex_unlock(&timer_lock);
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  for(struct esp_timer** link = &timers; *link; link = &(*link)->next) {
+    if(*link == timer) {
+      *link = timer->next;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&timer_lock);
+
+  free(timer);
+  return ESP_OK;
+}
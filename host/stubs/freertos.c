@@ -0,0 +1,348 @@
+/*
+ * Copyright 2017 Sam Leitch
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Host threads use more stack than the ESP32, so every task gets at least this much */
+#define HOST_TASK_MIN_STACK (256 * 1024)
+
+typedef enum {
+  HOST_SEMAPHORE_COUNTING,
+  HOST_SEMAPHORE_MUTEX,
+  HOST_SEMAPHORE_RECURSIVE_MUTEX,
+} host_semaphore_kind_t;
+
+struct host_semaphore_s {
+  pthread_mutex_t lock;
+  pthread_cond_t changed;
+  host_semaphore_kind_t kind;
+  UBaseType_t count;
+  UBaseType_t max_count;
+  pthread_t owner; /* The holder of a mutex */
+  int depth; /* Takes of a recursive mutex by its holder */
+};
+
+struct host_queue_s {
+  pthread_mutex_t lock;
+  pthread_cond_t changed;
+  UBaseType_t length;
+  UBaseType_t item_size;
+  UBaseType_t head; /* The oldest item */
+  UBaseType_t count;
+  uint8_t* items;
+};
+
+struct host_task_s {
+  pthread_t thread;
+  TaskFunction_t function;
+  void* param;
+  BaseType_t core_id; /* The core reported by xPortGetCoreID, 0 for tasks that are not pinned */
+};
+
+static struct timespec host_start_time;
+static pthread_once_t host_start_once = PTHREAD_ONCE_INIT;
+static __thread TaskHandle_t host_current_task;
+static __thread BaseType_t host_current_core = 0;
+
+static void host_record_start() {
+  clock_gettime(CLOCK_MONOTONIC, &host_start_time);
+}
+
+/** Initializes a condition variable that waits on the monotonic clock */
+static void host_cond_init(pthread_cond_t* cond) {
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(cond, &attr);
+  pthread_condattr_destroy(&attr);
+}
+
+/** Returns the time ticks from now, for pthread_cond_timedwait */
+static struct timespec host_deadline(TickType_t ticks) {
+  struct timespec deadline;
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+  int64_t ns = deadline.tv_nsec + (int64_t)ticks * portTICK_PERIOD_MS * 1000000;
+  deadline.tv_sec += ns / 1000000000;
+  deadline.tv_nsec = ns % 1000000000;
+  return deadline;
+}
+
+/** Waits for cond with lock held, returns false once ticks have passed */
+static bool host_wait(pthread_cond_t* cond, pthread_mutex_t* lock, TickType_t ticks, const struct timespec* deadline) {
+  if(ticks == 0) return false;
+  if(ticks == portMAX_DELAY) return pthread_cond_wait(cond, lock) == 0;
+  return pthread_cond_timedwait(cond, lock, deadline) != ETIMEDOUT;
+}
+
+static SemaphoreHandle_t host_semaphore_create(host_semaphore_kind_t kind, UBaseType_t max_count, UBaseType_t count) {
+  SemaphoreHandle_t semaphore = calloc(1, sizeof(struct host_semaphore_s));
+  if(!semaphore) return NULL;
+
+  pthread_mutex_init(&semaphore->lock, NULL);
+  host_cond_init(&semaphore->changed);
+  semaphore->kind = kind;
+  semaphore->max_count = max_count;
+  semaphore->count = count;
+  return semaphore;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void) {
+  return host_semaphore_create(HOST_SEMAPHORE_COUNTING, 1, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max_count, UBaseType_t initial_count) {
+  return host_semaphore_create(HOST_SEMAPHORE_COUNTING, max_count, initial_count);
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void) {
+  return host_semaphore_create(HOST_SEMAPHORE_MUTEX, 1, 1);
+}
+
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex(void) {
+  return host_semaphore_create(HOST_SEMAPHORE_RECURSIVE_MUTEX, 1, 1);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks_to_wait) {
+  struct timespec deadline = host_deadline(ticks_to_wait);
+  pthread_mutex_lock(&semaphore->lock);
+
+  bool taken = true;
+  while(semaphore->count == 0 && taken) {
+    taken = host_wait(&semaphore->changed, &semaphore->lock, ticks_to_wait, &deadline);
+  }
+
+  if(taken) {
+    --semaphore->count;
+    semaphore->owner = pthread_self();
+  }
+
+  pthread_mutex_unlock(&semaphore->lock);
+  return taken ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) {
+  pthread_mutex_lock(&semaphore->lock);
+  bool given = semaphore->count < semaphore->max_count;
+  if(given) {
+    ++semaphore->count;
+    pthread_cond_broadcast(&semaphore->changed);
+  }
+  pthread_mutex_unlock(&semaphore->lock);
+  return given ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t semaphore, BaseType_t* higher_priority_task_woken) {
+  if(higher_priority_task_woken) *higher_priority_task_woken = pdFALSE;
+  return xSemaphoreGive(semaphore);
+}
+
+BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t mutex, TickType_t ticks_to_wait) {
+  pthread_mutex_lock(&mutex->lock);
+  bool held = mutex->depth > 0 && pthread_equal(mutex->owner, pthread_self());
+  if(held) ++mutex->depth;
+  pthread_mutex_unlock(&mutex->lock);
+  if(held) return pdTRUE;
+
+  if(!xSemaphoreTake(mutex, ticks_to_wait)) return pdFALSE;
+
+  pthread_mutex_lock(&mutex->lock);
+  mutex->depth = 1;
+  pthread_mutex_unlock(&mutex->lock);
+  return pdTRUE;
+}
+
+BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t mutex) {
+  pthread_mutex_lock(&mutex->lock);
+  bool held = mutex->depth > 0 && pthread_equal(mutex->owner, pthread_self());
+  bool released = held && --mutex->depth == 0;
+  pthread_mutex_unlock(&mutex->lock);
+
+  if(released) xSemaphoreGive(mutex);
+  return held ? pdTRUE : pdFALSE;
+}
+
+UBaseType_t uxSemaphoreGetCount(SemaphoreHandle_t semaphore) {
+  pthread_mutex_lock(&semaphore->lock);
+  UBaseType_t count = semaphore->count;
+  pthread_mutex_unlock(&semaphore->lock);
+  return count;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t semaphore) {
+  if(!semaphore) return;
+  pthread_cond_destroy(&semaphore->changed);
+  pthread_mutex_destroy(&semaphore->lock);
+  free(semaphore);
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size) {
+  QueueHandle_t queue = calloc(1, sizeof(struct host_queue_s));
+  if(!queue) return NULL;
+
+  queue->items = malloc(length * item_size);
+  if(!queue->items) {
+    free(queue);
+    return NULL;
+  }
+
+  pthread_mutex_init(&queue->lock, NULL);
+  host_cond_init(&queue->changed);
+  queue->length = length;
+  queue->item_size = item_size;
+  return queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t ticks_to_wait) {
+  struct timespec deadline = host_deadline(ticks_to_wait);
+  pthread_mutex_lock(&queue->lock);
+
+  bool sent = true;
+  while(queue->count == queue->length && sent) {
+    sent = host_wait(&queue->changed, &queue->lock, ticks_to_wait, &deadline);
+  }
+
+  if(sent) {
+    UBaseType_t tail = (queue->head + queue->count) % queue->length;
+    memcpy(queue->items + tail * queue->item_size, item, queue->item_size);
+    ++queue->count;
+    pthread_cond_broadcast(&queue->changed);
+  }
+
+  pthread_mutex_unlock(&queue->lock);
+  return sent ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t ticks_to_wait) {
+  struct timespec deadline = host_deadline(ticks_to_wait);
+  pthread_mutex_lock(&queue->lock);
+
+  bool received = true;
+  while(queue->count == 0 && received) {
+    received = host_wait(&queue->changed, &queue->lock, ticks_to_wait, &deadline);
+  }
+
+  if(received) {
+    memcpy(item, queue->items + queue->head * queue->item_size, queue->item_size);
+    queue->head = (queue->head + 1) % queue->length;
+    --queue->count;
+    pthread_cond_broadcast(&queue->changed);
+  }
+
+  pthread_mutex_unlock(&queue->lock);
+  return received ? pdTRUE : pdFALSE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+  pthread_mutex_lock(&queue->lock);
+  UBaseType_t count = queue->count;
+  pthread_mutex_unlock(&queue->lock);
+  return count;
+}
+
+void vQueueDelete(QueueHandle_t queue) {
+  if(!queue) return;
+  pthread_cond_destroy(&queue->changed);
+  pthread_mutex_destroy(&queue->lock);
+  free(queue->items);
+  free(queue);
+}
+
+static void* host_task_main(void* param) {
+  TaskHandle_t task = (TaskHandle_t)param;
+  host_current_task = task;
+  host_current_core = task->core_id;
+  task->function(task->param);
+
+  /* FreeRTOS tasks must delete themselves rather than return */
+  abort();
+  return NULL;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char* name, uint32_t stack_depth, void* param,
+    UBaseType_t priority, TaskHandle_t* created_task, BaseType_t core_id) {
+  pthread_once(&host_start_once, host_record_start);
+
+  TaskHandle_t task = calloc(1, sizeof(struct host_task_s));
+  if(!task) return pdFAIL;
+  task->function = function;
+  task->param = param;
+  task->core_id = core_id == tskNO_AFFINITY ? 0 : core_id;
+
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  size_t stack_size = stack_depth < HOST_TASK_MIN_STACK ? HOST_TASK_MIN_STACK : stack_depth;
+  pthread_attr_setstacksize(&attr, stack_size);
+
+  int result = pthread_create(&task->thread, &attr, host_task_main, task);
+  pthread_attr_destroy(&attr);
+  if(result != 0) {
+    free(task);
+    return pdFAIL;
+  }
+
+  if(created_task) *created_task = task;
+  return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char* name, uint32_t stack_depth, void* param,
+    UBaseType_t priority, TaskHandle_t* created_task) {
+  return xTaskCreatePinnedToCore(function, name, stack_depth, param, priority, created_task, tskNO_AFFINITY);
+}
+
+void vTaskDelete(TaskHandle_t task) {
+  if(!task || task == host_current_task) pthread_exit(NULL);
+  pthread_cancel(task->thread);
+}
+
+void vTaskDelay(TickType_t ticks) {
+  struct timespec delay = {
+    .tv_sec = ticks * portTICK_PERIOD_MS / 1000,
+    .tv_nsec = (ticks * portTICK_PERIOD_MS % 1000) * 1000000L,
+  };
+  while(nanosleep(&delay, &delay) != 0 && errno == EINTR) {}
+}
+
+TickType_t xTaskGetTickCount(void) {
+  pthread_once(&host_start_once, host_record_start);
+
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  int64_t ms = (now.tv_sec - host_start_time.tv_sec) * 1000 + (now.tv_nsec - host_start_time.tv_nsec) / 1000000;
+  return (TickType_t)(ms / portTICK_PERIOD_MS);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) {
+  return host_current_task;
+}
+
+BaseType_t xPortGetCoreID(void) {
+  return host_current_core;
+}
+
+void host_task_set_core(BaseType_t core_id) {
+  host_current_core = core_id;
+}
@@ -0,0 +1,51 @@
+/*
+ * Copyright 2017 Sam Leitch
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HOST_CJSON_H_
+#define HOST_CJSON_H_
+
+/**
+ * A stand-in for the parts of cJSON 1.x the resources use. It is only built when the cJSON
+ * of ESP-IDF is not found. Like cJSON, every item is allocated on its own.
+ */
+
+#define cJSON_Invalid (0)
+#define cJSON_False (1 << 0)
+#define cJSON_True (1 << 1)
+#define cJSON_NULL (1 << 2)
+#define cJSON_Number (1 << 3)
+#define cJSON_String (1 << 4)
+#define cJSON_Array (1 << 5)
+#define cJSON_Object (1 << 6)
+
+typedef struct cJSON {
+  struct cJSON* next;
+  struct cJSON* prev;
+  struct cJSON* child;
+  int type;
+  char* valuestring;
+  int valueint;
+  double valuedouble;
+  char* string; /* The key of an object member */
+} cJSON;
+
+cJSON* cJSON_Parse(const char* value);
+void cJSON_Delete(cJSON* item);
+int cJSON_GetArraySize(const cJSON* array);
+cJSON* cJSON_GetArrayItem(const cJSON* array, int index);
+cJSON* cJSON_GetObjectItem(const cJSON* object, const char* string);
+
+#endif /* HOST_CJSON_H_ */
@@ -0,0 +1,185 @@
+/*
+ * Copyright 2017 Sam Leitch
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HOST_COAP_H_
+#define HOST_COAP_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+/**
+ * A stand-in for the parts of libcoap 4.1 the resources use. Requests are PDUs built in memory
+ * and handed to the handlers with host_coap_request, there is no network.
+ */
+
+#define COAP_DEFAULT_PORT 5683
+
+#define COAP_RESPONSE_CODE(N) (((N)/100 << 5) | (N)%100)
+
+#define COAP_REQUEST_GET 1
+#define COAP_REQUEST_POST 2
+#define COAP_REQUEST_PUT 3
+#define COAP_REQUEST_DELETE 4
+
+#define COAP_MESSAGE_CON 0
+#define COAP_MESSAGE_NON 1
+#define COAP_MESSAGE_ACK 2
+
+#define COAP_OPTION_OBSERVE 6
+#define COAP_OPTION_URI_PATH 11
+#define COAP_OPTION_CONTENT_TYPE 12
+#define COAP_OPTION_MAXAGE 14
+#define COAP_OPTION_URI_QUERY 15
+#define COAP_OPTION_BLOCK2 23
+#define COAP_OPTION_BLOCK1 27
+#define COAP_OPTION_SIZE1 60
+
+#define COAP_MEDIATYPE_TEXT_PLAIN 0
+#define COAP_MEDIATYPE_APPLICATION_OCTET_STREAM 42
+#define COAP_MEDIATYPE_APPLICATION_JSON 50
+
+#define COAP_MAX_PDU_SIZE 1400
+
+/* Options of one PDU */
+#define HOST_COAP_MAX_OPTIONS 16
+#define HOST_COAP_MAX_OPTION_SIZE 270
+
+typedef struct {
+  size_t length;
+  unsigned char* s;
+} str;
+
+typedef struct coap_address_t {
+  socklen_t size;
+  union {
+    struct sockaddr sa;
+    struct sockaddr_in sin;
+  } addr;
+} coap_address_t;
+
+typedef struct coap_endpoint_t {
+  int handle;
+  coap_address_t addr;
+} coap_endpoint_t;
+
+typedef struct {
+  unsigned int token_length:4;
+  unsigned int type:2;
+  unsigned int version:2;
+  unsigned int code:8;
+  uint16_t id;
+} coap_hdr_t;
+
+/** An option. Unlike libcoap, options are not encoded in the PDU */
+typedef struct coap_opt_s {
+  unsigned short number;
+  unsigned short length;
+  unsigned char value[HOST_COAP_MAX_OPTION_SIZE];
+} coap_opt_t;
+
+typedef struct coap_pdu_t {
+  size_t max_size;
+  coap_hdr_t* hdr;
+  unsigned short length; /* Bytes of payload */
+  unsigned char* data; /* The payload, or NULL */
+  coap_hdr_t header;
+  coap_opt_t options[HOST_COAP_MAX_OPTIONS];
+  int option_count;
+} coap_pdu_t;
+
+typedef struct {
+  coap_pdu_t* pdu;
+  int index; /* The next option */
+  unsigned short type;
+  unsigned int filtered:1;
+} coap_opt_iterator_t;
+
+typedef struct coap_subscription_t {
+  struct coap_subscription_t* next;
+  coap_address_t subscriber;
+  unsigned int non:1;
+  size_t token_length;
+  unsigned char token[8];
+} coap_subscription_t;
+
+struct coap_resource_t;
+struct coap_context_t;
+
+typedef void (*coap_method_handler_t)(struct coap_context_t *, struct coap_resource_t *, const coap_endpoint_t *,
+    coap_address_t *, coap_pdu_t *, str *, coap_pdu_t *);
+
+typedef struct coap_resource_t {
+  unsigned int dirty:1;
+  unsigned int partiallydirty:1;
+  unsigned int observable:1;
+  unsigned int cacheable:1;
+  coap_method_handler_t handler[4];
+  str uri;
+  coap_subscription_t* subscribers;
+  struct coap_resource_t* next;
+} coap_resource_t;
+
+typedef struct coap_context_t {
+  unsigned int observe;
+  coap_resource_t* resources;
+  coap_endpoint_t endpoint;
+} coap_context_t;
+
+typedef struct {
+  unsigned int num:20;
+  unsigned int m:1;
+  unsigned int szx:3;
+} coap_block_t;
+
+coap_context_t* coap_new_context(const coap_address_t* listen_addr);
+void coap_free_context(coap_context_t* context);
+void coap_address_init(coap_address_t* addr);
+
+coap_pdu_t* coap_pdu_init(unsigned char type, unsigned char code, unsigned short id, size_t size);
+void coap_delete_pdu(coap_pdu_t* pdu);
+
+unsigned int coap_encode_var_bytes(unsigned char* buf, unsigned int val);
+unsigned int coap_decode_var_bytes(unsigned char* buf, unsigned int len);
+
+size_t coap_add_option(coap_pdu_t* pdu, unsigned short type, unsigned int len, const unsigned char* data);
+int coap_add_data(coap_pdu_t* pdu, unsigned int len, const unsigned char* data);
+int coap_get_data(coap_pdu_t* pdu, size_t* len, unsigned char** data);
+
+coap_opt_t* coap_check_option(coap_pdu_t* pdu, unsigned short type, coap_opt_iterator_t* oi);
+coap_opt_t* coap_option_next(coap_opt_iterator_t* oi);
+unsigned short coap_opt_length(const coap_opt_t* opt);
+unsigned char* coap_opt_value(coap_opt_t* opt);
+
+coap_resource_t* coap_resource_init(const unsigned char* uri, size_t len, int flags);
+void coap_register_handler(coap_resource_t* resource, unsigned char method, coap_method_handler_t handler);
+void coap_add_resource(coap_context_t* context, coap_resource_t* resource);
+
+coap_subscription_t* coap_add_observer(coap_resource_t* resource, const coap_endpoint_t* local_interface,
+    const coap_address_t* observer, const str* token);
+coap_subscription_t* coap_find_observer(coap_resource_t* resource, const coap_address_t* peer, const str* token);
+void coap_delete_observer(coap_resource_t* resource, const coap_address_t* observer, const str* token);
+
+/** Sends a notification (a GET with a request of NULL) to every observer of a dirty resource */
+void coap_check_notify(coap_context_t* context);
+
+int coap_get_block(coap_pdu_t* pdu, unsigned short type, coap_block_t* block);
+int coap_write_block_opt(coap_block_t* block, unsigned short type, coap_pdu_t* pdu, size_t data_length);
+int coap_add_block(coap_pdu_t* pdu, unsigned int len, const unsigned char* data, unsigned int block_num,
+    unsigned char block_szx);
+
+#endif /* HOST_COAP_H_ */
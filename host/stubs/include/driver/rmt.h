@@ -0,0 +1,108 @@
+/*
+ * Copyright 2017 Sam Leitch
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HOST_DRIVER_RMT_H_
+#define HOST_DRIVER_RMT_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "driver/gpio.h"
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+/**
+ * A stand-in for the RMT driver. Transmissions are decoded back into bytes by a thread standing
+ * in for the peripheral and its interrupt, see host_rmt.h.
+ */
+
+typedef enum {
+  RMT_CHANNEL_0, RMT_CHANNEL_1, RMT_CHANNEL_2, RMT_CHANNEL_3,
+  RMT_CHANNEL_4, RMT_CHANNEL_5, RMT_CHANNEL_6, RMT_CHANNEL_7,
+  RMT_CHANNEL_MAX,
+} rmt_channel_t;
+
+typedef enum {
+  RMT_MODE_TX = 0,
+  RMT_MODE_RX,
+  RMT_MODE_MAX,
+} rmt_mode_t;
+
+typedef enum {
+  RMT_IDLE_LEVEL_LOW = 0,
+  RMT_IDLE_LEVEL_HIGH,
+  RMT_IDLE_LEVEL_MAX,
+} rmt_idle_level_t;
+
+typedef enum {
+  RMT_CARRIER_LEVEL_LOW = 0,
+  RMT_CARRIER_LEVEL_HIGH,
+  RMT_CARRIER_LEVEL_MAX,
+} rmt_carrier_level_t;
+
+typedef struct rmt_item32_s {
+  union {
+    struct {
+      uint32_t duration0 :15;
+      uint32_t level0 :1;
+      uint32_t duration1 :15;
+      uint32_t level1 :1;
+    };
+    uint32_t val;
+  };
+} rmt_item32_t;
+
+typedef struct {
+  bool loop_en;
+  uint32_t carrier_freq_hz;
+  uint8_t carrier_duty_percent;
+  rmt_carrier_level_t carrier_level;
+  bool carrier_en;
+  rmt_idle_level_t idle_level;
+  bool idle_output_en;
+} rmt_tx_config_t;
+
+typedef struct {
+  rmt_mode_t rmt_mode;
+  rmt_channel_t channel;
+  uint8_t clk_div;
+  gpio_num_t gpio_num;
+  uint8_t mem_block_num;
+  union {
+    rmt_tx_config_t tx_config;
+  };
+} rmt_config_t;
+
+typedef void (*sample_to_rmt_t)(const void* src, rmt_item32_t* dest, size_t src_size, size_t wanted_num,
+    size_t* translated_size, size_t* item_num);
+
+typedef void (*rmt_tx_end_fn_t)(rmt_channel_t channel, void* arg);
+
+typedef struct {
+  rmt_tx_end_fn_t function;
+  void* arg;
+} rmt_tx_end_callback_t;
+
+esp_err_t rmt_config(const rmt_config_t* rmt_param);
+esp_err_t rmt_driver_install(rmt_channel_t channel, size_t rx_buf_size, int intr_alloc_flags);
+esp_err_t rmt_driver_uninstall(rmt_channel_t channel);
+esp_err_t rmt_write_items(rmt_channel_t channel, const rmt_item32_t* rmt_item, int item_num, bool wait_tx_done);
+esp_err_t rmt_wait_tx_done(rmt_channel_t channel, TickType_t wait_time);
+esp_err_t rmt_translator_init(rmt_channel_t channel, sample_to_rmt_t fn);
+esp_err_t rmt_write_sample(rmt_channel_t channel, const uint8_t* src, size_t src_size, bool wait_tx_done);
+rmt_tx_end_callback_t rmt_register_tx_end_callback(rmt_tx_end_fn_t function, void* arg);
+
+#endif /* HOST_DRIVER_RMT_H_ */
@@ -0,0 +1,28 @@
+/*
+ * Copyright 2017 Sam Leitch
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HOST_ESP_SYSTEM_H_
+#define HOST_ESP_SYSTEM_H_
+
+#include <stdint.h>
+#include "esp_err.h"
+
+uint32_t esp_random(void);
+
+/** Makes the next esp_random return value, for tests that choose the ids of devices */
+void host_esp_random_set_next(uint32_t value);
+
+#endif /* HOST_ESP_SYSTEM_H_ */
@@ -0,0 +1,44 @@
+/*
+ * Copyright 2017 Sam Leitch
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HOST_FREERTOS_TASK_H_
+#define HOST_FREERTOS_TASK_H_
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct host_task_s* TaskHandle_t;
+typedef void (*TaskFunction_t)(void* param);
+
+BaseType_t xTaskCreate(TaskFunction_t task, const char* name, uint32_t stack_depth, void* param,
+    UBaseType_t priority, TaskHandle_t* created_task);
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t task, const char* name, uint32_t stack_depth, void* param,
+    UBaseType_t priority, TaskHandle_t* created_task, BaseType_t core_id);
+
+/** Deletes a task, or the calling task if task is NULL */
+void vTaskDelete(TaskHandle_t task);
+
+void vTaskDelay(TickType_t ticks);
+TickType_t xTaskGetTickCount(void);
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+BaseType_t xPortGetCoreID(void);
+
+/**
+ * Sets the core reported to the calling thread, for threads that play an interrupt of the core that installed it.
+ * Pinned tasks report their core and every other thread reports core 0.
+ */
+void host_task_set_core(BaseType_t core_id);
+
+#endif /* HOST_FREERTOS_TASK_H_ */
@@ -0,0 +1,36 @@
+/*
+ * Copyright 2017 Sam Leitch
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HOST_COAP_HELPERS_H_
+#define HOST_COAP_HELPERS_H_
+
+#include <coap.h>
+
+/** Finds a resource by its URI path, or returns NULL */
+coap_resource_t* host_coap_find_resource(coap_context_t* context, const char* uri);
+
+/**
+ * Calls the handler of a resource for request, from peer (or a default peer if NULL), with a token of "t".
+ *
+ * Returns the response code of the response, or 0 if the resource has no handler for the method.
+ */
+int host_coap_request(coap_context_t* context, coap_resource_t* resource, const coap_address_t* peer,
+    coap_pdu_t* request, coap_pdu_t* response);
+
+/** Observers of a resource */
+int host_coap_observer_count(coap_resource_t* resource);
+
+#endif /* HOST_COAP_HELPERS_H_ */
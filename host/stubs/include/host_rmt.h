@@ -0,0 +1,86 @@
+/*
+ * Copyright 2017 Sam Leitch
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HOST_RMT_H_
+#define HOST_RMT_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "driver/rmt.h"
+
+/**
+ * What the RMT stand-in sent, for tests and benchmarks.
+ *
+ * Every transmission is decoded back into the bytes it sends, and each bit is checked against the
+ * timing of the channel (WS2812B unless host_rmt_set_timing is called). The items are read while the
+ * transmission is in progress, like the peripheral reads them, so a buffer changed before the frame
+ * is done shows up as a wrong frame.
+ *
+ * Translated transmissions (rmt_write_sample) are filled half a block at a time from the channel thread,
+ * like the TX threshold interrupt does.
+ */
+
+/** Bit timings in ns, from a datasheet */
+typedef struct host_rmt_timing_s {
+  int zero_high_ns;
+  int zero_low_ns;
+  int one_high_ns;
+  int one_low_ns;
+  int tolerance_ns; /* Each high and low time may be this far from the datasheet */
+  int reset_ns; /* The shortest low that ends a frame */
+} host_rmt_timing_t;
+
+extern const host_rmt_timing_t host_rmt_timing_ws2812b;
+
+/**
+ * Decodes items back into the bytes they send, MSB first, up to the end of the transmission.
+ *
+ * A transmission ends with an item that has a duration of 0. The last bit must be followed by
+ * a reset, a low of at least timing->reset_ns.
+ * Returns the number of bytes, or -1 if a bit does not match the timing, the bits are not whole bytes,
+ * the reset is missing or the bytes do not fit.
+ */
+int host_rmt_decode(const rmt_item32_t* items, int item_count, int clk_div, const host_rmt_timing_t* timing,
+    uint8_t* bytes, int max_bytes);
+
+/** The items sent in ns, including the reset */
+int64_t host_rmt_duration_ns(const rmt_item32_t* items, int item_count, int clk_div);
+
+/** Sets the timing the frames of a channel are checked against */
+void host_rmt_set_timing(rmt_channel_t channel, const host_rmt_timing_t* timing);
+
+/** With wire time on, every transmission takes as long as it would on the wire. It is off by default. */
+void host_rmt_set_wire_time(bool enabled);
+
+/** Copies the bytes of the last frame sent on the channel, returns their count (at most max_bytes) */
+int host_rmt_get_frame(rmt_channel_t channel, uint8_t* bytes, int max_bytes);
+
+/** Frames sent on the channel */
+uint32_t host_rmt_get_frame_count(rmt_channel_t channel);
+
+/** Frames sent on the channel that could not be decoded */
+uint32_t host_rmt_get_errors(rmt_channel_t channel);
+
+/** Times the translator was called from the interrupt to refill the channel memory */
+uint32_t host_rmt_get_refills(rmt_channel_t channel);
+
+/** esp_timer_get_time when the last transmission on the channel started */
+int64_t host_rmt_get_start_us(rmt_channel_t channel);
+
+/** Waits until frame_count frames have been sent on the channel, returns false after timeout_ms */
+bool host_rmt_wait_frames(rmt_channel_t channel, uint32_t frame_count, int timeout_ms);
+
+#endif /* HOST_RMT_H_ */
@@ -0,0 +1,40 @@
+/*
+ * Copyright 2017 Sam Leitch
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HOST_XTENSA_HAL_H_
+#define HOST_XTENSA_HAL_H_
+
+#include <stdint.h>
+#include <time.h>
+#include "freertos/task.h"
+#include "sdkconfig.h"
+
+/* How far ahead the cycle counter of core 1 is, each core of the ESP32 counts its own cycles */
+#define HOST_CCOUNT_CORE_OFFSET 0x40000000u
+
+/**
+ * The cycle count of the calling core at CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ, from the monotonic clock.
+ *
+ * The cores' counters are far apart, so a time taken across cores shows up as wrong.
+ */
+static inline uint32_t xthal_get_ccount(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  uint64_t ns = (uint64_t)now.tv_sec * 1000000000u + now.tv_nsec;
+  return (uint32_t)(ns * CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ / 1000) + xPortGetCoreID() * HOST_CCOUNT_CORE_OFFSET;
+}
+
+#endif /* HOST_XTENSA_HAL_H_ */
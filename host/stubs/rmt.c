@@ -0,0 +1,434 @@
+/*
+ * Copyright 2017 Sam Leitch
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "driver/rmt.h"
+#include "host_rmt.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "esp_timer.h"
+#include "freertos/task.h"
+
+/* Items in one block of channel memory */
+#define HOST_RMT_MEM_ITEM_NUM 64
+
+const host_rmt_timing_t host_rmt_timing_ws2812b = {
+  .zero_high_ns = 400,
+  .zero_low_ns = 850,
+  .one_high_ns = 800,
+  .one_low_ns = 450,
+  .tolerance_ns = 150,
+  .reset_ns = 50000,
+};
+
+/** A channel, with the thread that stands in for the peripheral and its interrupt */
+typedef struct host_rmt_channel_s {
+  bool installed;
+  int clk_div;
+  int mem_block_num;
+  sample_to_rmt_t translator;
+  const host_rmt_timing_t* timing;
+  pthread_mutex_t lock;
+  pthread_cond_t changed;
+  pthread_t thread;
+  bool busy; /* A transmission is in progress */
+  const rmt_item32_t* tx_items; /* The items of rmt_write_items, read when they are sent */
+  int tx_item_count;
+  rmt_item32_t* items; /* The items translated by rmt_write_sample */
+  int item_count;
+  int item_capacity;
+  const uint8_t* sample_cur; /* The part of the sample that has not been translated */
+  size_t sample_size_remain;
+  bool translating; /* The TX threshold interrupt refills from the translator */
+  int64_t start_us;
+  uint8_t* frame; /* The bytes of the last frame */
+  int frame_size;
+  int frame_capacity;
+  uint32_t frame_count;
+  uint32_t errors;
+  uint32_t refills;
+  BaseType_t core_id; /* The core of the task that installed the driver, which runs the interrupt */
+} host_rmt_channel_t;
+
+static host_rmt_channel_t host_rmt_channels[RMT_CHANNEL_MAX];
+static rmt_config_t host_rmt_configs[RMT_CHANNEL_MAX];
+static rmt_tx_end_callback_t host_rmt_tx_end;
+static bool host_rmt_wire_time = false;
+
+/** RMT ticks of the 80MHz APB clock in ns */
+static inline int64_t host_rmt_ticks_ns(uint32_t ticks, int clk_div) {
+  return (int64_t)ticks * clk_div * 25 / 2;
+}
+
+static inline bool host_rmt_near(int64_t ns, int expected_ns, int tolerance_ns) {
+  return ns >= expected_ns - tolerance_ns && ns <= expected_ns + tolerance_ns;
+}
+
+int host_rmt_decode(const rmt_item32_t* items, int item_count, int clk_div, const host_rmt_timing_t* timing,
+    uint8_t* bytes, int max_bytes) {
+  int bit_count = 0;
+  bool reset = false;
+
+  for(int i=0; i < item_count && !reset; ++i) {
+    rmt_item32_t item = items[i];
+    if(item.duration0 == 0) break; /* The end of the transmission without a reset */
+
+    int64_t high_ns = host_rmt_ticks_ns(item.duration0, clk_div);
+    int64_t low_ns = host_rmt_ticks_ns(item.duration1, clk_div);
+
+    if(!item.level0) {
+      /* A low first half is the reset. The low lasts until the end of the transmission or the second half. */
+      if(item.level1 || item.duration1 == 0) low_ns = 0;
+      if(high_ns + low_ns < timing->reset_ns) return -1;
+      reset = true;
+      continue;
+    }
+
+    /* Every bit is a high followed by a low, a duration of 0 would end the transmission in the bit */
+    if(item.level1 || item.duration1 == 0) return -1;
+
+    int bit;
+    if(host_rmt_near(high_ns, timing->zero_high_ns, timing->tolerance_ns) &&
+        host_rmt_near(low_ns, timing->zero_low_ns, timing->tolerance_ns)) {
+      bit = 0;
+    } else if(host_rmt_near(high_ns, timing->one_high_ns, timing->tolerance_ns) &&
+        host_rmt_near(low_ns, timing->one_low_ns, timing->tolerance_ns)) {
+      bit = 1;
+    } else {
+      return -1;
+    }
+
+    int byte_index = bit_count / 8;
+    if(byte_index >= max_bytes) return -1;
+    if(bit_count % 8 == 0) bytes[byte_index] = 0;
+    bytes[byte_index] |= bit << (7 - bit_count % 8);
+    ++bit_count;
+  }
+
+  if(!reset || bit_count % 8 != 0) return -1;
+  return bit_count / 8;
+}
+
+int64_t host_rmt_duration_ns(const rmt_item32_t* items, int item_count, int clk_div) {
+  int64_t ns = 0;
+  for(int i=0; i < item_count; ++i) {
+    if(items[i].duration0 == 0) break;
+    ns += host_rmt_ticks_ns(items[i].duration0, clk_div);
+    if(items[i].duration1 == 0) break;
+    ns += host_rmt_ticks_ns(items[i].duration1, clk_div);
+  }
+  return ns;
+}
+
+/** With wire time on, sleeps until the items sent so far would be on the wire */
+static void host_rmt_wait_wire(host_rmt_channel_t* ch, const rmt_item32_t* items, int item_count) {
+  if(!host_rmt_wire_time) return;
+  int64_t end_us = ch->start_us + host_rmt_duration_ns(items, item_count, ch->clk_div) / 1000;
+  int64_t wait_us = end_us - esp_timer_get_time();
+  if(wait_us > 0) usleep(wait_us);
+}
+
+/** Adds items to the translated transmission */
+static rmt_item32_t* host_rmt_reserve(host_rmt_channel_t* ch, int count) {
+  if(ch->item_count + count > ch->item_capacity) {
+    int capacity = ch->item_capacity ? ch->item_capacity * 2 : 1024;
+    while(capacity < ch->item_count + count) capacity *= 2;
+    ch->items = realloc(ch->items, capacity * sizeof(rmt_item32_t));
+    if(!ch->items) abort();
+    ch->item_capacity = capacity;
+  }
+  return ch->items + ch->item_count;
+}
+
+/** Calls the translator for wanted items, like the driver does */
+static void host_rmt_translate(host_rmt_channel_t* ch, size_t wanted) {
+  rmt_item32_t* dest = host_rmt_reserve(ch, wanted);
+  size_t translated_size = 0;
+  size_t item_num = 0;
+  ch->translator(ch->sample_cur, dest, ch->sample_size_remain, wanted, &translated_size, &item_num);
+  ch->sample_cur += translated_size;
+  ch->sample_size_remain -= translated_size;
+  ch->item_count += item_num;
+
+  /* The hardware stops at an item with a duration of 0, which the driver writes after a short block */
+  ch->translating = item_num == wanted && ch->sample_size_remain > 0;
+}
+
+/** Sends the transmission: refills translated ones, decodes the items and records the frame */
+static void host_rmt_send(host_rmt_channel_t* ch) {
+  const rmt_item32_t* items;
+  int item_count;
+
+  if(ch->tx_items) {
+    items = ch->tx_items;
+    item_count = ch->tx_item_count;
+    host_rmt_wait_wire(ch, items, item_count);
+  } else {
+    /* The threshold interrupt fires each time half of the channel memory has been sent */
+    size_t sub_len = HOST_RMT_MEM_ITEM_NUM * ch->mem_block_num / 2;
+    while(ch->translating) {
+      host_rmt_wait_wire(ch, ch->items, ch->item_count - sub_len);
+      host_rmt_translate(ch, sub_len);
+      ++ch->refills;
+    }
+    items = ch->items;
+    item_count = ch->item_count;
+    host_rmt_wait_wire(ch, items, item_count);
+  }
+
+  /* Every item is at most 2 bits */
+  pthread_mutex_lock(&ch->lock);
+  int max_bytes = item_count / 8 + 1;
+  if(max_bytes > ch->frame_capacity) {
+    ch->frame = realloc(ch->frame, max_bytes);
+    if(!ch->frame) abort();
+    ch->frame_capacity = max_bytes;
+  }
+
+  int size = host_rmt_decode(items, item_count, ch->clk_div, ch->timing, ch->frame, ch->frame_capacity);
+  if(size < 0) {
+    ++ch->errors;
+    size = 0;
+  }
+  ch->frame_size = size;
+  pthread_mutex_unlock(&ch->lock);
+}
+
+/** The peripheral of a channel, it sends one transmission at a time */
+static void* host_rmt_task(void* param) {
+  host_rmt_channel_t* ch = param;
+  rmt_channel_t channel = ch - host_rmt_channels;
+  host_task_set_core(ch->core_id);
+
+  for(;;) {
+    pthread_mutex_lock(&ch->lock);
+    while(!ch->busy) pthread_cond_wait(&ch->changed, &ch->lock);
+    pthread_mutex_unlock(&ch->lock);
+
+    host_rmt_send(ch);
+
+    pthread_mutex_lock(&ch->lock);
+    ch->busy = false;
+    pthread_cond_broadcast(&ch->changed);
+    pthread_mutex_unlock(&ch->lock);
+
+    /* The driver gives the tx semaphore before calling the callback */
+    rmt_tx_end_callback_t tx_end = host_rmt_tx_end;
+    if(tx_end.function) tx_end.function(channel, tx_end.arg);
+
+    /* Counted once the interrupt is done, so host_rmt_wait_frames also waits for the callback */
+    pthread_mutex_lock(&ch->lock);
+    ++ch->frame_count;
+    pthread_cond_broadcast(&ch->changed);
+    pthread_mutex_unlock(&ch->lock);
+  }
+
+  return NULL;
+}
+
+/** Waits until the channel is idle, with the lock held */
+static bool host_rmt_wait_idle_locked(host_rmt_channel_t* ch, TickType_t wait_time) {
+  if(wait_time == portMAX_DELAY) {
+    while(ch->busy) pthread_cond_wait(&ch->changed, &ch->lock);
+    return true;
+  }
+
+  struct timespec deadline;
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+  int64_t ns = deadline.tv_nsec + (int64_t)wait_time * 1000000;
+  deadline.tv_sec += ns / 1000000000;
+  deadline.tv_nsec = ns % 1000000000;
+  while(ch->busy) {
+    if(pthread_cond_timedwait(&ch->changed, &ch->lock, &deadline) != 0) return !ch->busy;
+  }
+  return true;
+}
+
+esp_err_t rmt_config(const rmt_config_t* rmt_param) {
+  if(!rmt_param || rmt_param->channel >= RMT_CHANNEL_MAX || rmt_param->clk_div == 0) return ESP_ERR_INVALID_ARG;
+  if(rmt_param->mem_block_num == 0 || rmt_param->channel + rmt_param->mem_block_num > RMT_CHANNEL_MAX) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  host_rmt_configs[rmt_param->channel] = *rmt_param;
+  return ESP_OK;
+}
+
+esp_err_t rmt_driver_install(rmt_channel_t channel, size_t rx_buf_size, int intr_alloc_flags) {
+  if(channel >= RMT_CHANNEL_MAX) return ESP_ERR_INVALID_ARG;
+  host_rmt_channel_t* ch = host_rmt_channels + channel;
+  if(ch->installed) return ESP_ERR_INVALID_STATE;
+
+  ch->installed = true;
+  ch->core_id = xPortGetCoreID();
+  ch->clk_div = host_rmt_configs[channel].clk_div ? host_rmt_configs[channel].clk_div : 1;
+  ch->mem_block_num = host_rmt_configs[channel].mem_block_num ? host_rmt_configs[channel].mem_block_num : 1;
+  if(!ch->timing) ch->timing = &host_rmt_timing_ws2812b;
+
+  pthread_mutex_init(&ch->lock, NULL);
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&ch->changed, &attr);
+  pthread_condattr_destroy(&attr);
+  pthread_create(&ch->thread, NULL, host_rmt_task, ch);
+  pthread_detach(ch->thread);
+  return ESP_OK;
+}
+
+esp_err_t rmt_driver_uninstall(rmt_channel_t channel) {
+  if(channel >= RMT_CHANNEL_MAX || !host_rmt_channels[channel].installed) return ESP_ERR_INVALID_STATE;
+  host_rmt_channel_t* ch = host_rmt_channels + channel;
+  pthread_mutex_lock(&ch->lock);
+  host_rmt_wait_idle_locked(ch, portMAX_DELAY);
+  pthread_mutex_unlock(&ch->lock);
+  pthread_cancel(ch->thread);
+  ch->installed = false;
+  ch->translator = NULL;
+  return ESP_OK;
+}
+
+esp_err_t rmt_write_items(rmt_channel_t channel, const rmt_item32_t* rmt_item, int item_num, bool wait_tx_done) {
+  if(channel >= RMT_CHANNEL_MAX || !host_rmt_channels[channel].installed) return ESP_ERR_INVALID_STATE;
+  if(!rmt_item || item_num <= 0) return ESP_ERR_INVALID_ARG;
+  host_rmt_channel_t* ch = host_rmt_channels + channel;
+
+  pthread_mutex_lock(&ch->lock);
+  host_rmt_wait_idle_locked(ch, portMAX_DELAY);
+  ch->tx_items = rmt_item;
+  ch->tx_item_count = item_num;
+  ch->start_us = esp_timer_get_time();
+  ch->busy = true;
+  pthread_cond_broadcast(&ch->changed);
+  if(wait_tx_done) host_rmt_wait_idle_locked(ch, portMAX_DELAY);
+  pthread_mutex_unlock(&ch->lock);
+  return ESP_OK;
+}
+
+esp_err_t rmt_wait_tx_done(rmt_channel_t channel, TickType_t wait_time) {
+  if(channel >= RMT_CHANNEL_MAX || !host_rmt_channels[channel].installed) return ESP_ERR_INVALID_STATE;
+  host_rmt_channel_t* ch = host_rmt_channels + channel;
+
+  pthread_mutex_lock(&ch->lock);
+  bool idle = host_rmt_wait_idle_locked(ch, wait_time);
+  pthread_mutex_unlock(&ch->lock);
+  return idle ? ESP_OK : ESP_ERR_TIMEOUT;
+}
+
+esp_err_t rmt_translator_init(rmt_channel_t channel, sample_to_rmt_t fn) {
+  if(channel >= RMT_CHANNEL_MAX || !fn) return ESP_ERR_INVALID_ARG;
+  if(!host_rmt_channels[channel].installed) return ESP_ERR_INVALID_STATE;
+  host_rmt_channels[channel].translator = fn;
+  return ESP_OK;
+}
+
+esp_err_t rmt_write_sample(rmt_channel_t channel, const uint8_t* src, size_t src_size, bool wait_tx_done) {
+  if(channel >= RMT_CHANNEL_MAX || !host_rmt_channels[channel].installed) return ESP_ERR_INVALID_STATE;
+  host_rmt_channel_t* ch = host_rmt_channels + channel;
+  if(!ch->translator) return ESP_FAIL;
+
+  pthread_mutex_lock(&ch->lock);
+  host_rmt_wait_idle_locked(ch, portMAX_DELAY);
+
+  /* The first block is translated by the caller, the rest from the interrupt */
+  ch->tx_items = NULL;
+  ch->item_count = 0;
+  ch->sample_cur = src;
+  ch->sample_size_remain = src_size;
+  host_rmt_translate(ch, HOST_RMT_MEM_ITEM_NUM * ch->mem_block_num);
+
+  ch->start_us = esp_timer_get_time();
+  ch->busy = true;
+  pthread_cond_broadcast(&ch->changed);
+  if(wait_tx_done) host_rmt_wait_idle_locked(ch, portMAX_DELAY);
+  pthread_mutex_unlock(&ch->lock);
+  return ESP_OK;
+}
+
+rmt_tx_end_callback_t rmt_register_tx_end_callback(rmt_tx_end_fn_t function, void* arg) {
+  rmt_tx_end_callback_t previous = host_rmt_tx_end;
+  host_rmt_tx_end.function = function;
+  host_rmt_tx_end.arg = arg;
+  return previous;
+}
+
+void host_rmt_set_timing(rmt_channel_t channel, const host_rmt_timing_t* timing) {
+  host_rmt_channels[channel].timing = timing;
+}
+
+void host_rmt_set_wire_time(bool enabled) {
+  host_rmt_wire_time = enabled;
+}
+
+int host_rmt_get_frame(rmt_channel_t channel, uint8_t* bytes, int max_bytes) {
+  host_rmt_channel_t* ch = host_rmt_channels + channel;
+  pthread_mutex_lock(&ch->lock);
+  int size = ch->frame_size < max_bytes ? ch->frame_size : max_bytes;
+  if(size > 0) memcpy(bytes, ch->frame, size);
+  pthread_mutex_unlock(&ch->lock);
+  return size;
+}
+
+uint32_t host_rmt_get_frame_count(rmt_channel_t channel) {
+  host_rmt_channel_t* ch = host_rmt_channels + channel;
+  pthread_mutex_lock(&ch->lock);
+  uint32_t frame_count = ch->frame_count;
+  pthread_mutex_unlock(&ch->lock);
+  return frame_count;
+}
+
+uint32_t host_rmt_get_errors(rmt_channel_t channel) {
+  host_rmt_channel_t* ch = host_rmt_channels + channel;
+  pthread_mutex_lock(&ch->lock);
+  uint32_t errors = ch->errors;
+  pthread_mutex_unlock(&ch->lock);
+  return errors;
+}
+
+uint32_t host_rmt_get_refills(rmt_channel_t channel) {
+  host_rmt_channel_t* ch = host_rmt_channels + channel;
+  pthread_mutex_lock(&ch->lock);
+  uint32_t refills = ch->refills;
+  pthread_mutex_unlock(&ch->lock);
+  return refills;
+}
+
+int64_t host_rmt_get_start_us(rmt_channel_t channel) {
+  host_rmt_channel_t* ch = host_rmt_channels + channel;
+  pthread_mutex_lock(&ch->lock);
+  int64_t start_us = ch->start_us;
+  pthread_mutex_unlock(&ch->lock);
+  return start_us;
+}
+
+bool host_rmt_wait_frames(rmt_channel_t channel, uint32_t frame_count, int timeout_ms) {
+  host_rmt_channel_t* ch = host_rmt_channels + channel;
+  struct timespec deadline;
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+  int64_t ns = deadline.tv_nsec + (int64_t)timeout_ms * 1000000;
+  deadline.tv_sec += ns / 1000000000;
+  deadline.tv_nsec = ns % 1000000000;
+
+  pthread_mutex_lock(&ch->lock);
+  while((int32_t)(ch->frame_count - frame_count) < 0) {
+    if(pthread_cond_timedwait(&ch->changed, &ch->lock, &deadline) != 0) break;
+  }
+  bool done = (int32_t)(ch->frame_count - frame_count) >= 0;
+  pthread_mutex_unlock(&ch->lock);
+  return done;
+}
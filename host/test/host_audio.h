@@ -0,0 +1,68 @@
+/*
+ * Copyright 2017 Sam Leitch
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HOST_AUDIO_H_
+#define HOST_AUDIO_H_
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/**
+ * Music with known beats for the led_audio tests and benchmark.
+ *
+ * A kick drum (a falling sine from 120 Hz to 60 Hz) plays at 120 beats per minute from 2 s until a second
+ * before the end, over a steady 440 Hz tone, a 1800 Hz tone that plays for half of every second and noise
+ * about 50 dB below full scale.
+ */
+
+#define HOST_AUDIO_FIRST_BEAT_S 2.0
+#define HOST_AUDIO_BEAT_INTERVAL_S 0.5
+
+/** Fills count samples and returns the number of beats. The first of them starts at HOST_AUDIO_FIRST_BEAT_S. */
+static inline int host_audio_make_music(int16_t* samples, int count, int sample_rate) {
+  float* music = calloc(count, sizeof(float));
+  srand(1);
+
+  for(int i=0; i < count; ++i) {
+    double time = (double)i / sample_rate;
+    double u = (rand() + 1.0) / (RAND_MAX + 2.0);
+    double v = (rand() + 1.0) / (RAND_MAX + 2.0);
+    music[i] = 0.003 * sqrt(-2 * log(u)) * cos(2 * M_PI * v);
+    if(time > 1) music[i] += 0.08 * sin(2 * M_PI * 440 * time);
+    if(fmod(time, 1) < 0.5) music[i] += 0.05 * sin(2 * M_PI * 1800 * time);
+  }
+
+  int beat_count = 0;
+  double end = (double)count / sample_rate - 1;
+  for(double beat = HOST_AUDIO_FIRST_BEAT_S; beat < end; beat += HOST_AUDIO_BEAT_INTERVAL_S, ++beat_count) {
+    int start = (int)(beat * sample_rate);
+    for(int i=0; i < sample_rate * 15 / 100; ++i) {
+      double time = (double)i / sample_rate;
+      music[start + i] += 0.6 * sin(2 * M_PI * (60 + 60 * exp(-time * 30)) * time) * exp(-time * 18);
+    }
+  }
+
+  for(int i=0; i < count; ++i) {
+    float sample = music[i] > 1 ? 1 : music[i] < -1 ? -1 : music[i];
+    samples[i] = (int16_t)(sample * 32767);
+  }
+
+  free(music);
+  return beat_count;
+}
+
+#endif /* HOST_AUDIO_H_ */
@@ -0,0 +1,54 @@
+/*
+ * Copyright 2017 Sam Leitch
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HOST_TEST_H_
+#define HOST_TEST_H_
+
+#include <stdio.h>
+
+/**
+ * Checks for the host tests. A failed check is printed and counted, and the test
+ * carries on, so one run shows every failure. main returns host_test_result().
+ */
+
+static int host_test_checks = 0;
+static int host_test_failures = 0;
+
+#define HOST_CHECK(condition) do { \
+    ++host_test_checks; \
+    if(!(condition)) { \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+      ++host_test_failures; \
+    } \
+  } while(0)
+
+#define HOST_CHECK_EQUAL(expected, actual) do { \
+    ++host_test_checks; \
+    long long expected_ = (long long)(expected); \
+    long long actual_ = (long long)(actual); \
+    if(expected_ != actual_) { \
+      fprintf(stderr, "%s:%d: %s is %lld, expected %lld\n", __FILE__, __LINE__, #actual, actual_, expected_); \
+      ++host_test_failures; \
+    } \
+  } while(0)
+
+/** Prints the result and returns the exit code of the test */
+static inline int host_test_result(const char* name) {
+  printf("%s: %d checks, %d failed\n", name, host_test_checks, host_test_failures);
+  return host_test_failures ? 1 : 0;
+}
+
+#endif /* HOST_TEST_H_ */
@@ -0,0 +1,107 @@
+/*
+ * Copyright 2017 Sam Leitch
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Uploads animations to the animation resource while the ring plays the previous ones,
+ * and checks that the ring never sends a frame mixed from two uploads.
+ * The led_ring resource reports the animation as the mode of the ring.
+ */
+
+#include "animation_resource.h"
+#include "host_coap.h"
+#include "host_rmt.h"
+#include "host_test.h"
+#include "led_ring.h"
+#include "led_ring_resource.h"
+
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <string.h>
+
+#define LED_COUNT 1000
+#define FRAME_COUNT 2
+#define UPLOAD_COUNT 300
+
+static coap_context_t* context;
+static coap_resource_t* resource;
+static SemaphoreHandle_t uploads_done;
+static int rejected_uploads = 0;
+
+/** Uploads animations whose frames each have one color, different in every upload */
+static void upload_task(void* param) {
+  static uint8_t frames[FRAME_COUNT][LED_COUNT * 3];
+  for(int upload=0; upload < UPLOAD_COUNT; ++upload) {
+    for(int f=0; f < FRAME_COUNT; ++f) {
+      for(int i=0; i < LED_COUNT; ++i) {
+        frames[f][i * 3] = upload;
+        frames[f][i * 3 + 1] = f;
+        frames[f][i * 3 + 2] = upload >> 8;
+      }
+    }
+
+    coap_pdu_t* request = coap_pdu_init(COAP_MESSAGE_CON, COAP_REQUEST_PUT, 1, ANIMATION_MAX_SIZE);
+    coap_add_data(request, sizeof(frames), (const unsigned char*)frames);
+    coap_pdu_t* response = coap_pdu_init(COAP_MESSAGE_ACK, 0, 1, COAP_MAX_PDU_SIZE);
+    if(host_coap_request(context, resource, NULL, request, response) != COAP_RESPONSE_CODE(204)) ++rejected_uploads;
+    coap_delete_pdu(response);
+    coap_delete_pdu(request);
+  }
+
+  xSemaphoreGive(uploads_done);
+  vTaskDelete(NULL);
+}
+
+int main() {
+  context = coap_new_context(NULL);
+  led_ring_t ring = led_ring_init_pipelined(RMT_CHANNEL_0, 18, LED_COUNT, 1);
+  led_ring_set_frame_rate(ring, 1000);
+  led_ring_resource_init(context, ring);
+  animation_resource_init(context, ring);
+  resource = host_coap_find_resource(context, "animation");
+  HOST_CHECK(resource != NULL);
+
+  uploads_done = xSemaphoreCreateBinary();
+  xTaskCreate(upload_task, "upload", 4096, NULL, 5, NULL);
+
+  /* Every frame sent has one color */
+  int mixed_frames = 0;
+  while(!xSemaphoreTake(uploads_done, 0)) {
+    static uint8_t bytes[LED_COUNT * 3];
+    int size = host_rmt_get_frame(RMT_CHANNEL_0, bytes, sizeof(bytes));
+    if(size == sizeof(bytes) && memcmp(bytes, bytes + 3, sizeof(bytes) - 3) != 0) ++mixed_frames;
+  }
+
+  HOST_CHECK_EQUAL(0, rejected_uploads);
+  HOST_CHECK_EQUAL(0, mixed_frames);
+  HOST_CHECK_EQUAL(0, host_rmt_get_errors(RMT_CHANNEL_0));
+
+  /* Every upload changed the mode of the led_ring resource */
+  led_ring_resource_stats_t stats;
+  led_ring_resource_get_stats(&stats);
+  HOST_CHECK_EQUAL(UPLOAD_COUNT, stats.mode_requests[LED_RING_MODE_ANIMATION]);
+
+  coap_pdu_t* request = coap_pdu_init(COAP_MESSAGE_CON, COAP_REQUEST_GET, 1, COAP_MAX_PDU_SIZE);
+  coap_pdu_t* response = coap_pdu_init(COAP_MESSAGE_ACK, 0, 1, COAP_MAX_PDU_SIZE);
+  HOST_CHECK_EQUAL(COAP_RESPONSE_CODE(205),
+      host_coap_request(context, host_coap_find_resource(context, "led_ring"), NULL, request, response));
+  size_t size = 0;
+  uint8_t* data = NULL;
+  coap_get_data(response, &size, &data);
+  HOST_CHECK(size == strlen("[\"animation\"]") && memcmp(data, "[\"animation\"]", size) == 0);
+  coap_delete_pdu(response);
+  coap_delete_pdu(request);
+  return host_test_result("test_animation_resource");
+}
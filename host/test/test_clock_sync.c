@@ -0,0 +1,223 @@
+/*
+ * Copyright 2017 Sam Leitch
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Runs devices in separate processes that synchronize their clocks over multicast on this computer.
+ *
+ * The devices join 1.5 s apart, each with a lower id than the ones before it, and every device
+ * reports its synchronized time many times a second. The first device has to stay the leader, and
+ * the others adopt its clock. When it stops, the next oldest takes over with the same clock.
+ * No device's time may ever run backwards, and the devices have to agree to within a millisecond.
+ *
+ * The test is skipped (exit code 77) when multicast does not reach this computer.
+ */
+
+#include "clock_sync.h"
+#include "host_test.h"
+
+#include <esp_system.h>
+#include <lwip/sockets.h>
+#include <poll.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include <time.h>
+
+#define DEVICE_COUNT 3
+#define JOIN_INTERVAL_MS 1500
+#define REPORT_INTERVAL_US 20000
+#define MAX_SKEW_US 1000
+#define SKIP_RESULT 77
+
+typedef struct report_s {
+  int64_t monotonic_us; /* CLOCK_MONOTONIC, which every process shares */
+  int64_t time_us; /* clock_sync_get_time */
+  uint32_t exchanges;
+  bool leader;
+} report_t;
+
+typedef struct device_s {
+  pid_t pid;
+  int fd; /* The read end of the pipe the device reports on */
+  report_t last;
+  uint32_t reports;
+  uint32_t backwards; /* Reports with an earlier time than the one before */
+} device_t;
+
+static device_t devices[DEVICE_COUNT];
+
+static int64_t monotonic_us() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (int64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+/** Returns true if a packet sent to the clock sync group comes back */
+static bool multicast_works() {
+  int receive_fd = socket(AF_INET, SOCK_DGRAM, 0);
+  int send_fd = socket(AF_INET, SOCK_DGRAM, 0);
+  int reuse = 1;
+  setsockopt(receive_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = INADDR_ANY;
+  addr.sin_port = htons(CLOCK_SYNC_PORT);
+  bool works = bind(receive_fd, (struct sockaddr*)&addr, sizeof(addr)) == 0;
+
+  struct ip_mreq mreq;
+  mreq.imr_interface.s_addr = INADDR_ANY;
+  mreq.imr_multiaddr.s_addr = inet_addr("224.0.1.187");
+  works = works && setsockopt(receive_fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) == 0;
+
+  /* A packet that is not 32 bytes long is ignored by any device that is running */
+  addr.sin_addr = mreq.imr_multiaddr;
+  works = works && sendto(send_fd, "test", 4, 0, (struct sockaddr*)&addr, sizeof(addr)) == 4;
+
+  struct pollfd pfd = { .fd = receive_fd, .events = POLLIN };
+  works = works && poll(&pfd, 1, 1000) == 1;
+
+  close(receive_fd);
+  close(send_fd);
+  return works;
+}
+
+/** Runs a device in this process until it is killed */
+static void run_device(uint32_t id, int fd) {
+  prctl(PR_SET_PDEATHSIG, SIGKILL);
+  host_esp_random_set_next(id);
+  clock_sync_start();
+
+  for(;;) {
+    clock_sync_status_t status;
+    clock_sync_get_status(&status);
+
+    report_t report;
+    memset(&report, 0, sizeof(report));
+    report.monotonic_us = monotonic_us();
+    report.time_us = clock_sync_get_time();
+    report.exchanges = status.exchanges;
+    report.leader = status.leader;
+    if(write(fd, &report, sizeof(report)) != sizeof(report)) _exit(1);
+
+    usleep(REPORT_INTERVAL_US);
+  }
+}
+
+/** Starts device i in a new process, later devices have lower ids so the lowest id is not the oldest */
+static void start_device(int i) {
+  int fds[2];
+  if(pipe(fds) < 0) return;
+
+  pid_t pid = fork();
+  if(pid == 0) {
+    close(fds[0]);
+    run_device(0x30000000 - i * 0x10000000, fds[1]);
+  }
+
+  close(fds[1]);
+  devices[i].pid = pid;
+  devices[i].fd = fds[0];
+}
+
+static void stop_device(int i) {
+  kill(devices[i].pid, SIGKILL);
+  waitpid(devices[i].pid, NULL, 0);
+  close(devices[i].fd);
+  devices[i].fd = -1;
+}
+
+/** Reads the reports of the running devices for ms */
+static void read_reports(int ms) {
+  int64_t end_us = monotonic_us() + ms * 1000LL;
+
+  for(int64_t now_us = monotonic_us(); now_us < end_us; now_us = monotonic_us()) {
+    struct pollfd pfds[DEVICE_COUNT];
+    for(int i=0; i < DEVICE_COUNT; ++i) {
+      pfds[i].fd = devices[i].fd;
+      pfds[i].events = POLLIN;
+      pfds[i].revents = 0;
+    }
+    if(poll(pfds, DEVICE_COUNT, (end_us - now_us + 999) / 1000) <= 0) continue;
+
+    for(int i=0; i < DEVICE_COUNT; ++i) {
+      if(!(pfds[i].revents & POLLIN)) continue;
+
+      report_t report;
+      if(read(devices[i].fd, &report, sizeof(report)) != sizeof(report)) continue;
+
+      if(devices[i].reports && report.time_us < devices[i].last.time_us) {
+        fprintf(stderr, "device %d went back %lld us\n", i, (long long)(devices[i].last.time_us - report.time_us));
+        ++devices[i].backwards;
+      }
+      devices[i].last = report;
+      ++devices[i].reports;
+    }
+  }
+}
+
+/** Returns the difference of the last reported times of two devices, as if they were reported together */
+static int64_t skew_us(int a, int b) {
+  int64_t skew_us = (devices[a].last.time_us - devices[a].last.monotonic_us) -
+      (devices[b].last.time_us - devices[b].last.monotonic_us);
+  return skew_us < 0 ? -skew_us : skew_us;
+}
+
+int main() {
+  if(!multicast_works()) {
+    printf("test_clock_sync: multicast does not reach this computer, skipped\n");
+    return SKIP_RESULT;
+  }
+
+  for(int i=0; i < DEVICE_COUNT; ++i) devices[i].fd = -1;
+
+  /* The devices join one after the other, and follow the first one */
+  for(int i=0; i < DEVICE_COUNT; ++i) {
+    start_device(i);
+    read_reports(JOIN_INTERVAL_MS);
+  }
+  read_reports(2 * JOIN_INTERVAL_MS);
+
+  HOST_CHECK(devices[0].last.leader);
+  for(int i=1; i < DEVICE_COUNT; ++i) {
+    HOST_CHECK(!devices[i].last.leader);
+    HOST_CHECK(devices[i].last.exchanges > 0);
+    HOST_CHECK(skew_us(0, i) < MAX_SKEW_US);
+  }
+
+  /* The next oldest device takes over when the leader stops, and keeps the clock */
+  int64_t before_us = devices[1].last.time_us - devices[1].last.monotonic_us;
+  stop_device(0);
+  read_reports(5000);
+
+  HOST_CHECK(devices[1].last.leader);
+  for(int i=2; i < DEVICE_COUNT; ++i) {
+    HOST_CHECK(!devices[i].last.leader);
+    HOST_CHECK(skew_us(1, i) < MAX_SKEW_US);
+  }
+  int64_t moved_us = devices[1].last.time_us - devices[1].last.monotonic_us - before_us;
+  HOST_CHECK(moved_us < MAX_SKEW_US && moved_us > -MAX_SKEW_US);
+
+  for(int i=0; i < DEVICE_COUNT; ++i) {
+    HOST_CHECK(devices[i].reports > 0);
+    HOST_CHECK_EQUAL(0, devices[i].backwards);
+    if(devices[i].fd >= 0) stop_device(i);
+  }
+
+  return host_test_result("test_clock_sync");
+}
@@ -0,0 +1,146 @@
+/*
+ * Copyright 2017 Sam Leitch
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Uploads effects to the effect resource, and checks that the led_ring resource reports them as the mode of the ring
+ * and that the layers together keep to the operation budget of a frame.
+ */
+
+#include "effect_resource.h"
+#include "host_coap.h"
+#include "host_rmt.h"
+#include "host_test.h"
+#include "led_ring.h"
+#include "led_effect.h"
+#include "led_ring_resource.h"
+
+#include <string.h>
+
+#define LED_COUNT 256 /* 128 operations for each LED, which four layers fill */
+
+static coap_context_t* context;
+
+/* A rainbow spinning one hue step per frame, at 30 fps (see README.md) */
+static const uint8_t rainbow[] = { 0x1e, 0x01, 0x01, 0x00, 0x10, 0x02, 0x00, 0x01, 0x32, 0x11, 0x33, 0x13, 0x14, 0x00, 0x32, 0x30, 0x51 };
+
+/** Sends a request to the resource at uri, with a URI query if query is not NULL. Returns the response code. */
+static int request(unsigned char method, const char* uri, const char* query, const uint8_t* data, size_t size) {
+  coap_pdu_t* request = coap_pdu_init(COAP_MESSAGE_CON, method, 1, COAP_MAX_PDU_SIZE);
+  if(query) coap_add_option(request, COAP_OPTION_URI_QUERY, strlen(query), (const unsigned char*)query);
+  if(data) coap_add_data(request, size, data);
+
+  coap_pdu_t* response = coap_pdu_init(COAP_MESSAGE_ACK, 0, 1, COAP_MAX_PDU_SIZE);
+  int code = host_coap_request(context, host_coap_find_resource(context, uri), NULL, request, response);
+
+  coap_delete_pdu(response);
+  coap_delete_pdu(request);
+  return code;
+}
+
+/** Returns true if a GET of the led_ring resource returns message */
+static bool led_ring_mode_is(const char* message) {
+  coap_pdu_t* request = coap_pdu_init(COAP_MESSAGE_CON, COAP_REQUEST_GET, 1, COAP_MAX_PDU_SIZE);
+  coap_pdu_t* response = coap_pdu_init(COAP_MESSAGE_ACK, 0, 1, COAP_MAX_PDU_SIZE);
+  HOST_CHECK_EQUAL(COAP_RESPONSE_CODE(205),
+      host_coap_request(context, host_coap_find_resource(context, "led_ring"), NULL, request, response));
+
+  size_t size = 0;
+  uint8_t* data = NULL;
+  coap_get_data(response, &size, &data);
+  bool result = size == strlen(message) && memcmp(data, message, size) == 0;
+
+  coap_delete_pdu(response);
+  coap_delete_pdu(request);
+  return result;
+}
+
+/** Playing effects changes the mode, and a mode set afterwards replaces them */
+static void test_effect_mode() {
+  HOST_CHECK(led_ring_mode_is("[\"solid_color\", 0, 0, 0]"));
+
+  uint32_t frames = host_rmt_get_frame_count(RMT_CHANNEL_0);
+  HOST_CHECK_EQUAL(COAP_RESPONSE_CODE(204), request(COAP_REQUEST_PUT, "effect", NULL, rainbow, sizeof(rainbow)));
+  HOST_CHECK(host_rmt_wait_frames(RMT_CHANNEL_0, frames + 2, 1000));
+  HOST_CHECK(led_ring_mode_is("[\"effect\"]"));
+
+  /* Another layer keeps the mode */
+  HOST_CHECK_EQUAL(COAP_RESPONSE_CODE(204),
+      request(COAP_REQUEST_PUT, "effect", "layer=1", rainbow, sizeof(rainbow)));
+  HOST_CHECK(led_ring_mode_is("[\"effect\"]"));
+
+  led_ring_resource_stats_t stats;
+  led_ring_resource_get_stats(&stats);
+  HOST_CHECK_EQUAL(2, stats.mode_requests[LED_RING_MODE_EFFECT]);
+
+  const char* spinning = "[\"spinning_dots\"]";
+  HOST_CHECK_EQUAL(COAP_RESPONSE_CODE(204),
+      request(COAP_REQUEST_PUT, "led_ring", NULL, (const uint8_t*)spinning, strlen(spinning)));
+  HOST_CHECK(led_ring_mode_is(spinning));
+}
+
+/** Fills upload with an effect of op_count operations, returns its size */
+static size_t make_effect(uint8_t* upload, int op_count) {
+  size_t size = 0;
+  upload[size++] = 30;
+  upload[size++] = 0;
+  upload[size++] = LED_EFFECT_OP_INDEX;
+  for(int i=3; i < op_count; ++i) upload[size++] = LED_EFFECT_OP_NEG;
+  upload[size++] = LED_EFFECT_OP_DUP;
+  upload[size++] = LED_EFFECT_OP_DUP;
+  return size;
+}
+
+/** The layers together may take at most LED_EFFECT_MAX_OPS_PER_FRAME operations for each frame */
+static void test_frame_budget() {
+  uint8_t upload[2 + LED_EFFECT_MAX_CODE_SIZE];
+  int max_ops = LED_EFFECT_MAX_OPS_PER_FRAME / LED_COUNT;
+  int layer_ops = max_ops / 4;
+  size_t size = make_effect(upload, layer_ops);
+
+  /* Four layers fit, and a fifth goes over */
+  HOST_CHECK_EQUAL(COAP_RESPONSE_CODE(204), request(COAP_REQUEST_PUT, "effect", NULL, upload, size));
+  HOST_CHECK_EQUAL(COAP_RESPONSE_CODE(204), request(COAP_REQUEST_PUT, "effect", "layer=1", upload, size));
+  HOST_CHECK_EQUAL(COAP_RESPONSE_CODE(204), request(COAP_REQUEST_PUT, "effect", "layer=2", upload, size));
+  HOST_CHECK_EQUAL(COAP_RESPONSE_CODE(204), request(COAP_REQUEST_PUT, "effect", "layer=3", upload, size));
+  HOST_CHECK_EQUAL(COAP_RESPONSE_CODE(413), request(COAP_REQUEST_PUT, "effect", "layer=4", upload, size));
+  HOST_CHECK_EQUAL(COAP_RESPONSE_CODE(404), request(COAP_REQUEST_GET, "effect", "layer=4", NULL, 0));
+
+  /* A layer is counted with its new effect in place of the old one */
+  size_t rest = make_effect(upload, max_ops - layer_ops * 3);
+  HOST_CHECK_EQUAL(COAP_RESPONSE_CODE(204), request(COAP_REQUEST_PUT, "effect", "layer=3", upload, rest));
+  rest = make_effect(upload, max_ops - layer_ops * 3 + 1);
+  HOST_CHECK_EQUAL(COAP_RESPONSE_CODE(413), request(COAP_REQUEST_PUT, "effect", "layer=3", upload, rest));
+
+  /* Deleting a layer makes room */
+  HOST_CHECK_EQUAL(COAP_RESPONSE_CODE(202), request(COAP_REQUEST_DELETE, "effect", "layer=2", NULL, 0));
+  size = make_effect(upload, layer_ops);
+  HOST_CHECK_EQUAL(COAP_RESPONSE_CODE(204), request(COAP_REQUEST_PUT, "effect", "layer=4", upload, size));
+
+  /* An effect without a layer replaces them all, so only it is counted */
+  size = make_effect(upload, max_ops);
+  HOST_CHECK_EQUAL(COAP_RESPONSE_CODE(204), request(COAP_REQUEST_PUT, "effect", NULL, upload, size));
+}
+
+int main() {
+  context = coap_new_context(NULL);
+  led_ring_t ring = led_ring_init(RMT_CHANNEL_0, 18, LED_COUNT);
+  HOST_CHECK(led_ring_resource_init(context, ring) != NULL);
+  HOST_CHECK(effect_resource_init(context, ring, NULL) != NULL);
+
+  test_effect_mode();
+  test_frame_budget();
+  return host_test_result("test_effect_resource");
+}
@@ -0,0 +1,194 @@
+/*
+ * Copyright 2017 Sam Leitch
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Encodes an animation with the reference encoder, maps it as the animation partition from a file,
+ * and plays it through the led_ring resource.
+ *
+ * Every frame has to decode to the frame that was encoded, in order and out of order, and the ring
+ * has to send the frame chosen by its clock. Without a partition, ["recorded"] is refused and
+ * the mode reported by GET does not change.
+ */
+
+#include "host_coap.h"
+#include "host_rmt.h"
+#include "host_test.h"
+#include "led_animation.h"
+#include "led_animation_encoder.h"
+#include "led_ring.h"
+#include "led_ring_resource.h"
+
+#include <esp_partition.h>
+#include <freertos/task.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define LED_COUNT 300
+#define FRAME_COUNT 40
+#define FRAMES_PER_SECOND 20
+#define KEYFRAME_INTERVAL 8
+#define FRAME_PERIOD_US (1000000 / FRAMES_PER_SECOND)
+
+static uint8_t frames[FRAME_COUNT][LED_COUNT * 3];
+static coap_context_t* context;
+static coap_resource_t* resource;
+static int64_t fixed_time_us = 1000000;
+
+static int64_t fixed_clock() {
+  return fixed_time_us;
+}
+
+/**
+ * Fills the frames with long runs of one color (the background), a dot that moves one LED a frame,
+ * and a block that changes color every 5 frames, so keyframes, small and large delta frames all appear.
+ */
+static void fill_frames() {
+  for(int f=0; f < FRAME_COUNT; ++f) {
+    for(int i=0; i < LED_COUNT; ++i) {
+      uint8_t* color = frames[f] + i * 3;
+      color[0] = i < LED_COUNT / 2 ? 10 : 0;
+      color[1] = 0;
+      color[2] = i < LED_COUNT / 2 ? 0 : 20;
+      if(i >= 100 && i < 160) {
+        color[0] = (f / 5) * 30;
+        color[1] = i;
+      }
+    }
+    uint8_t* dot = frames[f] + (f * 7 % LED_COUNT) * 3;
+    dot[0] = dot[1] = dot[2] = 255;
+  }
+}
+
+/** Returns the mode in the GET response of the ring, like ["recorded"] */
+static void get_mode(char* mode, size_t max_size) {
+  coap_pdu_t* request = coap_pdu_init(COAP_MESSAGE_CON, COAP_REQUEST_GET, 1, COAP_MAX_PDU_SIZE);
+  coap_pdu_t* response = coap_pdu_init(COAP_MESSAGE_ACK, 0, 1, COAP_MAX_PDU_SIZE);
+  HOST_CHECK_EQUAL(COAP_RESPONSE_CODE(205), host_coap_request(context, resource, NULL, request, response));
+
+  size_t size = 0;
+  uint8_t* data = NULL;
+  coap_get_data(response, &size, &data);
+  if(size >= max_size) size = max_size - 1;
+  memcpy(mode, data, size);
+  mode[size] = 0;
+
+  coap_delete_pdu(response);
+  coap_delete_pdu(request);
+}
+
+static int put_recorded() {
+  const char* json = "[\"recorded\"]";
+  coap_pdu_t* request = coap_pdu_init(COAP_MESSAGE_CON, COAP_REQUEST_PUT, 1, COAP_MAX_PDU_SIZE);
+  coap_add_data(request, strlen(json), (unsigned char*)json);
+  coap_pdu_t* response = coap_pdu_init(COAP_MESSAGE_ACK, 0, 1, COAP_MAX_PDU_SIZE);
+  int code = host_coap_request(context, resource, NULL, request, response);
+  coap_delete_pdu(response);
+  coap_delete_pdu(request);
+  return code;
+}
+
+/** Every frame decodes to the frame encoded, whichever frame was decoded before it */
+static void test_decode(const uint8_t* data, size_t size) {
+  led_animation_t animation = led_animation_init(data, size);
+  HOST_CHECK(animation != NULL);
+  if(!animation) return;
+
+  HOST_CHECK_EQUAL(LED_COUNT, led_animation_get_led_count(animation));
+  HOST_CHECK_EQUAL(FRAME_COUNT, led_animation_get_frame_count(animation));
+  HOST_CHECK_EQUAL(FRAMES_PER_SECOND, led_animation_get_frames_per_second(animation));
+
+  for(int f=0; f < FRAME_COUNT; ++f) {
+    const uint8_t* colors = led_animation_decode(animation, f);
+    HOST_CHECK(colors && memcmp(colors, frames[f], sizeof(frames[f])) == 0);
+  }
+
+  const int order[] = { 37, 3, 3, 8, 9, 31, 0, 39, 40, 17 };
+  for(int i=0; i < sizeof(order) / sizeof(order[0]); ++i) {
+    const uint8_t* colors = led_animation_decode(animation, order[i]);
+    HOST_CHECK(colors && memcmp(colors, frames[order[i] % FRAME_COUNT], sizeof(frames[0])) == 0);
+  }
+
+  led_animation_uninit(&animation);
+}
+
+/** Waits up to a second for the ring to send frame f (in GRB order) */
+static bool wait_for_frame(int f) {
+  static uint8_t expected[LED_COUNT * 3];
+  for(int i=0; i < LED_COUNT; ++i) {
+    expected[i * 3] = frames[f][i * 3 + 1];
+    expected[i * 3 + 1] = frames[f][i * 3];
+    expected[i * 3 + 2] = frames[f][i * 3 + 2];
+  }
+
+  for(int ms=0; ms < 1000; ++ms) {
+    uint8_t bytes[LED_COUNT * 3];
+    int size = host_rmt_get_frame(RMT_CHANNEL_0, bytes, sizeof(bytes));
+    if(size == sizeof(bytes) && memcmp(bytes, expected, sizeof(bytes)) == 0) return true;
+    vTaskDelay(1);
+  }
+  return false;
+}
+
+int main() {
+  context = coap_new_context(NULL);
+  led_ring_t ring = led_ring_init(RMT_CHANNEL_0, 18, LED_COUNT);
+  led_ring_set_clock(ring, fixed_clock);
+  led_ring_resource_init(context, ring);
+  resource = host_coap_find_resource(context, "led_ring");
+
+  /* Nothing is recorded yet, so the mode stays */
+  char mode[64];
+  HOST_CHECK_EQUAL(COAP_RESPONSE_CODE(404), put_recorded());
+  HOST_CHECK(!led_ring_resource_play_recorded(ring));
+  get_mode(mode, sizeof(mode));
+  HOST_CHECK(strstr(mode, "solid_color") != NULL);
+
+  fill_frames();
+  size_t size;
+  uint8_t* data = led_animation_encode(frames[0], LED_COUNT, FRAME_COUNT, FRAMES_PER_SECOND, KEYFRAME_INTERVAL, &size);
+  HOST_CHECK(data != NULL);
+  if(!data) return host_test_result("test_led_animation_partition");
+  HOST_CHECK(size < sizeof(frames) / 4);
+  test_decode(data, size);
+
+  char path[] = "/tmp/test_led_animation_XXXXXX";
+  int fd = mkstemp(path);
+  HOST_CHECK(fd >= 0 && write(fd, data, size) == size);
+  close(fd);
+  HOST_CHECK(host_partition_set_file(LED_ANIMATION_PARTITION_LABEL, path));
+
+  /* The ring plays the mapped animation at its frame rate, choosing the frame by its clock */
+  HOST_CHECK(led_ring_resource_play_recorded(ring));
+  get_mode(mode, sizeof(mode));
+  HOST_CHECK(strstr(mode, "recorded") != NULL);
+  HOST_CHECK(wait_for_frame(0));
+
+  const int shown[] = { 1, 2, 9, 23, 39 };
+  for(int i=0; i < sizeof(shown) / sizeof(shown[0]); ++i) {
+    fixed_time_us += FRAME_PERIOD_US;
+    led_ring_set_epoch(ring, fixed_time_us - shown[i] * FRAME_PERIOD_US);
+    HOST_CHECK(wait_for_frame(shown[i]));
+  }
+
+  /* A request plays it too */
+  HOST_CHECK_EQUAL(COAP_RESPONSE_CODE(204), put_recorded());
+  HOST_CHECK(wait_for_frame(0));
+
+  unlink(path);
+  free(data);
+  return host_test_result("test_led_animation_partition");
+}
@@ -0,0 +1,140 @@
+/*
+ * Copyright 2017 Sam Leitch
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Plays music with known beats through a WAV file into the analysis, as the animation task would at 30 fps,
+ * and checks that every beat is found soon after it starts and nothing else is a beat.
+ * Also checks the bands of a tone, silence and a full ring.
+ */
+
+#include "host_audio.h"
+#include "host_test.h"
+#include "led_audio.h"
+#include "led_audio_wav.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define SAMPLE_RATE 16000
+#define DURATION_S 20
+#define FRAME_RATE 30
+#define MAX_BEAT_DELAY_S 0.1 /* From the start of a beat to the end of the frame that shows it */
+
+static void test_wav(const int16_t* music, int count) {
+  char path[] = "/tmp/test_led_audio_XXXXXX";
+  int fd = mkstemp(path);
+  HOST_CHECK(fd >= 0);
+  close(fd);
+
+  HOST_CHECK(led_audio_wav_write(path, music, count, SAMPLE_RATE));
+  led_audio_wav_t wav;
+  HOST_CHECK(led_audio_wav_read(&wav, path));
+  HOST_CHECK_EQUAL(SAMPLE_RATE, wav.sample_rate);
+  HOST_CHECK_EQUAL(count, wav.sample_count);
+  HOST_CHECK(wav.samples && memcmp(music, wav.samples, count * sizeof(int16_t)) == 0);
+  led_audio_wav_free(&wav);
+
+  /* A file that is not a WAV is not read */
+  FILE* file = fopen(path, "wb");
+  fputs("not a sound", file);
+  fclose(file);
+  HOST_CHECK(!led_audio_wav_read(&wav, path));
+  HOST_CHECK(wav.samples == NULL);
+  unlink(path);
+}
+
+static void test_beats(const int16_t* music, int count, int beat_count) {
+  led_audio_wav_t wav = { SAMPLE_RATE, count, (int16_t*)music, 0 };
+  led_audio_t audio = led_audio_init(SAMPLE_RATE);
+  HOST_CHECK(audio != NULL);
+
+  int found = 0;
+  int false_beats = 0;
+  int last_count = 0;
+  while(led_audio_wav_play(&wav, audio, SAMPLE_RATE / FRAME_RATE)) {
+    HOST_CHECK(led_audio_update(audio));
+    const int32_t* inputs = led_audio_get_inputs(audio);
+    if(inputs[LED_AUDIO_INPUT_BEAT_COUNT] == last_count) continue;
+    last_count = inputs[LED_AUDIO_INPUT_BEAT_COUNT];
+
+    double time = (double)wav.position / SAMPLE_RATE;
+    double since_beat = time - HOST_AUDIO_FIRST_BEAT_S;
+    since_beat -= HOST_AUDIO_BEAT_INTERVAL_S * (int)(since_beat / HOST_AUDIO_BEAT_INTERVAL_S);
+    if(time >= HOST_AUDIO_FIRST_BEAT_S && since_beat < MAX_BEAT_DELAY_S) {
+      ++found;
+      HOST_CHECK_EQUAL(255, inputs[LED_AUDIO_INPUT_BEAT]);
+    } else {
+      fprintf(stderr, "beat at %.3f s\n", time);
+      ++false_beats;
+    }
+  }
+
+  HOST_CHECK_EQUAL(beat_count, found);
+  HOST_CHECK_EQUAL(0, false_beats);
+
+  /* Nothing new, nothing changes */
+  HOST_CHECK(!led_audio_update(audio));
+  led_audio_uninit(&audio);
+  HOST_CHECK(audio == NULL);
+}
+
+static void test_tone_and_silence() {
+  static int16_t samples[SAMPLE_RATE];
+  led_audio_t audio = led_audio_init(SAMPLE_RATE);
+
+  /* 440 Hz is the lowest frequency of band 3 */
+  for(int i=0; i < SAMPLE_RATE; ++i) samples[i] = (int16_t)(8000 * sin(2 * M_PI * 460 * i / SAMPLE_RATE));
+  for(int i=0; i + SAMPLE_RATE / FRAME_RATE <= SAMPLE_RATE; i += SAMPLE_RATE / FRAME_RATE) {
+    led_audio_write(audio, samples + i, SAMPLE_RATE / FRAME_RATE);
+    led_audio_update(audio);
+  }
+
+  const int32_t* inputs = led_audio_get_inputs(audio);
+  HOST_CHECK_EQUAL(255, inputs[LED_AUDIO_INPUT_BAND + 3]);
+  HOST_CHECK(inputs[LED_AUDIO_INPUT_BAND + 7] < 128);
+  HOST_CHECK(inputs[LED_AUDIO_INPUT_LEVEL] > 200);
+  HOST_CHECK(inputs[LED_AUDIO_INPUT_PHASE] > 0);
+
+  memset(samples, 0, sizeof(samples));
+  led_audio_write(audio, samples, SAMPLE_RATE / FRAME_RATE);
+  led_audio_update(audio);
+  for(int band=0; band < LED_AUDIO_BAND_COUNT; ++band) HOST_CHECK_EQUAL(0, inputs[LED_AUDIO_INPUT_BAND + band]);
+  HOST_CHECK_EQUAL(0, inputs[LED_AUDIO_INPUT_LEVEL]);
+
+  /* Without updates the ring fills, and the rest is dropped */
+  int written = led_audio_write(audio, samples, SAMPLE_RATE);
+  HOST_CHECK(written > 0 && written < SAMPLE_RATE);
+  HOST_CHECK_EQUAL(0, led_audio_write(audio, samples, 1));
+  HOST_CHECK(led_audio_update(audio));
+  HOST_CHECK_EQUAL(1, led_audio_write(audio, samples, 1));
+
+  led_audio_uninit(&audio);
+}
+
+int main() {
+  int count = SAMPLE_RATE * DURATION_S;
+  int16_t* music = malloc(count * sizeof(int16_t));
+  int beat_count = host_audio_make_music(music, count, SAMPLE_RATE);
+
+  test_wav(music, count);
+  test_beats(music, count, beat_count);
+  test_tone_and_silence();
+
+  free(music);
+  return host_test_result("test_led_audio");
+}
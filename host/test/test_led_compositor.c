@@ -0,0 +1,133 @@
+/*
+ * Copyright 2017 Sam Leitch
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Checks the packed blends against a blend of one channel at a time.
+ *
+ * Every blend mode is checked for every opacity and every pair of channel values, since the packed
+ * add and max carry and borrow between bits and an error would only show for a few values.
+ * Each pixel also holds two other channels, to check that nothing crosses into them.
+ */
+
+#include "host_test.h"
+#include "led_compositor.h"
+
+#include <stdint.h>
+#include <string.h>
+
+/** The blend of one channel, as the compositor documents it */
+static uint8_t blend_channel(led_compositor_blend_t blend, int below, int above, int opacity) {
+  int blended;
+  switch(blend) {
+  case LED_COMPOSITOR_BLEND_ADD:
+    blended = below + above > 255 ? 255 : below + above;
+    break;
+  case LED_COMPOSITOR_BLEND_MAX:
+    blended = below > above ? below : above;
+    break;
+  case LED_COMPOSITOR_BLEND_MULTIPLY: {
+    int product = below * above;
+    blended = (product + 1 + (product >> 8)) >> 8;
+    break;
+  }
+  default:
+    blended = above;
+    break;
+  }
+
+  if(opacity == 0) return below;
+  int weight = opacity + (opacity >> 7);
+  return ((blended * weight) >> 8) + ((below * (256 - weight)) >> 8);
+}
+
+/** Returns the number of pixels that differ from blend_channel, for every value below and above */
+static int count_blend_errors(led_compositor_blend_t blend, int opacity) {
+  uint32_t pixels[256];
+  uint8_t colors[256 * 3];
+  int errors = 0;
+
+  for(int below=0; below < 256; ++below) {
+    uint8_t below_colors[3] = { below, 255 - below, (below * 7) & 255 };
+    for(int above=0; above < 256; ++above) {
+      pixels[above] = below_colors[0] | (below_colors[1] << 8) | ((uint32_t)below_colors[2] << 16);
+      colors[above * 3] = above;
+      colors[above * 3 + 1] = (above * 13) & 255;
+      colors[above * 3 + 2] = 255 - above;
+    }
+
+    led_compositor_blend(pixels, colors, 256, blend, opacity);
+
+    for(int above=0; above < 256; ++above) {
+      uint32_t expected = 0;
+      for(int channel=0; channel < 3; ++channel) {
+        expected |= (uint32_t)blend_channel(blend, below_colors[channel], colors[above * 3 + channel], opacity) << (channel * 8);
+      }
+      if(pixels[above] != expected) ++errors;
+    }
+  }
+
+  return errors;
+}
+
+static void test_blends() {
+  for(int blend=0; blend < LED_COMPOSITOR_BLEND_COUNT; ++blend) {
+    int errors = 0;
+    for(int opacity=0; opacity < 256; ++opacity) errors += count_blend_errors(blend, opacity);
+    HOST_CHECK_EQUAL(0, errors);
+  }
+}
+
+static const uint8_t* solid_layer(void* arg, int64_t frame_number) {
+  return arg;
+}
+
+static const uint8_t* empty_layer(void* arg, int64_t frame_number) {
+  return NULL;
+}
+
+static void test_render() {
+  static uint8_t red[2 * 3] = { 200, 0, 0, 200, 0, 0 };
+  static uint8_t blue[2 * 3] = { 0, 0, 100, 100, 0, 100 };
+
+  led_compositor_t compositor;
+  HOST_CHECK(led_compositor_init(&compositor, 2));
+
+  /* Nothing is drawn without layers */
+  const uint8_t* colors = led_compositor_render(&compositor, 0);
+  uint8_t black[2 * 3] = { 0 };
+  HOST_CHECK(memcmp(black, colors, sizeof(black)) == 0);
+
+  /* The first layer is blended onto black, and a layer without colors is left out */
+  compositor.layers[0] = (led_compositor_layer_t){ solid_layer, red, LED_COMPOSITOR_BLEND_ALPHA, 255 };
+  compositor.layers[1] = (led_compositor_layer_t){ empty_layer, NULL, LED_COMPOSITOR_BLEND_ALPHA, 255 };
+  compositor.layers[2] = (led_compositor_layer_t){ solid_layer, blue, LED_COMPOSITOR_BLEND_ADD, 255 };
+  colors = led_compositor_render(&compositor, 1);
+  uint8_t added[2 * 3] = { 200, 0, 100, 255, 0, 100 };
+  HOST_CHECK(memcmp(added, colors, sizeof(added)) == 0);
+
+  compositor.layers[2].blend = LED_COMPOSITOR_BLEND_MAX;
+  colors = led_compositor_render(&compositor, 2);
+  uint8_t brightest[2 * 3] = { 200, 0, 100, 200, 0, 100 };
+  HOST_CHECK(memcmp(brightest, colors, sizeof(brightest)) == 0);
+
+  led_compositor_uninit(&compositor);
+}
+
+int main() {
+  test_blends();
+  test_render();
+  return host_test_result("test_led_compositor");
+}
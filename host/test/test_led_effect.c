@@ -0,0 +1,189 @@
+/*
+ * Copyright 2017 Sam Leitch
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Loads effect programs and checks the colors they render, and that the loader rejects every program
+ * that could go wrong while running: unbalanced stacks, operations that run past the end of the program
+ * or read a missing parameter or input, and programs over the operation budget of a frame.
+ */
+
+#include "host_test.h"
+#include "led_effect.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#define LED_COUNT 24
+
+/* The header of an effect at 30 fps without parameters */
+#define NO_PARAMS 0x1e, 0x00
+
+#define LOAD(effect, upload, led_count) led_effect_load(effect, upload, sizeof(upload), led_count)
+
+static uint8_t colors[LED_COUNT * 3];
+
+/** Checks the color of an LED rendered into colors */
+static void check_color(int led, int r, int g, int b) {
+  HOST_CHECK_EQUAL(r, colors[led * 3]);
+  HOST_CHECK_EQUAL(g, colors[led * 3 + 1]);
+  HOST_CHECK_EQUAL(b, colors[led * 3 + 2]);
+}
+
+static void render(const led_effect_t* effect, int64_t frame_number, const int32_t* inputs) {
+  memset(colors, 0xAA, sizeof(colors));
+  led_effect_render(effect, frame_number, inputs, colors, LED_COUNT);
+}
+
+/** Valid programs render the colors of their operations, clamped to 0-255 */
+static void test_render() {
+  int32_t inputs[LED_EFFECT_MAX_INPUTS] = { 0 };
+  led_effect_t effect;
+
+  const uint8_t solid[] = { NO_PARAMS, LED_EFFECT_OP_PUSH8, 1, LED_EFFECT_OP_PUSH8, 2, LED_EFFECT_OP_PUSH8, 3 };
+  HOST_CHECK(LOAD(&effect, solid, LED_COUNT));
+  HOST_CHECK_EQUAL(30, effect.frames_per_second);
+  HOST_CHECK_EQUAL(3, effect.op_count);
+  render(&effect, 0, inputs);
+  for(int i=0; i < LED_COUNT; ++i) check_color(i, 1, 2, 3);
+
+  /* -5 and 300 are clamped */
+  const uint8_t clamped[] = { NO_PARAMS, LED_EFFECT_OP_PUSH16, 0xfb, 0xff, LED_EFFECT_OP_PUSH16, 0x2c, 0x01,
+      LED_EFFECT_OP_PUSH8, 7 };
+  HOST_CHECK(LOAD(&effect, clamped, LED_COUNT));
+  render(&effect, 0, inputs);
+  check_color(0, 0, 255, 7);
+
+  /* The spinning rainbow of README.md, its parameter is the hue step of each frame */
+  const uint8_t rainbow[] = { 0x1e, 0x01, 0x01, 0x00, LED_EFFECT_OP_INDEX, LED_EFFECT_OP_PUSH16, 0x00, 0x01,
+      LED_EFFECT_OP_MUL, LED_EFFECT_OP_COUNT, LED_EFFECT_OP_DIV, LED_EFFECT_OP_FRAME, LED_EFFECT_OP_PARAM, 0,
+      LED_EFFECT_OP_MUL, LED_EFFECT_OP_ADD, LED_EFFECT_OP_HUE };
+  HOST_CHECK(LOAD(&effect, rainbow, LED_COUNT));
+  HOST_CHECK_EQUAL(1, effect.params[0]);
+  render(&effect, 0, inputs);
+  check_color(0, 255, 0, 0);
+  check_color(6, 127, 255, 0); /* Hue 64, a third of the way from yellow to green */
+  render(&effect, 64, inputs);
+  check_color(0, 127, 255, 0);
+
+  /* Parameters are signed, inputs are given for each frame and the time follows the frame rate */
+  const uint8_t live[] = { 0x0a, 0x02, 0xff, 0xff, 0x2c, 0x01, LED_EFFECT_OP_PARAM, 0, LED_EFFECT_OP_PARAM, 1,
+      LED_EFFECT_OP_ADD, LED_EFFECT_OP_INPUT, 3, LED_EFFECT_OP_TIME, LED_EFFECT_OP_PUSH8, 100, LED_EFFECT_OP_DIV };
+  HOST_CHECK(LOAD(&effect, live, LED_COUNT));
+  inputs[3] = 42;
+  render(&effect, 25, inputs);
+  check_color(LED_COUNT - 1, 255, 42, 25);
+
+  /* Dividing by 0 gives 0, and SELECT picks on its condition */
+  const uint8_t select[] = { NO_PARAMS, LED_EFFECT_OP_PUSH8, 9, LED_EFFECT_OP_PUSH8, 0, LED_EFFECT_OP_DIV,
+      LED_EFFECT_OP_INDEX, LED_EFFECT_OP_PUSH8, 2, LED_EFFECT_OP_LT, LED_EFFECT_OP_PUSH8, 200, LED_EFFECT_OP_PUSH8, 50,
+      LED_EFFECT_OP_SELECT, LED_EFFECT_OP_PUSH8, 255, LED_EFFECT_OP_PUSH8, 128, LED_EFFECT_OP_SCALE };
+  HOST_CHECK(LOAD(&effect, select, LED_COUNT));
+  render(&effect, 0, inputs);
+  check_color(1, 0, 200, 128);
+  check_color(2, 0, 50, 128);
+}
+
+/** Loads a program that pushes depth values and drops all but three of them */
+static bool load_deep(led_effect_t* effect, int depth) {
+  uint8_t upload[2 + LED_EFFECT_STACK_SIZE * 2 + 2] = { NO_PARAMS };
+  size_t size = 2;
+  for(int i=0; i < depth; ++i) upload[size++] = LED_EFFECT_OP_INDEX;
+  for(int i=3; i < depth; ++i) upload[size++] = LED_EFFECT_OP_DROP;
+  return led_effect_load(effect, upload, size, LED_COUNT);
+}
+
+/** Programs that do not leave exactly r, g and b, or take more than the stack holds, are rejected */
+static void test_unbalanced_stack() {
+  led_effect_t effect;
+
+  const uint8_t two[] = { NO_PARAMS, LED_EFFECT_OP_PUSH8, 1, LED_EFFECT_OP_PUSH8, 2 };
+  HOST_CHECK(!LOAD(&effect, two, LED_COUNT));
+
+  const uint8_t four[] = { NO_PARAMS, LED_EFFECT_OP_INDEX, LED_EFFECT_OP_DUP, LED_EFFECT_OP_DUP, LED_EFFECT_OP_DUP };
+  HOST_CHECK(!LOAD(&effect, four, LED_COUNT));
+
+  /* Underflows before it ends up with three values */
+  const uint8_t underflow[] = { NO_PARAMS, LED_EFFECT_OP_ADD, LED_EFFECT_OP_INDEX, LED_EFFECT_OP_DUP,
+      LED_EFFECT_OP_DUP };
+  HOST_CHECK(!LOAD(&effect, underflow, LED_COUNT));
+
+  /* Overflows before it ends up with three values, while a full stack is fine */
+  HOST_CHECK(!load_deep(&effect, LED_EFFECT_STACK_SIZE + 1));
+  HOST_CHECK(load_deep(&effect, LED_EFFECT_STACK_SIZE));
+}
+
+/**
+ * The program has no jumps, so every operation is followed in order and the only ways to reach outside it
+ * are an immediate past the end of the code and an index past the parameters or inputs.
+ */
+static void test_out_of_range() {
+  led_effect_t effect;
+
+  const uint8_t truncated[] = { NO_PARAMS, LED_EFFECT_OP_PUSH8, 1, LED_EFFECT_OP_PUSH8, 2, LED_EFFECT_OP_PUSH16, 3 };
+  HOST_CHECK(!LOAD(&effect, truncated, LED_COUNT));
+
+  const uint8_t param[] = { 0x1e, 0x01, 0x05, 0x00, LED_EFFECT_OP_PARAM, 1, LED_EFFECT_OP_DUP, LED_EFFECT_OP_DUP };
+  HOST_CHECK(!LOAD(&effect, param, LED_COUNT));
+
+  const uint8_t input[] = { NO_PARAMS, LED_EFFECT_OP_INPUT, LED_EFFECT_MAX_INPUTS, LED_EFFECT_OP_DUP,
+      LED_EFFECT_OP_DUP };
+  HOST_CHECK(!LOAD(&effect, input, LED_COUNT));
+
+  const uint8_t unknown[] = { NO_PARAMS, 0xff, LED_EFFECT_OP_INDEX, LED_EFFECT_OP_DUP, LED_EFFECT_OP_DUP };
+  HOST_CHECK(!LOAD(&effect, unknown, LED_COUNT));
+
+  /* The header is checked too */
+  const uint8_t no_code[] = { NO_PARAMS };
+  HOST_CHECK(!LOAD(&effect, no_code, LED_COUNT));
+  const uint8_t no_rate[] = { 0x00, 0x00, LED_EFFECT_OP_INDEX, LED_EFFECT_OP_DUP, LED_EFFECT_OP_DUP };
+  HOST_CHECK(!LOAD(&effect, no_rate, LED_COUNT));
+  const uint8_t missing_params[] = { 0x1e, 0x02, 0x01, 0x00, LED_EFFECT_OP_INDEX };
+  HOST_CHECK(!LOAD(&effect, missing_params, LED_COUNT));
+
+  uint8_t too_long[2 + LED_EFFECT_MAX_CODE_SIZE + 1] = { NO_PARAMS };
+  for(int i=2; i < sizeof(too_long); ++i) too_long[i] = LED_EFFECT_OP_NEG;
+  too_long[2] = LED_EFFECT_OP_INDEX;
+  too_long[3] = LED_EFFECT_OP_DUP;
+  too_long[4] = LED_EFFECT_OP_DUP;
+  HOST_CHECK(!led_effect_load(&effect, too_long, sizeof(too_long), 1));
+  HOST_CHECK(led_effect_load(&effect, too_long, sizeof(too_long) - 1, 1));
+}
+
+/** A frame of the ring may take at most LED_EFFECT_MAX_OPS_PER_FRAME operations */
+static void test_budget() {
+  led_effect_t effect;
+  const uint8_t ten_ops[] = { NO_PARAMS, LED_EFFECT_OP_INDEX, LED_EFFECT_OP_NEG, LED_EFFECT_OP_NEG,
+      LED_EFFECT_OP_NEG, LED_EFFECT_OP_NEG, LED_EFFECT_OP_NEG, LED_EFFECT_OP_NEG, LED_EFFECT_OP_NEG,
+      LED_EFFECT_OP_DUP, LED_EFFECT_OP_DUP };
+
+  HOST_CHECK(LOAD(&effect, ten_ops, LED_EFFECT_MAX_OPS_PER_FRAME / 10));
+  HOST_CHECK_EQUAL(10, effect.op_count);
+  HOST_CHECK(!LOAD(&effect, ten_ops, LED_EFFECT_MAX_OPS_PER_FRAME / 10 + 1));
+
+  /* Does not overflow for the longest strips */
+  HOST_CHECK(!LOAD(&effect, ten_ops, 0x7fffffff));
+
+  /* A rejected program leaves the loaded effect as it was */
+  HOST_CHECK_EQUAL(10, effect.op_count);
+}
+
+int main() {
+  test_render();
+  test_unbalanced_stack();
+  test_out_of_range();
+  test_budget();
+  return host_test_result("test_led_effect");
+}
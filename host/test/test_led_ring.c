@@ -0,0 +1,347 @@
+/*
+ * Copyright 2017 Sam Leitch
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** Shows scenes and animations on rings and checks the frames decoded from the RMT stand-in */
+
+#include "host_rmt.h"
+#include "host_test.h"
+#include "led_ring.h"
+
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LED_COUNT 12
+
+static int64_t fixed_time_us = 0;
+
+static int64_t fixed_clock() {
+  return fixed_time_us;
+}
+
+/** Waits up to a second for the ring on channel to show colors (in GRB order) */
+static bool wait_for_colors(rmt_channel_t channel, const rgb_t* colors) {
+  uint8_t expected[LED_COUNT * 3];
+  for(int i=0; i < LED_COUNT; ++i) {
+    expected[i * 3] = colors[i].g;
+    expected[i * 3 + 1] = colors[i].r;
+    expected[i * 3 + 2] = colors[i].b;
+  }
+
+  for(int ms=0; ms < 1000; ++ms) {
+    uint8_t bytes[LED_COUNT * 3];
+    int size = host_rmt_get_frame(channel, bytes, sizeof(bytes));
+    if(size == sizeof(bytes) && memcmp(bytes, expected, sizeof(bytes)) == 0) return true;
+    vTaskDelay(1);
+  }
+  return false;
+}
+
+static void test_ring(rmt_channel_t channel, led_ring_t ring) {
+  HOST_CHECK(ring != NULL);
+  led_ring_set_clock(ring, fixed_clock);
+
+  rgb_t colors[LED_COUNT];
+  for(int i=0; i < LED_COUNT; ++i) colors[i] = (rgb_t){ i, 2 * i, 255 - i };
+
+  /* A static scene is shown when it is published */
+  led_ring_set_colors(ring, colors);
+  led_ring_update(ring);
+  HOST_CHECK(wait_for_colors(channel, colors));
+
+  /* The spinner shows the pattern rotated by the frame number, chosen from the time since the epoch */
+  led_ring_set_frame_rate(ring, 100);
+  led_ring_start_spinner_loop(ring);
+  led_ring_set_epoch(ring, fixed_time_us - 3 * 10000);
+  rgb_t rotated[LED_COUNT];
+  for(int i=0; i < LED_COUNT; ++i) rotated[i] = colors[(i + 3) % LED_COUNT];
+  HOST_CHECK(wait_for_colors(channel, rotated));
+
+  fixed_time_us += 2 * 10000;
+  for(int i=0; i < LED_COUNT; ++i) rotated[i] = colors[(i + 5) % LED_COUNT];
+  HOST_CHECK(wait_for_colors(channel, rotated));
+
+  /* Frames of a frames loop */
+  static rgb_t frames[4][LED_COUNT];
+  for(int f=0; f < 4; ++f) {
+    for(int i=0; i < LED_COUNT; ++i) frames[f][i] = (rgb_t){ f * 10, i, 7 };
+  }
+  led_ring_start_frames_loop(ring, frames[0], 4);
+  HOST_CHECK(wait_for_colors(channel, frames[0]));
+  fixed_time_us += 6 * 10000;
+  HOST_CHECK(wait_for_colors(channel, frames[2]));
+
+  /* Stopping the loop keeps the last frame until the next update */
+  led_ring_stop_loop(ring);
+  fixed_time_us += 10000;
+  vTaskDelay(30);
+  HOST_CHECK(wait_for_colors(channel, frames[2]));
+  led_ring_set_one_color(ring, (rgb_t){ 1, 2, 3 });
+  led_ring_update(ring);
+  rgb_t solid[LED_COUNT];
+  for(int i=0; i < LED_COUNT; ++i) solid[i] = (rgb_t){ 1, 2, 3 };
+  HOST_CHECK(wait_for_colors(channel, solid));
+
+  HOST_CHECK_EQUAL(0, host_rmt_get_errors(channel));
+}
+
+#define RAINBOW_COUNT 6 /* More rainbows than the palette cache holds, so entries are replaced */
+#define RAINBOW_ROUNDS 20000
+
+typedef struct rainbow_test_s {
+  led_ring_t ring;
+  rgb_t* expected[RAINBOW_COUNT];
+  int wrong;
+  SemaphoreHandle_t done;
+} rainbow_test_t;
+
+static void set_rainbow(led_ring_t ring, int rainbow) {
+  led_ring_set_rainbow_range(ring, 40 * rainbow, 30 * rainbow, 200 - 10 * rainbow);
+}
+
+/** Sets the rainbows over and over, checking the colors each time */
+static void rainbow_task(void* param) {
+  rainbow_test_t* test = param;
+  int led_count = led_ring_get_led_count(test->ring);
+  for(int round=0; round < RAINBOW_ROUNDS; ++round) {
+    int rainbow = round % RAINBOW_COUNT;
+    set_rainbow(test->ring, rainbow);
+    if(memcmp(led_ring_get_color_buffer(test->ring), test->expected[rainbow], led_count * sizeof(rgb_t)) != 0) {
+      ++test->wrong;
+    }
+  }
+  xSemaphoreGive(test->done);
+  vTaskDelete(NULL);
+}
+
+/** Rings of different sizes have their own palette caches, so tasks setting rainbows on them do not mix them up */
+static void test_rainbow_caches() {
+  rainbow_test_t tests[2] = {
+    { .ring = led_ring_init(RMT_CHANNEL_2, 20, 24) },
+    { .ring = led_ring_init(RMT_CHANNEL_3, 21, 60) },
+  };
+
+  for(int t=0; t < 2; ++t) {
+    int led_count = led_ring_get_led_count(tests[t].ring);
+    for(int rainbow=0; rainbow < RAINBOW_COUNT; ++rainbow) {
+      set_rainbow(tests[t].ring, rainbow);
+      tests[t].expected[rainbow] = malloc(led_count * sizeof(rgb_t));
+      memcpy(tests[t].expected[rainbow], led_ring_get_color_buffer(tests[t].ring), led_count * sizeof(rgb_t));
+    }
+    tests[t].done = xSemaphoreCreateBinary();
+  }
+
+  for(int t=0; t < 2; ++t) xTaskCreate(rainbow_task, "rainbow", 2048, tests + t, 5, NULL);
+  for(int t=0; t < 2; ++t) {
+    xSemaphoreTake(tests[t].done, portMAX_DELAY);
+    HOST_CHECK_EQUAL(0, tests[t].wrong);
+  }
+}
+
+#define WRITER_COUNT 2
+#define WRITER_ROUNDS 5000
+#define WRITER_LED_COUNT 300
+
+typedef struct writer_test_s {
+  led_ring_t ring;
+  rgb_t color;
+  int wrong;
+  SemaphoreHandle_t done;
+} writer_test_t;
+
+static volatile bool writers_running;
+
+/** Fills the ring with one color and publishes it, checking that no other task changed the draft in between */
+static void writer_task(void* param) {
+  writer_test_t* test = param;
+  for(int round=0; round < WRITER_ROUNDS; ++round) {
+    led_ring_lock(test->ring);
+    led_ring_stop_loop(test->ring);
+    led_ring_set_one_color(test->ring, test->color);
+    vTaskDelay(0); /* Gives the other writer a chance to run */
+    rgb_t* colors = led_ring_get_color_buffer(test->ring);
+    for(int i=0; i < WRITER_LED_COUNT; ++i) {
+      if(!rgb_equal(colors[i], test->color)) {
+        ++test->wrong;
+        break;
+      }
+    }
+    led_ring_update(test->ring);
+    led_ring_unlock(test->ring);
+  }
+  xSemaphoreGive(test->done);
+  vTaskDelete(NULL);
+}
+
+/** Tasks changing the same ring under its lock never mix their colors, in the draft or on the LEDs */
+static void test_writers() {
+  led_ring_t ring = led_ring_init(RMT_CHANNEL_4, 22, WRITER_LED_COUNT);
+  writer_test_t tests[WRITER_COUNT] = {
+    { .ring = ring, .color = { 255, 0, 0 } },
+    { .ring = ring, .color = { 0, 0, 255 } },
+  };
+
+  for(int t=0; t < WRITER_COUNT; ++t) {
+    tests[t].done = xSemaphoreCreateBinary();
+    xTaskCreate(writer_task, "writer", 2048, tests + t, 5, NULL);
+  }
+
+  /* Every frame sent shows a single color */
+  int mixed_frames = 0;
+  int finished = 0;
+  while(finished < WRITER_COUNT) {
+    static uint8_t bytes[WRITER_LED_COUNT * 3];
+    int size = host_rmt_get_frame(RMT_CHANNEL_4, bytes, sizeof(bytes));
+    if(size == sizeof(bytes) && memcmp(bytes, bytes + 3, sizeof(bytes) - 3) != 0) ++mixed_frames;
+    for(int t=0; t < WRITER_COUNT; ++t) {
+      if(xSemaphoreTake(tests[t].done, 0)) ++finished;
+    }
+  }
+
+  HOST_CHECK_EQUAL(0, mixed_frames);
+  for(int t=0; t < WRITER_COUNT; ++t) HOST_CHECK_EQUAL(0, tests[t].wrong);
+  HOST_CHECK_EQUAL(0, host_rmt_get_errors(RMT_CHANNEL_4));
+}
+
+#define LONG_RING_LED_COUNT 1000
+
+/**
+ * led_ring_update_all starts the rings together, even when one is still sending its last frame
+ * (1000 LEDs take 30 ms) and another is animated.
+ */
+static void test_update_all() {
+  led_ring_t rings[2] = {
+    led_ring_init(RMT_CHANNEL_5, 23, LONG_RING_LED_COUNT),
+    led_ring_init_pipelined(RMT_CHANNEL_6, 24, LED_COUNT, 1),
+  };
+  led_ring_set_clock(rings[1], fixed_clock);
+  host_rmt_set_wire_time(true);
+
+  /* Let the first frames (black) go out */
+  HOST_CHECK(host_rmt_wait_frames(RMT_CHANNEL_5, 1, 1000));
+  HOST_CHECK(host_rmt_wait_frames(RMT_CHANNEL_6, 1, 1000));
+
+  rgb_t white = { 255, 255, 255 };
+  led_ring_set_one_color(rings[0], white);
+  led_ring_update(rings[0]);
+  HOST_CHECK(host_rmt_wait_frames(RMT_CHANNEL_5, 2, 1000));
+  uint32_t long_frames = host_rmt_get_frame_count(RMT_CHANNEL_5);
+
+  rgb_t colors[LED_COUNT];
+  for(int i=0; i < LED_COUNT; ++i) colors[i] = (rgb_t){ 10 * i, 0, 0 };
+  rgb_t red = { 255, 0, 0 };
+  led_ring_set_one_color(rings[0], red);
+  led_ring_set_colors(rings[1], colors);
+  led_ring_set_frame_rate(rings[1], 10);
+  led_ring_start_spinner_loop(rings[1]);
+  led_ring_update_all(rings, 2);
+
+  /* The long ring's white frame is still being sent, so without a shared start the rings would be 30 ms apart */
+  int64_t skew_us = host_rmt_get_start_us(RMT_CHANNEL_5) - host_rmt_get_start_us(RMT_CHANNEL_6);
+  if(skew_us < 0) skew_us = -skew_us;
+  HOST_CHECK(skew_us < 2000);
+  HOST_CHECK(host_rmt_wait_frames(RMT_CHANNEL_5, long_frames + 1, 1000));
+  HOST_CHECK(wait_for_colors(RMT_CHANNEL_6, colors));
+
+  host_rmt_set_wire_time(false);
+}
+
+static rgb_t slow_colors[LED_COUNT];
+static atomic_int slow_source_calls;
+static atomic_bool in_slow_source;
+
+/** A source that takes 5 ms for each frame, and tells whether the animation task is in it */
+static rgb_t* slow_source(void* arg, int64_t frame_number) {
+  atomic_store(&in_slow_source, true);
+  vTaskDelay(pdMS_TO_TICKS(5));
+  atomic_fetch_add(&slow_source_calls, 1);
+  atomic_store(&in_slow_source, false);
+  return slow_colors;
+}
+
+/**
+ * A stopped loop's source is no longer used once the task has taken the stop,
+ * and the frame rate of a source loop does not carry over to the loops after it.
+ */
+static void test_stop_and_loop_rate(rmt_channel_t channel, led_ring_t ring) {
+  led_ring_set_frame_rate(ring, 100);
+
+  rgb_t colors[LED_COUNT];
+  for(int i=0; i < LED_COUNT; ++i) colors[i] = (rgb_t){ 3 * i, 0, i };
+  led_ring_set_colors(ring, colors);
+
+  led_ring_start_source_loop_at_rate(ring, slow_source, NULL, 1000);
+  vTaskDelay(pdMS_TO_TICKS(20));
+  HOST_CHECK(atomic_load(&slow_source_calls) > 0);
+
+  led_ring_stop_loop(ring);
+  led_ring_wait_taken(ring);
+  HOST_CHECK(!atomic_load(&in_slow_source));
+  int calls = atomic_load(&slow_source_calls);
+  vTaskDelay(pdMS_TO_TICKS(20));
+  HOST_CHECK_EQUAL(calls, atomic_load(&slow_source_calls));
+
+  /* Rates with a period under 1 ms are rejected, rather than giving a period of 0 */
+  led_ring_start_source_loop_at_rate(ring, slow_source, NULL, 2000000);
+  led_ring_set_frame_rate(ring, 2000000);
+  vTaskDelay(pdMS_TO_TICKS(20));
+  HOST_CHECK_EQUAL(calls, atomic_load(&slow_source_calls));
+
+  /* The spinner runs at the ring's 100 fps, so 50 ms is 5 frames rather than the source's 50 */
+  led_ring_start_spinner_loop(ring);
+  fixed_time_us += 50000;
+  rgb_t rotated[LED_COUNT];
+  for(int i=0; i < LED_COUNT; ++i) rotated[i] = colors[(i + 5) % LED_COUNT];
+  HOST_CHECK(wait_for_colors(channel, rotated));
+  led_ring_stop_loop(ring);
+}
+
+/**
+ * The pipelined ring starts frames on its own core while the end of transmission interrupt runs on
+ * the core that created the ring, and the wire time in the stats is still the time on the wire.
+ */
+static void test_pipelined_wire_time() {
+  led_ring_t ring = led_ring_init_pipelined(RMT_CHANNEL_7, 25, LED_COUNT, 1);
+  host_rmt_set_wire_time(true);
+
+  for(int f=0; f < 4; ++f) {
+    rgb_t color = { f, 0, 0 };
+    led_ring_set_one_color(ring, color);
+    led_ring_update(ring);
+    HOST_CHECK(host_rmt_wait_frames(RMT_CHANNEL_7, f + 2, 1000));
+  }
+
+  ws2812rmt_stats_t stats;
+  led_ring_get_output_stats(ring, &stats);
+  uint32_t wire_us = LED_COUNT * 30 + 50;
+  HOST_CHECK(stats.max_wire_us + 100 >= wire_us && stats.max_wire_us < wire_us + 2000);
+
+  host_rmt_set_wire_time(false);
+}
+
+int main() {
+  led_ring_t ring = led_ring_init(RMT_CHANNEL_0, 18, LED_COUNT);
+  test_ring(RMT_CHANNEL_0, ring);
+  test_ring(RMT_CHANNEL_1, led_ring_init_pipelined(RMT_CHANNEL_1, 19, LED_COUNT, 1));
+  test_rainbow_caches();
+  test_writers();
+  test_update_all();
+  test_pipelined_wire_time();
+  test_stop_and_loop_rate(RMT_CHANNEL_0, ring);
+  return host_test_result("test_led_ring");
+}
@@ -0,0 +1,153 @@
+/*
+ * Copyright 2017 Sam Leitch
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** Sends requests to the led_ring resources through the libcoap stand-in */
+
+#include "host_coap.h"
+#include "host_rmt.h"
+#include "host_test.h"
+#include "led_ring.h"
+#include "led_ring_resource.h"
+
+#include <esp_timer.h>
+#include <freertos/task.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LONG_RING_LED_COUNT 1000 /* 30 ms on the wire */
+#define MAX_SKEW_US 2000
+
+static coap_context_t* context;
+static coap_resource_t* resource;
+
+/** Sends a GET, with an Observe option of observe unless it is negative. Returns the response's Observe option or -1. */
+static int get(int observe) {
+  coap_pdu_t* request = coap_pdu_init(COAP_MESSAGE_CON, COAP_REQUEST_GET, 1, COAP_MAX_PDU_SIZE);
+  if(observe >= 0) {
+    unsigned char buf[4];
+    unsigned int len = coap_encode_var_bytes(buf, observe);
+    coap_add_option(request, COAP_OPTION_OBSERVE, len, buf);
+  }
+
+  coap_pdu_t* response = coap_pdu_init(COAP_MESSAGE_ACK, 0, 1, COAP_MAX_PDU_SIZE);
+  HOST_CHECK_EQUAL(COAP_RESPONSE_CODE(205), host_coap_request(context, resource, NULL, request, response));
+
+  coap_opt_iterator_t opt_iter;
+  coap_opt_t* option = coap_check_option(response, COAP_OPTION_OBSERVE, &opt_iter);
+  int result = option ? (int)coap_decode_var_bytes(coap_opt_value(option), coap_opt_length(option)) : -1;
+
+  coap_delete_pdu(response);
+  coap_delete_pdu(request);
+  return result;
+}
+
+/** Observe 0 registers the client, 1 deregisters it and other values are ignored */
+static void test_observe() {
+  HOST_CHECK_EQUAL(-1, get(-1));
+  HOST_CHECK_EQUAL(0, host_coap_observer_count(resource));
+
+  HOST_CHECK(get(0) >= 0);
+  HOST_CHECK_EQUAL(1, host_coap_observer_count(resource));
+
+  /* Registering again keeps the one registration */
+  HOST_CHECK(get(0) >= 0);
+  HOST_CHECK_EQUAL(1, host_coap_observer_count(resource));
+
+  /* A plain GET does not change the registration */
+  HOST_CHECK_EQUAL(-1, get(-1));
+  HOST_CHECK_EQUAL(1, host_coap_observer_count(resource));
+
+  HOST_CHECK_EQUAL(-1, get(1));
+  HOST_CHECK_EQUAL(0, host_coap_observer_count(resource));
+
+  HOST_CHECK_EQUAL(-1, get(5));
+  HOST_CHECK_EQUAL(0, host_coap_observer_count(resource));
+}
+
+/** Sends a JSON PUT to the resource at uri, with an at= query if at_ms is not 0. Returns the response code. */
+static int put(const char* uri, const char* json, long long at_ms) {
+  coap_pdu_t* request = coap_pdu_init(COAP_MESSAGE_CON, COAP_REQUEST_PUT, 1, COAP_MAX_PDU_SIZE);
+  if(at_ms) {
+    char query[32];
+    int length = snprintf(query, sizeof(query), "at=%lld", at_ms);
+    coap_add_option(request, COAP_OPTION_URI_QUERY, length, (unsigned char*)query);
+  }
+  coap_add_data(request, strlen(json), (unsigned char*)json);
+
+  coap_pdu_t* response = coap_pdu_init(COAP_MESSAGE_ACK, 0, 1, COAP_MAX_PDU_SIZE);
+  int code = host_coap_request(context, host_coap_find_resource(context, uri), NULL, request, response);
+
+  coap_delete_pdu(response);
+  coap_delete_pdu(request);
+  return code;
+}
+
+static int64_t start_skew_us() {
+  int64_t skew_us = host_rmt_get_start_us(RMT_CHANNEL_0) - host_rmt_get_start_us(RMT_CHANNEL_1);
+  return skew_us < 0 ? -skew_us : skew_us;
+}
+
+/**
+ * The rings of a batch switch on the same frame, an animation and a static mode alike,
+ * even when one of the rings is still sending a long frame.
+ */
+static void test_batch() {
+  host_rmt_set_wire_time(true);
+  HOST_CHECK(host_rmt_wait_frames(RMT_CHANNEL_1, 1, 1000));
+
+  /* The long ring's frame is still being sent when the batch arrives */
+  HOST_CHECK_EQUAL(COAP_RESPONSE_CODE(204), put("led_ring/1", "[\"solid_color\",255,255,255]", 0));
+  vTaskDelay(1);
+  uint32_t frames[2] = { host_rmt_get_frame_count(RMT_CHANNEL_0), host_rmt_get_frame_count(RMT_CHANNEL_1) };
+  HOST_CHECK_EQUAL(COAP_RESPONSE_CODE(204),
+      put("led_ring/batch", "{\"0\":[\"spinning_rainbow\"],\"1\":[\"solid_color\",64,0,0]}", 0));
+  HOST_CHECK(host_rmt_wait_frames(RMT_CHANNEL_0, frames[0] + 1, 1000));
+  HOST_CHECK(host_rmt_wait_frames(RMT_CHANNEL_1, frames[1] + 2, 1000));
+  HOST_CHECK(start_skew_us() < MAX_SKEW_US);
+
+  /* A batch for later is shown by one timer, on the same frame */
+  int64_t at_us = esp_timer_get_time() + 200000;
+  frames[0] = host_rmt_get_frame_count(RMT_CHANNEL_0);
+  frames[1] = host_rmt_get_frame_count(RMT_CHANNEL_1);
+  HOST_CHECK_EQUAL(COAP_RESPONSE_CODE(204),
+      put("led_ring/batch", "{\"0\":[\"solid_color\",0,64,0],\"1\":[\"strobing_dots\"]}", at_us / 1000));
+  HOST_CHECK_EQUAL(frames[1], host_rmt_get_frame_count(RMT_CHANNEL_1));
+  HOST_CHECK(host_rmt_wait_frames(RMT_CHANNEL_1, frames[1] + 1, 1000));
+  HOST_CHECK(host_rmt_get_start_us(RMT_CHANNEL_1) >= at_us - 1000);
+  HOST_CHECK(start_skew_us() < MAX_SKEW_US);
+
+  /* A time past the range of the clock in microseconds is rejected, rather than overflowing */
+  HOST_CHECK_EQUAL(COAP_RESPONSE_CODE(400), put("led_ring/batch", "{\"0\":[\"solid_color\",0,0,64]}", INT64_MAX / 1000 + 1));
+  HOST_CHECK_EQUAL(COAP_RESPONSE_CODE(400), put("led_ring", "[\"solid_color\",0,0,64]", INT64_MAX));
+
+  host_rmt_set_wire_time(false);
+}
+
+int main() {
+  context = coap_new_context(NULL);
+  led_ring_t led_rings[2] = {
+    led_ring_init(RMT_CHANNEL_0, 18, 24),
+    led_ring_init(RMT_CHANNEL_1, 19, LONG_RING_LED_COUNT),
+  };
+  HOST_CHECK(led_ring_resource_init_rings(context, led_rings, 2));
+  resource = host_coap_find_resource(context, "led_ring");
+  HOST_CHECK(resource != NULL);
+
+  test_observe();
+  test_batch();
+  return host_test_result("test_led_ring_resource");
+}
@@ -0,0 +1,208 @@
+/*
+ * Copyright 2017 Sam Leitch
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Streams 1000 LED frames to a ring at 60 fps over loopback and checks what the ring sends.
+ *
+ * Without wire time the ring keeps up with the stream, so every frame is shown. With wire time a
+ * WS2812B channel needs 30 ms for 1000 LEDs, so it can only show about 33 fps and the jitter buffer
+ * drops the oldest frames, but every frame is still received and the last one is shown.
+ * The led_ring resource reports the stream as the mode of the ring while it plays.
+ */
+
+#include "host_coap.h"
+#include "host_rmt.h"
+#include "host_test.h"
+#include "led_ring.h"
+#include "led_ring_resource.h"
+#include "pixel_stream.h"
+
+#include <esp_timer.h>
+#include <freertos/task.h>
+#include <lwip/sockets.h>
+#include <string.h>
+
+#define LED_COUNT 1000
+#define FRAME_RATE 60
+#define FRAME_COUNT 90
+#define PORT 14048
+#define CHUNK_SIZE 1440 /* Bytes of colors in each packet, 480 LEDs */
+
+static uint8_t frame[LED_COUNT * 3];
+static coap_context_t* context;
+static coap_resource_t* resource;
+
+/** Returns the mode of the led_ring resource, the JSON from a GET */
+static const char* get_mode() {
+  static char mode[64];
+  coap_pdu_t* request = coap_pdu_init(COAP_MESSAGE_CON, COAP_REQUEST_GET, 1, COAP_MAX_PDU_SIZE);
+  coap_pdu_t* response = coap_pdu_init(COAP_MESSAGE_ACK, 0, 1, COAP_MAX_PDU_SIZE);
+  HOST_CHECK_EQUAL(COAP_RESPONSE_CODE(205), host_coap_request(context, resource, NULL, request, response));
+
+  size_t size = 0;
+  uint8_t* data = NULL;
+  coap_get_data(response, &size, &data);
+  if(size >= sizeof(mode)) size = sizeof(mode) - 1;
+  memcpy(mode, data, size);
+  mode[size] = 0;
+
+  coap_delete_pdu(response);
+  coap_delete_pdu(request);
+  return mode;
+}
+
+static int put_mode(const char* json) {
+  coap_pdu_t* request = coap_pdu_init(COAP_MESSAGE_CON, COAP_REQUEST_PUT, 1, COAP_MAX_PDU_SIZE);
+  coap_add_data(request, strlen(json), (unsigned char*)json);
+  coap_pdu_t* response = coap_pdu_init(COAP_MESSAGE_ACK, 0, 1, COAP_MAX_PDU_SIZE);
+  int code = host_coap_request(context, resource, NULL, request, response);
+  coap_delete_pdu(response);
+  coap_delete_pdu(request);
+  return code;
+}
+
+static void fill_frame(int f) {
+  for(int i=0; i < LED_COUNT; ++i) {
+    frame[i * 3] = f;
+    frame[i * 3 + 1] = i;
+    frame[i * 3 + 2] = i >> 8;
+  }
+}
+
+/** Sends a frame in DDP packets, the last one with PUSH */
+static void send_frame(int sockfd, const struct sockaddr_in* addr, uint8_t sequence) {
+  uint8_t packet[10 + CHUNK_SIZE];
+  for(int offset=0; offset < sizeof(frame); offset += CHUNK_SIZE) {
+    int size = sizeof(frame) - offset < CHUNK_SIZE ? sizeof(frame) - offset : CHUNK_SIZE;
+    bool push = offset + size == sizeof(frame);
+    packet[0] = 0x40 | (push ? 0x01 : 0);
+    packet[1] = sequence;
+    packet[2] = 0x0B;
+    packet[3] = 1;
+    packet[4] = offset >> 24;
+    packet[5] = offset >> 16;
+    packet[6] = offset >> 8;
+    packet[7] = offset;
+    packet[8] = size >> 8;
+    packet[9] = size;
+    memcpy(packet + 10, frame + offset, size);
+    sendto(sockfd, packet, 10 + size, 0, (const struct sockaddr*)addr, sizeof(*addr));
+  }
+}
+
+/** Waits up to a second for the ring to send the last frame filled (in GRB order) */
+static bool wait_for_frame() {
+  static uint8_t expected[LED_COUNT * 3];
+  static uint8_t bytes[LED_COUNT * 3];
+  for(int i=0; i < LED_COUNT; ++i) {
+    expected[i * 3] = frame[i * 3 + 1];
+    expected[i * 3 + 1] = frame[i * 3];
+    expected[i * 3 + 2] = frame[i * 3 + 2];
+  }
+
+  for(int ms=0; ms < 1000; ++ms) {
+    int size = host_rmt_get_frame(RMT_CHANNEL_0, bytes, sizeof(bytes));
+    if(size == sizeof(bytes) && memcmp(bytes, expected, sizeof(bytes)) == 0) return true;
+    vTaskDelay(1);
+  }
+  return false;
+}
+
+/** Streams FRAME_COUNT frames at FRAME_RATE, starting from frame first */
+static void stream(int sockfd, const struct sockaddr_in* addr, int first) {
+  int64_t start_us = esp_timer_get_time();
+  for(int f=first; f < first + FRAME_COUNT; ++f) {
+    int64_t due_us = start_us + (int64_t)(f - first) * 1000000 / FRAME_RATE;
+    int64_t wait_us = due_us - esp_timer_get_time();
+    if(wait_us > 0) usleep(wait_us);
+
+    fill_frame(f);
+    send_frame(sockfd, addr, f % 15 + 1);
+  }
+}
+
+int main() {
+  led_ring_t ring = led_ring_init(RMT_CHANNEL_0, 18, LED_COUNT);
+  context = coap_new_context(NULL);
+  led_ring_resource_init(context, ring);
+  resource = host_coap_find_resource(context, "led_ring");
+  HOST_CHECK(strstr(get_mode(), "solid_color") != NULL);
+
+  pixel_stream_t ctx = pixel_stream_create(ring, PORT);
+  HOST_CHECK(ctx != NULL);
+  if(!ctx) return host_test_result("test_pixel_stream");
+  pixel_stream_start(ctx);
+
+  int sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(PORT);
+
+  /* The ring keeps up with the stream */
+  stream(sockfd, &addr, 0);
+  HOST_CHECK(wait_for_frame());
+  pixel_stream_stats_t stats;
+  pixel_stream_get_stats(ctx, &stats);
+  HOST_CHECK_EQUAL(FRAME_COUNT * 3, stats.packets);
+  HOST_CHECK_EQUAL(FRAME_COUNT, stats.frames);
+  HOST_CHECK_EQUAL(FRAME_COUNT, stats.frames_shown);
+  HOST_CHECK_EQUAL(0, stats.dropped_frames);
+  HOST_CHECK_EQUAL(0, stats.late_packets);
+  HOST_CHECK_EQUAL(0, stats.invalid_packets);
+
+  /* The stream is the mode, and only its start is counted as a change */
+  led_ring_resource_stats_t resource_stats;
+  HOST_CHECK_EQUAL(0, strcmp("[\"stream\"]", get_mode()));
+  led_ring_resource_get_stats(&resource_stats);
+  HOST_CHECK_EQUAL(1, resource_stats.mode_requests[LED_RING_MODE_STREAM]);
+
+  /* The wire is slower than the stream, so frames are dropped to keep up, but none are lost on the way */
+  host_rmt_set_wire_time(true);
+  /* A frame can be read before it is counted, which is once its interrupt is done */
+  HOST_CHECK(host_rmt_wait_frames(RMT_CHANNEL_0, FRAME_COUNT, 1000));
+  uint32_t sent_frames = host_rmt_get_frame_count(RMT_CHANNEL_0);
+  stream(sockfd, &addr, FRAME_COUNT);
+  HOST_CHECK(wait_for_frame());
+  uint32_t shown_frames = stats.frames_shown;
+  pixel_stream_get_stats(ctx, &stats);
+  HOST_CHECK_EQUAL(2 * FRAME_COUNT, stats.frames);
+  HOST_CHECK_EQUAL(2 * FRAME_COUNT, stats.frames_shown + stats.dropped_frames);
+  HOST_CHECK(stats.dropped_frames > 0);
+
+  /* Frames counted as shown were sent, rather than replaced on the ring before it got to them */
+  shown_frames = stats.frames_shown - shown_frames;
+  HOST_CHECK(host_rmt_wait_frames(RMT_CHANNEL_0, sent_frames + shown_frames, 1000));
+  HOST_CHECK_EQUAL(shown_frames, host_rmt_get_frame_count(RMT_CHANNEL_0) - sent_frames);
+  HOST_CHECK_EQUAL(0, stats.late_packets);
+  HOST_CHECK_EQUAL(0, stats.invalid_packets);
+  HOST_CHECK_EQUAL(0, host_rmt_get_errors(RMT_CHANNEL_0));
+  HOST_CHECK_EQUAL(0, strcmp("[\"stream\"]", get_mode()));
+
+  /* A command replaces the stream until its next frame, which is a new start */
+  HOST_CHECK_EQUAL(COAP_RESPONSE_CODE(204), put_mode("[\"solid_color\",0,0,64]"));
+  HOST_CHECK(strstr(get_mode(), "solid_color") != NULL);
+  fill_frame(0);
+  send_frame(sockfd, &addr, 1);
+  HOST_CHECK(wait_for_frame());
+  HOST_CHECK_EQUAL(0, strcmp("[\"stream\"]", get_mode()));
+  led_ring_resource_get_stats(&resource_stats);
+  HOST_CHECK_EQUAL(2, resource_stats.mode_requests[LED_RING_MODE_STREAM]);
+
+  close(sockfd);
+  return host_test_result("test_pixel_stream");
+}
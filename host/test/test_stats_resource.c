@@ -0,0 +1,91 @@
+/*
+ * Copyright 2017 Sam Leitch
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** Reads the stats of two rings through the stats/<index> resources */
+
+#include "host_coap.h"
+#include "host_rmt.h"
+#include "host_test.h"
+#include "led_ring.h"
+#include "led_ring_resource.h"
+#include "stats_resource.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static coap_context_t* context;
+
+/** GETs the stats at uri into message, which is null terminated. Returns the response code. */
+static int get_stats(const char* uri, char* message, size_t max_size) {
+  coap_pdu_t* request = coap_pdu_init(COAP_MESSAGE_CON, COAP_REQUEST_GET, 1, COAP_MAX_PDU_SIZE);
+  coap_pdu_t* response = coap_pdu_init(COAP_MESSAGE_ACK, 0, 1, COAP_MAX_PDU_SIZE);
+  int code = host_coap_request(context, host_coap_find_resource(context, uri), NULL, request, response);
+
+  size_t size = 0;
+  uint8_t* data = NULL;
+  coap_get_data(response, &size, &data);
+  if(size >= max_size) size = max_size - 1;
+  memcpy(message, data, size);
+  message[size] = 0;
+
+  coap_delete_pdu(response);
+  coap_delete_pdu(request);
+  return code;
+}
+
+/** Returns the frames sent in the stats at uri, or -1 if they are missing */
+static int get_sent(const char* uri) {
+  char message[1024];
+  HOST_CHECK_EQUAL(COAP_RESPONSE_CODE(205), get_stats(uri, message, sizeof(message)));
+  HOST_CHECK(message[strlen(message) - 1] == '}');
+
+  int sent = -1;
+  const char* field = strstr(message, "\"sent\":");
+  if(field) sscanf(field, "\"sent\":%d", &sent);
+  return sent;
+}
+
+int main() {
+  context = coap_new_context(NULL);
+  led_ring_t rings[2] = {
+    led_ring_init(RMT_CHANNEL_0, 18, 24),
+    led_ring_init(RMT_CHANNEL_1, 19, 100),
+  };
+  HOST_CHECK(led_ring_resource_init_rings(context, rings, 2));
+  HOST_CHECK(stats_resource_init_rings(context, rings, 2));
+
+  /* Each ring sends a first frame, with every LED off, when it starts */
+  HOST_CHECK(host_rmt_wait_frames(RMT_CHANNEL_0, 1, 1000));
+  HOST_CHECK(host_rmt_wait_frames(RMT_CHANNEL_1, 1, 1000));
+
+  /* Only the second ring sends more frames */
+  for(int f=1; f <= 3; ++f) {
+    led_ring_lock(rings[1]);
+    led_ring_set_one_color(rings[1], (rgb_t){ f, 0, 0 });
+    led_ring_update(rings[1]);
+    led_ring_unlock(rings[1]);
+    HOST_CHECK(host_rmt_wait_frames(RMT_CHANNEL_1, f + 1, 1000));
+  }
+
+  HOST_CHECK_EQUAL(1, get_sent("stats/0"));
+  HOST_CHECK_EQUAL(4, get_sent("stats/1"));
+
+  /* stats is the first ring, as it was before there were several */
+  HOST_CHECK_EQUAL(1, get_sent("stats"));
+  HOST_CHECK(host_coap_find_resource(context, "stats/2") == NULL);
+
+  return host_test_result("test_stats_resource");
+}
@@ -0,0 +1,213 @@
+/*
+ * Copyright 2017 Sam Leitch
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Sends frames through the RMT stand-in and decodes the waveform, checking the bytes of
+ * every LED and the WS2812B bit and reset timings.
+ */
+
+#include "host_rmt.h"
+#include "host_test.h"
+#include "ws2812rmt.h"
+
+#include <freertos/task.h>
+
+#include <string.h>
+
+#define LED_COUNT 16
+
+/* WS2812B items at 12.5ns per tick, as on the wire */
+static const rmt_item32_t zero_bit = {{{ 32, 1, 64, 0 }}}; /* 400ns high, 800ns low */
+static const rmt_item32_t one_bit = {{{ 68, 1, 36, 0 }}}; /* 850ns high, 450ns low */
+static const rmt_item32_t reset = {{{ 4000, 0, 0, 0 }}}; /* 50us low */
+
+/** Sets 8 items for a byte, MSB first */
+static void set_byte(rmt_item32_t* items, uint8_t value) {
+  for(int i=0; i < 8; ++i) items[i] = (value & (0x80 >> i)) ? one_bit : zero_bit;
+}
+
+static void test_decode() {
+  rmt_item32_t items[17];
+  uint8_t bytes[4];
+  set_byte(items, 0xA5);
+  set_byte(items + 8, 0x3C);
+  items[16] = reset;
+
+  HOST_CHECK_EQUAL(2, host_rmt_decode(items, 17, 1, &host_rmt_timing_ws2812b, bytes, sizeof(bytes)));
+  HOST_CHECK_EQUAL(0xA5, bytes[0]);
+  HOST_CHECK_EQUAL(0x3C, bytes[1]);
+
+  /* The whole frame is 1.25us per bit plus the reset */
+  HOST_CHECK_EQUAL(16 * 1250 + 50000, host_rmt_duration_ns(items, 17, 1));
+
+  /* No reset */
+  HOST_CHECK_EQUAL(-1, host_rmt_decode(items, 16, 1, &host_rmt_timing_ws2812b, bytes, sizeof(bytes)));
+
+  /* A reset that is too short to latch the colors */
+  rmt_item32_t short_reset = {{{ 3000, 0, 0, 0 }}};
+  items[16] = short_reset;
+  HOST_CHECK_EQUAL(-1, host_rmt_decode(items, 17, 1, &host_rmt_timing_ws2812b, bytes, sizeof(bytes)));
+  items[16] = reset;
+
+  /* A high of 600ns is neither a zero nor a one */
+  rmt_item32_t ambiguous = {{{ 48, 1, 52, 0 }}};
+  items[3] = ambiguous;
+  HOST_CHECK_EQUAL(-1, host_rmt_decode(items, 17, 1, &host_rmt_timing_ws2812b, bytes, sizeof(bytes)));
+  items[3] = one_bit;
+
+  /* Half a byte */
+  items[12] = reset;
+  HOST_CHECK_EQUAL(-1, host_rmt_decode(items, 13, 1, &host_rmt_timing_ws2812b, bytes, sizeof(bytes)));
+}
+
+/** Checks that the last frame on channel is the colors in GRB order, led_count LEDs repeating the colors */
+static void check_frame(rmt_channel_t channel, const rgb_t* colors, int color_count, int led_count) {
+  uint8_t bytes[LED_COUNT * 3 + 8];
+  HOST_CHECK_EQUAL(led_count * 3, host_rmt_get_frame(channel, bytes, sizeof(bytes)));
+  for(int i=0; i < led_count; ++i) {
+    rgb_t color = colors[i % color_count];
+    HOST_CHECK_EQUAL(color.g, bytes[i * 3]);
+    HOST_CHECK_EQUAL(color.r, bytes[i * 3 + 1]);
+    HOST_CHECK_EQUAL(color.b, bytes[i * 3 + 2]);
+  }
+}
+
+static void test_colors() {
+  ws2812rmt_t ctx = ws2812rmt_init(RMT_CHANNEL_0, 18, LED_COUNT);
+  HOST_CHECK(ctx != NULL);
+
+  rgb_t colors[LED_COUNT];
+  for(int i=0; i < LED_COUNT; ++i) colors[i] = (rgb_t){ i * 16, 255 - i, i ^ 0x5A };
+
+  ws2812rmt_set_colors(ctx, colors, LED_COUNT, false);
+  HOST_CHECK(host_rmt_wait_frames(RMT_CHANNEL_0, 1, 1000));
+  check_frame(RMT_CHANNEL_0, colors, LED_COUNT, LED_COUNT);
+
+  /* A repeated pattern fills the strip, a short one that is not repeated only sets its LEDs */
+  rgb_t pattern[3] = { { 255, 0, 0 }, { 0, 255, 0 }, { 0, 0, 255 } };
+  ws2812rmt_set_colors(ctx, pattern, 3, true);
+  check_frame(RMT_CHANNEL_0, pattern, 3, LED_COUNT);
+  ws2812rmt_set_colors(ctx, pattern, 3, false);
+  check_frame(RMT_CHANNEL_0, pattern, 3, 3);
+
+  /* The same frame again is not sent */
+  HOST_CHECK(host_rmt_wait_frames(RMT_CHANNEL_0, 3, 1000));
+  ws2812rmt_set_colors(ctx, pattern, 3, false);
+  vTaskDelay(10);
+  HOST_CHECK_EQUAL(3, host_rmt_get_frame_count(RMT_CHANNEL_0));
+
+  /* Rotated frames start at the rotation */
+  ws2812rmt_submit_rotated(ctx, pattern, 3, true, 1);
+  ws2812rmt_wait_idle(ctx);
+  rgb_t rotated[3] = { pattern[1], pattern[2], pattern[0] };
+  check_frame(RMT_CHANNEL_0, rotated, 3, LED_COUNT);
+
+  /* Brightness is applied while encoding */
+  ws2812rmt_set_brightness(ctx, 128);
+  ws2812rmt_set_colors(ctx, colors, LED_COUNT, false);
+  rgb_t dimmed[LED_COUNT];
+  for(int i=0; i < LED_COUNT; ++i) {
+    dimmed[i] = (rgb_t){ (colors[i].r * 128 + 127) / 255, (colors[i].g * 128 + 127) / 255, (colors[i].b * 128 + 127) / 255 };
+  }
+  check_frame(RMT_CHANNEL_0, dimmed, LED_COUNT, LED_COUNT);
+
+  HOST_CHECK_EQUAL(0, host_rmt_get_errors(RMT_CHANNEL_0));
+}
+
+static uint8_t sent_frames[8][LED_COUNT * 3];
+static int sent_frame_count = 0;
+
+/** Keeps each frame as it is done, before the next one can start */
+static void keep_frame(ws2812rmt_t ctx, void* arg) {
+  if(sent_frame_count < 8) host_rmt_get_frame(RMT_CHANNEL_1, sent_frames[sent_frame_count++], LED_COUNT * 3);
+}
+
+/** Frames submitted back to back are encoded into the other buffer while one is on the wire */
+static void test_double_buffer() {
+  ws2812rmt_t ctx = ws2812rmt_init(RMT_CHANNEL_1, 19, LED_COUNT);
+  ws2812rmt_set_done_callback(ctx, keep_frame, NULL);
+  host_rmt_set_wire_time(true);
+
+  rgb_t frames[8][LED_COUNT];
+  for(int f=0; f < 8; ++f) {
+    for(int i=0; i < LED_COUNT; ++i) frames[f][i] = (rgb_t){ f, i, f * i };
+  }
+
+  /* A buffer reused while it is still sent would be decoded as the wrong frame */
+  for(int f=0; f < 8; ++f) ws2812rmt_submit_colors(ctx, frames[f], LED_COUNT, false);
+  ws2812rmt_wait_idle(ctx);
+  HOST_CHECK(host_rmt_wait_frames(RMT_CHANNEL_1, 8, 1000));
+
+  HOST_CHECK_EQUAL(8, sent_frame_count);
+  for(int f=0; f < sent_frame_count; ++f) {
+    for(int i=0; i < LED_COUNT; ++i) {
+      HOST_CHECK_EQUAL(frames[f][i].g, sent_frames[f][i * 3]);
+      HOST_CHECK_EQUAL(frames[f][i].r, sent_frames[f][i * 3 + 1]);
+      HOST_CHECK_EQUAL(frames[f][i].b, sent_frames[f][i * 3 + 2]);
+    }
+  }
+
+  ws2812rmt_stats_t stats;
+  ws2812rmt_get_stats(ctx, &stats);
+  HOST_CHECK_EQUAL(8, stats.frames_sent);
+  HOST_CHECK_EQUAL(0, host_rmt_get_errors(RMT_CHANNEL_1));
+
+  /* 24 bits of 1.25us per LED and the reset, give or take the time for the threads to wake */
+  uint32_t wire_us = LED_COUNT * 30 + 50;
+  HOST_CHECK(stats.max_wire_us + 100 >= wire_us && stats.max_wire_us < wire_us + 2000);
+  host_rmt_set_wire_time(false);
+}
+
+/** The other chipsets are decoded with their own datasheet timings */
+static void test_chipsets() {
+  static const host_rmt_timing_t sk6812_timing = {
+    .zero_high_ns = 300, .zero_low_ns = 900, .one_high_ns = 600, .one_low_ns = 600,
+    .tolerance_ns = 150, .reset_ns = 80000,
+  };
+  static const host_rmt_timing_t ws2811_timing = {
+    .zero_high_ns = 500, .zero_low_ns = 2000, .one_high_ns = 1200, .one_low_ns = 1300,
+    .tolerance_ns = 150, .reset_ns = 50000,
+  };
+
+  host_rmt_set_timing(RMT_CHANNEL_2, &sk6812_timing);
+  ws2812rmt_t rgbw = ws2812rmt_init_chipset(RMT_CHANNEL_2, 21, 2, &ws2812rmt_chipset_sk6812_rgbw);
+  rgb_t colors[2] = { { 200, 100, 50 }, { 10, 20, 30 } };
+  ws2812rmt_set_colors(rgbw, colors, 2, false);
+
+  /* The white LED gets the part common to r, g and b */
+  uint8_t bytes[8];
+  HOST_CHECK_EQUAL(8, host_rmt_get_frame(RMT_CHANNEL_2, bytes, sizeof(bytes)));
+  const uint8_t expected_rgbw[8] = { 50, 150, 0, 50, 10, 0, 20, 10 };
+  HOST_CHECK(memcmp(bytes, expected_rgbw, 8) == 0);
+
+  host_rmt_set_timing(RMT_CHANNEL_3, &ws2811_timing);
+  ws2812rmt_t rgb = ws2812rmt_init_chipset(RMT_CHANNEL_3, 22, 2, &ws2812rmt_chipset_ws2811);
+  ws2812rmt_set_colors(rgb, colors, 2, false);
+  HOST_CHECK_EQUAL(6, host_rmt_get_frame(RMT_CHANNEL_3, bytes, sizeof(bytes)));
+  const uint8_t expected_rgb[6] = { 200, 100, 50, 10, 20, 30 };
+  HOST_CHECK(memcmp(bytes, expected_rgb, 6) == 0);
+
+  HOST_CHECK_EQUAL(0, host_rmt_get_errors(RMT_CHANNEL_2));
+  HOST_CHECK_EQUAL(0, host_rmt_get_errors(RMT_CHANNEL_3));
+}
+
+int main() {
+  test_decode();
+  test_colors();
+  test_double_buffer();
+  test_chipsets();
+  return host_test_result("test_ws2812rmt");
+}
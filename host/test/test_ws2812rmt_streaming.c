@@ -0,0 +1,130 @@
+/*
+ * Copyright 2017 Sam Leitch
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Streams frames through the RMT stand-in, which refills the channel memory from the translator
+ * half a block at a time like the TX threshold interrupt, and checks every decoded bit.
+ */
+
+#include "host_rmt.h"
+#include "host_test.h"
+#include "ws2812rmt.h"
+
+#include <string.h>
+
+#define LED_COUNT 100
+#define FRAME_COUNT 6
+
+/** The GRB bytes of led_count LEDs repeating colors, starting at rotation */
+static void expected_bytes(uint8_t* bytes, const rgb_t* colors, int color_count, int led_count, int rotation) {
+  for(int i=0; i < led_count; ++i) {
+    rgb_t color = colors[(i + rotation) % color_count];
+    bytes[i * 3] = color.g;
+    bytes[i * 3 + 1] = color.r;
+    bytes[i * 3 + 2] = color.b;
+  }
+}
+
+/** Checks the last frame on channel bit for bit */
+static void check_frame(rmt_channel_t channel, const uint8_t* expected, int size) {
+  uint8_t bytes[LED_COUNT * 3];
+  HOST_CHECK_EQUAL(size, host_rmt_get_frame(channel, bytes, sizeof(bytes)));
+  int wrong_bits = 0;
+  for(int i=0; i < size; ++i) wrong_bits += __builtin_popcount(bytes[i] ^ expected[i]);
+  HOST_CHECK_EQUAL(0, wrong_bits);
+}
+
+static void test_refills() {
+  ws2812rmt_t ctx = ws2812rmt_init_streaming(RMT_CHANNEL_0, 18, LED_COUNT);
+  HOST_CHECK(ctx != NULL);
+
+  rgb_t colors[LED_COUNT];
+  for(int i=0; i < LED_COUNT; ++i) colors[i] = (rgb_t){ i * 7, 255 - i, i ^ 0xC3 };
+  uint8_t expected[LED_COUNT * 3];
+
+  /* The first block (8 bytes) is translated when the frame starts, the rest 4 bytes at a time */
+  ws2812rmt_set_colors(ctx, colors, LED_COUNT, false);
+  HOST_CHECK(host_rmt_wait_frames(RMT_CHANNEL_0, 1, 1000));
+  expected_bytes(expected, colors, LED_COUNT, LED_COUNT, 0);
+  check_frame(RMT_CHANNEL_0, expected, LED_COUNT * 3);
+  HOST_CHECK_EQUAL((LED_COUNT * 3 - 8 + 1 + 3) / 4, host_rmt_get_refills(RMT_CHANNEL_0));
+
+  /* A repeated, rotated pattern is translated one LED at a time like the rest */
+  rgb_t pattern[7];
+  for(int i=0; i < 7; ++i) pattern[i] = (rgb_t){ 1 << i, i, 0xF0 | i };
+  ws2812rmt_submit_rotated(ctx, pattern, 7, true, 3);
+  ws2812rmt_wait_idle(ctx);
+  HOST_CHECK(host_rmt_wait_frames(RMT_CHANNEL_0, 2, 1000));
+  expected_bytes(expected, pattern, 7, LED_COUNT, 3);
+  check_frame(RMT_CHANNEL_0, expected, LED_COUNT * 3);
+
+  /* A frame that fits in the first block needs no refill */
+  uint32_t refills = host_rmt_get_refills(RMT_CHANNEL_0);
+  ws2812rmt_set_colors(ctx, pattern, 2, false);
+  HOST_CHECK(host_rmt_wait_frames(RMT_CHANNEL_0, 3, 1000));
+  expected_bytes(expected, pattern, 2, 2, 0);
+  check_frame(RMT_CHANNEL_0, expected, 6);
+  HOST_CHECK_EQUAL(refills, host_rmt_get_refills(RMT_CHANNEL_0));
+
+  HOST_CHECK_EQUAL(0, host_rmt_get_errors(RMT_CHANNEL_0));
+}
+
+static uint8_t sent_frames[FRAME_COUNT][LED_COUNT * 3];
+static int sent_frame_count = 0;
+
+static void keep_frame(ws2812rmt_t ctx, void* arg) {
+  if(sent_frame_count < FRAME_COUNT) host_rmt_get_frame(RMT_CHANNEL_1, sent_frames[sent_frame_count++], LED_COUNT * 3);
+}
+
+/** At wire speed the refills run while the caller prepares the next frame */
+static void test_wire_speed() {
+  ws2812rmt_t ctx = ws2812rmt_init_streaming(RMT_CHANNEL_1, 19, LED_COUNT);
+  ws2812rmt_set_done_callback(ctx, keep_frame, NULL);
+  ws2812rmt_set_brightness(ctx, 100);
+  host_rmt_set_wire_time(true);
+
+  static rgb_t frames[FRAME_COUNT][LED_COUNT];
+  for(int f=0; f < FRAME_COUNT; ++f) {
+    for(int i=0; i < LED_COUNT; ++i) frames[f][i] = (rgb_t){ f * 40, i * 2, (f + i) & 0xFF };
+  }
+
+  for(int f=0; f < FRAME_COUNT; ++f) ws2812rmt_submit_colors(ctx, frames[f], LED_COUNT, false);
+  ws2812rmt_wait_idle(ctx);
+  HOST_CHECK(host_rmt_wait_frames(RMT_CHANNEL_1, FRAME_COUNT, 1000));
+  HOST_CHECK_EQUAL(FRAME_COUNT, sent_frame_count);
+
+  for(int f=0; f < sent_frame_count; ++f) {
+    rgb_t dimmed[LED_COUNT];
+    for(int i=0; i < LED_COUNT; ++i) {
+      rgb_t color = frames[f][i];
+      dimmed[i] = (rgb_t){ (color.r * 100 + 127) / 255, (color.g * 100 + 127) / 255, (color.b * 100 + 127) / 255 };
+    }
+    uint8_t expected[LED_COUNT * 3];
+    expected_bytes(expected, dimmed, LED_COUNT, LED_COUNT, 0);
+    int wrong_bits = 0;
+    for(int i=0; i < LED_COUNT * 3; ++i) wrong_bits += __builtin_popcount(sent_frames[f][i] ^ expected[i]);
+    HOST_CHECK_EQUAL(0, wrong_bits);
+  }
+
+  HOST_CHECK_EQUAL(0, host_rmt_get_errors(RMT_CHANNEL_1));
+  host_rmt_set_wire_time(false);
+}
+
+int main() {
+  test_refills();
+  test_wire_speed();
+  return host_test_result("test_ws2812rmt_streaming");
+}
@@ -0,0 +1,90 @@
+/*
+ * Copyright 2017 Sam Leitch
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Encodes frames as a recorded animation for the animation partition (see led_animation.h):
+ *
+ *   led_animation_encode <led_count> <frames_per_second> [keyframe_interval] < frames.bin > animation.lra
+ *
+ * frames.bin is r, g, b for each LED of each frame, the same as an upload to the animation resource.
+ * A keyframe every second (the frame rate) is the default, so playing can start anywhere quickly.
+ */
+
+#include "led_animation_encoder.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/** Reads all of a file, returns its bytes (freed by the caller) and sets size */
+static uint8_t* read_all(FILE* file, size_t* size) {
+  size_t capacity = 1 << 16;
+  uint8_t* data = malloc(capacity);
+  *size = 0;
+
+  while(data) {
+    *size += fread(data + *size, 1, capacity - *size, file);
+    if(*size < capacity) break;
+
+    capacity *= 2;
+    uint8_t* larger = realloc(data, capacity);
+    if(!larger) free(data);
+    data = larger;
+  }
+
+  return data;
+}
+
+int main(int argc, char** argv) {
+  if(argc < 3 || argc > 4) {
+    fprintf(stderr, "usage: %s <led_count> <frames_per_second> [keyframe_interval] < frames.bin > animation.lra\n", argv[0]);
+    return 2;
+  }
+
+  int led_count = atoi(argv[1]);
+  int frames_per_second = atoi(argv[2]);
+  int keyframe_interval = argc > 3 ? atoi(argv[3]) : frames_per_second;
+  if(led_count <= 0) {
+    fprintf(stderr, "led_count %s is invalid\n", argv[1]);
+    return 2;
+  }
+
+  size_t frames_size;
+  uint8_t* frames = read_all(stdin, &frames_size);
+  if(!frames) {
+    fprintf(stderr, "No memory for the frames\n");
+    return 1;
+  }
+
+  size_t frame_size = (size_t)led_count * 3;
+  if(frames_size == 0 || frames_size % frame_size != 0) {
+    fprintf(stderr, "%zu bytes is not a whole number of %d LED frames\n", frames_size, led_count);
+    return 1;
+  }
+
+  size_t size;
+  uint8_t* animation = led_animation_encode(frames, led_count, frames_size / frame_size, frames_per_second,
+      keyframe_interval, &size);
+  if(!animation) {
+    fprintf(stderr, "The frames can not be encoded with these parameters\n");
+    return 1;
+  }
+
+  fwrite(animation, 1, size, stdout);
+  fprintf(stderr, "%zu frames, %zu bytes (%zu%% of the frames)\n", frames_size / frame_size, size, size * 100 / frames_size);
+  free(animation);
+  free(frames);
+  return 0;
+}
@@ -0,0 +1,138 @@
+/*
+ * Copyright 2017 Sam Leitch
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "led_animation_encoder.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LED_ANIMATION_HEADER_SIZE 16
+#define LED_ANIMATION_KEYFRAME 0
+#define LED_ANIMATION_DELTA_FRAME 1
+#define LED_ANIMATION_MAX_RUN 255
+
+static void led_animation_write_u16(uint8_t* data, uint32_t value) {
+  data[0] = value;
+  data[1] = value >> 8;
+}
+
+static void led_animation_write_u32(uint8_t* data, uint32_t value) {
+  led_animation_write_u16(data, value);
+  led_animation_write_u16(data + 2, value >> 16);
+}
+
+static bool led_animation_same_color(const uint8_t* a, const uint8_t* b) {
+  return a[0] == b[0] && a[1] == b[1] && a[2] == b[2];
+}
+
+/** Writes frame as a keyframe to data, returns its size */
+static size_t led_animation_encode_keyframe(const uint8_t* frame, int led_count, uint8_t* data) {
+  size_t size = 0;
+  data[size++] = LED_ANIMATION_KEYFRAME;
+
+  for(int led=0; led < led_count;) {
+    int count = 1;
+    while(count < LED_ANIMATION_MAX_RUN && led + count < led_count &&
+        led_animation_same_color(frame + led * 3, frame + (led + count) * 3)) {
+      ++count;
+    }
+
+    data[size++] = count;
+    memcpy(data + size, frame + led * 3, 3);
+    size += 3;
+    led += count;
+  }
+
+  return size;
+}
+
+/** Writes the LEDs of frame that changed since previous to data as a delta frame, returns its size */
+static size_t led_animation_encode_delta(const uint8_t* frame, const uint8_t* previous, int led_count, uint8_t* data) {
+  size_t size = 0;
+  data[size++] = LED_ANIMATION_DELTA_FRAME;
+
+  for(int led=0; led < led_count;) {
+    /* A change costs 3 bytes and a new pair 2, so an unchanged LED always ends the changes */
+    int skip_count = 0;
+    while(skip_count < LED_ANIMATION_MAX_RUN && led + skip_count < led_count &&
+        led_animation_same_color(frame + (led + skip_count) * 3, previous + (led + skip_count) * 3)) {
+      ++skip_count;
+    }
+    led += skip_count;
+
+    int count = 0;
+    while(count < LED_ANIMATION_MAX_RUN && led + count < led_count &&
+        !led_animation_same_color(frame + (led + count) * 3, previous + (led + count) * 3)) {
+      ++count;
+    }
+
+    data[size++] = skip_count;
+    data[size++] = count;
+    memcpy(data + size, frame + led * 3, count * 3);
+    size += count * 3;
+    led += count;
+  }
+
+  return size;
+}
+
+uint8_t* led_animation_encode(const uint8_t* frames, int led_count, int frame_count, int frames_per_second,
+    int keyframe_interval, size_t* size) {
+  if(led_count <= 0 || led_count > 0xFFFF || frames_per_second <= 0 || frames_per_second > 0xFFFF ||
+      frame_count <= 0 || keyframe_interval <= 0 || keyframe_interval > 0xFFFF) {
+    return NULL;
+  }
+
+  /* A keyframe of runs of one LED is the largest a frame can be, a delta frame is never larger */
+  size_t keyframe_count = (frame_count + keyframe_interval - 1) / keyframe_interval;
+  size_t max_frame_size = 1 + (size_t)led_count * 4;
+  size_t max_size = LED_ANIMATION_HEADER_SIZE + keyframe_count * 4 + frame_count * max_frame_size;
+  uint8_t* data = malloc(max_size);
+  uint8_t* delta = malloc(max_frame_size);
+  if(!data || !delta) {
+    free(data);
+    free(delta);
+    return NULL;
+  }
+
+  memcpy(data, "LRA1", 4);
+  led_animation_write_u16(data + 4, led_count);
+  led_animation_write_u16(data + 6, frames_per_second);
+  led_animation_write_u32(data + 8, frame_count);
+  led_animation_write_u16(data + 12, keyframe_interval);
+  led_animation_write_u16(data + 14, 0);
+
+  size_t offset = LED_ANIMATION_HEADER_SIZE + keyframe_count * 4;
+  for(int f=0; f < frame_count; ++f) {
+    const uint8_t* frame = frames + (size_t)f * led_count * 3;
+    if(f % keyframe_interval == 0) led_animation_write_u32(data + LED_ANIMATION_HEADER_SIZE + f / keyframe_interval * 4, offset);
+
+    size_t frame_size = led_animation_encode_keyframe(frame, led_count, data + offset);
+    if(f % keyframe_interval != 0) {
+      size_t delta_size = led_animation_encode_delta(frame, frame - led_count * 3, led_count, delta);
+      if(delta_size < frame_size) {
+        memcpy(data + offset, delta, delta_size);
+        frame_size = delta_size;
+      }
+    }
+    offset += frame_size;
+  }
+
+  free(delta);
+  *size = offset;
+  return data;
+}
@@ -0,0 +1,39 @@
+/*
+ * Copyright 2017 Sam Leitch
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HOST_LED_ANIMATION_ENCODER_H_
+#define HOST_LED_ANIMATION_ENCODER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * The reference encoder of recorded animations, the format that led_animation.h decodes.
+ *
+ * A frame that has to be a keyframe is encoded as runs of the same color. Any other frame is
+ * encoded as the LEDs that changed since the frame before it, or as a keyframe if that is smaller.
+ */
+
+/**
+ * Encodes frame_count frames, r, g, b for each of the led_count LEDs of each frame.
+ *
+ * Returns the animation, which the caller frees, and sets size to its size.
+ * Returns NULL if a parameter is out of the range of the header or there is no memory.
+ */
+uint8_t* led_animation_encode(const uint8_t* frames, int led_count, int frame_count, int frames_per_second,
+    int keyframe_interval, size_t* size);
+
+#endif /* HOST_LED_ANIMATION_ENCODER_H_ */
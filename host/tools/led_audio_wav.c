@@ -0,0 +1,145 @@
+/*
+ * Copyright 2017 Sam Leitch
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "led_audio_wav.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LED_AUDIO_WAV_FORMAT_PCM 1
+#define LED_AUDIO_WAV_FORMAT_EXTENSIBLE 0xFFFE
+
+static uint32_t led_audio_wav_u32(const uint8_t* bytes) {
+  return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+}
+
+static uint16_t led_audio_wav_u16(const uint8_t* bytes) {
+  return bytes[0] | (bytes[1] << 8);
+}
+
+/** Reads the samples of the data chunk, averaging the channels of each frame */
+static bool led_audio_wav_read_data(led_audio_wav_t* wav, FILE* file, uint32_t size, int channels) {
+  int frame_size = channels * sizeof(int16_t);
+  wav->sample_count = size / frame_size;
+  wav->samples = malloc(wav->sample_count * sizeof(int16_t) + 1);
+  uint8_t* frame = malloc(frame_size);
+  if(!wav->samples || !frame) {
+    free(frame);
+    return false;
+  }
+
+  for(int i=0; i < wav->sample_count; ++i) {
+    if(fread(frame, frame_size, 1, file) != 1) {
+      wav->sample_count = i; /* A file cut short plays up to where it ends */
+      break;
+    }
+
+    int32_t sum = 0;
+    for(int channel=0; channel < channels; ++channel) sum += (int16_t)led_audio_wav_u16(frame + channel * 2);
+    wav->samples[i] = sum / channels;
+  }
+
+  free(frame);
+  return true;
+}
+
+bool led_audio_wav_read(led_audio_wav_t* wav, const char* path) {
+  memset(wav, 0, sizeof(*wav));
+
+  FILE* file = fopen(path, "rb");
+  if(!file) return false;
+
+  uint8_t header[12];
+  if(fread(header, sizeof(header), 1, file) != 1 || memcmp(header, "RIFF", 4) != 0 || memcmp(header + 8, "WAVE", 4) != 0) {
+    goto error;
+  }
+
+  /* The chunks are in any order, but fmt is always before data */
+  int channels = 0;
+  uint8_t chunk[8];
+  while(fread(chunk, sizeof(chunk), 1, file) == 1) {
+    uint32_t size = led_audio_wav_u32(chunk + 4);
+
+    if(memcmp(chunk, "fmt ", 4) == 0) {
+      uint8_t format[16];
+      if(size < sizeof(format) || fread(format, sizeof(format), 1, file) != 1) goto error;
+
+      uint16_t tag = led_audio_wav_u16(format);
+      channels = led_audio_wav_u16(format + 2);
+      wav->sample_rate = led_audio_wav_u32(format + 4);
+      int bits = led_audio_wav_u16(format + 14);
+      if((tag != LED_AUDIO_WAV_FORMAT_PCM && tag != LED_AUDIO_WAV_FORMAT_EXTENSIBLE) || bits != 16 ||
+          channels <= 0 || wav->sample_rate <= 0) {
+        goto error;
+      }
+      size -= sizeof(format);
+    } else if(memcmp(chunk, "data", 4) == 0) {
+      if(!channels || !led_audio_wav_read_data(wav, file, size, channels)) goto error;
+      fclose(file);
+      return true;
+    }
+
+    /* Chunks are padded to an even size */
+    if(fseek(file, size + (size & 1), SEEK_CUR) != 0) goto error;
+  }
+
+  error:
+  fclose(file);
+  led_audio_wav_free(wav);
+  return false;
+}
+
+int led_audio_wav_play(led_audio_wav_t* wav, led_audio_t audio, int count) {
+  if(count > wav->sample_count - wav->position) count = wav->sample_count - wav->position;
+  if(count <= 0) return 0;
+
+  led_audio_write(audio, wav->samples + wav->position, count);
+  wav->position += count;
+  return count;
+}
+
+bool led_audio_wav_write(const char* path, const int16_t* samples, int count, int sample_rate) {
+  FILE* file = fopen(path, "wb");
+  if(!file) return false;
+
+  uint32_t data_size = count * sizeof(int16_t);
+  uint32_t byte_rate = sample_rate * sizeof(int16_t);
+  uint8_t header[44] = {
+    'R', 'I', 'F', 'F', 0, 0, 0, 0, 'W', 'A', 'V', 'E',
+    'f', 'm', 't', ' ', 16, 0, 0, 0,
+    LED_AUDIO_WAV_FORMAT_PCM, 0, 1, 0, /* PCM, 1 channel */
+    sample_rate, sample_rate >> 8, sample_rate >> 16, sample_rate >> 24,
+    byte_rate, byte_rate >> 8, byte_rate >> 16, byte_rate >> 24,
+    2, 0, 16, 0, /* 2 bytes for each frame, 16 bits */
+    'd', 'a', 't', 'a', data_size, data_size >> 8, data_size >> 16, data_size >> 24,
+  };
+  uint32_t riff_size = sizeof(header) - 8 + data_size;
+  for(int i=0; i < 4; ++i) header[4 + i] = riff_size >> (i * 8);
+
+  bool written = fwrite(header, sizeof(header), 1, file) == 1;
+  for(int i=0; written && i < count; ++i) {
+    uint8_t sample[2] = { (uint16_t)samples[i], (uint16_t)samples[i] >> 8 };
+    written = fwrite(sample, sizeof(sample), 1, file) == 1;
+  }
+
+  return fclose(file) == 0 && written;
+}
+
+void led_audio_wav_free(led_audio_wav_t* wav) {
+  free(wav->samples);
+  memset(wav, 0, sizeof(*wav));
+}
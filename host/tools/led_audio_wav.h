@@ -0,0 +1,55 @@
+/*
+ * Copyright 2017 Sam Leitch
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HOST_LED_AUDIO_WAV_H_
+#define HOST_LED_AUDIO_WAV_H_
+
+#include "led_audio.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * A sound file as a stand-in for the microphone of led_audio_i2s, so the analysis can be tested with music.
+ *
+ * The file is 16 bit PCM, and files with several channels are mixed to one, as the microphone hears.
+ */
+
+typedef struct led_audio_wav_s {
+  int sample_rate;
+  int sample_count;
+  int16_t* samples;
+  int position; /* The next sample played */
+} led_audio_wav_t;
+
+/** Reads a WAV file. Returns false if it can not be read, is not 16 bit PCM or there is no memory. */
+bool led_audio_wav_read(led_audio_wav_t* wav, const char* path);
+
+/**
+ * Writes the next count samples into an analysis, as the microphone would in count / sample_rate seconds.
+ *
+ * Samples the analysis has no room for are dropped, like the microphone's. Returns the number of samples
+ * played, which is less than count at the end of the file.
+ */
+int led_audio_wav_play(led_audio_wav_t* wav, led_audio_t audio, int count);
+
+/** Writes samples to a mono WAV file. Returns false if it can not be written. */
+bool led_audio_wav_write(const char* path, const int16_t* samples, int count, int sample_rate);
+
+/** Releases the samples */
+void led_audio_wav_free(led_audio_wav_t* wav);
+
+#endif /* HOST_LED_AUDIO_WAV_H_ */
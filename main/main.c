@@ -14,18 +14,26 @@
  * limitations under the License.
  */
 
+#include "animation_resource.h"
+#include "clock_sync.h"
 #include "coap_server.h"
 #include "driver/gpio.h"
 #include "driver/rmt.h"
+#include "effect_resource.h"
 #include "esp_event.h"
 #include "esp_event_loop.h"
 #include "esp_log.h"
 #include "esp_system.h"
 #include "esp_wifi.h"
 #include "freertos/FreeRTOS.h"
+#include "led_audio_i2s.h"
 #include "led_ring_resource.h"
 #include "nvs_flash.h"
+#include "pixel_stream.h"
+#include "soc/soc.h"
+#include "stats_resource.h"
 #include "string.h"
+#include "time_resource.h"
 #include "ws2812rmt.h"
 
 esp_err_t event_handler(void *ctx, system_event_t *event)
@@ -58,17 +66,45 @@ void app_main()
   ESP_ERROR_CHECK( esp_wifi_start() );
   ESP_ERROR_CHECK( esp_wifi_connect() );
 
+#ifdef CONFIG_FREERTOS_UNICORE
   led_ring = led_ring_init(WS2812_CHANNEL, WS2812_PIN, 24);
+#else
+  // app_main runs on the PRO CPU, so the RMT interrupt stays here while frames are encoded on the APP CPU
+  led_ring = led_ring_init_pipelined(WS2812_CHANNEL, WS2812_PIN, 24, APP_CPU_NUM);
+#endif
+
+  // Animations follow the synchronized clock so that rings on different devices stay in phase
+  clock_sync_start();
+  led_ring_set_clock(led_ring, clock_sync_get_time);
+
+#ifdef CONFIG_LED_AUDIO_I2S
+  led_audio_t audio = led_audio_i2s_start(I2S_NUM_0, CONFIG_LED_AUDIO_I2S_BCK_PIN, CONFIG_LED_AUDIO_I2S_WS_PIN,
+      CONFIG_LED_AUDIO_I2S_DATA_PIN);
+#else
+  led_audio_t audio = NULL;
+#endif
 
   coap_context_t* server = coap_server_create();
   led_ring_resource_init(server, led_ring);
+  animation_resource_init(server, led_ring);
+  effect_resource_init(server, led_ring, audio);
+  time_resource_init(server);
+  stats_resource_init(server, led_ring);
   coap_server_start(server);
 
+  pixel_stream_t stream = pixel_stream_create(led_ring, PIXEL_STREAM_DEFAULT_PORT);
+  if (stream) pixel_stream_start(stream);
+
   // Startup sequence
   for (int i=16; i >= 0; --i) {
     rgb_t blue = { 0, 0, i };
+    led_ring_lock(led_ring);
     led_ring_set_one_color(led_ring, blue);
     led_ring_update(led_ring);
+    led_ring_unlock(led_ring);
     vTaskDelay(pdMS_TO_TICKS(50));
   }
+
+  // Play the recorded animation, if one has been flashed to the animation partition
+  led_ring_resource_play_recorded(led_ring);
 }